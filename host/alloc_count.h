@@ -0,0 +1,56 @@
+/* Allocation counter for the host benches
+
+   Counts operator new and, when the bench is linked with
+   count_allocations() from CMakeLists.txt, every malloc, calloc and
+   realloc made by the bench and the firmware sources built into it, so a
+   C module that allocates shows up as well. Calls from inside the shared
+   C and C++ runtimes are not seen. Include it from the one source file of
+   a bench; the link fails if the wrapping was left out.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<uint64_t> allocations{0};
+
+}  // namespace
+
+extern "C" {
+
+void *__real_malloc(std::size_t size);
+void *__real_calloc(std::size_t count, std::size_t size);
+void *__real_realloc(void *p, std::size_t size);
+
+void *__wrap_malloc(std::size_t size) {
+    allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(std::size_t count, std::size_t size) {
+    allocations++;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *p, std::size_t size) {
+    allocations++;
+    return __real_realloc(p, size);
+}
+
+}  // extern "C"
+
+void *operator new(std::size_t size) {
+    allocations++;
+    if (void *p = __real_malloc(size)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
@@ -0,0 +1,122 @@
+/* analyze_capture — validate an exported capture file and report the
+   inter-arrival histogram, gaps and per-axis moments, using every core.
+
+   usage: analyze_capture [-j threads] [-f hz] [-c chunk_mb] [-g gaps] capture.bin
+
+   The file is memory mapped; frames are packed battery_packet records
+   (main/frame.h). Without -f the sensor rate is the median interval of
+   the first frames. See capture_analysis.h for how the work is split.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "capture_analysis.h"
+
+namespace {
+
+using namespace capture_analysis;
+
+void usage() {
+    std::fprintf(stderr, "usage: analyze_capture [-j threads] [-f hz] [-c chunk_mb] [-g gaps] capture.bin\n");
+}
+
+void report(const Result &r, int64_t nominal_us, size_t gaps_shown) {
+    std::printf("frames %llu, valid %llu, bad markers %llu, clock resets %llu\n", (unsigned long long)r.frames,
+                (unsigned long long)r.valid, (unsigned long long)r.bad_marker, (unsigned long long)r.clock_resets);
+    if (r.intervals == 0) return;
+    std::printf("interval: nominal %lld us, min %lld, mean %.3f, max %lld us over %llu intervals\n", (long long)nominal_us,
+                (long long)r.interval_min, static_cast<double>(r.interval_sum) / r.intervals, (long long)r.interval_max,
+                (unsigned long long)r.intervals);
+    uint64_t peak = *std::max_element(r.histogram, r.histogram + kIntervalBuckets);
+    for (int b = 0; b < kIntervalBuckets; b++) {
+        if (r.histogram[b] == 0) continue;
+        int bar = static_cast<int>(40.0 * r.histogram[b] / peak + 0.5);
+        std::printf("  %10llu us %12llu %.*s\n", (unsigned long long)bucket_floor(b), (unsigned long long)r.histogram[b],
+                    bar, "########################################");
+    }
+    std::printf("gaps %llu, frames lost %llu\n", (unsigned long long)r.gaps, (unsigned long long)r.lost);
+    // largest first, file order among equals
+    std::vector<Gap> largest(r.gap_list);
+    std::stable_sort(largest.begin(), largest.end(), [](const Gap &a, const Gap &b) { return a.lost > b.lost; });
+    for (size_t i = 0; i < std::min(gaps_shown, largest.size()); i++) {
+        const Gap &g = largest[i];
+        std::printf("  frame %12llu: %lld -> %lld us, %llu lost\n", (unsigned long long)g.frame, (long long)g.from_us,
+                    (long long)g.to_us, (unsigned long long)g.lost);
+    }
+    std::printf("%-8s %12s %8s %8s %12s %12s %9s %9s\n", "channel", "n", "min", "max", "mean", "stddev", "skew", "kurtosis");
+    for (int c = 0; c < kChannels; c++) {
+        const Moments &m = r.channels[c];
+        std::printf("%-8s %12llu %8lld %8lld %12.4f %12.4f %9.4f %9.4f\n", channel_name(c), (unsigned long long)m.n,
+                    (long long)(m.n ? m.min : 0), (long long)(m.n ? m.max : 0), m.mean(), m.stddev(), m.skewness(),
+                    m.kurtosis());
+    }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    double frequency = 0;
+    uint64_t chunk_frames = kDefaultChunkFrames;
+    size_t gaps_shown = 10;
+    int opt;
+    while ((opt = getopt(argc, argv, "j:f:c:g:")) != -1) {
+        switch (opt) {
+            case 'j': threads = std::max(1, std::atoi(optarg)); break;
+            case 'f': frequency = std::atof(optarg); break;
+            case 'c': chunk_frames = std::max<uint64_t>(1, (std::strtoull(optarg, nullptr, 10) << 20) / kFrameSize); break;
+            case 'g': gaps_shown = std::strtoul(optarg, nullptr, 10); break;
+            default: usage(); return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+        return 2;
+    }
+
+    int fd = open(argv[optind], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        std::perror(argv[optind]);
+        return 1;
+    }
+    const uint64_t frames = static_cast<uint64_t>(st.st_size) / kFrameSize;
+    if (frames == 0) {
+        std::fprintf(stderr, "%s: no complete frame\n", argv[optind]);
+        return 1;
+    }
+    if (st.st_size % kFrameSize) {
+        std::fprintf(stderr, "%s: %lld trailing bytes ignored\n", argv[optind], (long long)(st.st_size % kFrameSize));
+    }
+    void *map = mmap(nullptr, frames * kFrameSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        std::perror("mmap");
+        return 1;
+    }
+    madvise(map, frames * kFrameSize, MADV_SEQUENTIAL);
+    const uint8_t *data = static_cast<const uint8_t *>(map);
+
+    int64_t nominal_us = (frequency > 0) ? static_cast<int64_t>(1e6 / frequency + 0.5) : estimate_nominal_us(data, frames);
+    auto start = std::chrono::steady_clock::now();
+    Result r = analyze(data, frames, threads, nominal_us, chunk_frames);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    report(r, nominal_us, gaps_shown);
+    std::fprintf(stderr, "%.2f GB in %.3f s on %d threads: %.2f GB/s, %.1f M frames/s\n", frames * kFrameSize / 1e9,
+                 seconds, threads, frames * kFrameSize / 1e9 / seconds, frames / 1e6 / seconds);
+    munmap(map, frames * kFrameSize);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,162 @@
+/* bench_analyze — scaling of the capture analyzer (capture_analysis.h) with
+   threads, on a generated capture file of known content.
+
+   usage: bench_analyze [gigabytes] [path] [max_threads]
+
+   Defaults: 10 GB at /tmp/bench_capture.bin, every hardware thread. The
+   file is written once and reused while its size matches. It holds a
+   1 kHz stream with +-20 us of jitter, 3 frames missing after every 2^20
+   and one frame in 65536 with a broken marker, so the expected counts are
+   known in closed form. Each thread count runs after a warm-up pass; when
+   the file is larger than the page cache the figures are disk bound.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "capture_analysis.h"
+
+namespace {
+
+using namespace capture_analysis;
+
+constexpr int64_t kNominalUs = 1000;
+constexpr int kGapShift = 20;
+constexpr int64_t kLostPerGap = 3;
+constexpr uint64_t kCorruptEvery = 65536;
+constexpr uint64_t kCorruptPhase = 12345;
+
+uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    return x ^ (x >> 33);
+}
+
+// Frame i is a pure function of i, so any thread can write any part of the file
+void make_frame(uint64_t i, battery_packet &f) {
+    uint64_t h = mix(i);
+    f.ID0 = ((i % kCorruptEvery) == kCorruptPhase) ? 0x11 : FRAME_ID0;
+    f.time = 5000000 + static_cast<int64_t>(i + (i >> kGapShift) * kLostPerGap) * kNominalUs +
+             static_cast<int64_t>(h % 41) - 20;
+    f.accelX = static_cast<int16_t>(h >> 8);
+    f.accelY = static_cast<int16_t>(h >> 24);
+    f.accelZ = static_cast<int16_t>(h >> 40);
+    f.gyroX = static_cast<int16_t>((h >> 16) % 2000) - 1000;
+    f.gyroY = static_cast<int16_t>((h >> 32) % 2000) - 1000;
+    f.gyroZ = static_cast<int16_t>((h >> 48) % 2000) - 1000;
+    f.battery = static_cast<uint16_t>(3300 + (i >> 24));
+    f.IDfinal = FRAME_IDFINAL;
+}
+
+bool generate(const std::string &path, uint64_t frames, int threads) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, static_cast<off_t>(frames * kFrameSize)) != 0) {
+        std::perror(path.c_str());
+        return false;
+    }
+    const uint64_t block = 1 << 20;
+    std::atomic<uint64_t> next{0};
+    std::atomic<bool> ok{true};
+    auto writer = [&] {
+        std::vector<battery_packet> buffer(block);
+        for (uint64_t b; (b = next.fetch_add(block)) < frames;) {
+            uint64_t count = std::min(block, frames - b);
+            for (uint64_t i = 0; i < count; i++) make_frame(b + i, buffer[i]);
+            if (pwrite(fd, buffer.data(), count * kFrameSize, static_cast<off_t>(b * kFrameSize)) !=
+                static_cast<ssize_t>(count * kFrameSize))
+                ok = false;
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++) pool.emplace_back(writer);
+    writer();
+    for (auto &t : pool) t.join();
+    close(fd);
+    return ok;
+}
+
+double run(const uint8_t *data, uint64_t frames, int threads, Result &result) {
+    auto start = std::chrono::steady_clock::now();
+    result = analyze(data, frames, threads, kNominalUs);
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const double gigabytes = (argc > 1) ? std::atof(argv[1]) : 10;
+    const std::string path = (argc > 2) ? argv[2] : "/tmp/bench_capture.bin";
+    const int hardware = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    const int max_threads = (argc > 3) ? std::max(1, std::atoi(argv[3])) : hardware;
+    const uint64_t frames = static_cast<uint64_t>(gigabytes * 1e9) / kFrameSize;
+
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || static_cast<uint64_t>(st.st_size) != frames * kFrameSize) {
+        std::printf("writing %.2f GB (%llu frames) to %s\n", frames * kFrameSize / 1e9, (unsigned long long)frames,
+                    path.c_str());
+        auto start = std::chrono::steady_clock::now();
+        if (!generate(path, frames, hardware)) return 1;
+        std::printf("written in %.1f s\n",
+                    std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    int fd = open(path.c_str(), O_RDONLY);
+    void *map = mmap(nullptr, frames * kFrameSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (fd < 0 || map == MAP_FAILED) {
+        std::perror(path.c_str());
+        return 1;
+    }
+    madvise(map, frames * kFrameSize, MADV_SEQUENTIAL);
+    const uint8_t *data = static_cast<const uint8_t *>(map);
+
+    // expected content, from the generator's closed form
+    const uint64_t bad = frames / kCorruptEvery + ((frames % kCorruptEvery) > kCorruptPhase);
+    // every dropped marker also leaves a one frame gap between its valid neighbours
+    const uint64_t gaps = ((frames - 1) >> kGapShift) + bad;
+    const uint64_t lost = ((frames - 1) >> kGapShift) * kLostPerGap + bad;
+
+    Result reference;
+    run(data, frames, max_threads, reference);  // warm-up, and the result every run must match
+    std::printf("%llu frames: %llu bad markers, %llu gaps, %llu lost (expected %llu, %llu, %llu)\n",
+                (unsigned long long)reference.frames, (unsigned long long)reference.bad_marker,
+                (unsigned long long)reference.gaps, (unsigned long long)reference.lost, (unsigned long long)bad,
+                (unsigned long long)gaps, (unsigned long long)lost);
+    if (reference.bad_marker != bad || reference.gaps != gaps || reference.lost != lost) {
+        std::printf("MISMATCH: analyzer does not find the generated defects\n");
+        return 1;
+    }
+
+    std::printf("%8s %10s %10s %12s %9s %11s\n", "threads", "seconds", "GB/s", "M frames/s", "speedup", "efficiency");
+    std::vector<int> counts;
+    for (int threads = 1; threads < max_threads; threads *= 2) counts.push_back(threads);
+    counts.push_back(max_threads);
+    double single = 0;
+    for (int threads : counts) {
+        Result result;
+        double seconds = run(data, frames, threads, result);
+        if (threads == 1) single = seconds;
+        std::printf("%8d %10.3f %10.2f %12.1f %8.2fx %10.0f%%\n", threads, seconds, frames * kFrameSize / 1e9 / seconds,
+                    frames / 1e6 / seconds, single / seconds, 100 * single / seconds / threads);
+        if (!identical(result, reference)) {
+            std::printf("MISMATCH: %d threads disagree with %d\n", threads, max_threads);
+            return 1;
+        }
+    }
+    munmap(map, frames * kFrameSize);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,204 @@
+/* bench_control — what pipelining buys on the remote control protocol
+   (main/control.h), against a simulated board.
+
+   usage: bench_control [commands] [link_ms] [command_us]
+
+   The simulated board sits on the other end of a socketpair behind a link
+   that delays every message by link_ms each way (2 ms by default, about
+   what a station sees across the AP), and keeps its control task busy for
+   command_us per command (300 us) the way the board runs one command line
+   at a time. One command in eight starts a job whose "done" comes before
+   or after its "ok", as it does on the board. host/control_client.h
+   drives it at several window sizes; every pass must see each command
+   answered and each job done exactly once, and the tool exits nonzero
+   otherwise.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "control_client.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Messages wait here until the link has carried them
+class DelayLine {
+  public:
+    void push(Clock::time_point at, std::string data) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back({at, std::move(data)});
+        ready_.notify_one();
+    }
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        ready_.notify_one();
+    }
+    // Blocks until the oldest message is due, false once closed and empty
+    bool pop(std::string *data) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        ready_.wait(lock, [&] { return closed_ || !queue_.empty(); });
+        if (queue_.empty()) return false;
+        Clock::time_point at = queue_.front().first;
+        lock.unlock();
+        std::this_thread::sleep_until(at);
+        lock.lock();
+        *data = std::move(queue_.front().second);
+        queue_.pop_front();
+        return true;
+    }
+
+  private:
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<std::pair<Clock::time_point, std::string>> queue_;
+    bool closed_ = false;
+};
+
+std::string message(uint32_t id, const char *kind, int32_t code, uint32_t jobs, uint32_t ms, const std::string &body) {
+    return std::to_string(id) + ' ' + kind + ' ' + std::to_string(code) + ' ' + std::to_string(jobs) + ' ' +
+           std::to_string(ms) + ' ' + std::to_string(body.size()) + '\n' + body;
+}
+
+/* The board: requests cross the link, run one at a time on the control
+ * task, and the answers cross back.
+ */
+void simulated_board(int fd, std::chrono::microseconds link, std::chrono::microseconds command) {
+    DelayLine inbound, outbound;
+    std::thread receiver([&] {
+        std::string held;
+        char data[4096];
+        ssize_t got;
+        while ((got = recv(fd, data, sizeof(data), 0)) > 0) {
+            held.append(data, static_cast<size_t>(got));
+            size_t newline;
+            while ((newline = held.find('\n')) != std::string::npos) {
+                inbound.push(Clock::now() + link, held.substr(0, newline));
+                held.erase(0, newline + 1);
+            }
+        }
+        inbound.close();
+    });
+    std::thread sender([&] {
+        std::string data;
+        while (outbound.pop(&data)) {
+            if (send(fd, data.data(), data.size(), MSG_NOSIGNAL) < 0) break;
+        }
+    });
+
+    outbound.push(Clock::now() + link, message(0, "hello", control::kVersion, 0, 0, ""));
+    std::string line;
+    while (inbound.pop(&line)) {
+        char *end;
+        uint32_t id = static_cast<uint32_t>(std::strtoul(line.c_str(), &end, 10));
+        std::string cmd(end + (*end == ' '));
+        Clock::time_point busy_until = Clock::now() + command;
+        while (Clock::now() < busy_until) {
+        }
+        std::string output = "ran " + cmd + "\n";
+        if (id % 8 == 0) {
+            // a quick job can finish before the command line returns
+            std::string ok = message(id, "ok", 0, 1, 0, output);
+            std::string done = message(id, "done", 0, 0, 1, "job");
+            bool done_first = (id % 16 == 0);
+            outbound.push(Clock::now() + link, done_first ? done : ok);
+            outbound.push(Clock::now() + link, done_first ? ok : done);
+        } else {
+            outbound.push(Clock::now() + link, message(id, "ok", 0, 0, 0, output));
+        }
+    }
+    outbound.close();
+    sender.join();
+    receiver.join();
+}
+
+struct Pass {
+    size_t window;
+    double seconds;
+    uint32_t completed;
+    uint32_t jobs;
+    std::vector<double> response_ms;
+    bool ok;
+};
+
+Pass run(size_t window, uint32_t commands, std::chrono::microseconds link, std::chrono::microseconds command) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        std::perror("socketpair");
+        std::exit(1);
+    }
+    std::thread board(simulated_board, fds[1], link, command);
+
+    Pass pass{window, 0, 0, 0, {}, true};
+    bool outputs_match = true;
+    {
+        control::Client client(fds[0]);
+        client.on_complete([&](const control::Request &r) {
+            pass.completed++;
+            pass.jobs += r.done;
+            pass.response_ms.push_back(r.response_ms());
+            outputs_match &= !r.error && r.output == "ran " + r.line + "\n";
+        });
+        bool alive = true;
+        const int64_t start = control::now_ns();
+        for (uint32_t i = 0; i < commands && alive; i++) {
+            while (alive && client.unanswered() >= window) alive = client.poll(1000);
+            client.send("recv_sensor -n " + std::to_string(i));
+        }
+        while (alive && client.pending() > 0) alive = client.poll(1000);
+        pass.seconds = (control::now_ns() - start) / 1e9;
+        pass.ok = alive && outputs_match && client.hello_seen() && client.unmatched() == 0;
+        shutdown(fds[0], SHUT_WR);
+        board.join();
+    }
+    close(fds[1]);
+    pass.ok &= pass.completed == commands && pass.jobs == commands / 8;
+    std::sort(pass.response_ms.begin(), pass.response_ms.end());
+    return pass;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const uint32_t commands = (argc > 1) ? static_cast<uint32_t>(std::atoi(argv[1])) : 2000;
+    const double link_ms = (argc > 2) ? std::atof(argv[2]) : 2.0;
+    const int command_us = (argc > 3) ? std::atoi(argv[3]) : 300;
+    if (commands < 1 || link_ms < 0 || command_us < 0) {
+        std::fprintf(stderr, "usage: bench_control [commands >= 1] [link_ms >= 0] [command_us >= 0]\n");
+        return 2;
+    }
+    const auto link = std::chrono::microseconds(static_cast<int64_t>(link_ms * 1000));
+    const auto command = std::chrono::microseconds(command_us);
+
+    std::printf("%u commands, %.1f ms each way, %d us per command on the board\n", commands, link_ms, command_us);
+    std::printf("%-8s %12s %10s %10s %10s%s\n", "window", "commands/s", "p50 ms", "p99 ms", "max ms", "");
+    int failed = 0;
+    double lock_step = 0;
+    for (size_t window : {1, 2, 4, 8, 16, 32}) {
+        Pass p = run(window, commands, link, command);
+        double rate = p.completed / (p.seconds > 0 ? p.seconds : 1);
+        if (window == 1) lock_step = rate;
+        failed += !p.ok;
+        std::printf("%-8zu %12.0f %10.2f %10.2f %10.2f   x%.1f%s\n", window, rate, control::percentile(p.response_ms, 50),
+                    control::percentile(p.response_ms, 99), p.response_ms.empty() ? 0.0 : p.response_ms.back(),
+                    rate / (lock_step > 0 ? lock_step : 1), p.ok ? "" : "  FAIL");
+    }
+    std::printf("%s\n", failed ? "FAILED" : "every command answered and every job done once, matched by id");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,280 @@
+/* bench_demux — cost and correctness of main/demux.c, which tells the
+   sensor's JSON replies apart from its binary frames on one socket.
+
+   usage: bench_demux [frames] [frames_per_reply]
+
+   Builds a stream of battery_packet frames with a JSON reply (the kind a
+   system_info or start_sensor command gets) after every frames_per_reply
+   frames on average, some followed by the newline or NUL the sensor pads
+   them with, and cuts it into reads of random size like recv() returns
+   them. Then:
+
+     slots      the receive loop before the demultiplexer: every
+                frame-sized slot decoded in place, on frames only
+     demux      the same frames through demux_feed(): the frame path cost
+     mixed      the interleaved stream through demux_feed(); every frame
+                and every reply must come out, the replies byte for byte
+     slots mix  the interleaved stream through the old loop, to show what
+                a reply does to it
+     damaged    the interleaved stream with some frame markers broken:
+                each broken frame must cost exactly one boundary loss
+
+   Frame payload bytes avoid 0xff and '{' so that a frame can only be found
+   on a real boundary and the damaged counts are exact. The demux passes
+   must not allocate; the tool exits nonzero if any check fails.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "alloc_count.h"
+#include "demux.h"
+#include "frame_schema.h"
+
+namespace {
+
+int64_t now_ns() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+const char *const kReplies[] = {
+    "{\"command\": \"system_info\", \"firmware\": \"v2.3.1\", \"battery\": 3917, \"freq\": 1000, "
+    "\"sensors\": {\"accel\": true, \"gyro\": true}, \"uptime_ms\": 5123991}",
+    "{\"status\": \"ok\"}",
+    "{\"command\": \"start_sensor\", \"status\": \"streaming\", \"freq\": 500, \"note\": \"escaped \\\"}\\\" stays inside\"}",
+    "{\"error\": \"unknown command\", \"got\": [\"{\", \"}\", 1, 2.5e3, null]}",
+    "{}",
+};
+
+struct Stream {
+    std::vector<uint8_t> bytes;
+    std::vector<std::string> replies;   // in stream order
+    uint64_t frames = 0;
+    uint64_t broken = 0;
+};
+
+void append_frame(Stream &s, std::mt19937 &rng, uint64_t index, bool broken) {
+    battery_packet frame{};
+    frame.ID0 = broken ? 0x55 : FRAME_ID0;
+    frame.time = static_cast<int64_t>(index * 1000);
+    frame.accelX = static_cast<int16_t>(rng());
+    frame.accelY = static_cast<int16_t>(rng());
+    frame.accelZ = static_cast<int16_t>(rng());
+    frame.gyroX = static_cast<int16_t>(rng());
+    frame.gyroY = static_cast<int16_t>(rng());
+    frame.gyroZ = static_cast<int16_t>(rng());
+    frame.battery = static_cast<uint16_t>(3000 + rng() % 1200);
+    frame.IDfinal = FRAME_IDFINAL;
+    uint8_t raw[sizeof(frame)];
+    std::memcpy(raw, &frame, sizeof(frame));
+    for (size_t i = 1; i + 1 < sizeof(raw); i++) {
+        if (raw[i] == 0xff) raw[i] = 0xfe;
+        if (raw[i] == '{') raw[i] = 'z';
+    }
+    s.bytes.insert(s.bytes.end(), raw, raw + sizeof(raw));
+    s.frames += !broken;
+    s.broken += broken;
+}
+
+Stream generate(uint64_t frames, uint32_t per_reply, bool with_replies, uint32_t break_one_in) {
+    std::mt19937 rng(7);
+    Stream s;
+    s.bytes.reserve(frames * sizeof(battery_packet) * 11 / 10 + 4096);
+    for (uint64_t i = 0; i < frames; i++) {
+        // never two broken frames in a row, each must be its own boundary loss
+        bool broken = break_one_in && (rng() % break_one_in == 0) && (i % 2 == 0);
+        append_frame(s, rng, i, broken);
+        if (with_replies && rng() % per_reply == 0) {
+            const char *reply = kReplies[rng() % (sizeof(kReplies) / sizeof(kReplies[0]))];
+            s.replies.emplace_back(reply);
+            s.bytes.insert(s.bytes.end(), reply, reply + std::strlen(reply));
+            switch (rng() % 4) {
+                case 0: s.bytes.push_back('\n'); break;
+                case 1: s.bytes.push_back('\0'); break;
+                case 2: s.bytes.push_back('\r'); s.bytes.push_back('\n'); break;
+                default: break;
+            }
+        }
+    }
+    return s;
+}
+
+// What came out of a pass
+struct Seen {
+    uint64_t frames = 0;
+    uint64_t bad = 0;              // slots with bad markers, or boundary losses
+    uint64_t replies = 0;
+    uint64_t replies_wrong = 0;
+    uint64_t aborted = 0;
+    int64_t time_sum = 0;
+    const std::vector<std::string> *expected = nullptr;
+    char text[DEMUX_MAX_MESSAGE];
+    size_t len = 0;
+};
+
+void on_frame(void *ctx, frame_status_t status, const battery_packet *frame, size_t) {
+    Seen *seen = static_cast<Seen *>(ctx);
+    if (status == FRAME_OK) {
+        seen->frames++;
+        seen->time_sum += frame->time;
+    } else {
+        seen->bad++;
+    }
+}
+
+void on_json(void *ctx, const char *text, size_t len, demux_json_part_t part) {
+    Seen *seen = static_cast<Seen *>(ctx);
+    if (part == DEMUX_JSON_ABORT) {
+        seen->aborted++;
+        seen->len = 0;
+        return;
+    }
+    if (seen->len + len <= sizeof(seen->text)) std::memcpy(seen->text + seen->len, text, len);
+    seen->len += len;
+    if (part == DEMUX_JSON_END) {
+        const std::vector<std::string> &expected = *seen->expected;
+        bool same = seen->replies < expected.size() && expected[seen->replies].size() == seen->len &&
+                    std::memcmp(expected[seen->replies].data(), seen->text, seen->len) == 0;
+        seen->replies_wrong += !same;
+        seen->replies++;
+        seen->len = 0;
+    }
+}
+
+// Reads of 1 to 1460 bytes, drawn up front
+std::vector<uint32_t> segment(size_t total, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint32_t> reads;
+    for (size_t at = 0; at < total;) {
+        uint32_t n = (rng() % 8 == 0) ? 1 + rng() % 23 : 1 + rng() % 1460;
+        reads.push_back(n);
+        at += n;
+    }
+    return reads;
+}
+
+// The loop recv_sensor and soak had: decode every frame-sized slot of what arrived
+void run_slots(const Stream &s, const std::vector<uint32_t> &reads, uint8_t *buffer, Seen *seen) {
+    const frame_schema_t *schema = &frame_schema_default;
+    size_t held = 0, at = 0;
+    for (uint32_t n : reads) {
+        n = static_cast<uint32_t>(std::min<size_t>(n, s.bytes.size() - at));
+        std::memcpy(buffer + held, s.bytes.data() + at, n);   // what recv() does
+        at += n;
+        held += n;
+        size_t offset = 0;
+        for (; held - offset >= schema->size; offset += schema->size) {
+            battery_packet frame;
+            on_frame(seen, frame_decode(schema, buffer + offset, &frame), &frame, offset + schema->size);
+        }
+        held -= offset;
+        std::memmove(buffer, buffer + offset, held);
+    }
+}
+
+void run_demux(const Stream &s, const std::vector<uint32_t> &reads, uint8_t *buffer, Seen *seen, demux_t *demux) {
+    demux_init(demux, &frame_schema_default, on_frame, on_json, seen);
+    size_t held = 0, at = 0;
+    for (uint32_t n : reads) {
+        n = static_cast<uint32_t>(std::min<size_t>(n, s.bytes.size() - at));
+        std::memcpy(buffer + held, s.bytes.data() + at, n);
+        at += n;
+        held += n;
+        size_t used = demux_feed(demux, buffer, held);
+        held -= used;
+        std::memmove(buffer, buffer + used, held);
+    }
+}
+
+struct Pass {
+    const char *name;
+    double ns_per_frame;
+    double mb_per_s;
+    uint64_t allocations;
+    Seen seen;
+    demux_stats_t stats;
+    bool ok;
+};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const uint64_t frames = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+    const uint32_t per_reply = (argc > 2) ? static_cast<uint32_t>(std::atoi(argv[2])) : 50;
+    if (frames < 1 || per_reply < 1) {
+        std::fprintf(stderr, "usage: bench_demux [frames >= 1] [frames_per_reply >= 1]\n");
+        return 2;
+    }
+    const Stream plain = generate(frames, per_reply, false, 0);
+    const Stream mixed = generate(frames, per_reply, true, 0);
+    const Stream damaged = generate(frames, per_reply, true, 1000);
+    const std::vector<uint32_t> plain_reads = segment(plain.bytes.size(), 1);
+    const std::vector<uint32_t> mixed_reads = segment(mixed.bytes.size(), 2);
+    const std::vector<uint32_t> damaged_reads = segment(damaged.bytes.size(), 3);
+    std::vector<uint8_t> buffer(1460 + FRAME_SCHEMA_MAX_SIZE);
+    static demux_t demux;
+    static Pass passes[5];
+
+    auto timed = [&](Pass *p, const char *name, const Stream &s, auto &&body) {
+        p->name = name;
+        p->seen.expected = &s.replies;
+        uint64_t before = allocations.load();
+        int64_t start = now_ns();
+        body(&p->seen);
+        int64_t elapsed = now_ns() - start;
+        p->allocations = allocations.load() - before;
+        p->stats = demux.stats;
+        p->ns_per_frame = static_cast<double>(elapsed) / static_cast<double>(s.frames + s.broken);
+        p->mb_per_s = s.bytes.size() * 1e3 / (elapsed ? elapsed : 1);
+    };
+
+    timed(&passes[0], "slots", plain, [&](Seen *seen) { run_slots(plain, plain_reads, buffer.data(), seen); });
+    passes[0].ok = passes[0].seen.frames == plain.frames && passes[0].seen.bad == 0;
+
+    timed(&passes[1], "demux", plain, [&](Seen *seen) { run_demux(plain, plain_reads, buffer.data(), seen, &demux); });
+    passes[1].ok = passes[1].seen.frames == plain.frames && passes[1].seen.bad == 0 && passes[1].allocations == 0;
+
+    timed(&passes[2], "mixed", mixed, [&](Seen *seen) { run_demux(mixed, mixed_reads, buffer.data(), seen, &demux); });
+    passes[2].ok = passes[2].seen.frames == mixed.frames && passes[2].seen.bad == 0 &&
+                   passes[2].seen.replies == mixed.replies.size() && passes[2].seen.replies_wrong == 0 &&
+                   passes[2].seen.aborted == 0 && passes[2].allocations == 0;
+
+    timed(&passes[3], "slots mix", mixed, [&](Seen *seen) { run_slots(mixed, mixed_reads, buffer.data(), seen); });
+    // expected to fail: only shows how much the old loop loses
+    passes[3].ok = true;
+
+    timed(&passes[4], "damaged", damaged,
+          [&](Seen *seen) { run_demux(damaged, damaged_reads, buffer.data(), seen, &demux); });
+    passes[4].ok = passes[4].seen.frames == damaged.frames && passes[4].seen.bad == damaged.broken &&
+                   passes[4].seen.replies == damaged.replies.size() && passes[4].seen.replies_wrong == 0 &&
+                   passes[4].allocations == 0;
+
+    std::printf("%" PRIu64 " frames, a reply every %u frames on average: %zu replies, %.1f MB; %" PRIu64
+                " broken frames in the damaged stream\n",
+                frames, per_reply, mixed.replies.size(), mixed.bytes.size() / 1e6, damaged.broken);
+    std::printf("%-10s %9s %8s %10s %8s %8s %8s %7s\n", "pass", "ns/frame", "MB/s", "frames", "bad", "replies",
+                "aborted", "allocs");
+    int failed = 0;
+    for (const Pass &p : passes) {
+        failed += !p.ok;
+        std::printf("%-10s %9.2f %8.0f %10" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %7" PRIu64 "%s\n", p.name,
+                    p.ns_per_frame, p.mb_per_s, p.seen.frames, p.seen.bad, p.seen.replies, p.seen.aborted, p.allocations,
+                    p.ok ? "" : "  FAIL");
+    }
+    std::printf("frame path: demux %.2f ns/frame against %.2f for fixed slots (%+.1f%%)\n", passes[1].ns_per_frame,
+                passes[0].ns_per_frame, 100.0 * (passes[1].ns_per_frame / passes[0].ns_per_frame - 1));
+    std::printf("damaged: %" PRIu64 " bytes skipped to find the boundary again, %" PRIu64 " false starts\n",
+                passes[4].stats.skipped, passes[4].stats.false_starts);
+    std::printf("%s\n", failed ? "FAILED" : "every frame and reply routed once, replies intact, allocation free");
+    return failed ? 1 : 0;
+}
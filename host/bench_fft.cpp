@@ -0,0 +1,72 @@
+/* bench_fft — the real FFT used by the "spectrum" command (main/fft.c),
+   timed with the same fft_bench() the device runs for "spectrum --bench".
+
+   usage: bench_fft [iterations]
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "fft.h"
+
+namespace {
+
+int64_t now_us() {
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void print_spectrum(const char *title, const fft_spectrum_t &spectrum) {
+    std::printf("%s: %u points at %.1f Hz, %.3f Hz/bin, noise floor %.1f dBFS\n", title, spectrum.n, spectrum.sample_rate,
+                spectrum.resolution, spectrum.noise_floor_db);
+    for (int i = 0; i < spectrum.peak_count; i++)
+        std::printf("  peak %8.2f Hz  +%.1f dB\n", spectrum.peaks[i].frequency, spectrum.peaks[i].level_db);
+    for (int i = 0; i < spectrum.spur_count; i++)
+        std::printf("  spur %8.2f Hz  +%.1f dB  (fs/%u)\n", spectrum.spurs[i].frequency, spectrum.spurs[i].level_db, spectrum.spurs[i].divisor);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const int iterations = (argc > 1) ? std::atoi(argv[1]) : 2000;
+    const uint32_t max_n = 4096;
+    std::vector<float> sine(max_n / 4 + 1), work(max_n);
+    fft_table_t table = {max_n, sine.data()};
+    fft_table_init(&table, max_n);
+
+    std::printf("%6s %12s %14s\n", "points", "us/fft", "max rel error");
+    for (uint32_t n = 256; n <= max_n; n <<= 1) {
+        fft_bench_result_t result;
+        fft_bench(work.data(), n, iterations, &table, now_us, &result);
+        std::printf("%6u %12.3f %14.2e\n", n, result.us_per_fft, result.max_error);
+        if (result.max_error > 1e-3f) {
+            std::printf("FFT error too large\n");
+            return 1;
+        }
+    }
+
+    // a 1 kHz sensor with a 37 Hz motion, then the same stream with every 4th sample duplicated
+    const float rate = 1000.0f;
+    fft_spectrum_t spectrum;
+    uint32_t seed = 1;
+    auto noise = [&seed] {
+        seed = seed * 1664525u + 1013904223u;
+        return static_cast<float>(seed >> 26) - 32.0f;
+    };
+    for (uint32_t i = 0; i < max_n; i++) work[i] = 12000.0f * std::sin(2 * M_PI * 37.0 * i / rate) + noise();
+    fft_spectrum(work.data(), max_n, rate, &table, &spectrum);
+    print_spectrum("clean", spectrum);
+
+    for (uint32_t i = 0, source = 0; i < max_n; i++) {
+        work[i] = 12000.0f * std::sin(2 * M_PI * 37.0 * source / rate) + noise();
+        if (i % 4 != 3) source++;
+    }
+    fft_spectrum(work.data(), max_n, rate, &table, &spectrum);
+    print_spectrum("every 4th sample duplicated", spectrum);
+    return 0;
+}
@@ -0,0 +1,343 @@
+/* bench_json — correctness and cost of main/json_tok.c and main/sensor_info.c,
+   which read the sensor's JSON replies as they arrive, without buffering
+   them whole and without allocating.
+
+   usage: bench_json [replies]
+
+   Runs over a corpus of replies the sensor firmwares send (system_info,
+   start_sensor, errors, and spellings like FW, vbat or "rate": "250"):
+
+     splits     every reply tokenized whole, then cut in two at every
+                offset, in three at every pair of offsets and fed a byte at
+                a time: the tokens must be the same each time
+     fields     the fields extracted from every reply, against what it says
+     invalid    malformed replies must fail, whole and a byte at a time;
+                nesting one level past JSON_TOK_MAX_DEPTH too
+     tokens     the tokenizer alone over the corpus back to back
+     stream     `replies` replies between console noise and false starts,
+                cut into reads of random size like recv() returns them, fed
+                to sensor_parser_feed(): every reply must come out once with
+                the right fields and every false start be counted
+
+   The tokens and stream passes must not allocate; the tool exits nonzero
+   if any check fails.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "alloc_count.h"
+#include "json_tok.h"
+#include "sensor_info.h"
+
+namespace {
+
+int64_t now_ns() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+struct Reply {
+    const char *text;
+    sensor_info_t expected;
+};
+
+sensor_info_t info(uint32_t fields, const char *command, const char *status, const char *error, const char *firmware,
+                   uint32_t mv, uint8_t percent, uint16_t hz, bool accel, bool gyro, uint64_t uptime_ms) {
+    sensor_info_t i{};
+    i.fields = fields;
+    std::snprintf(i.command, sizeof(i.command), "%s", command);
+    std::snprintf(i.status, sizeof(i.status), "%s", status);
+    std::snprintf(i.error, sizeof(i.error), "%s", error);
+    std::snprintf(i.firmware, sizeof(i.firmware), "%s", firmware);
+    i.battery_mv = mv;
+    i.battery_percent = percent;
+    i.rate_hz = hz;
+    i.accel = accel;
+    i.gyro = gyro;
+    i.uptime_ms = uptime_ms;
+    return i;
+}
+
+const Reply kReplies[] = {
+    {"{\"command\": \"system_info\", \"firmware\": \"v2.3.1\", \"battery\": 3917, \"freq\": 1000, "
+     "\"sensors\": {\"accel\": true, \"gyro\": true}, \"uptime_ms\": 5123991}",
+     info(SENSOR_INFO_COMMAND | SENSOR_INFO_FIRMWARE | SENSOR_INFO_BATTERY_MV | SENSOR_INFO_RATE | SENSOR_INFO_ACCEL |
+              SENSOR_INFO_GYRO | SENSOR_INFO_UPTIME,
+          "system_info", "", "", "v2.3.1", 3917, 0, 1000, true, true, 5123991)},
+    {"{\"status\": \"ok\"}", info(SENSOR_INFO_STATUS, "", "ok", "", "", 0, 0, 0, false, false, 0)},
+    {"{\"command\": \"start_sensor\", \"status\": \"streaming\", \"freq\": 500, \"note\": \"escaped \\\"}\\\" stays inside\"}",
+     info(SENSOR_INFO_COMMAND | SENSOR_INFO_STATUS | SENSOR_INFO_RATE, "start_sensor", "streaming", "", "", 0, 0, 500, false,
+          false, 0)},
+    {"{\"error\": \"unknown command\", \"got\": [\"{\", \"}\", 1, 2.5e3, null]}",
+     info(SENSOR_INFO_ERROR, "", "", "unknown command", "", 0, 0, 0, false, false, 0)},
+    {"{}", info(0, "", "", "", "", 0, 0, 0, false, false, 0)},
+    {"{\"FW\":\"1.0.4-rc\\u00e9\",\"vbat\":3.71,\"battery_pct\":64,\"rate\":\"250\",\"ACCEL\":1,\"GYRO\":0,\"uptime\":12.5}",
+     info(SENSOR_INFO_FIRMWARE | SENSOR_INFO_BATTERY_MV | SENSOR_INFO_BATTERY_PERCENT | SENSOR_INFO_RATE |
+              SENSOR_INFO_ACCEL | SENSOR_INFO_GYRO | SENSOR_INFO_UPTIME,
+          "", "", "", "1.0.4-rc\xc3\xa9", 3710, 64, 250, true, false, 12500)},
+    {"{ \"battery\" : 87 , \"version\" : 3 , \"extra\" : { \"deep\" : [ [ [ { \"x\" : -0.5e-3 } ] ] ] } ,\r\n"
+     "  \"flag\" : false , \"none\" : null , \"freq\" : null }",
+     info(SENSOR_INFO_BATTERY_PERCENT | SENSOR_INFO_FIRMWARE, "", "", "", "3", 0, 87, 0, false, false, 0)},
+    {"{\"error\":\"a message much longer than the sixty four bytes a value may hold, cut\",\"cmd\":\"tab\\tslash\\/\"}",
+     info(SENSOR_INFO_COMMAND, "tab\tslash/", "", "", "", 0, 0, 0, false, false, 0)},
+    // only members of the reply, and accel and gyro within "sensors", are read
+    {"{\"status\":\"ok\",\"config\":{\"freq\":100,\"version\":\"2\",\"sensors\":{\"gyro\":1}},\"sensors\":{\"accel\":0}}",
+     info(SENSOR_INFO_STATUS | SENSOR_INFO_ACCEL, "", "ok", "", "", 0, 0, 0, false, false, 0)},
+    // a flag is an integer: 1.5 and 1e0 are not read as one
+    {"{\"accel\":1.5,\"gyro\":1e0,\"status\":\"1\"}", info(SENSOR_INFO_STATUS, "", "1", "", "", 0, 0, 0, false, false, 0)},
+    {"{\"accel\":\"1\",\"gyro\":-0}",
+     info(SENSOR_INFO_ACCEL | SENSOR_INFO_GYRO, "", "", "", "", 0, 0, 0, true, false, 0)},
+};
+constexpr size_t kReplyCount = sizeof(kReplies) / sizeof(kReplies[0]);
+
+const char *const kInvalid[] = {
+    "{\"a\" 1}",      "{\"a\":}",        "{,}",           "[1,]",           "{\"a\":1,}",       "{\"a\":tru}",
+    "{\"a\":01}",     "{\"a\":-}",       "{\"a\":1.}",    "{\"a\":1e}",     "{\"a\":\"\\x\"}",  "{\"a\":\"\\u12g4\"}",
+    "{\"a\":\"\t\"}", "{\"a\":1]",       "[1}",           "}",              "{\"a\":1}}",       "{1:2}",
+    "{\"a\":+1}",     "{\"a\":[1 2]}",   "{\"a\":nul}",   "{\"a\"::1}",
+};
+
+// Each token as text, to compare how differently cut input was tokenized
+void trace_token(void *ctx, const json_tok_t *, const json_token_t *token) {
+    std::string *trace = static_cast<std::string *>(ctx);
+    *trace += static_cast<char>('A' + token->type);
+    *trace += static_cast<char>('0' + token->depth);
+    *trace += token->truncated ? '!' : ' ';
+    *trace += token->key;
+    *trace += '=';
+    trace->append(token->text, token->len);
+    *trace += ';';
+}
+
+std::string tokenize(const char *text, const std::vector<size_t> &cuts, bool *ok) {
+    std::string trace;
+    json_tok_t tok;
+    json_tok_init(&tok, trace_token, &trace);
+    size_t len = std::strlen(text), from = 0;
+    *ok = true;
+    for (size_t i = 0; i <= cuts.size(); i++) {
+        size_t to = (i < cuts.size()) ? cuts[i] : len;
+        *ok = *ok && json_tok_feed(&tok, text + from, to - from);
+        from = to;
+    }
+    *ok = *ok && json_tok_idle(&tok);
+    return trace;
+}
+
+bool same_info(const sensor_info_t &a, const sensor_info_t &b) {
+    uint32_t f = a.fields;
+    return a.fields == b.fields && (!(f & SENSOR_INFO_COMMAND) || !std::strcmp(a.command, b.command)) &&
+           (!(f & SENSOR_INFO_STATUS) || !std::strcmp(a.status, b.status)) &&
+           (!(f & SENSOR_INFO_ERROR) || !std::strcmp(a.error, b.error)) &&
+           (!(f & SENSOR_INFO_FIRMWARE) || !std::strcmp(a.firmware, b.firmware)) &&
+           (!(f & SENSOR_INFO_BATTERY_MV) || a.battery_mv == b.battery_mv) &&
+           (!(f & SENSOR_INFO_BATTERY_PERCENT) || a.battery_percent == b.battery_percent) &&
+           (!(f & SENSOR_INFO_RATE) || a.rate_hz == b.rate_hz) && (!(f & SENSOR_INFO_ACCEL) || a.accel == b.accel) &&
+           (!(f & SENSOR_INFO_GYRO) || a.gyro == b.gyro) && (!(f & SENSOR_INFO_UPTIME) || a.uptime_ms == b.uptime_ms);
+}
+
+// What the stream pass expects, checked in the reply sink as replies come out
+struct Seen {
+    const std::vector<uint8_t> *order = nullptr;
+    uint64_t replies = 0;
+    uint64_t wrong = 0;
+};
+
+void on_reply(void *ctx, const sensor_info_t *got) {
+    Seen *seen = static_cast<Seen *>(ctx);
+    if (seen->replies >= seen->order->size() || !same_info(*got, kReplies[(*seen->order)[seen->replies]].expected)) {
+        seen->wrong++;
+    }
+    seen->replies++;
+}
+
+struct Stream {
+    std::string bytes;
+    std::vector<uint8_t> order;     // corpus index of each reply, in stream order
+    uint64_t false_starts = 0;
+};
+
+Stream generate(uint64_t replies) {
+    // what else the sensor prints on the socket: prompts, padding, log lines with a stray brace
+    static const char *const noise[] = {"", "\n", "\r\n", "OK\n", "ready> ", "log: {oops} ", "\n\n"};
+    std::mt19937 rng(7);
+    Stream s;
+    s.order.reserve(replies);
+    for (uint64_t n = 0; n < replies; n++) {
+        const char *junk = noise[rng() % (sizeof(noise) / sizeof(noise[0]))];
+        s.false_starts += (std::strchr(junk, '{') != nullptr);
+        s.bytes += junk;
+        uint8_t r = static_cast<uint8_t>(rng() % kReplyCount);
+        s.order.push_back(r);
+        s.bytes += kReplies[r].text;
+    }
+    return s;
+}
+
+std::vector<uint32_t> segment(size_t total, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint32_t> reads;
+    for (size_t at = 0; at < total;) {
+        uint32_t n = 1 + rng() % ((rng() % 4 == 0) ? 16 : 1460);
+        reads.push_back(n);
+        at += n;
+    }
+    return reads;
+}
+
+void count_token(void *ctx, const json_tok_t *, const json_token_t *) { ++*static_cast<uint64_t *>(ctx); }
+
+struct Pass {
+    const char *name;
+    uint64_t cases = 0;
+    uint64_t failures = 0;
+    uint64_t allocations = 0;
+    double ns_per_byte = 0;
+    double mb_per_s = 0;
+};
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const uint64_t replies = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 200000;
+    if (replies < 1) {
+        std::fprintf(stderr, "usage: bench_json [replies >= 1]\n");
+        return 2;
+    }
+    static Pass passes[5];
+
+    Pass *p = &passes[0];
+    p->name = "splits";
+    for (const Reply &reply : kReplies) {
+        bool ok;
+        const std::string whole = tokenize(reply.text, {}, &ok);
+        p->cases++;
+        p->failures += !ok;
+        size_t len = std::strlen(reply.text);
+        std::vector<size_t> bytewise;
+        for (size_t i = 1; i < len; i++) {
+            bytewise.push_back(i);
+            p->cases++;
+            p->failures += tokenize(reply.text, {i}, &ok) != whole || !ok;
+            for (size_t j = i; j < len; j++) {
+                p->cases++;
+                p->failures += tokenize(reply.text, {i, j}, &ok) != whole || !ok;
+            }
+        }
+        p->cases++;
+        p->failures += tokenize(reply.text, bytewise, &ok) != whole || !ok;
+    }
+
+    p = &passes[1];
+    p->name = "fields";
+    for (const Reply &reply : kReplies) {
+        static Seen seen;
+        std::vector<uint8_t> order{static_cast<uint8_t>(&reply - kReplies)};
+        seen = Seen{};
+        seen.order = &order;
+        static sensor_parser_t parser;
+        sensor_parser_init(&parser, on_reply, &seen);
+        sensor_parser_feed(&parser, reply.text, std::strlen(reply.text));
+        p->cases++;
+        if (seen.replies != 1 || seen.wrong != 0) {
+            p->failures++;
+            char line[256];
+            sensor_info_format(&parser.info, line, sizeof(line));
+            std::printf("fields of reply %u: %s\n", static_cast<unsigned>(order[0]), line);
+        }
+    }
+
+    p = &passes[2];
+    p->name = "invalid";
+    for (const char *text : kInvalid) {
+        bool ok;
+        std::vector<size_t> bytewise;
+        for (size_t i = 1; i < std::strlen(text); i++) bytewise.push_back(i);
+        tokenize(text, {}, &ok);
+        p->cases++;
+        p->failures += ok;
+        tokenize(text, bytewise, &ok);
+        p->cases++;
+        p->failures += ok;
+    }
+    for (int depth = JSON_TOK_MAX_DEPTH; depth <= JSON_TOK_MAX_DEPTH + 1; depth++) {
+        std::string nested = std::string(depth, '[') + std::string(depth, ']');
+        json_tok_t tok;
+        json_tok_init(&tok, nullptr, nullptr);
+        bool ok = json_tok_feed(&tok, nested.data(), nested.size());
+        p->cases++;
+        p->failures += (depth <= JSON_TOK_MAX_DEPTH) ? !ok : (ok || tok.error != JSON_ERR_DEPTH);
+    }
+
+    const Stream stream = generate(replies);
+    const std::vector<uint32_t> reads = segment(stream.bytes.size(), 1);
+
+    p = &passes[3];
+    p->name = "tokens";
+    {
+        std::string corpus;
+        for (const Reply &reply : kReplies) corpus += reply.text;
+        static json_tok_t tok;
+        uint64_t tokens = 0;
+        json_tok_init(&tok, count_token, &tokens);
+        const uint64_t rounds = std::max<uint64_t>(1, stream.bytes.size() / corpus.size());
+        uint64_t before = allocations.load();
+        int64_t start = now_ns();
+        bool ok = true;
+        for (uint64_t r = 0; r < rounds; r++) ok = json_tok_feed(&tok, corpus.data(), corpus.size()) && ok;
+        int64_t elapsed = now_ns() - start;
+        p->allocations = allocations.load() - before;
+        p->cases = tok.values;
+        p->failures = !ok || tok.values != rounds * kReplyCount || p->allocations != 0;
+        p->ns_per_byte = static_cast<double>(elapsed) / static_cast<double>(rounds * corpus.size());
+        p->mb_per_s = rounds * corpus.size() * 1e3 / (elapsed ? elapsed : 1);
+    }
+
+    p = &passes[4];
+    p->name = "stream";
+    {
+        static Seen seen;
+        static sensor_parser_t parser;
+        seen.order = &stream.order;
+        sensor_parser_init(&parser, on_reply, &seen);
+        uint64_t before = allocations.load();
+        int64_t start = now_ns();
+        size_t at = 0;
+        for (uint32_t n : reads) {
+            n = static_cast<uint32_t>(std::min<size_t>(n, stream.bytes.size() - at));
+            sensor_parser_feed(&parser, stream.bytes.data() + at, n);
+            at += n;
+        }
+        int64_t elapsed = now_ns() - start;
+        p->allocations = allocations.load() - before;
+        p->cases = seen.replies;
+        p->failures = seen.wrong + (seen.replies != stream.order.size()) + (parser.rejected != stream.false_starts) +
+                      (p->allocations != 0);
+        p->ns_per_byte = static_cast<double>(elapsed) / static_cast<double>(stream.bytes.size());
+        p->mb_per_s = stream.bytes.size() * 1e3 / (elapsed ? elapsed : 1);
+        std::printf("%" PRIu64 " replies in %.1f MB cut into %zu reads: %u replies out, %u false starts rejected (%" PRIu64
+                    " expected)\n",
+                    replies, stream.bytes.size() / 1e6, reads.size(), parser.replies, parser.rejected, stream.false_starts);
+    }
+
+    std::printf("%-8s %9s %9s %7s %9s %8s\n", "pass", "cases", "failures", "allocs", "ns/byte", "MB/s");
+    int failed = 0;
+    for (const Pass &pass : passes) {
+        failed += pass.failures != 0;
+        std::printf("%-8s %9" PRIu64 " %9" PRIu64 " %7" PRIu64 " %9.2f %8.0f%s\n", pass.name, pass.cases, pass.failures,
+                    pass.allocations, pass.ns_per_byte, pass.mb_per_s, pass.failures ? "  FAIL" : "");
+    }
+    std::printf("tokenizer state: %zu bytes, none of it allocated\n", sizeof(json_tok_t));
+    std::printf("%s\n", failed ? "FAILED" : "same tokens however the replies are cut, fields right, allocation free");
+    return failed ? 1 : 0;
+}
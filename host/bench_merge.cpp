@@ -0,0 +1,187 @@
+/* bench_merge — the time-ordered k-way merge behind "fairness --merge"
+   (main/merge.c), timed against a single priority queue over every frame.
+
+   usage: bench_merge [frames per input] [rate hz]
+
+   Each input is a sensor at the given rate whose frames reach the board
+   after an exponential network delay, a few at a time, with a burst every
+   so often that holds one input back. The arrivals of all inputs are
+   generated first and then replayed through the merge in arrival order,
+   calling merge_advance() once per millisecond of arrival time like the
+   firmware's poll loop. For each input count and reorder window it
+   reports the merge cost, the frames that came too late for the window
+   and the latency the window adds. The output is checked to be in time
+   order and complete, and the merge loop must not allocate; the tool
+   exits nonzero otherwise.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <queue>
+#include <random>
+#include <vector>
+
+#include "alloc_count.h"
+#include "merge.h"
+
+namespace {
+
+const uint32_t kMaxInputs = 16;
+const uint32_t kDepth = 256;
+
+// what MERGE_DEFINE reserves on the board
+merge_entry_t bench_entries[kMaxInputs * kDepth];
+merge_t bench_merged;
+
+struct Arrival {
+    int64_t arrival_us;
+    int64_t key;            // sample time on the AP clock
+    uint32_t input;
+    battery_packet frame;
+};
+
+int64_t now_ns() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+std::vector<Arrival> generate(uint32_t inputs, uint32_t frames, uint32_t rate, unsigned seed) {
+    std::mt19937_64 rng(seed);
+    std::exponential_distribution<double> delay(1.0 / 2000);
+    std::uniform_int_distribution<int> batch(1, 4);
+    std::uniform_real_distribution<double> phase(0, 1e6 / rate);
+    std::vector<Arrival> all;
+    all.reserve(static_cast<size_t>(inputs) * frames);
+    for (uint32_t input = 0; input < inputs; input++) {
+        double start = 1000000 + phase(rng);
+        int64_t last_arrival = 0;
+        for (uint32_t i = 0; i < frames;) {
+            // a batch leaves with its last frame; every ~2 s one input stalls for 30 ms
+            uint32_t n = std::min<uint32_t>(batch(rng), frames - i);
+            double sent = start + (i + n - 1) * 1e6 / rate;
+            double stall = ((i + input * rate / 8) % (2 * rate) < n) ? 30000 : 0;
+            int64_t arrival = static_cast<int64_t>(sent + 500 + delay(rng) + stall);
+            arrival = std::max(arrival, last_arrival);    // TCP keeps one connection in order
+            last_arrival = arrival;
+            for (uint32_t j = 0; j < n; j++, i++) {
+                Arrival a{arrival, static_cast<int64_t>(start + i * 1e6 / rate), input, {}};
+                a.frame.ID0 = FRAME_ID0;
+                a.frame.IDfinal = FRAME_IDFINAL;
+                a.frame.time = i;
+                a.frame.battery = static_cast<uint16_t>(input);
+                all.push_back(a);
+            }
+        }
+    }
+    std::stable_sort(all.begin(), all.end(),
+                     [](const Arrival &a, const Arrival &b) { return a.arrival_us < b.arrival_us; });
+    return all;
+}
+
+struct Out {
+    uint64_t count = 0;
+    uint64_t disorder = 0;
+    int64_t last = INT64_MIN;
+    uint64_t checksum = 0;
+};
+
+void sink(void *ctx, uint32_t input, int64_t key, const battery_packet *frame) {
+    Out *out = static_cast<Out *>(ctx);
+    out->disorder += key < out->last;
+    out->last = key;
+    out->count++;
+    out->checksum += static_cast<uint64_t>(frame->time) * (input + 1);
+}
+
+struct Result {
+    double ns_per_frame;
+    uint64_t allocations;
+    Out out;
+};
+
+Result run_merge(const std::vector<Arrival> &arrivals, uint32_t inputs, int64_t window_us) {
+    Result result{};
+    bench_merged.depth = kDepth;
+    bench_merged.entries = bench_entries;
+    merge_reset(&bench_merged, inputs, window_us, sink, &result.out);
+    uint64_t before = allocations.load();
+    int64_t start = now_ns();
+    int64_t next_poll = arrivals.front().arrival_us;
+    for (const Arrival &a : arrivals) {
+        if (a.arrival_us >= next_poll) {
+            merge_advance(&bench_merged, a.arrival_us);
+            next_poll = a.arrival_us + 1000;
+        }
+        merge_push(&bench_merged, a.input, a.key, a.arrival_us, &a.frame);
+    }
+    merge_flush(&bench_merged, arrivals.back().arrival_us);
+    result.ns_per_frame = static_cast<double>(now_ns() - start) / arrivals.size();
+    result.allocations = allocations.load() - before;
+    return result;
+}
+
+// The obvious alternative: every frame in one heap keyed by time, released by the same window
+double run_priority_queue(const std::vector<Arrival> &arrivals, int64_t window_us, uint64_t *emitted) {
+    using Item = std::pair<int64_t, uint32_t>;
+    std::vector<Item> storage;
+    storage.reserve(arrivals.size());
+    std::priority_queue<Item, std::vector<Item>, std::greater<Item>> heap(std::greater<Item>(), std::move(storage));
+    Out out;
+    int64_t start = now_ns();
+    int64_t next_poll = arrivals.front().arrival_us;
+    for (size_t i = 0; i < arrivals.size(); i++) {
+        const Arrival &a = arrivals[i];
+        if (a.arrival_us >= next_poll) {
+            while (!heap.empty() && heap.top().first <= a.arrival_us - window_us) {
+                sink(&out, arrivals[heap.top().second].input, heap.top().first, &arrivals[heap.top().second].frame);
+                heap.pop();
+            }
+            next_poll = a.arrival_us + 1000;
+        }
+        if (a.key >= out.last) heap.push({a.key, static_cast<uint32_t>(i)});
+    }
+    while (!heap.empty()) {
+        sink(&out, arrivals[heap.top().second].input, heap.top().first, &arrivals[heap.top().second].frame);
+        heap.pop();
+    }
+    *emitted = out.count;
+    return static_cast<double>(now_ns() - start) / arrivals.size();
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const uint32_t frames = (argc > 1) ? static_cast<uint32_t>(std::atoi(argv[1])) : 100000;
+    const uint32_t rate = (argc > 2) ? static_cast<uint32_t>(std::atoi(argv[2])) : 1000;
+    if (frames < 10 || rate < 1 || rate > 20000) {
+        std::fprintf(stderr, "usage: bench_merge [frames per input >= 10] [rate 1..20000 Hz]\n");
+        return 2;
+    }
+    int failed = 0;
+    std::printf("%6s %8s %10s %10s %9s %8s %8s %8s %10s %10s\n", "inputs", "window", "merge ns", "pqueue ns", "late",
+                "forced", "p50 us", "p99 us", "deepest", "allocs");
+    for (uint32_t inputs : {2u, 8u, 16u}) {
+        std::vector<Arrival> arrivals = generate(inputs, frames, rate, inputs);
+        for (int64_t window_ms : {0, 5, 20, 50}) {
+            Result r = run_merge(arrivals, inputs, window_ms * 1000);
+            uint64_t pq_emitted = 0;
+            double pq_ns = run_priority_queue(arrivals, window_ms * 1000, &pq_emitted);
+            uint64_t late = merge_late(&bench_merged);
+            bool ok = r.out.disorder == 0 && r.out.count + late == arrivals.size() && r.allocations == 0;
+            failed += !ok;
+            std::printf("%6u %6lld ms %10.1f %10.1f %9llu %8llu %8u %8u %10u %10llu%s\n", inputs,
+                        static_cast<long long>(window_ms), r.ns_per_frame, pq_ns,
+                        static_cast<unsigned long long>(late),
+                        static_cast<unsigned long long>(merge_forced(&bench_merged)),
+                        soak_histogram_percentile(bench_merged.latency, 50),
+                        soak_histogram_percentile(bench_merged.latency, 99), bench_merged.max_queued,
+                        static_cast<unsigned long long>(r.allocations), ok ? "" : "  FAIL");
+        }
+    }
+    std::printf("%s\n", failed ? "FAILED" : "every merge in time order, complete and allocation free");
+    return failed ? 1 : 0;
+}
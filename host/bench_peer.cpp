@@ -0,0 +1,562 @@
+/* bench_peer — the station end of bench_tcp and bench_udp (main/bench_net.c).
+
+   usage: bench_peer -s [-p port]
+          bench_peer -c host [-u] [-R] [-t s] [-i s] [-l bytes] [-P n] [-b kbps] [-p port]
+
+   -s serves: TCP and UDP on the port (default 5201), one test after the
+   other, for "bench_tcp"/"bench_udp" on the board. The board's flags choose
+   direction, duration and buffer size.
+
+   -c connects to a board running "bench_tcp --listen" or "bench_udp
+   --listen", or to another bench_peer -s. The client sends unless -R is
+   given. The other flags mean what they mean on the board.
+
+   A TCP sender also prints the segments Linux retransmitted (TCP_INFO).
+   That is the retransmit count the board cannot see when it is the
+   receiving side. Run both ends on one machine to measure the local
+   network stack.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_net.h"
+
+namespace {
+
+int64_t now_us() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+void sleep_until_us(int64_t t) {
+    timespec ts{static_cast<time_t>(t / 1000000), static_cast<long>(t % 1000000) * 1000};
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+}
+
+double mbps(uint64_t bytes, int64_t us) { return us > 0 ? bytes * 8.0 / us : 0; }
+
+std::mutex print_lock;
+
+#define LOG(...)                                    \
+    do {                                            \
+        std::lock_guard<std::mutex> guard(print_lock); \
+        std::printf(__VA_ARGS__);                   \
+        std::fflush(stdout);                        \
+    } while (0)
+
+bool read_all(int sock, void *data, size_t size) {
+    for (size_t have = 0; have < size;) {
+        ssize_t got = recv(sock, static_cast<uint8_t *>(data) + have, size - have, 0);
+        if (got <= 0) return false;
+        have += static_cast<size_t>(got);
+    }
+    return true;
+}
+
+uint32_t tcp_retransmits(int sock) {
+    tcp_info info{};
+    socklen_t size = sizeof(info);
+    return getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &size) == 0 ? info.tcpi_total_retrans : 0;
+}
+
+struct Stream {
+    int index = 0;
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<bool> done{false};
+    int64_t elapsed_us = 0;     // sender: start to end, receiver: first to last byte
+    uint32_t packets = 0;       // UDP sender: datagrams sent
+    uint32_t retransmits = 0;
+    bool have_result = false;
+    bench_net_result_t result{};  // what the receiver counted (also filled by a receiver for itself)
+};
+
+// Sequence, loss and RFC 3550 jitter accounting of one UDP stream, as on the board
+struct UdpReceiver {
+    uint32_t next = 0;
+    uint32_t packets = 0, lost = 0, out_of_order = 0;
+    double jitter = 0;
+    int64_t last_transit = 0;
+    bool have_transit = false;
+    int64_t first = 0, last = 0;
+    uint64_t bytes = 0;
+    bool finished = false;
+
+    void data(const bench_net_datagram_t &h, size_t len, int64_t now) {
+        if (h.flags & BENCH_NET_FIN) {
+            if (!finished && h.seq > next) {
+                lost += h.seq - next;
+                next = h.seq;
+            }
+            finished = true;
+            return;
+        }
+        if (finished) return;
+        if (bytes == 0) first = now;
+        last = now;
+        bytes += len;
+        packets++;
+        if (h.seq == next) {
+            next++;
+        } else if (h.seq > next) {
+            lost += h.seq - next;
+            next = h.seq + 1;
+        } else {
+            out_of_order++;
+            if (lost) lost--;
+        }
+        int64_t transit = now - h.sent_us;
+        if (have_transit) jitter += (std::llabs(transit - last_transit) - jitter) / 16;
+        last_transit = transit;
+        have_transit = true;
+    }
+
+    bench_net_result_t result(uint8_t stream) const {
+        bench_net_result_t r{};
+        r.magic = BENCH_NET_RESULT;
+        r.stream = stream;
+        r.bytes = bytes;
+        r.duration_us = static_cast<uint32_t>(last - first);
+        r.packets = packets;
+        r.lost = lost;
+        r.out_of_order = out_of_order;
+        r.jitter_us = static_cast<uint32_t>(jitter);
+        return r;
+    }
+};
+
+std::vector<uint8_t> payload(size_t length) { return std::vector<uint8_t>(std::max<size_t>(length, 64), 0x5a); }
+
+void tcp_send(int sock, const bench_net_hello_t &hello, Stream &s) {
+    auto buffer = payload(hello.length);
+    const int64_t start = now_us(), end = start + hello.duration_ms * 1000LL;
+    while (now_us() < end) {
+        ssize_t sent = send(sock, buffer.data(), hello.length, MSG_NOSIGNAL);
+        if (sent <= 0) break;
+        s.bytes += static_cast<uint64_t>(sent);
+    }
+    s.elapsed_us = now_us() - start;
+    s.retransmits = tcp_retransmits(sock);
+    shutdown(sock, SHUT_WR);
+    s.have_result = read_all(sock, &s.result, sizeof(s.result)) && s.result.magic == BENCH_NET_RESULT;
+}
+
+void tcp_receive(int sock, const bench_net_hello_t &hello, Stream &s) {
+    auto buffer = payload(BENCH_NET_MAX_LENGTH);
+    int64_t first = 0, last = 0;
+    ssize_t got;
+    while ((got = recv(sock, buffer.data(), buffer.size(), 0)) > 0) {
+        last = now_us();
+        if (s.bytes == 0) first = last;
+        s.bytes += static_cast<uint64_t>(got);
+    }
+    s.elapsed_us = last - first;
+    s.result = bench_net_result_t{};
+    s.result.magic = BENCH_NET_RESULT;
+    s.result.stream = hello.stream;
+    s.result.bytes = s.bytes;
+    s.result.duration_us = static_cast<uint32_t>(s.elapsed_us);
+    send(sock, &s.result, sizeof(s.result), MSG_NOSIGNAL);
+}
+
+/* Paced datagrams to `to`, then the end until the result arrives. The
+ * result comes through `result_ready`: from this thread's own recv() on a
+ * client socket, or from the server's receive loop on a shared one.
+ */
+void udp_send(int sock, const sockaddr_in &to, const bench_net_hello_t &hello, Stream &s,
+              const std::atomic<bool> *result_ready) {
+    auto buffer = payload(hello.length);
+    const int64_t period = static_cast<int64_t>(hello.length) * 8 * 1000 * hello.streams / std::max(1u, hello.rate_kbps);
+    const int64_t start = now_us(), end = start + hello.duration_ms * 1000LL;
+    bench_net_datagram_t h{BENCH_NET_DATA, hello.stream, 0, 0, 0, 0};
+    for (int64_t due = start; due < end; due += period) {
+        sleep_until_us(due);
+        h.sent_us = now_us();
+        std::memcpy(buffer.data(), &h, sizeof(h));
+        if (sendto(sock, buffer.data(), hello.length, 0, reinterpret_cast<const sockaddr *>(&to), sizeof(to)) > 0) {
+            s.bytes += hello.length;
+            h.seq++;
+        }
+    }
+    s.elapsed_us = now_us() - start;
+    s.packets = h.seq;
+    h.flags = BENCH_NET_FIN;
+    for (int attempt = 0; attempt < 30 && !s.have_result; attempt++) {
+        h.sent_us = now_us();
+        sendto(sock, &h, sizeof(h), 0, reinterpret_cast<const sockaddr *>(&to), sizeof(to));
+        if (result_ready) {
+            for (int wait = 0; wait < 10 && !*result_ready; wait++) usleep(10000);
+            s.have_result = *result_ready;
+            continue;
+        }
+        timeval tv{0, 100000};
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        bench_net_result_t r;
+        if (recv(sock, &r, sizeof(r), 0) == sizeof(r) && r.magic == BENCH_NET_RESULT) {
+            s.result = r;
+            s.have_result = true;
+        }
+    }
+}
+
+// Client side UDP receiver: its own socket, ends with the sender's end
+void udp_receive(int sock, const sockaddr_in &to, const bench_net_hello_t &hello, Stream &s) {
+    auto buffer = payload(BENCH_NET_UDP_MAX_LENGTH + 64);
+    UdpReceiver rx;
+    timeval tv{1, 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    const int64_t give_up = now_us() + hello.duration_ms * 1000LL + 5000000;
+    while (!rx.finished && now_us() < give_up) {
+        ssize_t got = recv(sock, buffer.data(), buffer.size(), 0);
+        if (got < static_cast<ssize_t>(sizeof(bench_net_datagram_t))) continue;
+        bench_net_datagram_t h;
+        std::memcpy(&h, buffer.data(), sizeof(h));
+        if (h.magic != BENCH_NET_DATA) continue;
+        rx.data(h, static_cast<size_t>(got), now_us());
+        s.bytes = rx.bytes;
+    }
+    s.result = rx.result(hello.stream);
+    s.elapsed_us = s.result.duration_us;
+    // answer the first end and a few repeats in case the answer is lost
+    for (int i = 0; i < 3 && rx.finished; i++) {
+        sendto(sock, &s.result, sizeof(s.result), 0, reinterpret_cast<const sockaddr *>(&to), sizeof(to));
+        usleep(20000);
+    }
+}
+
+void report(const char *label, bool udp, bool sending, const Stream &s) {
+    char line[256];
+    int len;
+    if (sending) {
+        len = std::snprintf(line, sizeof(line), "%s sent %.2f MB in %.2f s = %.2f Mbps", label, s.bytes / 1048576.0,
+                            s.elapsed_us / 1e6, mbps(s.bytes, s.elapsed_us));
+        if (s.have_result) {
+            len += std::snprintf(line + len, sizeof(line) - len, ", peer received %.2f MB = %.2f Mbps",
+                                 s.result.bytes / 1048576.0, mbps(s.result.bytes, s.result.duration_us));
+        } else {
+            len += std::snprintf(line + len, sizeof(line) - len, ", no result from the peer");
+        }
+        if (!udp) len += std::snprintf(line + len, sizeof(line) - len, ", %u retransmits", s.retransmits);
+    } else {
+        len = std::snprintf(line, sizeof(line), "%s received %.2f MB in %.2f s = %.2f Mbps", label, s.bytes / 1048576.0,
+                            s.result.duration_us / 1e6, mbps(s.bytes, s.result.duration_us));
+    }
+    if (udp && (s.have_result || !sending)) {
+        uint32_t total = sending ? s.packets : s.result.packets + s.result.lost;
+        std::snprintf(line + len, sizeof(line) - len, ", lost %u/%u (%.2f%%), out of order %u, jitter %.2f ms",
+                      s.result.lost, total, total ? 100.0 * s.result.lost / total : 0.0, s.result.out_of_order,
+                      s.result.jitter_us / 1000.0);
+    }
+    LOG("%s\n", line);
+}
+
+bool valid_hello(const bench_net_hello_t &h, bool udp) {
+    uint32_t max_length = udp ? BENCH_NET_UDP_MAX_LENGTH : BENCH_NET_MAX_LENGTH;
+    return h.magic == BENCH_NET_HELLO && h.version == BENCH_NET_VERSION && !(h.flags & BENCH_NET_UDP) == !udp &&
+           h.streams >= 1 && h.streams <= BENCH_NET_MAX_STREAMS && h.stream < h.streams &&
+           h.length >= sizeof(bench_net_datagram_t) && h.length <= max_length;
+}
+
+int bound_socket(int type, int port) {
+    int sock = socket(AF_INET, type, 0);
+    int yes = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+        (type == SOCK_STREAM && listen(sock, BENCH_NET_MAX_STREAMS) != 0)) {
+        std::perror("bind");
+        std::exit(1);
+    }
+    return sock;
+}
+
+void serve_tcp_connection(int sock, sockaddr_in from) {
+    bench_net_hello_t hello;
+    if (!read_all(sock, &hello, sizeof(hello)) || !valid_hello(hello, false)) {
+        LOG("%s: not a bench_tcp client\n", inet_ntoa(from.sin_addr));
+        close(sock);
+        return;
+    }
+    bool sending = !(hello.flags & BENCH_NET_CLIENT_SENDS);
+    LOG("tcp stream %u/%u from %s: %s for %u s, %u byte buffers\n", hello.stream + 1, hello.streams,
+        inet_ntoa(from.sin_addr), sending ? "sending" : "receiving", hello.duration_ms / 1000, hello.length);
+    Stream s;
+    s.index = hello.stream;
+    if (sending) {
+        tcp_send(sock, hello, s);
+    } else {
+        tcp_receive(sock, hello, s);
+    }
+    char label[16];
+    std::snprintf(label, sizeof(label), "[%u]", hello.stream);
+    report(label, false, sending, s);
+    close(sock);
+}
+
+// Server side UDP: one socket, flows told apart by address and stream index
+struct UdpFlow {
+    bench_net_hello_t hello{};
+    UdpReceiver rx;
+    Stream stream;
+    std::atomic<bool> result_ready{false};
+    bool reported = false;
+};
+
+void serve_udp(int sock) {
+    std::map<std::pair<uint64_t, uint8_t>, std::shared_ptr<UdpFlow>> flows;
+    std::vector<uint8_t> buffer(BENCH_NET_UDP_MAX_LENGTH + 64);
+    while (true) {
+        sockaddr_in from{};
+        socklen_t from_size = sizeof(from);
+        ssize_t got = recvfrom(sock, buffer.data(), buffer.size(), 0, reinterpret_cast<sockaddr *>(&from), &from_size);
+        if (got < 4) continue;
+        const int64_t now = now_us();
+        uint32_t magic;
+        std::memcpy(&magic, buffer.data(), sizeof(magic));
+        uint64_t address = (static_cast<uint64_t>(from.sin_addr.s_addr) << 16) | from.sin_port;
+        if (magic == BENCH_NET_HELLO && got >= static_cast<ssize_t>(sizeof(bench_net_hello_t))) {
+            bench_net_hello_t hello;
+            std::memcpy(&hello, buffer.data(), sizeof(hello));
+            if (!valid_hello(hello, true)) continue;
+            auto &flow = flows[{address, hello.stream}];
+            bool is_new = !flow || flow->reported ||
+                          std::memcmp(&flow->hello, &hello, sizeof(hello)) != 0;
+            if (is_new) {
+                flow = std::make_shared<UdpFlow>();
+                flow->hello = hello;
+                bool sending = !(hello.flags & BENCH_NET_CLIENT_SENDS);
+                LOG("udp stream %u/%u from %s: %s for %u s, %u byte datagrams, %u kbps\n", hello.stream + 1,
+                    hello.streams, inet_ntoa(from.sin_addr), sending ? "sending" : "receiving", hello.duration_ms / 1000,
+                    hello.length, hello.rate_kbps);
+                if (sending) {
+                    std::thread([sock, from, flow] {
+                        udp_send(sock, from, flow->hello, flow->stream, &flow->result_ready);
+                        char label[16];
+                        std::snprintf(label, sizeof(label), "[%u]", flow->hello.stream);
+                        report(label, true, true, flow->stream);
+                        flow->reported = true;
+                    }).detach();
+                }
+            }
+            sendto(sock, &hello, sizeof(hello), 0, reinterpret_cast<sockaddr *>(&from), sizeof(from));
+        } else if (magic == BENCH_NET_DATA && got >= static_cast<ssize_t>(sizeof(bench_net_datagram_t))) {
+            bench_net_datagram_t h;
+            std::memcpy(&h, buffer.data(), sizeof(h));
+            auto it = flows.find({address, h.stream});
+            if (it == flows.end() || !(it->second->hello.flags & BENCH_NET_CLIENT_SENDS)) continue;
+            UdpFlow &flow = *it->second;
+            flow.rx.data(h, static_cast<size_t>(got), now);
+            if (!flow.rx.finished) continue;
+            flow.stream.result = flow.rx.result(h.stream);
+            flow.stream.bytes = flow.rx.bytes;
+            sendto(sock, &flow.stream.result, sizeof(flow.stream.result), 0, reinterpret_cast<sockaddr *>(&from),
+                   sizeof(from));
+            if (!flow.reported) {
+                char label[16];
+                std::snprintf(label, sizeof(label), "[%u]", h.stream);
+                report(label, true, false, flow.stream);
+                flow.reported = true;
+            }
+        } else if (magic == BENCH_NET_RESULT && got >= static_cast<ssize_t>(sizeof(bench_net_result_t))) {
+            bench_net_result_t r;
+            std::memcpy(&r, buffer.data(), sizeof(r));
+            auto it = flows.find({address, r.stream});
+            if (it == flows.end() || it->second->result_ready) continue;
+            it->second->stream.result = r;
+            it->second->result_ready = true;
+        }
+    }
+}
+
+struct ClientOptions {
+    std::string host;
+    bool udp = false;
+    bool reverse = false;
+    int seconds = 10;
+    int interval = 1;
+    int length = 0;
+    int streams = 1;
+    int rate_kbps = 10000;
+    int port = BENCH_NET_PORT;
+};
+
+int run_client(const ClientOptions &o) {
+    sockaddr_in peer{};
+    peer.sin_family = AF_INET;
+    peer.sin_port = htons(static_cast<uint16_t>(o.port));
+    if (inet_pton(AF_INET, o.host.c_str(), &peer.sin_addr) != 1) {
+        std::fprintf(stderr, "not an IPv4 address: %s\n", o.host.c_str());
+        return 2;
+    }
+    const bool sending = !o.reverse;
+    std::vector<std::unique_ptr<Stream>> streams;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < o.streams; i++) {
+        bench_net_hello_t hello{};
+        hello.magic = BENCH_NET_HELLO;
+        hello.version = BENCH_NET_VERSION;
+        hello.flags = (o.udp ? BENCH_NET_UDP : 0) | (sending ? BENCH_NET_CLIENT_SENDS : 0);
+        hello.stream = static_cast<uint8_t>(i);
+        hello.streams = static_cast<uint8_t>(o.streams);
+        hello.duration_ms = static_cast<uint32_t>(o.seconds) * 1000;
+        hello.length = static_cast<uint32_t>(o.length);
+        hello.rate_kbps = static_cast<uint32_t>(o.rate_kbps);
+        int sock = socket(AF_INET, o.udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+        if (!o.udp) {
+            if (connect(sock, reinterpret_cast<sockaddr *>(&peer), sizeof(peer)) != 0 ||
+                send(sock, &hello, sizeof(hello), MSG_NOSIGNAL) != sizeof(hello)) {
+                std::perror("connect");
+                return 1;
+            }
+        } else {
+            timeval tv{0, 200000};
+            setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            bool answered = false;
+            for (int attempt = 0; attempt < 10 && !answered; attempt++) {
+                sendto(sock, &hello, sizeof(hello), 0, reinterpret_cast<sockaddr *>(&peer), sizeof(peer));
+                bench_net_hello_t echo;
+                answered = recv(sock, &echo, sizeof(echo), 0) == sizeof(echo) && echo.magic == BENCH_NET_HELLO &&
+                           echo.stream == i;
+            }
+            if (!answered) {
+                std::fprintf(stderr, "no answer from %s:%d\n", o.host.c_str(), o.port);
+                return 1;
+            }
+        }
+        streams.push_back(std::make_unique<Stream>());
+        Stream *s = streams.back().get();
+        s->index = i;
+        threads.emplace_back([=] {
+            if (o.udp) {
+                sending ? udp_send(sock, peer, hello, *s, nullptr) : udp_receive(sock, peer, hello, *s);
+            } else {
+                sending ? tcp_send(sock, hello, *s) : tcp_receive(sock, hello, *s);
+            }
+            close(sock);
+            s->done = true;
+        });
+    }
+
+    const int64_t start = now_us();
+    std::vector<uint64_t> previous(o.streams, 0);
+    int64_t from = start;
+    auto all_done = [&] {
+        return std::all_of(streams.begin(), streams.end(), [](const std::unique_ptr<Stream> &s) { return s->done.load(); });
+    };
+    while (!all_done()) {
+        usleep(10000);
+        int64_t now = now_us();
+        if (o.interval <= 0 || now - from < o.interval * 1000000LL || now - start > o.seconds * 1000000LL) continue;
+        uint64_t total = 0;
+        for (int i = 0; i < o.streams; i++) {
+            uint64_t bytes = streams[i]->bytes - previous[i];
+            previous[i] += bytes;
+            total += bytes;
+            if (o.streams > 1)
+                LOG("[%d] %6.1f-%6.1f s %10.1f KB %8.2f Mbps\n", i, (from - start) / 1e6, (now - start) / 1e6,
+                    bytes / 1024.0, mbps(bytes, now - from));
+        }
+        LOG("[SUM] %6.1f-%6.1f s %10.1f KB %8.2f Mbps\n", (from - start) / 1e6, (now - start) / 1e6, total / 1024.0,
+            mbps(total, now - from));
+        from = now;
+    }
+    for (auto &t : threads) t.join();
+
+    Stream sum;
+    sum.have_result = true;
+    for (auto &s : streams) {
+        char label[16];
+        std::snprintf(label, sizeof(label), "[%d]", s->index);
+        if (o.streams > 1) report(label, o.udp, sending, *s);
+        sum.bytes += s->bytes;
+        sum.elapsed_us = std::max(sum.elapsed_us, s->elapsed_us);
+        sum.packets += s->packets;
+        sum.retransmits += s->retransmits;
+        sum.have_result &= s->have_result || !sending;
+        sum.result.bytes += s->result.bytes;
+        sum.result.duration_us = std::max(sum.result.duration_us, s->result.duration_us);
+        sum.result.packets += s->result.packets;
+        sum.result.lost += s->result.lost;
+        sum.result.out_of_order += s->result.out_of_order;
+        sum.result.jitter_us = std::max(sum.result.jitter_us, s->result.jitter_us);
+    }
+    report("[SUM]", o.udp, sending, sum);
+    return 0;
+}
+
+void usage() {
+    std::fprintf(stderr,
+                 "usage: bench_peer -s [-p port]\n"
+                 "       bench_peer -c host [-u] [-R] [-t s] [-i s] [-l bytes] [-P n] [-b kbps] [-p port]\n");
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    bool server = false;
+    ClientOptions o;
+    int opt;
+    while ((opt = getopt(argc, argv, "sc:uRt:i:l:P:b:p:")) != -1) {
+        switch (opt) {
+            case 's': server = true; break;
+            case 'c': o.host = optarg; break;
+            case 'u': o.udp = true; break;
+            case 'R': o.reverse = true; break;
+            case 't': o.seconds = std::atoi(optarg); break;
+            case 'i': o.interval = std::atoi(optarg); break;
+            case 'l': o.length = std::atoi(optarg); break;
+            case 'P': o.streams = std::atoi(optarg); break;
+            case 'b': o.rate_kbps = std::atoi(optarg); break;
+            case 'p': o.port = std::atoi(optarg); break;
+            default: usage(); return 2;
+        }
+    }
+    if (server == !o.host.empty()) {
+        usage();
+        return 2;
+    }
+    if (server) {
+        int tcp = bound_socket(SOCK_STREAM, o.port);
+        int udp = bound_socket(SOCK_DGRAM, o.port);
+        LOG("serving bench_tcp and bench_udp on port %d\n", o.port);
+        std::thread(serve_udp, udp).detach();
+        while (true) {
+            sockaddr_in from{};
+            socklen_t size = sizeof(from);
+            int sock = accept(tcp, reinterpret_cast<sockaddr *>(&from), &size);
+            if (sock >= 0) std::thread(serve_tcp_connection, sock, from).detach();
+        }
+    }
+    if (o.length == 0) o.length = o.udp ? 1460 : 4096;
+    int max_length = o.udp ? BENCH_NET_UDP_MAX_LENGTH : BENCH_NET_MAX_LENGTH;
+    if (o.streams < 1 || o.streams > BENCH_NET_MAX_STREAMS || o.seconds < 1 || o.rate_kbps < 1 ||
+        o.length < static_cast<int>(sizeof(bench_net_datagram_t)) || o.length > max_length) {
+        std::fprintf(stderr, "streams 1..%d, length %zu..%d, time and bandwidth positive\n", BENCH_NET_MAX_STREAMS,
+                     sizeof(bench_net_datagram_t), max_length);
+        return 2;
+    }
+    return run_client(o);
+}
@@ -0,0 +1,88 @@
+/* bench_query — columnar capture aggregation (main/capture.c) against a scan
+   of the packed battery_packet frames it replaces.
+
+   usage: bench_query [frames] [repetitions]
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "capture.h"
+
+namespace {
+
+template <typename F>
+double time_ns_per_frame(F &&body, int repetitions, uint32_t frames) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; i++) body();
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    return elapsed / (static_cast<double>(repetitions) * frames);
+}
+
+bool same(const capture_stats_t &a, const capture_stats_t &b) {
+    return a.count == b.count && a.min == b.min && a.max == b.max &&
+           std::fabs(a.mean - b.mean) < 1e-6 * (1 + std::fabs(a.mean)) &&
+           std::fabs(a.stddev - b.stddev) < 1e-6 * (1 + std::fabs(a.stddev));
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const uint32_t frames = (argc > 1) ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 1u << 20;
+    const int repetitions = (argc > 2) ? std::atoi(argv[2]) : 50;
+
+    std::vector<battery_packet> packed(frames);
+    std::vector<int64_t> time(frames);
+    std::vector<int16_t> axis[CAPTURE_AXES];
+    std::vector<uint16_t> battery(frames);
+    for (auto &column : axis) column.resize(frames);
+    capture_t capture = {frames, 0, 0, time.data(),
+                         {axis[0].data(), axis[1].data(), axis[2].data(), axis[3].data(), axis[4].data(), axis[5].data()},
+                         battery.data()};
+
+    // 1 kHz sensor with a little jitter
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> sample(-32768, 32767);
+    std::uniform_int_distribution<int> jitter(-20, 20);
+    int64_t t = 5000000;
+    for (uint32_t i = 0; i < frames; i++) {
+        battery_packet &frame = packed[i];
+        t += 1000 + jitter(rng);
+        frame.ID0 = FRAME_ID0;
+        frame.time = t;
+        frame.accelX = sample(rng);
+        frame.accelY = sample(rng);
+        frame.accelZ = sample(rng);
+        frame.gyroX = sample(rng);
+        frame.gyroY = sample(rng);
+        frame.gyroZ = sample(rng);
+        frame.battery = 3000 + (i % 1200);
+        frame.IDfinal = FRAME_IDFINAL;
+        capture_append(&capture, &frame);
+    }
+
+    // the middle half of the capture
+    const int64_t from = packed[frames / 4].time;
+    const int64_t to = packed[3 * frames / 4].time;
+
+    std::printf("%u frames, %d repetitions, range covers %u frames\n", frames, repetitions, frames / 2 + 1);
+    std::printf("%-8s %12s %12s %8s\n", "field", "packed ns/f", "column ns/f", "speedup");
+    for (int field = 0; field < CAPTURE_FIELD_COUNT; field++) {
+        capture_stats_t columnar, reference;
+        auto f = static_cast<capture_field_t>(field);
+        double packed_ns = time_ns_per_frame([&] { capture_query_packed(packed.data(), frames, f, from, to, &reference); }, repetitions, frames);
+        double column_ns = time_ns_per_frame([&] { capture_query(&capture, f, from, to, &columnar); }, repetitions, frames);
+        if (!same(columnar, reference)) {
+            std::printf("%s: results differ\n", capture_field_name(f));
+            return 1;
+        }
+        std::printf("%-8s %12.3f %12.3f %7.2fx\n", capture_field_name(f), packed_ns, column_ns, packed_ns / column_ns);
+    }
+    return 0;
+}
@@ -0,0 +1,286 @@
+/* bench_result — decode cost of the binary result channel (main/result.h)
+   with host/result_decoder.h.
+
+   usage: bench_result [records]
+
+   Builds a stream of run, histogram, station and error records laid out
+   the way the board queues them, then decodes it three ways: in place
+   over the whole buffer, through a StreamDecoder fed in reads of random
+   size like recv() returns them, and, for comparison, by copying every
+   payload into its struct first. A last pass puts garbage between records
+   and checks the parser finds every record again. Every pass must see
+   each record exactly once with the same field sums, and the decoding
+   loops must not allocate; the tool exits nonzero otherwise.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "alloc_count.h"
+#include "result_decoder.h"
+#include "soak.h"
+
+namespace {
+
+int64_t now_ns() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// What the decoder has to get back: one number per record type, summed
+struct Sums {
+    uint64_t records = 0;
+    uint64_t run_frames = 0;
+    uint64_t histogram_counts = 0;
+    uint64_t station_frames = 0;
+    int64_t error_codes = 0;
+    uint64_t error_text = 0;
+
+    bool operator==(const Sums &o) const {
+        return records == o.records && run_frames == o.run_frames && histogram_counts == o.histogram_counts &&
+               station_frames == o.station_frames && error_codes == o.error_codes && error_text == o.error_text;
+    }
+};
+
+// The same bytes result_emit() puts in the ring
+void append(std::vector<uint8_t> &out, uint16_t type, uint32_t sequence, const void *fixed, size_t fixed_len,
+            const void *extra = nullptr, size_t extra_len = 0) {
+    result_header_t header{RESULT_MAGIC, type, static_cast<uint32_t>(fixed_len + extra_len), sequence, sequence * 10};
+    const uint8_t *h = reinterpret_cast<const uint8_t *>(&header);
+    out.insert(out.end(), h, h + sizeof(header));
+    const uint8_t *f = static_cast<const uint8_t *>(fixed);
+    out.insert(out.end(), f, f + fixed_len);
+    if (extra_len) {
+        const uint8_t *e = static_cast<const uint8_t *>(extra);
+        out.insert(out.end(), e, e + extra_len);
+    }
+}
+
+std::vector<uint8_t> generate(uint32_t records, Sums *sums) {
+    std::mt19937 rng(1);
+    std::vector<uint8_t> out;
+    out.reserve(static_cast<size_t>(records) * 200);
+    static const char *messages[] = {"socket error", "stall, round aborted", "no idle worker", "socket is not open"};
+    for (uint32_t seq = 0; seq < records; seq++) {
+        sums->records++;
+        switch (rng() % 8) {
+            case 0: {
+                result_histogram_t h{RESULT_CMD_SOAK, RESULT_HISTOGRAM_JITTER, RESULT_BUCKETS_SOAK, SOAK_JITTER_BUCKETS, 0, 0};
+                uint32_t counts[SOAK_JITTER_BUCKETS];
+                for (uint32_t &c : counts) {
+                    c = rng() % 1000;
+                    sums->histogram_counts += c;
+                }
+                append(out, RESULT_HISTOGRAM, seq, &h, sizeof(h), counts, sizeof(counts));
+                break;
+            }
+            case 1: {
+                const char *text = messages[rng() % 4];
+                result_error_t e{RESULT_CMD_RECV_SENSOR, 0, -static_cast<int32_t>(rng() % 200)};
+                sums->error_codes += e.code;
+                sums->error_text += std::strlen(text);
+                append(out, RESULT_ERROR, seq, &e, sizeof(e), text, std::strlen(text));
+                break;
+            }
+            case 2:
+            case 3:
+            case 4: {
+                result_station_t s{};
+                s.command = RESULT_CMD_FAIRNESS;
+                s.index = static_cast<uint16_t>(seq % 10 + 1);
+                s.frames = rng() % 100000;
+                s.rate_hz = s.frames / 10.0f;
+                sums->station_frames += s.frames;
+                append(out, RESULT_STATION, seq, &s, sizeof(s));
+                break;
+            }
+            default: {
+                result_run_t r{};
+                r.command = RESULT_CMD_RECV_SENSOR;
+                r.round = static_cast<uint16_t>(seq % 10 + 1);
+                r.rounds = 10;
+                r.frequency = 1000;
+                r.frames = rng() % 60000;
+                r.rate_hz = 999.5f;
+                sums->run_frames += r.frames;
+                append(out, RESULT_RUN, seq, &r, sizeof(r));
+                break;
+            }
+        }
+    }
+    return out;
+}
+
+struct Visitor {
+    Sums *sums;
+    void operator()(const result::Record &record) const {
+        sums->records++;
+        switch (record.type()) {
+            case RESULT_RUN:
+                sums->run_frames += record.run().frames();
+                break;
+            case RESULT_HISTOGRAM:
+                sums->histogram_counts += record.histogram().total();
+                break;
+            case RESULT_STATION:
+                sums->station_frames += record.station().frames();
+                break;
+            case RESULT_ERROR: {
+                result::Error e = record.error();
+                sums->error_codes += e.code();
+                sums->error_text += e.text().size();
+                break;
+            }
+        }
+    }
+};
+
+// The alternative: copy every payload into its struct, then read the struct
+struct CopyingVisitor {
+    Sums *sums;
+    void operator()(const result::Record &record) const {
+        sums->records++;
+        switch (record.type()) {
+            case RESULT_RUN: {
+                result_run_t r{};
+                std::memcpy(&r, record.payload(), std::min<size_t>(sizeof(r), record.length()));
+                sums->run_frames += r.frames;
+                break;
+            }
+            case RESULT_HISTOGRAM: {
+                struct {
+                    result_histogram_t h;
+                    uint32_t counts[SOAK_JITTER_BUCKETS];
+                } copy{};
+                std::memcpy(&copy, record.payload(), std::min<size_t>(sizeof(copy), record.length()));
+                for (uint32_t i = 0; i < copy.h.buckets && i < SOAK_JITTER_BUCKETS; i++) sums->histogram_counts += copy.counts[i];
+                break;
+            }
+            case RESULT_STATION: {
+                result_station_t s{};
+                std::memcpy(&s, record.payload(), std::min<size_t>(sizeof(s), record.length()));
+                sums->station_frames += s.frames;
+                break;
+            }
+            case RESULT_ERROR: {
+                result_error_t e{};
+                char text[RESULT_MAX_TEXT];
+                size_t len = std::min<size_t>(record.length() - sizeof(e), sizeof(text));
+                std::memcpy(&e, record.payload(), sizeof(e));
+                std::memcpy(text, record.payload() + sizeof(e), len);
+                sums->error_codes += e.code;
+                sums->error_text += len;
+                break;
+            }
+        }
+    }
+};
+
+struct Pass {
+    const char *name;
+    double ns_per_record;
+    double mb_per_s;
+    uint64_t allocations;
+    Sums sums;
+    result::Counters counters;
+};
+
+template <typename F>
+Pass timed(const char *name, size_t bytes, F &&body) {
+    Pass pass{name, 0, 0, 0, {}, {}};
+    uint64_t before = allocations.load();
+    int64_t start = now_ns();
+    body(&pass);
+    int64_t elapsed = now_ns() - start;
+    pass.allocations = allocations.load() - before;
+    pass.ns_per_record = static_cast<double>(elapsed) / (pass.sums.records ? pass.sums.records : 1);
+    pass.mb_per_s = bytes * 1e3 / (elapsed ? elapsed : 1);
+    return pass;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const uint32_t records = (argc > 1) ? static_cast<uint32_t>(std::atoi(argv[1])) : 1000000;
+    if (records < 1) {
+        std::fprintf(stderr, "usage: bench_result [records >= 1]\n");
+        return 2;
+    }
+    Sums expected;
+    std::vector<uint8_t> stream = generate(records, &expected);
+
+    // reads of 1 byte to 8 KiB, drawn up front so the pass only decodes
+    std::mt19937 rng(2);
+    std::vector<uint32_t> reads;
+    for (size_t at = 0; at < stream.size();) {
+        uint32_t n = (rng() % 4 == 0) ? 1 + rng() % 64 : 1 + rng() % 8192;
+        reads.push_back(n);
+        at += n;
+    }
+
+    // garbage between records, never the magic's first byte so it can't fake a header
+    std::vector<uint8_t> noisy;
+    noisy.reserve(stream.size() * 2);
+    uint64_t garbage = 0;
+    for (size_t at = 0; at < stream.size();) {
+        uint32_t length = result::load<uint32_t>(stream.data() + at + offsetof(result_header_t, length));
+        size_t size = sizeof(result_header_t) + length;
+        noisy.insert(noisy.end(), stream.begin() + at, stream.begin() + at + size);
+        at += size;
+        for (uint32_t n = (rng() % 16 == 0) ? rng() % 40 : 0; n > 0; n--, garbage++) {
+            uint8_t byte = static_cast<uint8_t>(rng());
+            noisy.push_back((byte == (RESULT_MAGIC & 0xff)) ? 0 : byte);
+        }
+    }
+
+    result::StreamDecoder decoder;
+    std::vector<Pass> passes;
+    passes.push_back(timed("in place", stream.size(), [&](Pass *p) {
+        result::Parser parser;
+        size_t used = parser.parse(stream.data(), stream.size(), Visitor{&p->sums});
+        p->counters = parser.counters();
+        p->counters.skipped_bytes += stream.size() - used;
+    }));
+    passes.push_back(timed("stream", stream.size(), [&](Pass *p) {
+        size_t at = 0;
+        for (uint32_t n : reads) {
+            n = static_cast<uint32_t>(std::min<size_t>({n, stream.size() - at, decoder.space_size()}));
+            std::memcpy(decoder.space(), stream.data() + at, n);   // what recv() does
+            decoder.commit(n, Visitor{&p->sums});
+            at += n;
+        }
+        p->counters = decoder.counters();
+        p->counters.skipped_bytes += decoder.held();
+    }));
+    passes.push_back(timed("copying", stream.size(), [&](Pass *p) {
+        result::Parser parser;
+        parser.parse(stream.data(), stream.size(), CopyingVisitor{&p->sums});
+        p->counters = parser.counters();
+    }));
+    passes.push_back(timed("resync", noisy.size(), [&](Pass *p) {
+        result::Parser parser;
+        parser.parse(noisy.data(), noisy.size(), Visitor{&p->sums});
+        p->counters = parser.counters();
+        p->counters.skipped_bytes -= garbage;
+    }));
+
+    int failed = 0;
+    std::printf("%u records, %.1f MB, %" PRIu64 " garbage bytes in the resync pass\n", records, stream.size() / 1e6, garbage);
+    std::printf("%-10s %10s %10s %10s %10s %10s\n", "pass", "ns/record", "MB/s", "missed", "skipped", "allocs");
+    for (const Pass &p : passes) {
+        bool ok = p.sums == expected && p.counters.missed == 0 && p.counters.skipped_bytes == 0 && p.allocations == 0;
+        failed += !ok;
+        std::printf("%-10s %10.1f %10.0f %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "%s\n", p.name, p.ns_per_record,
+                    p.mb_per_s, p.counters.missed, p.counters.skipped_bytes, p.allocations, ok ? "" : "  FAIL");
+    }
+    std::printf("%s\n", failed ? "FAILED" : "every record decoded once, in place and allocation free");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,323 @@
+/* capture_analysis.h — parallel statistics over an exported capture file:
+   packed battery_packet frames (main/frame.h) back to back, as the sensor
+   sends them.
+
+   The file is cut into fixed size chunks on frame boundaries. Worker
+   threads take chunks from a shared counter, each chunk gets its own
+   result and the results are merged in file order. Sums are exact
+   integers and the chunking does not depend on the number of threads, so
+   the output is bit for bit the same with 1 or 64 threads.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "frame.h"
+
+namespace capture_analysis {
+
+constexpr size_t kFrameSize = sizeof(battery_packet);
+// 4 buckets per power of two from 8 us, past 1 hour in the last one
+constexpr int kIntervalBuckets = 128;
+// accelX..gyroZ and battery
+constexpr int kChannels = 7;
+// gap positions kept per chunk; all gaps are counted
+constexpr size_t kGapsPerChunk = 1024;
+// 16 MiB of frames
+constexpr uint64_t kDefaultChunkFrames = (16u << 20) / kFrameSize;
+
+inline const char *channel_name(int channel) {
+    static const char *names[kChannels] = {"accelX", "accelY", "accelZ", "gyroX", "gyroY", "gyroZ", "battery"};
+    return names[channel];
+}
+
+// Same log-linear layout as the firmware's jitter histogram (main/soak.h), with more octaves
+inline int interval_bucket(uint64_t us) {
+    if (us < 8) return static_cast<int>(us);
+    int octave = 63 - __builtin_clzll(us);
+    int bucket = 8 + (octave - 3) * 4 + static_cast<int>((us >> (octave - 2)) & 3);
+    return std::min(bucket, kIntervalBuckets - 1);
+}
+
+inline uint64_t bucket_floor(int bucket) {
+    if (bucket < 8) return static_cast<uint64_t>(bucket);
+    int octave = 3 + (bucket - 8) / 4;
+    return static_cast<uint64_t>(4 + (bucket - 8) % 4) << (octave - 2);
+}
+
+struct Gap {
+    uint64_t frame;     // index in the file of the first frame after the gap
+    int64_t from_us;    // sensor times on both sides
+    int64_t to_us;
+    uint64_t lost;
+};
+
+/* Exact power sums of one channel. Samples are 16 bit, so each power fits
+ * 64 bits and the sums of 10^11 frames fit 128 bits.
+ */
+struct Moments {
+    uint64_t n = 0;
+    int64_t min = INT64_MAX;
+    int64_t max = INT64_MIN;
+    __int128 s1 = 0;
+    __int128 s2 = 0;
+    __int128 s3 = 0;
+    __int128 s4 = 0;
+
+    void add(int64_t x) {
+        int64_t x2 = x * x;
+        n++;
+        min = std::min(min, x);
+        max = std::max(max, x);
+        s1 += x;
+        s2 += x2;
+        s3 += x2 * x;
+        s4 += static_cast<uint64_t>(x2) * static_cast<uint64_t>(x2);
+    }
+    void merge(const Moments &o) {
+        n += o.n;
+        min = std::min(min, o.min);
+        max = std::max(max, o.max);
+        s1 += o.s1;
+        s2 += o.s2;
+        s3 += o.s3;
+        s4 += o.s4;
+    }
+    double mean() const { return n ? static_cast<double>(static_cast<long double>(s1) / n) : 0; }
+    // central moments from the raw sums, in long double
+    double stddev() const {
+        if (n < 2) return 0;
+        long double m = static_cast<long double>(s1) / n;
+        long double var = (static_cast<long double>(s2) - n * m * m) / (n - 1);
+        return var > 0 ? std::sqrt(static_cast<double>(var)) : 0;
+    }
+    double skewness() const {
+        if (n < 3) return 0;
+        long double m = static_cast<long double>(s1) / n;
+        long double m2 = static_cast<long double>(s2) / n - m * m;
+        long double m3 = static_cast<long double>(s3) / n - 3 * m * static_cast<long double>(s2) / n + 2 * m * m * m;
+        return m2 > 0 ? static_cast<double>(m3 / std::pow(m2, 1.5L)) : 0;
+    }
+    double kurtosis() const {  // excess
+        if (n < 4) return 0;
+        long double m = static_cast<long double>(s1) / n;
+        long double e2 = static_cast<long double>(s2) / n, e3 = static_cast<long double>(s3) / n,
+                    e4 = static_cast<long double>(s4) / n;
+        long double m2 = e2 - m * m;
+        long double m4 = e4 - 4 * m * e3 + 6 * m * m * e2 - 3 * m * m * m * m;
+        return m2 > 0 ? static_cast<double>(m4 / (m2 * m2) - 3) : 0;
+    }
+};
+
+struct Result {
+    uint64_t frames = 0;
+    uint64_t valid = 0;
+    uint64_t bad_marker = 0;
+    uint64_t clock_resets = 0;      // sensor time went backwards or stood still
+    bool has_valid = false;
+    uint64_t first_index = 0;       // first and last valid frame, for the interval across a chunk boundary
+    int64_t first_time = 0;
+    uint64_t last_index = 0;
+    int64_t last_time = 0;
+    uint64_t intervals = 0;
+    int64_t interval_sum = 0;
+    int64_t interval_min = INT64_MAX;
+    int64_t interval_max = 0;
+    uint64_t histogram[kIntervalBuckets] = {};
+    uint64_t gaps = 0;
+    uint64_t lost = 0;
+    std::vector<Gap> gap_list;      // in file order, capped per chunk
+    Moments channels[kChannels];
+
+    void interval(uint64_t index, int64_t previous, int64_t time, int64_t nominal_us) {
+        int64_t dt = time - previous;
+        if (dt <= 0) {
+            clock_resets++;
+            return;
+        }
+        intervals++;
+        interval_sum += dt;
+        interval_min = std::min(interval_min, dt);
+        interval_max = std::max(interval_max, dt);
+        histogram[interval_bucket(static_cast<uint64_t>(dt))]++;
+        if (2 * dt > 3 * nominal_us) {
+            uint64_t missing = static_cast<uint64_t>((dt + nominal_us / 2) / nominal_us - 1);
+            gaps++;
+            lost += missing;
+            if (gap_list.size() < kGapsPerChunk) gap_list.push_back({index, previous, time, missing});
+        }
+    }
+};
+
+/* Power sums of a few thousand frames in 64 bits, folded into the 128 bit
+ * Moments before they can overflow: 128 bit adds on every sample cost more
+ * than the rest of the frame.
+ */
+struct Block {
+    static constexpr uint32_t kFrames = 4096;   // 4096 * 2^48 for x^3 stays below 2^63
+    uint32_t n = 0;
+    int64_t min[kChannels], max[kChannels], s1[kChannels], s2[kChannels], s3[kChannels];
+    __int128 s4[kChannels];
+
+    Block() { reset(); }
+    void reset() {
+        n = 0;
+        for (int c = 0; c < kChannels; c++) {
+            min[c] = INT64_MAX;
+            max[c] = INT64_MIN;
+            s1[c] = s2[c] = s3[c] = 0;
+            s4[c] = 0;
+        }
+    }
+    void add(int c, int64_t x) {
+        int64_t x2 = x * x;
+        min[c] = std::min(min[c], x);
+        max[c] = std::max(max[c], x);
+        s1[c] += x;
+        s2[c] += x2;
+        s3[c] += x2 * x;
+        s4[c] += static_cast<uint64_t>(x2) * static_cast<uint64_t>(x2);
+    }
+    void flush(Moments *channels) {
+        for (int c = 0; n > 0 && c < kChannels; c++) {
+            Moments &m = channels[c];
+            m.n += n;
+            m.min = std::min(m.min, min[c]);
+            m.max = std::max(m.max, max[c]);
+            m.s1 += s1[c];
+            m.s2 += s2[c];
+            m.s3 += s3[c];
+            m.s4 += s4[c];
+        }
+        reset();
+    }
+};
+
+inline void analyze_chunk(const uint8_t *data, uint64_t first, uint64_t count, int64_t nominal_us, Result &r) {
+    Block block;
+    bool have_previous = false;
+    int64_t previous = 0;
+    for (uint64_t i = first; i < first + count; i++) {
+        battery_packet f;
+        std::memcpy(&f, data + i * kFrameSize, kFrameSize);
+        if (f.ID0 != FRAME_ID0 || f.IDfinal != FRAME_IDFINAL) {
+            r.bad_marker++;
+            continue;
+        }
+        r.valid++;
+        if (have_previous) {
+            r.interval(i, previous, f.time, nominal_us);
+        } else {
+            r.has_valid = true;
+            r.first_index = i;
+            r.first_time = f.time;
+        }
+        have_previous = true;
+        previous = f.time;
+        r.last_index = i;
+        r.last_time = f.time;
+        const int64_t values[kChannels] = {f.accelX, f.accelY, f.accelZ, f.gyroX, f.gyroY, f.gyroZ, f.battery};
+        for (int c = 0; c < kChannels; c++) block.add(c, values[c]);
+        if (++block.n == Block::kFrames) block.flush(r.channels);
+    }
+    block.flush(r.channels);
+    r.frames = count;
+}
+
+// Append `next`, the chunk that follows `total` in the file
+inline void merge(Result &total, Result &next, int64_t nominal_us) {
+    if (total.has_valid && next.has_valid) {
+        total.interval(next.first_index, total.last_time, next.first_time, nominal_us);
+    }
+    if (!total.has_valid && next.has_valid) {
+        total.has_valid = true;
+        total.first_index = next.first_index;
+        total.first_time = next.first_time;
+    }
+    if (next.has_valid) {
+        total.last_index = next.last_index;
+        total.last_time = next.last_time;
+    }
+    total.frames += next.frames;
+    total.valid += next.valid;
+    total.bad_marker += next.bad_marker;
+    total.clock_resets += next.clock_resets;
+    total.intervals += next.intervals;
+    total.interval_sum += next.interval_sum;
+    total.interval_min = std::min(total.interval_min, next.interval_min);
+    total.interval_max = std::max(total.interval_max, next.interval_max);
+    for (int b = 0; b < kIntervalBuckets; b++) total.histogram[b] += next.histogram[b];
+    total.gaps += next.gaps;
+    total.lost += next.lost;
+    total.gap_list.insert(total.gap_list.end(), next.gap_list.begin(), next.gap_list.end());
+    for (int c = 0; c < kChannels; c++) total.channels[c].merge(next.channels[c]);
+}
+
+/* Median interval of the first valid frames, when the sensor rate is not
+ * given. Needs a few hundred intervals to be meaningful.
+ */
+inline int64_t estimate_nominal_us(const uint8_t *data, uint64_t frames, uint64_t sample = 4096) {
+    std::vector<int64_t> dts;
+    bool have_previous = false;
+    int64_t previous = 0;
+    for (uint64_t i = 0; i < frames && dts.size() < sample; i++) {
+        battery_packet f;
+        std::memcpy(&f, data + i * kFrameSize, kFrameSize);
+        if (f.ID0 != FRAME_ID0 || f.IDfinal != FRAME_IDFINAL) continue;
+        if (have_previous && f.time > previous) dts.push_back(f.time - previous);
+        have_previous = true;
+        previous = f.time;
+    }
+    if (dts.empty()) return 1000;
+    std::nth_element(dts.begin(), dts.begin() + dts.size() / 2, dts.end());
+    return std::max<int64_t>(1, dts[dts.size() / 2]);
+}
+
+// Analyze `frames` frames at `data` on `threads` threads
+inline Result analyze(const uint8_t *data, uint64_t frames, int threads, int64_t nominal_us,
+                      uint64_t chunk_frames = kDefaultChunkFrames) {
+    const uint64_t chunks = (frames + chunk_frames - 1) / chunk_frames;
+    std::vector<Result> results(chunks);
+    std::atomic<uint64_t> next{0};
+    auto worker = [&] {
+        for (uint64_t c; (c = next.fetch_add(1, std::memory_order_relaxed)) < chunks;) {
+            uint64_t first = c * chunk_frames;
+            analyze_chunk(data, first, std::min(chunk_frames, frames - first), nominal_us, results[c]);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++) pool.emplace_back(worker);
+    worker();
+    for (auto &t : pool) t.join();
+
+    Result total;
+    for (auto &r : results) merge(total, r, nominal_us);
+    return total;
+}
+
+// Every field that goes into the report, for checking that two runs agree exactly
+inline bool identical(const Result &a, const Result &b) {
+    if (a.frames != b.frames || a.valid != b.valid || a.bad_marker != b.bad_marker || a.clock_resets != b.clock_resets ||
+        a.intervals != b.intervals || a.interval_sum != b.interval_sum || a.interval_min != b.interval_min ||
+        a.interval_max != b.interval_max || a.gaps != b.gaps || a.lost != b.lost || a.gap_list.size() != b.gap_list.size())
+        return false;
+    if (std::memcmp(a.histogram, b.histogram, sizeof(a.histogram)) != 0) return false;
+    for (size_t i = 0; i < a.gap_list.size(); i++)
+        if (a.gap_list[i].frame != b.gap_list[i].frame || a.gap_list[i].lost != b.gap_list[i].lost) return false;
+    for (int c = 0; c < kChannels; c++) {
+        const Moments &x = a.channels[c], &y = b.channels[c];
+        if (x.n != y.n || x.min != y.min || x.max != y.max || x.s1 != y.s1 || x.s2 != y.s2 || x.s3 != y.s3 || x.s4 != y.s4)
+            return false;
+    }
+    return true;
+}
+
+}  // namespace capture_analysis
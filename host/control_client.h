@@ -0,0 +1,275 @@
+/* control_client.h — client side of the firmware's remote control server
+   (main/control.h).
+
+   Client sends command lines tagged with ids without waiting for the
+   answers, and matches every "ok", "error" and "done" the board sends
+   back to its request by id. A request is complete once it was answered
+   and every job it started has reported; the completion callback then
+   gets it with its timings: sent to answered, and sent to the last job
+   done.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace control {
+
+constexpr uint32_t kVersion = 2;      // CONTROL_VERSION
+constexpr int kPort = 2325;           // CONFIG_TESTSUITE_CONTROL_PORT default
+
+enum class Kind { hello, ok, error, done, unknown };
+
+inline const char *kind_name(Kind kind) {
+    switch (kind) {
+        case Kind::hello: return "hello";
+        case Kind::ok: return "ok";
+        case Kind::error: return "error";
+        case Kind::done: return "done";
+        default: return "unknown";
+    }
+}
+
+struct Message {
+    uint32_t id;
+    Kind kind;
+    int32_t code;
+    uint32_t jobs;
+    uint32_t ms;              // ok: time the command ran, done: time the job took; 0 from a version 1 board
+    std::string_view body;    // valid only during the callback
+};
+
+inline int64_t now_ns() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Splits the byte stream into messages: a header line, then <length> bytes of body
+class Parser {
+  public:
+    // Returns false on a header that is not one, after which the stream can't be trusted
+    template <typename Visit>
+    bool feed(const char *data, size_t size, Visit &&visit) {
+        buffer_.append(data, size);
+        size_t at = 0;
+        bool good = true;
+        while (true) {
+            size_t newline = buffer_.find('\n', at);
+            if (newline == std::string::npos) break;
+            Message message{};
+            uint32_t length = 0;
+            if (!parse_header(std::string_view(buffer_).substr(at, newline - at), &message, &length)) {
+                good = false;
+                break;
+            }
+            if (buffer_.size() - newline - 1 < length) break;
+            message.body = std::string_view(buffer_).substr(newline + 1, length);
+            visit(static_cast<const Message &>(message));
+            at = newline + 1 + length;
+        }
+        buffer_.erase(0, at);
+        return good;
+    }
+
+  private:
+    static bool parse_number(std::string_view &rest, long long *value) {
+        size_t space = rest.find(' ');
+        std::string field(rest.substr(0, space));
+        char *end;
+        *value = std::strtoll(field.c_str(), &end, 10);
+        rest = (space == std::string_view::npos) ? std::string_view() : rest.substr(space + 1);
+        return !field.empty() && *end == '\0';
+    }
+
+    static bool parse_header(std::string_view line, Message *message, uint32_t *length) {
+        long long id, code, jobs, ms = 0, len;
+        if (!parse_number(line, &id)) return false;
+        size_t space = line.find(' ');
+        if (space == std::string_view::npos) return false;
+        std::string_view kind = line.substr(0, space);
+        line = line.substr(space + 1);
+        if (!parse_number(line, &code) || !parse_number(line, &jobs) || !parse_number(line, &len)) return false;
+        // version 2 puts <ms> before the length
+        if (!line.empty()) {
+            ms = len;
+            if (!parse_number(line, &len) || !line.empty()) return false;
+        }
+        if (id < 0 || id > UINT32_MAX || ms < 0 || ms > UINT32_MAX || len < 0 || len > 1 << 20) return false;
+        message->id = static_cast<uint32_t>(id);
+        message->kind = (kind == "hello") ? Kind::hello
+                      : (kind == "ok")    ? Kind::ok
+                      : (kind == "error") ? Kind::error
+                      : (kind == "done")  ? Kind::done
+                                          : Kind::unknown;
+        message->code = static_cast<int32_t>(code);
+        message->jobs = static_cast<uint32_t>(jobs);
+        message->ms = static_cast<uint32_t>(ms);
+        *length = static_cast<uint32_t>(len);
+        return true;
+    }
+
+    std::string buffer_;
+};
+
+struct Request {
+    uint32_t id = 0;
+    std::string line;
+    int64_t sent_ns = 0;
+    int64_t answered_ns = 0;     // 0 until the ok or error
+    int64_t finished_ns = 0;     // the answer or the last done, whichever came last
+    bool error = false;
+    int32_t code = 0;            // command return code, or the esp_err_t of an error
+    uint32_t jobs = 0;
+    uint32_t done = 0;
+    std::string output;
+
+    bool answered() const { return answered_ns != 0; }
+    bool complete() const { return answered() && done >= jobs; }
+    double response_ms() const { return (answered_ns - sent_ns) / 1e6; }
+    double completion_ms() const { return (finished_ns - sent_ns) / 1e6; }
+};
+
+class Client {
+  public:
+    using Complete = std::function<void(const Request &)>;
+
+    Client() = default;
+    explicit Client(int fd) : fd_(fd) {}
+    ~Client() {
+        if (fd_ >= 0) ::close(fd_);
+    }
+    Client(const Client &) = delete;
+    Client &operator=(const Client &) = delete;
+
+    bool connect(const char *host, int port, std::string *error) {
+        sockaddr_in peer{};
+        peer.sin_family = AF_INET;
+        peer.sin_port = htons(port);
+        if (inet_pton(AF_INET, host, &peer.sin_addr) != 1) {
+            *error = std::string("not an IPv4 address: ") + host;
+            return false;
+        }
+        fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (fd_ < 0 || ::connect(fd_, reinterpret_cast<sockaddr *>(&peer), sizeof(peer)) != 0) {
+            *error = std::strerror(errno);
+            return false;
+        }
+        int nodelay = 1;
+        setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        return true;
+    }
+
+    void on_complete(Complete complete) { complete_ = std::move(complete); }
+
+    // Sends one command line without waiting, returns its id, 0 if the connection is gone
+    uint32_t send(std::string_view line) {
+        uint32_t id = next_id_++;
+        if (next_id_ == 0) next_id_ = 1;
+        std::string wire = std::to_string(id);
+        wire += ' ';
+        wire += line;
+        wire += '\n';
+        Request &request = requests_[id];
+        request.id = id;
+        request.line = line;
+        request.sent_ns = now_ns();
+        for (size_t at = 0; at < wire.size();) {
+            ssize_t sent = ::send(fd_, wire.data() + at, wire.size() - at, MSG_NOSIGNAL);
+            if (sent <= 0) {
+                requests_.erase(id);
+                return 0;
+            }
+            at += static_cast<size_t>(sent);
+        }
+        unanswered_++;
+        return id;
+    }
+
+    // Reads what arrives within timeout_ms and handles it; false once the board closed or sent garbage
+    bool poll(int timeout_ms) {
+        pollfd p{fd_, POLLIN, 0};
+        int ready = ::poll(&p, 1, timeout_ms);
+        if (ready < 0) return errno == EINTR;
+        if (ready == 0) return true;
+        char data[16384];
+        ssize_t got = ::recv(fd_, data, sizeof(data), 0);
+        if (got <= 0) return false;
+        return parser_.feed(data, static_cast<size_t>(got), [this](const Message &m) { handle(m); });
+    }
+
+    // Requests sent and not answered yet
+    size_t unanswered() const { return unanswered_; }
+    // Requests not complete: unanswered, or with jobs still running
+    size_t pending() const { return requests_.size(); }
+    bool hello_seen() const { return hello_; }
+    uint32_t version() const { return version_; }
+    // Messages with an id no request has, or not a known kind
+    uint64_t unmatched() const { return unmatched_; }
+
+  private:
+    void handle(const Message &m) {
+        if (m.kind == Kind::hello) {
+            hello_ = true;
+            version_ = static_cast<uint32_t>(m.code);
+            return;
+        }
+        auto found = requests_.find(m.id);
+        if (found == requests_.end() || m.kind == Kind::unknown) {
+            unmatched_++;
+            return;
+        }
+        Request &request = found->second;
+        int64_t now = now_ns();
+        if (m.kind == Kind::done) {
+            request.done++;
+        } else {
+            request.answered_ns = now;
+            request.error = (m.kind == Kind::error);
+            request.code = m.code;
+            request.jobs = m.jobs;
+            request.output.assign(m.body);
+            unanswered_--;
+        }
+        request.finished_ns = now;
+        if (request.complete()) {
+            if (complete_) complete_(request);
+            requests_.erase(found);
+        }
+    }
+
+    int fd_ = -1;
+    uint32_t next_id_ = 1;
+    size_t unanswered_ = 0;
+    bool hello_ = false;
+    uint32_t version_ = 0;
+    uint64_t unmatched_ = 0;
+    Parser parser_;
+    Complete complete_;
+    std::unordered_map<uint32_t, Request> requests_;
+};
+
+// Sorted-sample percentile, p in 0..100
+template <typename V>
+double percentile(const V &sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = static_cast<size_t>(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[rank];
+}
+
+}  // namespace control
@@ -0,0 +1,144 @@
+/* control_run — runs a script of console commands on the board through the
+   remote control server (main/control.h) and reports how long the board
+   took to answer them.
+
+   usage: control_run [--window N] [host] [port] < script
+
+   One command line per script line, as typed on the console; blank lines
+   and lines starting with '#' are skipped, and a line "wait" holds the
+   script until every command sent so far has been answered and every job
+   they started (streams, benchmarks) has finished. Up to N commands (4 by
+   default) are sent ahead of their answers, so the link's round trip is
+   paid once per window instead of once per command; --window 1 sends in
+   lock step.
+
+   Every completed command prints one line: id, "ok" or "error", return
+   code, jobs, the response and completion times, and the command; its
+   output follows, indented. A summary of the response latency (sent to
+   answered) and the completion latency of the commands that started jobs
+   (sent to the last job done) goes to stderr at the end. The exit status
+   is 1 if any command was rejected or returned nonzero.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "control_client.h"
+
+namespace {
+
+void usage() {
+    std::fprintf(stderr, "usage: control_run [--window N] [host] [port] < script\n");
+    std::exit(2);
+}
+
+void print(const control::Request &r) {
+    std::printf("%" PRIu32 " %s %" PRId32 " jobs=%" PRIu32 " response=%.2fms completion=%.2fms: %s\n", r.id,
+                r.error ? "error" : "ok", r.code, r.jobs, r.response_ms(), r.completion_ms(), r.line.c_str());
+    size_t at = 0;
+    while (at < r.output.size()) {
+        size_t end = r.output.find('\n', at);
+        if (end == std::string::npos) end = r.output.size();
+        std::printf("    %.*s\n", static_cast<int>(end - at), r.output.data() + at);
+        at = end + 1;
+    }
+    std::fflush(stdout);
+}
+
+void summary(const char *name, std::vector<double> &ms) {
+    if (ms.empty()) return;
+    std::sort(ms.begin(), ms.end());
+    std::fprintf(stderr, "%-10s %6zu   p50 %8.2f ms   p99 %8.2f ms   max %8.2f ms\n", name, ms.size(),
+                 control::percentile(ms, 50), control::percentile(ms, 99), ms.back());
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const char *host = "192.168.4.1";
+    int port = control::kPort;
+    size_t window = 4;
+    int positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            int n = std::atoi(argv[++i]);
+            if (n < 1) usage();
+            window = static_cast<size_t>(n);
+        } else if (argv[i][0] == '-') {
+            usage();
+        } else if (positional == 0) {
+            host = argv[i];
+            positional++;
+        } else if (positional == 1) {
+            port = std::atoi(argv[i]);
+            positional++;
+        } else {
+            usage();
+        }
+    }
+    if (port < 1 || port > 65535) usage();
+
+    control::Client client;
+    std::string error;
+    if (!client.connect(host, port, &error)) {
+        std::fprintf(stderr, "can't connect to %s:%d: %s\n", host, port, error.c_str());
+        return 1;
+    }
+
+    std::vector<double> response, completion;
+    uint32_t failed = 0;
+    client.on_complete([&](const control::Request &r) {
+        print(r);
+        response.push_back(r.response_ms());
+        if (r.jobs > 0) completion.push_back(r.completion_ms());
+        failed += (r.error || r.code != 0);
+    });
+
+    bool alive = true;
+    auto drain_until = [&](auto &&done) {
+        while (alive && !done()) alive = client.poll(1000);
+    };
+
+    const int64_t start = control::now_ns();
+    std::string line;
+    uint32_t sent = 0;
+    while (alive && std::getline(std::cin, line)) {
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') continue;
+        line.erase(0, first);
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.pop_back();
+        if (line == "wait") {
+            drain_until([&] { return client.pending() == 0; });
+            continue;
+        }
+        drain_until([&] { return client.unanswered() < window; });
+        if (alive && client.send(line) == 0) alive = false;
+        sent++;
+    }
+    drain_until([&] { return client.pending() == 0; });
+    const double elapsed_s = (control::now_ns() - start) / 1e9;
+
+    if (!client.hello_seen()) {
+        std::fprintf(stderr, "no hello from %s:%d, is it the control port?\n", host, port);
+    } else if (client.version() != control::kVersion) {
+        std::fprintf(stderr, "board speaks control version %" PRIu32 ", this tool %" PRIu32 "\n", client.version(),
+                     control::kVersion);
+    }
+    if (!alive) {
+        std::fprintf(stderr, "connection lost with %zu commands not complete\n", client.pending());
+    }
+    std::fprintf(stderr, "%" PRIu32 " commands in %.2f s (%.1f/s, window %zu), %" PRIu32 " failed, %" PRIu64
+                 " unmatched messages\n",
+                 sent, elapsed_s, sent / (elapsed_s > 0 ? elapsed_s : 1), window, failed, client.unmatched());
+    summary("response", response);
+    summary("completion", completion);
+    return (failed || !alive) ? 1 : 0;
+}
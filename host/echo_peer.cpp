@@ -0,0 +1,164 @@
+/* echo_peer — TCP echo for the firmware's "rtt" command, and the same
+   ping-pong from the host side for a baseline.
+
+   usage: echo_peer [-p port]
+          echo_peer -c host [-p port] [-r rate] [-s size] [-n count]
+
+   Without -c it echoes every byte back on every connection, with
+   TCP_NODELAY so an echo is not held back by Nagle. The port defaults to
+   8001, where "connect_to" connects, so rtt can run on the test socket.
+   Serve 7007 as well (a second echo_peer -p 7007) for rtt while a stream
+   runs on the board: it then opens its own connection to that port.
+
+   -c sends timestamped messages the way the board does and reports the
+   same statistics (main/rtt.c). Against a local echo_peer it measures
+   the host's own loopback floor.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "rtt.h"
+
+namespace {
+
+int64_t now_us() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+void set_nodelay(int sock) {
+    int yes = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+}
+
+void echo(int sock, sockaddr_in from) {
+    std::fprintf(stderr, "echoing for %s:%d\n", inet_ntoa(from.sin_addr), ntohs(from.sin_port));
+    set_nodelay(sock);
+    char buffer[4096];
+    ssize_t got;
+    while ((got = recv(sock, buffer, sizeof(buffer), 0)) > 0) {
+        for (ssize_t sent = 0, n; sent < got; sent += n) {
+            n = send(sock, buffer + sent, got - sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                close(sock);
+                return;
+            }
+        }
+    }
+    std::fprintf(stderr, "%s:%d closed\n", inet_ntoa(from.sin_addr), ntohs(from.sin_port));
+    close(sock);
+}
+
+int serve(int port) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(listener, 4) != 0) {
+        std::perror("listen");
+        return 1;
+    }
+    std::fprintf(stderr, "echo on port %d\n", port);
+    while (true) {
+        sockaddr_in from{};
+        socklen_t size = sizeof(from);
+        int sock = accept(listener, reinterpret_cast<sockaddr *>(&from), &size);
+        if (sock >= 0) std::thread(echo, sock, from).detach();
+    }
+}
+
+int ping(const std::string &host, int port, int rate, int size, int count) {
+    sockaddr_in peer{};
+    peer.sin_family = AF_INET;
+    peer.sin_port = htons(static_cast<uint16_t>(port));
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (inet_pton(AF_INET, host.c_str(), &peer.sin_addr) != 1 ||
+        connect(sock, reinterpret_cast<sockaddr *>(&peer), sizeof(peer)) != 0) {
+        std::perror(host.c_str());
+        return 1;
+    }
+    set_nodelay(sock);
+    static uint8_t tx[RTT_MAX_SIZE], rx[RTT_MAX_SIZE];
+    static rtt_t stats;
+    rtt_reset(&stats);
+    const int64_t start = now_us();
+    for (int seq = 0; seq < count; seq++) {
+        int64_t due = start + static_cast<int64_t>(seq) * 1000000 / rate;
+        timespec ts{static_cast<time_t>(due / 1000000), static_cast<long>(due % 1000000) * 1000};
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+        rtt_message_t message{RTT_MAGIC, static_cast<uint32_t>(seq), now_us()};
+        std::memcpy(tx, &message, sizeof(message));
+        if (send(sock, tx, size, MSG_NOSIGNAL) != size) break;
+        int have = 0;
+        while (have < size) {
+            ssize_t got = recv(sock, rx + have, size - have, 0);
+            if (got <= 0) {
+                std::fprintf(stderr, "connection closed\n");
+                return 1;
+            }
+            have += static_cast<int>(got);
+        }
+        int64_t received = now_us();
+        rtt_message_t back;
+        std::memcpy(&back, rx, sizeof(back));
+        if (back.magic != RTT_MAGIC || back.seq != message.seq) {
+            std::fprintf(stderr, "the peer does not echo\n");
+            return 1;
+        }
+        rtt_record(&stats, back.seq, static_cast<uint32_t>((message.sent_us - start) / 1000),
+                   static_cast<uint32_t>(received - back.sent_us));
+    }
+    close(sock);
+    char line[256];
+    rtt_format(&stats, line, sizeof(line));
+    std::printf("%s\n", line);
+    for (uint32_t i = 0; i < stats.worst_count; i++) {
+        std::printf("worst #%u: seq %u at %u ms, %u us\n", i + 1, stats.worst[i].seq, stats.worst[i].at_ms,
+                    stats.worst[i].rtt_us);
+    }
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    std::string host;
+    int port = 8001, rate = 100, size = 32, count = 1000;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:p:r:s:n:")) != -1) {
+        switch (opt) {
+            case 'c': host = optarg; break;
+            case 'p': port = std::atoi(optarg); break;
+            case 'r': rate = std::atoi(optarg); break;
+            case 's': size = std::atoi(optarg); break;
+            case 'n': count = std::atoi(optarg); break;
+            default:
+                std::fprintf(stderr, "usage: echo_peer [-p port]\n"
+                                     "       echo_peer -c host [-p port] [-r rate] [-s size] [-n count]\n");
+                return 2;
+        }
+    }
+    if (host.empty()) return serve(port);
+    if (rate < 1 || size < static_cast<int>(sizeof(rtt_message_t)) || size > RTT_MAX_SIZE || count < 1) {
+        std::fprintf(stderr, "rate at least 1, size %zu..%d, count at least 1\n", sizeof(rtt_message_t), RTT_MAX_SIZE);
+        return 2;
+    }
+    return ping(host, port, rate, size, count);
+}
@@ -0,0 +1,240 @@
+/* gen_receiver — receiving end of the firmware's "generate" command: checks
+   the frames arrive complete and measures how well they are paced.
+
+   usage: gen_receiver [-p port] [-f hz] [-n frames] [-o capture.bin] [-s hz[:batch]]
+
+   Listens on the port (default 8001) for the connection "connect_to" opens,
+   then reads battery_packet frames until the board closes it or -n frames
+   have arrived. Every frame's time field is the moment the generator's
+   schedule made it due (board clock), so:
+
+     schedule  steps between consecutive time fields, they must be exactly
+               one period (1/f); a longer step is a frame that never arrived
+     rate      frames per second at the receiver
+     lateness  arrival minus due time, after removing the fitted clock offset
+               and drift between the two clocks; with "generate -b N" a frame
+               waits for the rest of its batch, up to (N-1)/f
+
+   -o keeps the raw frames, readable by analyze_capture. -s runs a paced
+   sender in the same process instead of waiting for a board, to check the
+   receiver and the local network stack on their own.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "frame.h"
+
+namespace {
+
+int64_t now_us() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+struct Arrival {
+    int64_t due_us;     // frame time field, board clock
+    int64_t arrived_us; // local clock
+};
+
+// Same schedule as main/generator.c: frame i due at start + i/f, a batch leaves once its last frame is due
+void simulate(int port, int frequency, int batch) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(sock, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+        std::perror("simulate: connect");
+        return;
+    }
+    const uint64_t frames = static_cast<uint64_t>(frequency) * 5;
+    std::vector<battery_packet> buffer(batch);
+    const int64_t start = now_us();
+    for (uint64_t sent = 0; sent < frames;) {
+        uint32_t n = static_cast<uint32_t>(std::min<uint64_t>(batch, frames - sent));
+        int64_t due = start + static_cast<int64_t>((sent + n - 1) * 1000000 / frequency);
+        timespec ts{static_cast<time_t>(due / 1000000), static_cast<long>(due % 1000000) * 1000};
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+        for (uint32_t i = 0; i < n; i++) {
+            battery_packet &f = buffer[i];
+            std::memset(&f, 0, sizeof(f));
+            f.ID0 = FRAME_ID0;
+            f.IDfinal = FRAME_IDFINAL;
+            f.time = start + static_cast<int64_t>((sent + i) * 1000000 / frequency);
+        }
+        if (send(sock, buffer.data(), n * sizeof(battery_packet), MSG_NOSIGNAL) < 0) break;
+        sent += n;
+    }
+    close(sock);
+}
+
+double percentile(std::vector<double> &values, double p) {
+    if (values.empty()) return 0;
+    size_t rank = static_cast<size_t>(std::ceil(p / 100 * values.size()));
+    rank = std::max<size_t>(rank, 1);
+    std::nth_element(values.begin(), values.begin() + (rank - 1), values.end());
+    return values[rank - 1];
+}
+
+void report(const std::vector<Arrival> &arrivals, uint64_t bad_marker, double frequency) {
+    std::printf("frames %zu, bad markers %llu\n", arrivals.size(), (unsigned long long)bad_marker);
+    if (arrivals.size() < 2) return;
+
+    std::vector<int64_t> steps;
+    for (size_t i = 1; i < arrivals.size(); i++) steps.push_back(arrivals[i].due_us - arrivals[i - 1].due_us);
+    double period = (frequency > 0) ? 1e6 / frequency : 0;
+    if (period == 0) {
+        std::vector<int64_t> sorted(steps.begin(), steps.begin() + std::min<size_t>(steps.size(), 1000));
+        std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+        period = static_cast<double>(sorted[sorted.size() / 2]);
+    }
+    // the schedule rounds each due time down to a microsecond, so a step is within 1 us of the period
+    uint64_t off_schedule = 0, missing = 0;
+    for (int64_t step : steps) {
+        if (std::fabs(step - period) <= 1) continue;
+        off_schedule++;
+        if (step > 1.5 * period) missing += static_cast<uint64_t>(std::llround(step / period)) - 1;
+    }
+    std::printf("schedule: period %.1f us (%.1f Hz), %llu steps off schedule, %llu frames missing\n", period,
+                1e6 / period, (unsigned long long)off_schedule, (unsigned long long)missing);
+
+    double seconds = (arrivals.back().arrived_us - arrivals.front().arrived_us) / 1e6;
+    double rate = (arrivals.size() - 1) / seconds;
+    std::printf("rate: %.2f Hz received over %.3f s, %.3f%% of the schedule\n", rate, seconds, 100 * rate * period / 1e6);
+
+    // least squares fit of (arrival - due) against due: offset and drift between the two clocks
+    const double t0 = static_cast<double>(arrivals.front().due_us);
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    const double o0 = static_cast<double>(arrivals.front().arrived_us - arrivals.front().due_us);
+    for (const Arrival &a : arrivals) {
+        double x = a.due_us - t0;
+        double y = (a.arrived_us - a.due_us) - o0;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    const double n = static_cast<double>(arrivals.size());
+    const double denominator = n * sxx - sx * sx;
+    const double slope = (denominator > 0) ? (n * sxy - sx * sy) / denominator : 0;
+    const double intercept = (sy - slope * sx) / n;
+    std::vector<double> lateness;
+    lateness.reserve(arrivals.size());
+    for (const Arrival &a : arrivals) {
+        double x = a.due_us - t0;
+        lateness.push_back((a.arrived_us - a.due_us) - o0 - (intercept + slope * x));
+    }
+    const double lowest = *std::min_element(lateness.begin(), lateness.end());
+    for (double &l : lateness) l -= lowest;
+    std::printf("clock drift %.1f ppm\n", slope * 1e6);
+    std::printf("lateness: p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f us\n", percentile(lateness, 50),
+                percentile(lateness, 90), percentile(lateness, 99), percentile(lateness, 99.9),
+                percentile(lateness, 100));
+}
+
+void usage() {
+    std::fprintf(stderr, "usage: gen_receiver [-p port] [-f hz] [-n frames] [-o capture.bin] [-s hz[:batch]]\n");
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    int port = 8001;
+    double frequency = 0;
+    uint64_t limit = 0;
+    std::string output;
+    int simulate_hz = 0, simulate_batch = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:f:n:o:s:")) != -1) {
+        switch (opt) {
+            case 'p': port = std::atoi(optarg); break;
+            case 'f': frequency = std::atof(optarg); break;
+            case 'n': limit = std::strtoull(optarg, nullptr, 10); break;
+            case 'o': output = optarg; break;
+            case 's':
+                if (std::sscanf(optarg, "%d:%d", &simulate_hz, &simulate_batch) < 1 || simulate_hz < 1 || simulate_batch < 1) {
+                    usage();
+                    return 2;
+                }
+                break;
+            default: usage(); return 2;
+        }
+    }
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(simulate_hz ? INADDR_LOOPBACK : INADDR_ANY);
+    if (bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(listener, 1) != 0) {
+        std::perror("listen");
+        return 1;
+    }
+    std::thread sender;
+    if (simulate_hz) {
+        sender = std::thread(simulate, port, simulate_hz, simulate_batch);
+    } else {
+        std::fprintf(stderr, "waiting for the board on port %d\n", port);
+    }
+    sockaddr_in peer{};
+    socklen_t peer_size = sizeof(peer);
+    int sock = accept(listener, reinterpret_cast<sockaddr *>(&peer), &peer_size);
+    if (sock < 0) {
+        std::perror("accept");
+        return 1;
+    }
+    close(listener);
+    std::fprintf(stderr, "connected from %s\n", inet_ntoa(peer.sin_addr));
+
+    FILE *capture = output.empty() ? nullptr : std::fopen(output.c_str(), "wb");
+    if (!output.empty() && capture == nullptr) {
+        std::perror(output.c_str());
+        return 1;
+    }
+    std::vector<Arrival> arrivals;
+    uint64_t bad_marker = 0;
+    uint8_t buffer[64 * 1024];
+    size_t held = 0;
+    while (limit == 0 || arrivals.size() < limit) {
+        ssize_t got = recv(sock, buffer + held, sizeof(buffer) - held, 0);
+        if (got <= 0) break;
+        const int64_t arrived = now_us();
+        held += static_cast<size_t>(got);
+        size_t offset = 0;
+        for (; held - offset >= sizeof(battery_packet); offset += sizeof(battery_packet)) {
+            battery_packet f;
+            std::memcpy(&f, buffer + offset, sizeof(f));
+            if (capture) std::fwrite(&f, sizeof(f), 1, capture);
+            if (f.ID0 != FRAME_ID0 || f.IDfinal != FRAME_IDFINAL) {
+                bad_marker++;
+                continue;
+            }
+            arrivals.push_back({f.time, arrived});
+        }
+        held -= offset;
+        std::memmove(buffer, buffer + offset, held);
+    }
+    close(sock);
+    if (sender.joinable()) sender.join();
+    if (capture) std::fclose(capture);
+    report(arrivals, bad_marker, frequency);
+    return 0;
+}
@@ -0,0 +1,153 @@
+/* result_client — reads the board's binary result channel and prints one
+   JSON object per record, for CI scripts that would otherwise scrape the
+   console.
+
+   usage: result_client [host] [port]
+
+   Connects to the result port ("results" on the board, 2324 unless changed
+   in menuconfig) of the board's AP address, 192.168.4.1 by default, and
+   prints until the board closes the connection. Records queued on the
+   board before the connection come first. A summary of the decoder
+   counters goes to stderr at the end.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "result_decoder.h"
+
+namespace {
+
+void print_text(std::string_view text) {
+    std::putchar('"');
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            std::printf("\\%c", c);
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            std::printf("\\u%04x", c);
+        } else {
+            std::putchar(c);
+        }
+    }
+    std::putchar('"');
+}
+
+void print(const result::Record &record) {
+    std::printf("{\"type\":\"%s\",\"seq\":%" PRIu32 ",\"ms\":%" PRIu32, result::type_name(record.type()),
+                record.sequence(), record.timestamp_ms());
+    switch (record.type()) {
+        case RESULT_HELLO: {
+            result::Hello h = record.hello();
+            std::printf(",\"version\":%u,\"dropped\":%" PRIu32 ",\"queued\":%" PRIu32, h.version(), h.dropped(),
+                        h.queued());
+            break;
+        }
+        case RESULT_RUN: {
+            result::Run r = record.run();
+            std::printf(",\"command\":\"%s\",\"round\":%u,\"rounds\":%u,\"stopped\":%s,\"failed\":%s,\"frequency\":%" PRIu32
+                        ",\"duration_ms\":%" PRIu32 ",\"frames\":%" PRIu64 ",\"corrupted\":%" PRIu64
+                        ",\"crc_failed\":%" PRIu64 ",\"gaps\":%" PRIu64 ",\"lost\":%" PRIu64 ",\"stalls\":%" PRIu32
+                        ",\"reconnects\":%" PRIu32 ",\"rate_hz\":%.3f,\"jitter_p50\":%" PRIu32 ",\"jitter_p99\":%" PRIu32
+                        ",\"jitter_max\":%" PRIu32,
+                        result::command_name(r.command()), r.round(), r.rounds(),
+                        (r.flags() & RESULT_RUN_STOPPED) ? "true" : "false",
+                        (r.flags() & RESULT_RUN_FAILED) ? "true" : "false", r.frequency(), r.duration_ms(), r.frames(),
+                        r.corrupted(), r.crc_failed(), r.gaps(), r.lost(), r.stalls(), r.reconnects(), r.rate_hz(),
+                        r.jitter_p50(), r.jitter_p99(), r.jitter_max());
+            if (r.stations()) std::printf(",\"stations\":%" PRIu32 ",\"jain\":%.4f", r.stations(), r.jain());
+            if (r.bytes()) std::printf(",\"bytes\":%" PRIu64, r.bytes());
+            if (r.drift_ppm() != 0 || r.offset_ms() != 0)
+                std::printf(",\"drift_ppm\":%.2f,\"offset_ms\":%.3f,\"residual_us\":%.1f", r.drift_ppm(), r.offset_ms(),
+                            r.residual_us());
+            if (r.cpu_pct() != 0) std::printf(",\"cpu_pct\":%.1f", r.cpu_pct());
+            if (r.run_id()) std::printf(",\"run_id\":%" PRIu32, r.run_id());
+            if (r.source()) std::printf(",\"source\":\"%s\"", result::command_name(r.source()));
+            break;
+        }
+        case RESULT_HISTOGRAM: {
+            result::Histogram h = record.histogram();
+            static const char *kinds[] = {"unknown", "jitter", "rtt", "merge_latency", "send_latency"};
+            std::printf(",\"command\":\"%s\",\"kind\":\"%s\",\"station\":%u,\"p50\":%" PRIu32 ",\"p99\":%" PRIu32
+                        ",\"buckets\":[",
+                        result::command_name(h.command()), kinds[(h.kind() < 5) ? h.kind() : 0], h.station(),
+                        h.percentile(50), h.percentile(99));
+            // only the buckets in use, as [floor, count]
+            bool first = true;
+            for (uint32_t i = 0; i < h.buckets(); i++) {
+                if (h.count(i) == 0) continue;
+                std::printf("%s[%" PRIu32 ",%" PRIu32 "]", first ? "" : ",", h.floor(i), h.count(i));
+                first = false;
+            }
+            std::putchar(']');
+            break;
+        }
+        case RESULT_STATION: {
+            result::Station s = record.station();
+            const uint8_t *mac = s.mac();
+            in_addr ip{s.ip()};
+            std::printf(",\"command\":\"%s\",\"index\":%u,\"mac\":\"%02x:%02x:%02x:%02x:%02x:%02x\",\"ip\":\"%s\""
+                        ",\"rssi\":%d,\"failed\":%s,\"closed\":%s",
+                        result::command_name(s.command()), s.index(), mac[0], mac[1], mac[2], mac[3], mac[4], mac[5],
+                        inet_ntoa(ip), s.rssi(), (s.flags() & RESULT_STATION_FAILED) ? "true" : "false",
+                        (s.flags() & RESULT_STATION_CLOSED) ? "true" : "false");
+            if (s.command() != RESULT_CMD_LIST_STATIONS) {
+                std::printf(",\"frames\":%" PRIu32 ",\"lost\":%" PRIu32 ",\"corrupted\":%" PRIu32 ",\"starvations\":%" PRIu32
+                            ",\"jitter_p50\":%" PRIu32 ",\"jitter_p99\":%" PRIu32 ",\"longest_silence_ms\":%" PRIu32
+                            ",\"rate_hz\":%.3f",
+                            s.frames(), s.lost(), s.corrupted(), s.starvations(), s.jitter_p50(), s.jitter_p99(),
+                            s.longest_silence_ms(), s.rate_hz());
+            }
+            break;
+        }
+        case RESULT_ERROR: {
+            result::Error e = record.error();
+            std::printf(",\"command\":\"%s\",\"code\":%" PRId32 ",\"text\":", result::command_name(e.command()), e.code());
+            print_text(e.text());
+            break;
+        }
+        default:
+            std::printf(",\"length\":%" PRIu32, record.length());
+            break;
+    }
+    std::printf("}\n");
+    std::fflush(stdout);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    const char *host = (argc > 1) ? argv[1] : "192.168.4.1";
+    const int port = (argc > 2) ? std::atoi(argv[2]) : 2324;
+    sockaddr_in peer{};
+    peer.sin_family = AF_INET;
+    peer.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &peer.sin_addr) != 1 || port < 1 || port > 65535) {
+        std::fprintf(stderr, "usage: result_client [host] [port]\n");
+        return 2;
+    }
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0 || connect(sock, reinterpret_cast<sockaddr *>(&peer), sizeof(peer)) != 0) {
+        std::fprintf(stderr, "can't connect to %s:%d: %s\n", host, port, std::strerror(errno));
+        return 1;
+    }
+    result::StreamDecoder decoder;
+    ssize_t got;
+    while ((got = recv(sock, decoder.space(), decoder.space_size(), 0)) > 0) {
+        decoder.commit(static_cast<size_t>(got), print);
+    }
+    close(sock);
+    const result::Counters &c = decoder.counters();
+    std::fprintf(stderr, "%" PRIu64 " records, %" PRIu64 " missed, %" PRIu64 " bytes skipped, %zu left undecoded\n",
+                 c.records, c.missed, c.skipped_bytes, decoder.held());
+    return 0;
+}
@@ -0,0 +1,320 @@
+/* result_decoder.h — reads the binary result records of the firmware's
+   result channel (main/result.h) where they lie in the receive buffer.
+
+   A view is a pointer into the buffer: fields are loaded on access, by
+   offset into the firmware's own structs, with a fixed size memcpy that
+   compiles to a plain load, so nothing is copied or allocated per record
+   and alignment does not matter. A field past the end of a shorter
+   payload from an older firmware reads as 0; bytes past the fields known
+   here are ignored.
+
+   Parser walks a buffer and hands every complete record to a callback,
+   resynchronising on the magic when it meets bytes that are not a
+   record. StreamDecoder owns one fixed buffer that recv() writes into
+   directly; only the partial record at its end ever moves.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include "result.h"
+
+namespace result {
+
+// A record longer than this is taken for garbage and skipped
+constexpr uint32_t kMaxLength = 64 * 1024;
+
+template <typename T>
+inline T load(const uint8_t *p) {
+    T value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+class Payload {
+  public:
+    Payload(const uint8_t *data, uint32_t size) : data_(data), size_(size) {}
+    const uint8_t *data() const { return data_; }
+    uint32_t size() const { return size_; }
+
+  protected:
+    template <typename T>
+    T field(size_t offset) const {
+        return (offset + sizeof(T) <= size_) ? load<T>(data_ + offset) : T{};
+    }
+
+    const uint8_t *data_;
+    uint32_t size_;
+};
+
+#define RESULT_FIELD(type, name) \
+    decltype(type::name) name() const { return field<decltype(type::name)>(offsetof(type, name)); }
+
+class Hello : public Payload {
+  public:
+    using Payload::Payload;
+    RESULT_FIELD(result_hello_t, version)
+    RESULT_FIELD(result_hello_t, dropped)
+    RESULT_FIELD(result_hello_t, queued)
+};
+
+class Run : public Payload {
+  public:
+    using Payload::Payload;
+    RESULT_FIELD(result_run_t, command)
+    RESULT_FIELD(result_run_t, round)
+    RESULT_FIELD(result_run_t, rounds)
+    RESULT_FIELD(result_run_t, flags)
+    RESULT_FIELD(result_run_t, frequency)
+    RESULT_FIELD(result_run_t, duration_ms)
+    RESULT_FIELD(result_run_t, frames)
+    RESULT_FIELD(result_run_t, corrupted)
+    RESULT_FIELD(result_run_t, crc_failed)
+    RESULT_FIELD(result_run_t, gaps)
+    RESULT_FIELD(result_run_t, lost)
+    RESULT_FIELD(result_run_t, stalls)
+    RESULT_FIELD(result_run_t, reconnects)
+    RESULT_FIELD(result_run_t, rate_hz)
+    RESULT_FIELD(result_run_t, jitter_p50)
+    RESULT_FIELD(result_run_t, jitter_p99)
+    RESULT_FIELD(result_run_t, jitter_max)
+    RESULT_FIELD(result_run_t, stations)
+    RESULT_FIELD(result_run_t, jain)
+    RESULT_FIELD(result_run_t, bytes)
+    RESULT_FIELD(result_run_t, drift_ppm)
+    RESULT_FIELD(result_run_t, offset_ms)
+    RESULT_FIELD(result_run_t, residual_us)
+    RESULT_FIELD(result_run_t, cpu_pct)
+    RESULT_FIELD(result_run_t, run_id)
+    RESULT_FIELD(result_run_t, source)
+};
+
+// Smallest value of a bucket in either layout
+inline uint32_t bucket_floor(uint16_t layout, uint32_t bucket) {
+    if (bucket < 8) return bucket;
+    uint32_t per_octave = (layout == RESULT_BUCKETS_RTT) ? 8 : 4;
+    uint32_t octave = 3 + (bucket - 8) / per_octave;
+    uint32_t shift = octave - ((layout == RESULT_BUCKETS_RTT) ? 3 : 2);
+    return (per_octave + (bucket - 8) % per_octave) << shift;
+}
+
+class Histogram : public Payload {
+  public:
+    using Payload::Payload;
+    RESULT_FIELD(result_histogram_t, command)
+    RESULT_FIELD(result_histogram_t, kind)
+    RESULT_FIELD(result_histogram_t, layout)
+    RESULT_FIELD(result_histogram_t, station)
+
+    // Counts actually present, fewer than announced if the record was cut short
+    uint32_t buckets() const {
+        uint32_t present = (size_ > sizeof(result_histogram_t)) ? (size_ - sizeof(result_histogram_t)) / 4 : 0;
+        uint32_t announced = field<uint16_t>(offsetof(result_histogram_t, buckets));
+        return (announced < present) ? announced : present;
+    }
+    uint32_t count(uint32_t bucket) const { return load<uint32_t>(data_ + sizeof(result_histogram_t) + 4 * bucket); }
+    uint32_t floor(uint32_t bucket) const { return bucket_floor(layout(), bucket); }
+
+    uint64_t total() const {
+        uint64_t sum = 0;
+        for (uint32_t i = 0, n = buckets(); i < n; i++) sum += count(i);
+        return sum;
+    }
+
+    // Upper bound of the bucket holding the p-th percentile (0..100), the same as soak_histogram_percentile()
+    uint32_t percentile(uint32_t p) const {
+        uint64_t all = total();
+        if (all == 0) return 0;
+        uint64_t rank = (all * p + 99) / 100;
+        rank = (rank == 0) ? 1 : rank;
+        uint64_t seen = 0;
+        uint32_t n = buckets();
+        for (uint32_t i = 0; i < n; i++) {
+            seen += count(i);
+            if (seen >= rank) return (i + 1 < n) ? floor(i + 1) - 1 : floor(i);
+        }
+        return floor(n - 1);
+    }
+};
+
+class Station : public Payload {
+  public:
+    using Payload::Payload;
+    RESULT_FIELD(result_station_t, command)
+    RESULT_FIELD(result_station_t, index)
+    RESULT_FIELD(result_station_t, rssi)
+    RESULT_FIELD(result_station_t, flags)
+    RESULT_FIELD(result_station_t, ip)
+    RESULT_FIELD(result_station_t, frames)
+    RESULT_FIELD(result_station_t, lost)
+    RESULT_FIELD(result_station_t, corrupted)
+    RESULT_FIELD(result_station_t, starvations)
+    RESULT_FIELD(result_station_t, jitter_p50)
+    RESULT_FIELD(result_station_t, jitter_p99)
+    RESULT_FIELD(result_station_t, longest_silence_ms)
+    RESULT_FIELD(result_station_t, rate_hz)
+    const uint8_t *mac() const { return data_ + offsetof(result_station_t, mac); }
+};
+
+class Error : public Payload {
+  public:
+    using Payload::Payload;
+    RESULT_FIELD(result_error_t, command)
+    RESULT_FIELD(result_error_t, code)
+    std::string_view text() const {
+        if (size_ <= sizeof(result_error_t)) return {};
+        return {reinterpret_cast<const char *>(data_) + sizeof(result_error_t), size_ - sizeof(result_error_t)};
+    }
+};
+
+#undef RESULT_FIELD
+
+class Record {
+  public:
+    explicit Record(const uint8_t *data) : data_(data) {}
+    uint16_t type() const { return load<uint16_t>(data_ + offsetof(result_header_t, type)); }
+    uint32_t length() const { return load<uint32_t>(data_ + offsetof(result_header_t, length)); }
+    uint32_t sequence() const { return load<uint32_t>(data_ + offsetof(result_header_t, sequence)); }
+    uint32_t timestamp_ms() const { return load<uint32_t>(data_ + offsetof(result_header_t, timestamp_ms)); }
+    const uint8_t *payload() const { return data_ + sizeof(result_header_t); }
+    size_t size() const { return sizeof(result_header_t) + length(); }
+
+    Hello hello() const { return {payload(), length()}; }
+    Run run() const { return {payload(), length()}; }
+    Histogram histogram() const { return {payload(), length()}; }
+    Station station() const { return {payload(), length()}; }
+    Error error() const { return {payload(), length()}; }
+
+  private:
+    const uint8_t *data_;
+};
+
+inline const char *type_name(uint16_t type) {
+    switch (type) {
+        case RESULT_HELLO: return "hello";
+        case RESULT_RUN: return "run";
+        case RESULT_HISTOGRAM: return "histogram";
+        case RESULT_STATION: return "station";
+        case RESULT_ERROR: return "error";
+        default: return "unknown";
+    }
+}
+
+inline const char *command_name(uint16_t command) {
+    switch (command) {
+        case RESULT_CMD_RECV_SENSOR: return "recv_sensor";
+        case RESULT_CMD_SOAK: return "soak";
+        case RESULT_CMD_LIST_STATIONS: return "list_stations";
+        case RESULT_CMD_FAIRNESS: return "fairness";
+        case RESULT_CMD_RTT: return "rtt";
+        case RESULT_CMD_BENCH_TCP: return "bench_tcp";
+        case RESULT_CMD_BENCH_UDP: return "bench_udp";
+        case RESULT_CMD_GENERATE: return "generate";
+        case RESULT_CMD_TUNE_AB: return "tune_ab";
+        case RESULT_CMD_HISTORY: return "history";
+        default: return "none";
+    }
+}
+
+struct Counters {
+    uint64_t records = 0;
+    uint64_t skipped_bytes = 0;     // not part of any record, passed over to resynchronise
+    uint64_t missed = 0;            // sequence numbers never seen: dropped on the board, or lost in garbage
+};
+
+class Parser {
+  public:
+    /* Hands every complete record in [data, data + size) to visit(const
+     * Record &) and returns the bytes used. The rest is the start of a
+     * record: present it again with more bytes after it.
+     */
+    template <typename Visit>
+    size_t parse(const uint8_t *data, size_t size, Visit &&visit) {
+        size_t at = 0;
+        while (size - at >= sizeof(result_header_t)) {
+            const uint8_t *p = data + at;
+            uint32_t length = load<uint32_t>(p + offsetof(result_header_t, length));
+            if (load<uint16_t>(p) != RESULT_MAGIC || length > kMaxLength) {
+                at++;
+                counters_.skipped_bytes++;
+                continue;
+            }
+            if (size - at - sizeof(result_header_t) < length) break;
+            Record record(p);
+            track(record);
+            visit(static_cast<const Record &>(record));
+            at += record.size();
+        }
+        return at;
+    }
+
+    const Counters &counters() const { return counters_; }
+
+  private:
+    void track(const Record &record) {
+        counters_.records++;
+        if (record.type() == RESULT_HELLO) {
+            // a new connection: the queued records that follow have smaller numbers
+            have_last_ = false;
+            return;
+        }
+        uint32_t sequence = record.sequence();
+        if (have_last_ && sequence != last_ + 1) counters_.missed += static_cast<uint32_t>(sequence - last_ - 1);
+        have_last_ = true;
+        last_ = sequence;
+    }
+
+    Counters counters_;
+    bool have_last_ = false;
+    uint32_t last_ = 0;
+};
+
+class StreamDecoder {
+  public:
+    explicit StreamDecoder(size_t capacity = 256 * 1024) : buffer_(capacity) {}
+
+    // Where the next read goes, and how much fits there
+    uint8_t *space() { return buffer_.data() + held_; }
+    size_t space_size() const { return buffer_.size() - held_; }
+
+    // `size` bytes were written at space(): decode every record they complete
+    template <typename Visit>
+    void commit(size_t size, Visit &&visit) {
+        held_ += size;
+        size_t used = parser_.parse(buffer_.data(), held_, visit);
+        if (used == 0 && held_ == buffer_.size()) {
+            // one record larger than the buffer cannot be a record
+            used = 1;
+        }
+        held_ -= used;
+        std::memmove(buffer_.data(), buffer_.data() + used, held_);
+    }
+
+    // Copying convenience for bytes that are already somewhere else
+    template <typename Visit>
+    void feed(const uint8_t *data, size_t size, Visit &&visit) {
+        while (size > 0) {
+            size_t chunk = (size < space_size()) ? size : space_size();
+            std::memcpy(space(), data, chunk);
+            commit(chunk, visit);
+            data += chunk;
+            size -= chunk;
+        }
+    }
+
+    const Counters &counters() const { return parser_.counters(); }
+    size_t held() const { return held_; }
+
+  private:
+    std::vector<uint8_t> buffer_;
+    size_t held_ = 0;
+    Parser parser_;
+};
+
+}  // namespace result
@@ -0,0 +1,166 @@
+/* sim_drift — checks the clock drift estimator behind recv_sensor and soak
+   (main/drift.c) against simulated sensors with a known crystal error.
+
+   usage: sim_drift [-d ppm] [-f hz] [-t seconds] [-b batch] [-j delay_us]
+                    [-s seed] [-v]
+
+   Without -d it runs a fixed table of sensors from -5000 to +5000 ppm over
+   a clean link, a jittery one, a bursty one and a link that batches frames,
+   and exits nonzero if an estimate misses the injected drift or offset.
+   With -d it simulates that one sensor and prints what the board would log.
+
+   A simulated sensor stamps frame i with i/f on its own clock, which runs
+   (1 + ppm/1e6) times as fast as the AP's; every frame then waits a fixed
+   path delay, an exponential queueing delay and for the rest of its batch.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+#include "drift.h"
+
+namespace {
+
+struct Link {
+    const char *name;
+    double delay_us;        // mean exponential queueing delay on top of the path
+    int batch;              // frames the sensor sends together
+    double burst_every_s;   // a stall of burst_us every so often, 0 for none
+    double burst_us;
+};
+
+struct Result {
+    drift_estimate_t estimate;
+    double true_offset_ms;  // sensor minus AP time at the last frame, less the path delay
+};
+
+const double kPathUs = 1500;
+const double kSensorJitterUs = 20;
+
+Result simulate(double ppm, int frequency, double seconds, const Link &link, unsigned seed, drift_t *drift) {
+    std::mt19937_64 rng(seed);
+    std::exponential_distribution<double> queue(1.0 / (link.delay_us > 0 ? link.delay_us : 1));
+    std::uniform_real_distribution<double> jitter(-kSensorJitterUs, kSensorJitterUs);
+    drift_init(drift, DRIFT_WINDOW_US);
+
+    const double rate = 1 + ppm / 1e6;
+    const double sensor_start_us = 123456789;   // unrelated to the AP clock
+    const double ap_start_us = 5000000;
+    const long frames = static_cast<long>(seconds * frequency);
+    const int batch = link.batch > 0 ? link.batch : 1;
+    double burst_until = 0, next_burst = link.burst_every_s * 1e6;
+    double last_offset = 0;
+    for (long first = 0; first < frames; first += batch) {
+        long last = (first + batch < frames) ? first + batch : frames;
+        // the batch leaves once its last frame is taken, on the sensor's clock
+        double sent = ap_start_us + (last - 1) * 1e6 / frequency / rate;
+        if (link.burst_every_s > 0 && sent >= next_burst) {
+            burst_until = sent + link.burst_us;
+            next_burst += link.burst_every_s * 1e6;
+        }
+        double arrival = sent + kPathUs + (link.delay_us > 0 ? queue(rng) : 0);
+        arrival = (arrival < burst_until) ? burst_until + queue(rng) : arrival;
+        for (long i = first; i < last; i++) {
+            double taken = ap_start_us + i * 1e6 / frequency / rate;
+            double stamp = sensor_start_us + i * 1e6 / frequency + jitter(rng);
+            drift_add(drift, static_cast<int64_t>(std::llround(stamp)), static_cast<int64_t>(std::llround(arrival)));
+            last_offset = (sensor_start_us + i * 1e6 / frequency) - (taken + kPathUs);
+        }
+    }
+    Result result;
+    drift_estimate(drift, &result.estimate);
+    result.true_offset_ms = last_offset / 1000;
+    return result;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    double ppm = 0, seconds = 60, delay_us = 500;
+    int frequency = 1000, batch = 1;
+    unsigned seed = 1;
+    bool single = false, verbose = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:f:t:b:j:s:v")) != -1) {
+        switch (opt) {
+            case 'd': ppm = std::atof(optarg); single = true; break;
+            case 'f': frequency = std::atoi(optarg); break;
+            case 't': seconds = std::atof(optarg); break;
+            case 'b': batch = std::atoi(optarg); break;
+            case 'j': delay_us = std::atof(optarg); break;
+            case 's': seed = static_cast<unsigned>(std::atoi(optarg)); break;
+            case 'v': verbose = true; break;
+            default:
+                std::fprintf(stderr, "usage: sim_drift [-d ppm] [-f hz] [-t seconds] [-b batch] [-j delay_us] [-s seed] [-v]\n");
+                return 2;
+        }
+    }
+    if (frequency < 1 || seconds <= 0 || batch < 1) {
+        std::fprintf(stderr, "frequency and batch at least 1, a positive duration\n");
+        return 2;
+    }
+    static drift_t drift;
+    char line[256];
+    if (single) {
+        Link link{"custom", delay_us, batch, 0, 0};
+        Result result = simulate(ppm, frequency, seconds, link, seed, &drift);
+        drift_format(&drift, line, sizeof(line));
+        std::printf("%s\n", line);
+        std::printf("injected %+.1f ppm, offset %.3f ms\n", ppm, result.true_offset_ms);
+        return 0;
+    }
+
+    const Link links[] = {
+        {"clean", 0, 1, 0, 0},
+        {"jitter", 2000, 1, 0, 0},
+        {"bursts", 300, 1, 7, 250000},
+        {"batched", 300, 25, 0, 0},
+    };
+    const double drifts[] = {-5000, -50, 0, 3.5, 50, 5000};
+    // the least squares over all frames only has to hold on stationary links
+    const double all_tolerance_ppm = 2, envelope_tolerance_ppm = 2, offset_tolerance_ms = 0.5;
+    int failed = 0;
+    std::printf("%-8s %10s %12s %12s %10s %10s %12s\n", "link", "injected", "all frames", "envelope", "offset",
+                "expected", "residual us");
+    for (const Link &link : links) {
+        for (double injected : drifts) {
+            Result result = simulate(injected, frequency, seconds, link, seed, &drift);
+            const drift_estimate_t &e = result.estimate;
+            bool stationary = link.burst_every_s == 0;
+            bool ok = std::fabs(e.envelope_ppm - injected) <= envelope_tolerance_ppm &&
+                      std::fabs(e.offset_ms - result.true_offset_ms) <= offset_tolerance_ms &&
+                      (!stationary || std::fabs(e.drift_ppm - injected) <= all_tolerance_ppm);
+            failed += !ok;
+            std::printf("%-8s %+10.1f %+12.2f %+12.2f %10.3f %10.3f %12.0f%s\n", link.name, injected, e.drift_ppm,
+                        e.envelope_ppm, e.offset_ms, result.true_offset_ms, e.residual_us, ok ? "" : "  FAIL");
+            if (verbose) {
+                drift_format(&drift, line, sizeof(line));
+                std::printf("         %s\n", line);
+            }
+        }
+    }
+
+    // a sensor that restarts its clock halfway: the fit starts over and counts it
+    Link link{"restart", 300, 1, 0, 0};
+    simulate(5000, frequency, seconds / 2, link, seed, &drift);
+    drift_t restarted = drift;
+    for (long i = 0; i < static_cast<long>(seconds / 2 * frequency); i++) {
+        int64_t arrival = drift.last_x + 1000000 + static_cast<int64_t>(i * 1e6 / frequency / 1.005) + 1500;
+        drift_add(&restarted, static_cast<int64_t>(i * 1e6 / frequency), arrival);
+    }
+    drift_estimate_t e;
+    drift_estimate(&restarted, &e);
+    bool ok = restarted.resets == 1 && std::fabs(e.envelope_ppm - 5000) <= envelope_tolerance_ppm;
+    failed += !ok;
+    std::printf("%-8s %+10.1f %+12.2f %+12.2f %10.3f %10s %12.0f  (%u restart)%s\n", link.name, 5000.0, e.drift_ppm,
+                e.envelope_ppm, e.offset_ms, "-", e.residual_us, restarted.resets, ok ? "" : "  FAIL");
+
+    std::printf("%s\n", failed ? "FAILED" : "all estimates within tolerance");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,363 @@
+/* sim_fairness — runs the "fairness" command's stepping and statistics
+   (main/fairness.c) against simulated sensors sharing a simulated channel.
+
+   usage: sim_fairness [-f hz] [-d seconds] [-v]
+
+   Every sensor queues frames at the same rate into a small buffer and
+   drops what does not fit, like the sensor firmware does when the link is
+   slow. A channel of fixed capacity is shared by weighted max-min between
+   the sensors with something queued; a weight stands for a station's link
+   quality. Time is virtual, so each scenario runs in milliseconds.
+
+   Every step also merges the stations into one stream in AP time order
+   (main/merge.c, 100 ms window), which must come out sorted and account
+   for every frame.
+
+   The scenarios: a channel with room for everyone, one saturated by
+   three sensors, one station with a poor link, one that drops out
+   periodically, and one that never accepts the connection. Each step is
+   checked against the rates the water-filling predicts, and starvation
+   against the outages injected; the tool exits nonzero on any mismatch.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <vector>
+
+#include "fairness.h"
+
+namespace {
+
+const int64_t kTickUs = 1000;
+const size_t kSensorQueue = 32;     // frames a sensor holds before it drops
+const int64_t kStartUs = 20000;     // start command to first frame
+
+struct Sensor {
+    double weight = 1;
+    bool refuses = false;           // connect fails
+    int64_t outage_every_us = 0;    // no airtime for outage_us out of every outage_every_us
+    int64_t outage_us = 0;
+
+    bool open = false;
+    int64_t first_due = 0;
+    uint64_t next_index = 0;
+    int64_t time_base = 0;          // sensor clock at its first frame
+    double owed = 0;                // fraction of a byte of airtime carried to the next tick
+    std::deque<uint8_t> queued;     // frames waiting for airtime, whole frames only
+    std::deque<uint8_t> delivered;  // bytes on the board's side of the link
+};
+
+struct Scenario {
+    const char *name;
+    uint32_t stations;
+    double capacity;                // channel capacity in frames per second
+    std::vector<double> weights;
+    int refusing = -1;
+    int outage_station = -1;
+    int64_t outage_every_us = 0;
+    int64_t outage_us = 0;
+};
+
+struct Sim {
+    int64_t now = 1000000;
+    uint32_t frequency = 100;
+    double capacity_bytes = 0;      // per tick
+    double credit = 0;              // fractional bytes carried to the next tick
+    std::vector<Sensor> sensors;
+
+    bool in_outage(const Sensor &s) const {
+        return s.outage_every_us > 0 && (now % s.outage_every_us) < s.outage_us;
+    }
+
+    void tick() {
+        now += kTickUs;
+        for (Sensor &s : sensors) {
+            if (!s.open) continue;
+            // frame i is taken at first_due + i/f whether or not there is room for it
+            while (s.first_due + static_cast<int64_t>(s.next_index * 1000000 / frequency) <= now) {
+                battery_packet frame{};
+                frame.ID0 = FRAME_ID0;
+                frame.IDfinal = FRAME_IDFINAL;
+                frame.time = s.time_base + static_cast<int64_t>(s.next_index * 1000000 / frequency);
+                frame.battery = 3700;
+                s.next_index++;
+                if (s.queued.size() + sizeof(frame) <= kSensorQueue * sizeof(frame)) {
+                    auto *bytes = reinterpret_cast<const uint8_t *>(&frame);
+                    s.queued.insert(s.queued.end(), bytes, bytes + sizeof(frame));
+                }
+            }
+        }
+        // weighted max-min: split what is left by weight, cap each at its backlog, repeat
+        double left = capacity_bytes + credit;
+        std::vector<double> give(sensors.size(), 0);
+        std::vector<bool> active(sensors.size(), false);
+        for (size_t i = 0; i < sensors.size(); i++) {
+            active[i] = sensors[i].open && !sensors[i].queued.empty() && !in_outage(sensors[i]);
+        }
+        while (left > 1e-9) {
+            double weights = 0;
+            for (size_t i = 0; i < sensors.size(); i++) weights += active[i] ? sensors[i].weight : 0;
+            if (weights == 0) break;
+            bool capped = false;
+            double used = 0;
+            for (size_t i = 0; i < sensors.size(); i++) {
+                if (!active[i]) continue;
+                double share = left * sensors[i].weight / weights;
+                double room = sensors[i].queued.size() - give[i];
+                if (share >= room) {
+                    give[i] += room;
+                    used += room;
+                    active[i] = false;
+                    capped = true;
+                }
+            }
+            if (!capped) {
+                for (size_t i = 0; i < sensors.size(); i++) {
+                    if (active[i]) give[i] += left * sensors[i].weight / weights;
+                }
+                used = left;
+            }
+            left -= used;
+        }
+        credit = std::min(left, capacity_bytes);
+        for (size_t i = 0; i < sensors.size(); i++) {
+            Sensor &s = sensors[i];
+            double airtime = give[i] + s.owed;
+            size_t bytes = std::min(static_cast<size_t>(airtime), s.queued.size());
+            s.owed = (bytes < s.queued.size()) ? airtime - bytes : 0;
+            s.delivered.insert(s.delivered.end(), s.queued.begin(), s.queued.begin() + bytes);
+            s.queued.erase(s.queued.begin(), s.queued.begin() + bytes);
+        }
+    }
+};
+
+int64_t sim_now(void *ctx) { return static_cast<Sim *>(ctx)->now; }
+
+int sim_open(void *ctx, uint32_t station) {
+    Sim *sim = static_cast<Sim *>(ctx);
+    Sensor &s = sim->sensors[station];
+    if (s.refuses) return -1;
+    s.open = true;
+    s.first_due = sim->now + kStartUs;
+    s.next_index = 0;
+    s.time_base = 1000000 * (station + 1);
+    s.owed = 0;
+    s.queued.clear();
+    s.delivered.clear();
+    return 0;
+}
+
+void sim_close(void *ctx, uint32_t station) { static_cast<Sim *>(ctx)->sensors[station].open = false; }
+
+int sim_wait(void *ctx, uint32_t stations, int64_t timeout_us, uint32_t *ready) {
+    Sim *sim = static_cast<Sim *>(ctx);
+    const int64_t deadline = sim->now + timeout_us;
+    while (true) {
+        for (uint32_t i = 0; i < stations; i++) {
+            if (!sim->sensors[i].delivered.empty()) *ready |= 1u << i;
+        }
+        if (*ready || sim->now >= deadline) return 0;
+        sim->tick();
+    }
+}
+
+int sim_recv(void *ctx, uint32_t station, uint8_t *buffer, size_t size) {
+    Sensor &s = static_cast<Sim *>(ctx)->sensors[station];
+    size_t n = std::min(size, s.delivered.size());
+    std::copy(s.delivered.begin(), s.delivered.begin() + n, buffer);
+    s.delivered.erase(s.delivered.begin(), s.delivered.begin() + n);
+    return static_cast<int>(n);
+}
+
+const fairness_io_t kSimIo = {sim_now, sim_open, sim_close, sim_wait, sim_recv};
+
+// Long run rates in frames per second: weighted max-min of the capacity, each capped at the sensor rate
+std::vector<double> water_fill(double capacity, double demand, const std::vector<double> &weights,
+                               const std::vector<bool> &present) {
+    std::vector<double> rate(weights.size(), 0);
+    std::vector<bool> active = present;
+    double left = capacity;
+    while (left > 1e-9) {
+        double total = 0;
+        for (size_t i = 0; i < weights.size(); i++) total += active[i] ? weights[i] : 0;
+        if (total == 0) break;
+        bool capped = false;
+        double used = 0;
+        for (size_t i = 0; i < weights.size(); i++) {
+            if (active[i] && left * weights[i] / total >= demand - rate[i]) {
+                used += demand - rate[i];
+                rate[i] = demand;
+                active[i] = false;
+                capped = true;
+            }
+        }
+        if (!capped) {
+            for (size_t i = 0; i < weights.size(); i++) {
+                if (active[i]) rate[i] += left * weights[i] / total;
+            }
+            used = left;
+        }
+        left -= used;
+    }
+    return rate;
+}
+
+// The merged stream of a step, checked for order and against the frames the stations counted
+struct Merged {
+    uint64_t count = 0;
+    uint64_t disorder = 0;
+    int64_t last = INT64_MIN;
+};
+
+void merged_frame(void *ctx, uint32_t, int64_t key, const battery_packet *) {
+    Merged *merged = static_cast<Merged *>(ctx);
+    merged->disorder += key < merged->last;
+    merged->last = key;
+    merged->count++;
+}
+
+struct Check {
+    const Scenario *scenario;
+    bool verbose;
+    Merged merged;
+    int failed = 0;
+};
+
+void report(void *ctx, const fairness_t *fairness, const fairness_summary_t *summary) {
+    Check *check = static_cast<Check *>(ctx);
+    const Scenario &sc = *check->scenario;
+    const uint32_t k = summary->stations;
+    std::vector<double> weights(sc.weights.begin(), sc.weights.begin() + k);
+    std::vector<bool> present(k, true);
+    if (sc.refusing >= 0 && sc.refusing < static_cast<int>(k)) present[sc.refusing] = false;
+
+    bool ok = true;
+    if (sc.outage_station >= 0 && sc.outage_station < static_cast<int>(k)) {
+        /* each outage that keeps the station silent past the threshold inside
+         * the step is one starvation; one that ends within a poll of the
+         * threshold may go either way
+         */
+        const int64_t step_end = fairness->step_start + fairness->step_us;
+        uint32_t least = 0, most = 0;
+        for (int64_t start = (fairness->step_start / sc.outage_every_us) * sc.outage_every_us; start < step_end;
+             start += sc.outage_every_us) {
+            int64_t silent = std::min(start + sc.outage_us, step_end) - std::max(start, fairness->step_start);
+            least += silent > fairness->starve_us + FAIRNESS_POLL_US;
+            most += silent > fairness->starve_us - FAIRNESS_POLL_US;
+        }
+        ok &= summary->starvations >= least && summary->starvations <= most;
+    } else {
+        ok &= summary->starvations == 0;
+        std::vector<float> expected_rates;
+        std::vector<double> rates = water_fill(sc.capacity, fairness->frequency, weights, present);
+        for (uint32_t i = 0; i < k; i++) {
+            expected_rates.push_back(static_cast<float>(rates[i]));
+            // the first 20 ms of the step nothing is sent, allow that and a little for the queues
+            double measured = fairness->station[i].frames / summary->seconds;
+            double tolerance = 0.03 * fairness->frequency + 1;
+            if (std::fabs(measured - rates[i]) > tolerance) {
+                ok = false;
+                std::printf("    station %u: %.1f fps, expected %.1f\n", i + 1, measured, rates[i]);
+            }
+        }
+        float jain = fairness_jain(expected_rates.data(), k);
+        if (std::fabs(summary->jain - jain) > 0.02f) {
+            ok = false;
+            std::printf("    Jain %.3f, expected %.3f\n", summary->jain, jain);
+        }
+    }
+    ok &= summary->failed == static_cast<uint32_t>(std::count(present.begin(), present.end(), false));
+    uint64_t frames = 0;
+    for (uint32_t i = 0; i < k; i++) frames += fairness->station[i].frames;
+    const uint64_t late = merge_late(fairness->merge);
+    if (check->merged.disorder != 0 || check->merged.count + late != frames) {
+        ok = false;
+        std::printf("    merge: %llu frames out of order, %llu merged + %llu late of %llu\n",
+                    static_cast<unsigned long long>(check->merged.disorder),
+                    static_cast<unsigned long long>(check->merged.count), static_cast<unsigned long long>(late),
+                    static_cast<unsigned long long>(frames));
+    }
+    check->merged = Merged();
+
+    check->failed += !ok;
+    std::printf("  %-10s %2u stations %8.1f fps %7.1f kB/s  Jain %.3f  loss %5.1f%%  starvations %u  failed %u  "
+                "merge late %llu%s\n",
+                sc.name, k, summary->aggregate_fps, summary->aggregate_kbps, summary->jain, summary->loss_pct,
+                summary->starvations, summary->failed, static_cast<unsigned long long>(late), ok ? "" : "  FAIL");
+    if (check->verbose) {
+        char line[256];
+        merge_format(fairness->merge, line, sizeof(line));
+        std::printf("  %s\n", line);
+        for (uint32_t i = 0; i < k; i++) {
+            fairness_format_station(fairness, i, summary->seconds, line, sizeof(line));
+            std::printf("  %s\n", line);
+        }
+    }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    uint32_t frequency = 100, seconds = 10;
+    bool verbose = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:d:v")) != -1) {
+        switch (opt) {
+            case 'f': frequency = static_cast<uint32_t>(std::atoi(optarg)); break;
+            case 'd': seconds = static_cast<uint32_t>(std::atoi(optarg)); break;
+            case 'v': verbose = true; break;
+            default:
+                std::fprintf(stderr, "usage: sim_fairness [-f hz] [-d seconds] [-v]\n");
+                return 2;
+        }
+    }
+    if (frequency < 1 || frequency > 4000 || seconds < 2) {
+        std::fprintf(stderr, "frequency 1..4000 Hz, at least 2 s per step\n");
+        return 2;
+    }
+    const double f = frequency;
+    const std::vector<Scenario> scenarios = {
+        {"ample", 6, 20 * f, {1, 1, 1, 1, 1, 1}},
+        {"saturated", 6, 3 * f, {1, 1, 1, 1, 1, 1}},
+        {"poor link", 5, 3.5 * f, {1, 1, 1, 1, 0.1}},
+        {"outage", 4, 10 * f, {1, 1, 1, 1}, -1, 1, 2000000, 600000},
+        {"absent", 4, 10 * f, {1, 1, 1, 1}, 2},
+    };
+
+    static fairness_t fairness;
+    static merge_entry_t merge_entries[FAIRNESS_MAX_STATIONS * 256];
+    static merge_t merged;
+    merged.depth = 256;
+    merged.entries = merge_entries;
+    volatile bool running = true;
+    int failed = 0;
+    for (const Scenario &sc : scenarios) {
+        Sim sim;
+        sim.frequency = frequency;
+        sim.capacity_bytes = sc.capacity * sizeof(battery_packet) * kTickUs / 1e6;
+        sim.sensors.resize(sc.stations);
+        for (uint32_t i = 0; i < sc.stations; i++) {
+            sim.sensors[i].weight = sc.weights[i];
+            sim.sensors[i].refuses = static_cast<int>(i) == sc.refusing;
+            if (static_cast<int>(i) == sc.outage_station) {
+                sim.sensors[i].outage_every_us = sc.outage_every_us;
+                sim.sensors[i].outage_us = sc.outage_us;
+            }
+        }
+        std::printf("%s: %u sensors at %u Hz, channel %.0f fps\n", sc.name, sc.stations, frequency, sc.capacity);
+        fairness_init(&fairness, &frame_schema_default, frequency, seconds * 1000, 1, sc.stations, 0, &running);
+        Check check{&sc, verbose, {}};
+        fairness_merge(&fairness, &merged, 100000, merged_frame, &check.merged);
+        fairness_run(&fairness, &kSimIo, &sim, report, &check);
+        failed += check.failed;
+    }
+    std::printf("%s\n", failed ? "FAILED" : "every step as predicted");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,151 @@
+/* trace2json — convert a "trace dump" from the test suite console into
+   Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev).
+
+   usage: trace2json [console.log] > trace.json
+
+   The input may be a full console capture; only the TRACE_BEGIN/TN/TE/TRACE_END
+   lines are used. Cycle counters are 32-bit, so gaps longer than one wrap
+   (about 17 s at 240 MHz) between two events of one core are folded.
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Must match trace_event_type_t in main/trace.h
+enum TraceEventType : unsigned {
+    TRACE_RECV_START = 1,
+    TRACE_RECV_END,
+    TRACE_DECODE,
+    TRACE_SEND,
+    TRACE_JOB_BEGIN,
+    TRACE_JOB_END,
+    TRACE_WIFI,
+};
+
+struct CoreClock {
+    bool started = false;
+    uint32_t last = 0;
+    uint64_t epoch = 0;
+    uint64_t first = 0;
+};
+
+std::string escape(const std::string &in) {
+    std::string out;
+    for (char c : in) {
+        if (c == '"' || c == '\\') out += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20) out += c;
+    }
+    return out;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+    std::ifstream file;
+    if (argc > 1) {
+        file.open(argv[1]);
+        if (!file) {
+            std::cerr << "cannot open " << argv[1] << "\n";
+            return 1;
+        }
+    }
+    std::istream &in = (argc > 1) ? static_cast<std::istream &>(file) : std::cin;
+
+    double cycles_per_us = 240.0;
+    std::map<uint32_t, std::string> task_names;
+    std::map<int, CoreClock> clocks;
+    std::vector<std::string> events;
+    std::string line;
+    char buffer[160];
+
+    while (std::getline(in, line)) {
+        size_t pos;
+        if ((pos = line.find("TRACE_BEGIN")) != std::string::npos) {
+            unsigned hz = 0;
+            if (std::sscanf(line.c_str() + pos, "TRACE_BEGIN cpu_hz=%u", &hz) == 1 && hz > 0) {
+                cycles_per_us = hz / 1e6;
+            }
+        } else if ((pos = line.find("TN ")) != std::string::npos) {
+            std::istringstream fields(line.substr(pos + 3));
+            std::string handle, name;
+            fields >> handle;
+            std::getline(fields >> std::ws, name);
+            task_names[static_cast<uint32_t>(std::stoul(handle, nullptr, 16))] = name;
+        } else if ((pos = line.find("TE ")) != std::string::npos) {
+            int core;
+            unsigned ts, task, type, arg;
+            if (std::sscanf(line.c_str() + pos, "TE %d %x %x %x %x", &core, &ts, &task, &type, &arg) != 5) {
+                continue;
+            }
+            CoreClock &clock = clocks[core];
+            if (clock.started && ts < clock.last) {
+                clock.epoch += 1ull << 32;
+            }
+            clock.last = ts;
+            uint64_t cycles = clock.epoch + ts;
+            if (!clock.started) {
+                clock.first = cycles;
+                clock.started = true;
+            }
+            double us = (cycles - clock.first) / cycles_per_us;
+            int signed_arg = static_cast<int32_t>(arg);
+
+            switch (type) {
+            case TRACE_RECV_START:
+                std::snprintf(buffer, sizeof(buffer), "{\"name\":\"recv\",\"ph\":\"B\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"args\":{\"requested\":%u}}", core, task, us, arg);
+                break;
+            case TRACE_RECV_END:
+                std::snprintf(buffer, sizeof(buffer), "{\"name\":\"recv\",\"ph\":\"E\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"args\":{\"bytes\":%d}}", core, task, us, signed_arg);
+                break;
+            case TRACE_DECODE:
+                std::snprintf(buffer, sizeof(buffer), "{\"name\":\"decode\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"args\":{\"frames\":%u}}", core, task, us, arg);
+                break;
+            case TRACE_SEND:
+                std::snprintf(buffer, sizeof(buffer), "{\"name\":\"send\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"args\":{\"bytes\":%d}}", core, task, us, signed_arg);
+                break;
+            case TRACE_JOB_BEGIN:
+                std::snprintf(buffer, sizeof(buffer), "{\"name\":\"job\",\"ph\":\"B\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"args\":{\"worker\":%u}}", core, task, us, arg);
+                break;
+            case TRACE_JOB_END:
+                std::snprintf(buffer, sizeof(buffer), "{\"name\":\"job\",\"ph\":\"E\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f}", core, task, us);
+                break;
+            case TRACE_WIFI:
+                std::snprintf(buffer, sizeof(buffer), "{\"name\":\"wifi event %u\",\"ph\":\"i\",\"s\":\"p\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f}", arg, core, task, us);
+                break;
+            default:
+                std::snprintf(buffer, sizeof(buffer), "{\"name\":\"event %u\",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"args\":{\"arg\":%u}}", type, core, task, us, arg);
+                break;
+            }
+            events.emplace_back(buffer);
+        }
+    }
+
+    std::cout << "{\"traceEvents\":[\n";
+    bool first = true;
+    for (const auto &clock : clocks) {
+        std::snprintf(buffer, sizeof(buffer), "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"core %d\"}}", clock.first, clock.first);
+        std::cout << (first ? "" : ",\n") << buffer;
+        first = false;
+        for (const auto &task : task_names) {
+            std::cout << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << clock.first << ",\"tid\":" << task.first
+                      << ",\"args\":{\"name\":\"" << escape(task.second) << "\"}}";
+        }
+    }
+    for (const auto &event : events) {
+        std::cout << (first ? "" : ",\n") << event;
+        first = false;
+    }
+    std::cout << "\n],\"displayTimeUnit\":\"ns\"}\n";
+    std::cerr << events.size() << " events converted\n";
+    return 0;
+}
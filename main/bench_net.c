@@ -0,0 +1,859 @@
+/* Bulk TCP/UDP throughput between the AP and a station (bench_tcp, bench_udp)
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include "esp_log.h"
+#include "esp_console.h"
+#include "esp_timer.h"
+#include "argtable3/argtable3.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "lwip/stats.h"
+#include "bench_net.h"
+#include "session.h"
+#include "tuning.h"
+#include "worker_pool.h"
+#include "dlog.h"
+#include "result.h"
+
+// A TCP stream that could not send for this long counts a stall: a full window, usually retransmissions
+#define BENCH_NET_STALL_US      100000
+// How long a sender waits for the receiver's result, and a receiver for a silent sender
+#define BENCH_NET_END_WAIT_US   3000000
+#define BENCH_NET_ACCEPT_US     30000000
+#define BENCH_NET_FIN_EVERY_US  100000
+#define BENCH_NET_HELLO_TRIES   10
+// Longest select(), bounds how late a stop or the end of the test is seen
+#define BENCH_NET_POLL_US       10000
+// Limits of a test, for the command line and for a hello from a remote client alike
+#define BENCH_NET_MAX_SECONDS   3600
+#define BENCH_NET_MAX_KBPS      100000
+
+static const char *TAG = "bench_net";
+
+typedef enum {
+    BENCH_WAITING,              // UDP listener: no hello from this stream yet
+    BENCH_ACTIVE,               // moving data
+    BENCH_ENDING,               // sender: end sent, waiting for the result
+    BENCH_DONE
+} bench_state_t;
+
+typedef struct {
+    int sock;
+    struct sockaddr_in peer;    // UDP: where this stream's datagrams go
+    bench_state_t state;
+    uint64_t bytes;             // payload sent or received
+    uint64_t interval_bytes;
+    int64_t first_us;           // first and last data received
+    int64_t last_us;
+    int64_t progress_us;        // last successful send
+    int64_t next_due_us;        // UDP sender pacing
+    int64_t end_us;             // when the end was sent
+    int64_t fin_us;             // UDP: last time the end was sent
+    uint32_t seq;               // sender: next to send, receiver: next expected
+    uint32_t packets;
+    uint32_t lost;
+    uint32_t out_of_order;
+    uint32_t stalls;
+    float jitter_us;
+    int64_t last_transit;
+    bool have_transit;
+    bench_net_result_t result;  // sender: what the receiver reported
+    size_t result_have;
+} bench_stream_t;
+
+typedef struct {
+    bool udp;
+    bool listen;
+    bool sending;               // this side sends
+    int streams;
+    uint32_t duration_ms;
+    uint32_t interval_ms;
+    uint32_t length;
+    uint32_t rate_kbps;
+    struct sockaddr_in peer;
+} bench_net_config_t;
+
+static bench_net_config_t config;
+static bench_stream_t streams[BENCH_NET_MAX_STREAMS];
+static uint8_t buffer[BENCH_NET_MAX_LENGTH];
+static int listen_sock = -1;
+static volatile bool running = false;
+
+static const char *bench_name(void){
+    return config.udp ? "bench_udp" : "bench_tcp";
+}
+
+static result_command_t bench_command(void){
+    return config.udp ? RESULT_CMD_BENCH_UDP : RESULT_CMD_BENCH_TCP;
+}
+
+static double bench_mbps(uint64_t bytes, int64_t us){
+    return (us > 0) ? bytes*8.0/us : 0;
+}
+
+static void bench_nonblocking(int sock){
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+}
+
+static void bench_log(esp_log_level_t level, const char *line, int len, size_t size){
+    dlog_write_text(level, TAG, line, (len < size) ? len : size - 1);
+}
+
+static void bench_hello(bench_net_hello_t *hello, int stream){
+    memset(hello, 0, sizeof(*hello));
+    hello->magic = BENCH_NET_HELLO;
+    hello->version = BENCH_NET_VERSION;
+    hello->flags = (config.udp ? BENCH_NET_UDP : 0) | (config.sending ? BENCH_NET_CLIENT_SENDS : 0);
+    hello->stream = stream;
+    hello->streams = config.streams;
+    hello->duration_ms = config.duration_ms;
+    hello->length = config.length;
+    hello->rate_kbps = config.rate_kbps;
+}
+
+// Take the test parameters from the client's hello, false if it is not one we can run
+static bool bench_accept_hello(const bench_net_hello_t *hello){
+    uint32_t max_length = config.udp ? BENCH_NET_UDP_MAX_LENGTH : BENCH_NET_MAX_LENGTH;
+    if ((hello->magic != BENCH_NET_HELLO) || (hello->version != BENCH_NET_VERSION) ||
+        (!(hello->flags & BENCH_NET_UDP) != !config.udp) || (hello->streams < 1) ||
+        (hello->streams > BENCH_NET_MAX_STREAMS) || (hello->stream >= hello->streams) ||
+        (hello->length < sizeof(bench_net_datagram_t)) || (hello->length > max_length) ||
+        (hello->duration_ms < 1000) || (hello->duration_ms > BENCH_NET_MAX_SECONDS*1000) ||
+        (hello->rate_kbps > BENCH_NET_MAX_KBPS) || (config.udp && (hello->rate_kbps < 1))){
+        // an unpaced UDP sender would flood the AP, an endless test would hold a worker and a socket
+        return false;
+    }
+    config.sending = !(hello->flags & BENCH_NET_CLIENT_SENDS);
+    config.streams = hello->streams;
+    config.duration_ms = hello->duration_ms;
+    config.length = hello->length;
+    config.rate_kbps = hello->rate_kbps;
+    return true;
+}
+
+static void bench_result(const bench_stream_t *stream, int index, bench_net_result_t *result){
+    memset(result, 0, sizeof(*result));
+    result->magic = BENCH_NET_RESULT;
+    result->stream = index;
+    result->bytes = stream->bytes;
+    result->duration_us = (uint32_t)(stream->last_us - stream->first_us);
+    result->packets = stream->packets;
+    result->lost = stream->lost;
+    result->out_of_order = stream->out_of_order;
+    result->jitter_us = (uint32_t)stream->jitter_us;
+}
+
+static void bench_received(bench_stream_t *stream, size_t bytes, int64_t now){
+    if (stream->bytes == 0){
+        stream->first_us = now;
+    }
+    stream->last_us = now;
+    stream->bytes += bytes;
+    stream->interval_bytes += bytes;
+}
+
+// One data or end datagram on the receiving side: sequence accounting and RFC 3550 jitter
+static void bench_udp_data(bench_stream_t *stream, int index, const bench_net_datagram_t *header, int len, int64_t now){
+    if (header->flags & BENCH_NET_FIN){
+        if (stream->state == BENCH_ACTIVE){
+            // the end carries the count sent, so losses at the tail are counted too
+            if (header->seq > stream->seq){
+                stream->lost += header->seq - stream->seq;
+                stream->seq = header->seq;
+            }
+            stream->state = BENCH_DONE;
+        }
+        bench_net_result_t result;
+        bench_result(stream, index, &result);
+        sendto(stream->sock, &result, sizeof(result), 0, (struct sockaddr *)&stream->peer, sizeof(stream->peer));
+        return;
+    }
+    if (stream->state != BENCH_ACTIVE){
+        return;
+    }
+    bench_received(stream, len, now);
+    stream->packets++;
+    if (header->seq == stream->seq){
+        stream->seq++;
+    }else if (header->seq > stream->seq){
+        stream->lost += header->seq - stream->seq;
+        stream->seq = header->seq + 1;
+    }else{
+        // counted lost when the later one arrived
+        stream->out_of_order++;
+        stream->lost -= (stream->lost > 0) ? 1 : 0;
+    }
+    int64_t transit = now - header->sent_us;
+    if (stream->have_transit){
+        int64_t d = transit - stream->last_transit;
+        d = (d < 0) ? -d : d;
+        stream->jitter_us += (d - stream->jitter_us)/16;
+    }
+    stream->last_transit = transit;
+    stream->have_transit = true;
+}
+
+// Read every datagram waiting on `sock` and hand it to its stream
+static void bench_udp_drain(int sock){
+    while (true){
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int len = recvfrom(sock, buffer, sizeof(buffer), 0, (struct sockaddr *)&from, &from_len);
+        if (len < (int)sizeof(uint32_t)){
+            return;
+        }
+        int64_t now = esp_timer_get_time();
+        uint32_t magic;
+        memcpy(&magic, buffer, sizeof(magic));
+        if ((magic == BENCH_NET_HELLO) && config.listen && (len >= (int)sizeof(bench_net_hello_t))){
+            bench_net_hello_t hello;
+            memcpy(&hello, buffer, sizeof(hello));
+            if ((hello.stream >= config.streams) || !bench_accept_hello(&hello)){
+                continue;
+            }
+            bench_stream_t *stream = &streams[hello.stream];
+            if (stream->state == BENCH_WAITING){
+                stream->peer = from;
+                stream->state = BENCH_ACTIVE;
+                stream->next_due_us = now;
+                stream->progress_us = now;
+            }
+            // also the answer to a repeated hello whose echo was lost
+            sendto(sock, &hello, sizeof(hello), 0, (struct sockaddr *)&from, sizeof(from));
+        }else if ((magic == BENCH_NET_DATA) && !config.sending && (len >= (int)sizeof(bench_net_datagram_t))){
+            bench_net_datagram_t header;
+            memcpy(&header, buffer, sizeof(header));
+            if (header.stream < config.streams){
+                bench_udp_data(&streams[header.stream], header.stream, &header, len, now);
+            }
+        }else if ((magic == BENCH_NET_RESULT) && config.sending && (len >= (int)sizeof(bench_net_result_t))){
+            bench_net_result_t result;
+            memcpy(&result, buffer, sizeof(result));
+            if ((result.stream < config.streams) && (streams[result.stream].state == BENCH_ENDING)){
+                streams[result.stream].result = result;
+                streams[result.stream].result_have = sizeof(result);
+                streams[result.stream].state = BENCH_DONE;
+            }
+        }
+    }
+}
+
+static int bench_read_all(int sock, void *data, size_t size){
+    size_t have = 0;
+    while (have < size){
+        int err = recv(sock, (uint8_t *)data + have, size - have, 0);
+        if (err <= 0){
+            return -1;
+        }
+        have += err;
+    }
+    return 0;
+}
+
+// Wait until `sock` is readable, polling the running flag; false on timeout or stop
+static bool bench_wait_readable(int sock, int64_t timeout_us){
+    int64_t deadline = esp_timer_get_time() + timeout_us;
+    while (running && (esp_timer_get_time() < deadline)){
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        FD_SET(sock, &readfds);
+        struct timeval tv = {0, BENCH_NET_POLL_US*10};
+        if (select(sock + 1, &readfds, NULL, NULL, &tv) > 0){
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool bench_setup_client(void){
+    for(int i = 0; i < config.streams; i++){
+        bench_stream_t *stream = &streams[i];
+        stream->peer = config.peer;
+        stream->sock = socket(AF_INET, config.udp ? SOCK_DGRAM : SOCK_STREAM, config.udp ? IPPROTO_UDP : IPPROTO_TCP);
+        if (stream->sock < 0){
+            DLOGE(TAG,"stream %d: socket() failed: errno %d",i,errno);
+            return false;
+        }
+        bench_net_hello_t hello;
+        bench_hello(&hello, i);
+        if (!config.udp){
+            if (connect(stream->sock, (struct sockaddr *)&stream->peer, sizeof(stream->peer)) != 0){
+                // DLOG keeps only the pointer, inet_ntoa's buffer is reused: format the line here
+                char line[80];
+                int len = snprintf(line, sizeof(line), "stream %d: connect to %s:%d failed: errno %d", i,
+                                   inet_ntoa(stream->peer.sin_addr), ntohs(stream->peer.sin_port), errno);
+                bench_log(ESP_LOG_ERROR, line, len, sizeof(line));
+                return false;
+            }
+            if (send(stream->sock, &hello, sizeof(hello), 0) != sizeof(hello)){
+                DLOGE(TAG,"stream %d: hello not sent: errno %d",i,errno);
+                return false;
+            }
+        }else{
+            bool answered = false;
+            for(int attempt = 0; (attempt < BENCH_NET_HELLO_TRIES) && !answered && running; attempt++){
+                sendto(stream->sock, &hello, sizeof(hello), 0, (struct sockaddr *)&stream->peer, sizeof(stream->peer));
+                if (bench_wait_readable(stream->sock, 200000)){
+                    bench_net_hello_t echo;
+                    int len = recv(stream->sock, &echo, sizeof(echo), 0);
+                    answered = (len == sizeof(echo)) && (echo.magic == BENCH_NET_HELLO) && (echo.stream == i);
+                }
+            }
+            if (!answered){
+                char line[80];
+                int len = snprintf(line, sizeof(line), "stream %d: no answer from %s:%d", i,
+                                   inet_ntoa(stream->peer.sin_addr), ntohs(stream->peer.sin_port));
+                bench_log(ESP_LOG_ERROR, line, len, sizeof(line));
+                return false;
+            }
+        }
+        bench_nonblocking(stream->sock);
+        stream->state = BENCH_ACTIVE;
+    }
+    return true;
+}
+
+static bool bench_setup_listener(uint16_t port){
+    listen_sock = socket(AF_INET, config.udp ? SOCK_DGRAM : SOCK_STREAM, config.udp ? IPPROTO_UDP : IPPROTO_TCP);
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if ((listen_sock < 0) || (bind(listen_sock, (struct sockaddr *)&address, sizeof(address)) != 0) ||
+        (!config.udp && (listen(listen_sock, BENCH_NET_MAX_STREAMS) != 0))){
+        DLOGE(TAG,"cannot listen on port %d: errno %d",port,errno);
+        return false;
+    }
+    DLOGI(TAG,"%s: waiting on port %d",bench_name(),port);
+    if (config.udp){
+        // every stream shares the socket; the first hello tells how many follow, the rest start as they come
+        config.streams = BENCH_NET_MAX_STREAMS;
+        for(int i = 0; i < BENCH_NET_MAX_STREAMS; i++){
+            streams[i].sock = listen_sock;
+        }
+        bench_nonblocking(listen_sock);
+        while (bench_wait_readable(listen_sock, BENCH_NET_ACCEPT_US)){
+            bench_udp_drain(listen_sock);
+            for(int i = 0; i < config.streams; i++){
+                if (streams[i].state != BENCH_WAITING){
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+    for(int accepted = 0; accepted < config.streams; accepted++){
+        if (!bench_wait_readable(listen_sock, BENCH_NET_ACCEPT_US)){
+            return false;
+        }
+        struct sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+        int sock = accept(listen_sock, (struct sockaddr *)&from, &from_len);
+        bench_net_hello_t hello;
+        if ((sock < 0) || (bench_read_all(sock, &hello, sizeof(hello)) != 0) || !bench_accept_hello(&hello) ||
+            (streams[hello.stream].sock >= 0)){
+            char line[80];
+            int len = snprintf(line, sizeof(line), "connection from %s is not a bench_tcp client", inet_ntoa(from.sin_addr));
+            bench_log(ESP_LOG_ERROR, line, len, sizeof(line));
+            if (sock >= 0){
+                close(sock);
+            }
+            accepted--;
+            continue;
+        }
+        streams[hello.stream].sock = sock;
+        streams[hello.stream].peer = from;
+        streams[hello.stream].state = BENCH_ACTIVE;
+        bench_nonblocking(sock);
+    }
+    return true;
+}
+
+// The end datagram carries the number of datagrams sent
+static void bench_send_fin(bench_stream_t *stream, int64_t now){
+    bench_net_datagram_t header = {BENCH_NET_DATA, stream - streams, BENCH_NET_FIN, 0, stream->seq, now};
+    sendto(stream->sock, &header, sizeof(header), 0, (struct sockaddr *)&stream->peer, sizeof(stream->peer));
+    stream->fin_us = now;
+}
+
+static void bench_end_stream(bench_stream_t *stream, int64_t now){
+    stream->state = BENCH_ENDING;
+    stream->end_us = now;
+    if (config.udp){
+        bench_send_fin(stream, now);
+    }else{
+        shutdown(stream->sock, SHUT_WR);
+    }
+}
+
+static void bench_tcp_send(bench_stream_t *stream, int64_t now){
+    int err = send(stream->sock, buffer, config.length, 0);
+    if (err > 0){
+        if (now - stream->progress_us > BENCH_NET_STALL_US){
+            stream->stalls++;
+        }
+        stream->progress_us = now;
+        stream->bytes += err;
+        stream->interval_bytes += err;
+    }else if ((errno != EAGAIN) && (errno != EWOULDBLOCK)){
+        int error = errno;
+        DLOGE(TAG,"stream %d: send failed: errno %d",stream - streams,error);
+        result_error(bench_command(),error,"send failed");
+        stream->state = BENCH_DONE;
+    }
+}
+
+static void bench_tcp_read(bench_stream_t *stream, int64_t now){
+    if (stream->state == BENCH_ENDING){
+        // the sender side: the receiver's result after our end
+        int err = recv(stream->sock, (uint8_t *)&stream->result + stream->result_have, sizeof(stream->result) - stream->result_have, 0);
+        if (err > 0){
+            stream->result_have += err;
+        }
+        if ((err == 0) || (stream->result_have == sizeof(stream->result)) ||
+            ((err < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK))){
+            stream->state = BENCH_DONE;
+        }
+        return;
+    }
+    int err = recv(stream->sock, buffer, config.length, 0);
+    if (err > 0){
+        bench_received(stream, err, now);
+    }else if (err == 0){
+        bench_net_result_t result;
+        bench_result(stream, stream - streams, &result);
+        send(stream->sock, &result, sizeof(result), 0);
+        stream->state = BENCH_DONE;
+    }else if ((errno != EAGAIN) && (errno != EWOULDBLOCK)){
+        int error = errno;
+        DLOGE(TAG,"stream %d: recv failed: errno %d",stream - streams,error);
+        result_error(bench_command(),error,"recv failed");
+        stream->state = BENCH_DONE;
+    }
+}
+
+static void bench_udp_send(bench_stream_t *stream, int index, int64_t now, int64_t period_us){
+    // after a long block restart the schedule rather than bursting to catch up
+    if (now - stream->next_due_us > 100000){
+        stream->next_due_us = now;
+    }
+    while (stream->next_due_us <= now){
+        bench_net_datagram_t header = {BENCH_NET_DATA, index, 0, 0, stream->seq, now};
+        memcpy(buffer, &header, sizeof(header));
+        int err = sendto(stream->sock, buffer, config.length, 0, (struct sockaddr *)&stream->peer, sizeof(stream->peer));
+        if (err < 0){
+            // out of buffers, the same datagram goes on the next round
+            stream->stalls += (errno == ENOMEM) || (errno == EAGAIN);
+            return;
+        }
+        stream->seq++;
+        stream->packets++;
+        stream->bytes += err;
+        stream->interval_bytes += err;
+        stream->next_due_us += period_us;
+    }
+}
+
+static void bench_interval(int64_t from_us, int64_t to_us){
+    char line[120];
+    uint64_t total = 0;
+    for(int i = 0; i < config.streams; i++){
+        total += streams[i].interval_bytes;
+        if (config.streams > 1){
+            int len = snprintf(line, sizeof(line), "[%d] %6.1f-%6.1f s %10.1f KB %8.2f Mbps", i, from_us/1e6, to_us/1e6,
+                               streams[i].interval_bytes/1024.0, bench_mbps(streams[i].interval_bytes, to_us - from_us));
+            bench_log(ESP_LOG_INFO, line, len, sizeof(line));
+        }
+        streams[i].interval_bytes = 0;
+    }
+    int len = snprintf(line, sizeof(line), "[SUM] %6.1f-%6.1f s %10.1f KB %8.2f Mbps", from_us/1e6, to_us/1e6,
+                       total/1024.0, bench_mbps(total, to_us - from_us));
+    bench_log(ESP_LOG_INFO, line, len, sizeof(line));
+}
+
+// Final line and result record of one stream (index >= 0) or of the sum (-1)
+static void bench_final(int index, int64_t elapsed_us, result_run_t *run){
+    uint64_t bytes = 0, remote_bytes = 0;
+    uint32_t packets = 0, lost = 0, out_of_order = 0, stalls = 0, jitter = 0, duration = 0, results = 0;
+    for(int i = 0; i < config.streams; i++){
+        const bench_stream_t *s = &streams[i];
+        if ((index >= 0) && (i != index)){
+            continue;
+        }
+        bool have = (s->result_have == sizeof(s->result));
+        bytes += s->bytes;
+        stalls += s->stalls;
+        if (config.sending){
+            results += have;
+            remote_bytes += have ? s->result.bytes : 0;
+            packets += config.udp ? s->packets : 0;
+            lost += have ? s->result.lost : 0;
+            out_of_order += have ? s->result.out_of_order : 0;
+            jitter = (have && (s->result.jitter_us > jitter)) ? s->result.jitter_us : jitter;
+            duration = (have && (s->result.duration_us > duration)) ? s->result.duration_us : duration;
+        }else{
+            packets += s->packets + s->lost;
+            lost += s->lost;
+            out_of_order += s->out_of_order;
+            jitter = ((uint32_t)s->jitter_us > jitter) ? (uint32_t)s->jitter_us : jitter;
+            duration = ((uint32_t)(s->last_us - s->first_us) > duration) ? (uint32_t)(s->last_us - s->first_us) : duration;
+        }
+    }
+    char label[8];
+    snprintf(label, sizeof(label), (index >= 0) ? "[%d]" : "[SUM]", index);
+    char line[200];
+    int len;
+    if (config.sending){
+        len = snprintf(line, sizeof(line), "%s sent %.2f MB in %.2f s = %.2f Mbps", label, bytes/1048576.0,
+                       elapsed_us/1e6, bench_mbps(bytes, elapsed_us));
+        if (results){
+            len += snprintf(line + len, sizeof(line) - len, ", peer received %.2f MB = %.2f Mbps", remote_bytes/1048576.0,
+                            bench_mbps(remote_bytes, duration));
+        }else{
+            len += snprintf(line + len, sizeof(line) - len, ", no result from the peer");
+        }
+    }else{
+        len = snprintf(line, sizeof(line), "%s received %.2f MB in %.2f s = %.2f Mbps", label, bytes/1048576.0,
+                       duration/1e6, bench_mbps(bytes, duration));
+    }
+    if (config.udp && (len < sizeof(line))){
+        len += snprintf(line + len, sizeof(line) - len, ", lost %u/%u (%.2f%%), out of order %u, jitter %.2f ms",
+                        lost, packets, packets ? 100.0*lost/packets : 0.0, out_of_order, jitter/1000.0);
+    }
+    if (config.sending && (len < sizeof(line))){
+        len += snprintf(line + len, sizeof(line) - len, config.udp ? ", %u sends out of buffers" : ", %u send stalls", stalls);
+    }
+    bench_log(((config.udp && lost) || stalls) ? ESP_LOG_WARN : ESP_LOG_INFO, line, len, sizeof(line));
+    *run = (result_run_t){
+        .command = bench_command(),
+        .round = index + 1,
+        .rounds = config.streams,
+        .duration_ms = (uint32_t)((config.sending ? elapsed_us : duration)/1000),
+        .frames = packets,
+        .lost = lost,
+        .stalls = stalls,
+        .jitter_max = jitter,
+        .bytes = bytes,
+    };
+}
+
+static void task_bench_net(void *pvParameters){
+    uint16_t port = (uint16_t)(uintptr_t)pvParameters;
+    bool ready = config.listen ? bench_setup_listener(port) : bench_setup_client();
+    if (!ready){
+        int error = errno;
+        DLOGE(TAG,"%s: not started",bench_name());
+        result_error(bench_command(),error,"not started");
+        goto cleanup;
+    }
+    DLOGI(TAG,"%s: %d stream(s), %u s, %u byte buffers, this side %s",bench_name(),config.streams,
+          config.duration_ms/1000,config.length,config.sending ? "sends" : "receives");
+
+    tuning_cpu_t cpu;
+    tuning_cpu_begin(&cpu);
+#if LWIP_STATS && MIB2_STATS
+    uint32_t retransmits = lwip_stats.mib2.tcpretranssegs;
+#endif
+    const int64_t start = esp_timer_get_time();
+    const int64_t end = start + (int64_t)config.duration_ms*1000;
+    const int64_t period_us = config.rate_kbps ? (int64_t)config.length*8*1000*config.streams/config.rate_kbps : 0;
+    int64_t report_from = start;
+    int64_t sent_until = end;
+    for(int i = 0; i < config.streams; i++){
+        streams[i].next_due_us = start;
+        streams[i].progress_us = start;
+    }
+    while (running){
+        int64_t now = esp_timer_get_time();
+        int busy = 0;
+        for(int i = 0; i < config.streams; i++){
+            bench_stream_t *s = &streams[i];
+            if (config.sending && (s->state == BENCH_ACTIVE) && (now >= end)){
+                bench_end_stream(s, now);
+                sent_until = now;
+            }
+            if ((s->state == BENCH_WAITING) && (now >= end)){
+                // a UDP stream whose hello never came
+                s->state = BENCH_DONE;
+            }
+            if ((s->state == BENCH_ENDING) && (now - s->end_us > BENCH_NET_END_WAIT_US)){
+                s->state = BENCH_DONE;
+            }
+            if (config.udp && (s->state == BENCH_ENDING) && (now - s->fin_us > BENCH_NET_FIN_EVERY_US)){
+                bench_send_fin(s, now);
+            }
+            busy += (s->state != BENCH_DONE);
+        }
+        // a receiver whose sender went quiet does not wait forever
+        if ((busy == 0) || (!config.sending && (now > end + BENCH_NET_END_WAIT_US))){
+            break;
+        }
+        if ((config.interval_ms > 0) && (now - report_from >= (int64_t)config.interval_ms*1000)){
+            bench_interval(report_from - start, now - start);
+            report_from = now;
+        }
+
+        fd_set readfds, writefds;
+        FD_ZERO(&readfds);
+        FD_ZERO(&writefds);
+        int max_fd = -1;
+        for(int i = 0; i < config.streams; i++){
+            bench_stream_t *s = &streams[i];
+            if ((s->state == BENCH_DONE) || (s->sock < 0)){
+                continue;
+            }
+            if (config.sending && !config.udp && (s->state == BENCH_ACTIVE)){
+                FD_SET(s->sock, &writefds);
+            }else{
+                FD_SET(s->sock, &readfds);
+            }
+            max_fd = (s->sock > max_fd) ? s->sock : max_fd;
+        }
+        int64_t wait_us = BENCH_NET_POLL_US;
+        if (config.udp && config.sending){
+            for(int i = 0; i < config.streams; i++){
+                if (streams[i].state == BENCH_ACTIVE){
+                    int64_t until = streams[i].next_due_us - now;
+                    wait_us = (until < wait_us) ? until : wait_us;
+                }
+            }
+            wait_us = (wait_us < 0) ? 0 : wait_us;
+        }
+        struct timeval tv = {0, wait_us};
+        int ready_fds = (max_fd >= 0) ? select(max_fd + 1, &readfds, &writefds, NULL, &tv) : 0;
+        now = esp_timer_get_time();
+        if (config.udp){
+            if ((ready_fds > 0) && config.listen){
+                bench_udp_drain(listen_sock);
+            }
+            for(int i = 0; i < config.streams; i++){
+                bench_stream_t *s = &streams[i];
+                if ((ready_fds > 0) && !config.listen && (s->sock >= 0) && FD_ISSET(s->sock, &readfds)){
+                    bench_udp_drain(s->sock);
+                }
+                if (config.sending && (s->state == BENCH_ACTIVE) && (now < end)){
+                    bench_udp_send(s, i, now, period_us);
+                }
+            }
+            continue;
+        }
+        for(int i = 0; (i < config.streams) && (ready_fds > 0); i++){
+            bench_stream_t *s = &streams[i];
+            if ((s->sock >= 0) && FD_ISSET(s->sock, &writefds) && (s->state == BENCH_ACTIVE)){
+                bench_tcp_send(s, now);
+            }
+            if ((s->sock >= 0) && FD_ISSET(s->sock, &readfds)){
+                bench_tcp_read(s, now);
+            }
+        }
+    }
+
+    // the loop leaves with running still set unless --stop ended it
+    uint16_t flags = running ? 0 : RESULT_RUN_STOPPED;
+    tuning_cpu_usage_t usage;
+    tuning_cpu_end(&cpu, &usage);
+    // stopped early, the sending ended with the stop
+    int64_t stopped = esp_timer_get_time();
+    int64_t elapsed = ((sent_until < stopped) ? sent_until : stopped) - start;
+    if ((config.interval_ms > 0) && (report_from - start < elapsed)){
+        bench_interval(report_from - start, elapsed);
+    }
+    result_run_t run;
+    for(int i = 0; (i < config.streams) && (config.streams > 1); i++){
+        bench_final(i, elapsed, &run);
+        run.flags = flags;
+        result_run(&run);
+    }
+    bench_final(-1, elapsed, &run);
+    run.flags = flags;
+    run.cpu_pct = usage.valid ? usage.task_pct : 0;
+    result_run(&run);
+    char line[120];
+    int len = 0;
+    if (usage.valid){
+        len = snprintf(line, sizeof(line), "%s: cpu %.1f%% of a core", bench_name(), usage.task_pct);
+        for(int core = 0; core < portNUM_PROCESSORS; core++){
+            len += snprintf(line + len, sizeof(line) - len, ", core%d %.0f%% busy", core, usage.load_pct[core]);
+        }
+    }else{
+        len = snprintf(line, sizeof(line), "%s: cpu usage needs FreeRTOS run time stats", bench_name());
+    }
+    bench_log(ESP_LOG_INFO, line, len, sizeof(line));
+#if LWIP_STATS && MIB2_STATS
+    if (!config.udp){
+        DLOGI(TAG,"%s: %u TCP segments retransmitted",bench_name(),lwip_stats.mib2.tcpretranssegs - retransmits);
+    }
+#endif
+
+cleanup:
+    for(int i = 0; i < BENCH_NET_MAX_STREAMS; i++){
+        if ((streams[i].sock >= 0) && (streams[i].sock != listen_sock)){
+            close(streams[i].sock);
+        }
+        streams[i].sock = -1;
+    }
+    if (listen_sock >= 0){
+        close(listen_sock);
+        listen_sock = -1;
+    }
+    running = false;
+}
+
+typedef struct {
+    struct arg_str *host;
+    struct arg_lit *listen;
+    struct arg_lit *reverse;
+    struct arg_int *seconds;
+    struct arg_int *interval;
+    struct arg_int *length;
+    struct arg_int *parallel;
+    struct arg_int *port;
+    struct arg_lit *stop;
+} bench_net_args_t;
+
+static struct {
+    bench_net_args_t common;
+    struct arg_end *end;
+} bench_tcp_args;
+
+static struct {
+    bench_net_args_t common;
+    struct arg_int *bandwidth;
+    struct arg_end *end;
+} bench_udp_args;
+
+static int bench_net_start(bool udp, const bench_net_args_t *args, int rate_kbps){
+    result_command_t command = udp ? RESULT_CMD_BENCH_UDP : RESULT_CMD_BENCH_TCP;
+    if (args->stop->count > 0){
+        if (!running){
+            ESP_LOGW(TAG,"No benchmark running");
+        }
+        running = false;
+        return ESP_OK;
+    }
+    if (running){
+        ESP_LOGW(TAG,"A benchmark is still running, stop it with --stop");
+        result_error(command,ESP_ERR_INVALID_STATE,"a benchmark is still running");
+        return ESP_OK;
+    }
+    memset(&config, 0, sizeof(config));
+    memset(streams, 0, sizeof(streams));
+    for(int i = 0; i < BENCH_NET_MAX_STREAMS; i++){
+        streams[i].sock = -1;
+    }
+    config.udp = udp;
+    config.listen = (args->listen->count > 0);
+    config.sending = (args->reverse->count == 0);
+    config.streams = (args->parallel->count > 0) ? args->parallel->ival[0] : 1;
+    int seconds = (args->seconds->count > 0) ? args->seconds->ival[0] : 10;
+    int interval = (args->interval->count > 0) ? args->interval->ival[0] : 1;
+    int length = (args->length->count > 0) ? args->length->ival[0] : (udp ? 1460 : 4096);
+    int port = (args->port->count > 0) ? args->port->ival[0] : BENCH_NET_PORT;
+    int max_length = udp ? BENCH_NET_UDP_MAX_LENGTH : BENCH_NET_MAX_LENGTH;
+    if ((config.streams < 1) || (config.streams > BENCH_NET_MAX_STREAMS) || (seconds < 1) || (seconds > BENCH_NET_MAX_SECONDS) ||
+        (interval < 0) || (interval > 60) || (length < (int)sizeof(bench_net_datagram_t)) || (length > max_length) ||
+        (port < 1) || (port > 65535) || (rate_kbps < 0) || (rate_kbps > BENCH_NET_MAX_KBPS)){
+        ESP_LOGE(TAG,"Streams 1..%d, duration 1..3600 s, interval 0..60 s, buffer %d..%d bytes, port 1..65535, bandwidth up to 100000 kbps",
+                 BENCH_NET_MAX_STREAMS,(int)sizeof(bench_net_datagram_t),max_length);
+        result_error(command,ESP_ERR_INVALID_ARG,"invalid streams, duration, interval, buffer, port or bandwidth");
+        return ESP_OK;
+    }
+    config.duration_ms = seconds*1000;
+    config.interval_ms = interval*1000;
+    config.length = length;
+    config.rate_kbps = rate_kbps;
+    if (!config.listen){
+        if (args->host->count > 0){
+            config.peer.sin_family = AF_INET;
+            if (inet_pton(AF_INET, args->host->sval[0], &config.peer.sin_addr) != 1){
+                ESP_LOGE(TAG,"Not an IPv4 address: %s",args->host->sval[0]);
+                result_error(command,ESP_ERR_INVALID_ARG,"not an IPv4 address");
+                return ESP_OK;
+            }
+        }else if (!session_peer(&config.peer)){
+            ESP_LOGE(TAG,"No peer: give --host, use connect_to first, or --listen");
+            result_error(command,ESP_ERR_NOT_FOUND,"no peer");
+            return ESP_OK;
+        }
+        config.peer.sin_port = htons(port);
+    }
+    running = true;
+    if (worker_submit("bench_net", task_bench_net, (void *)(uintptr_t)port) != ESP_OK){
+        result_error(command,ESP_ERR_NO_MEM,"no idle worker");
+        running = false;
+    }
+    return ESP_OK;
+}
+
+static int bench_tcp(int argc, char **argv){
+    int nerrors = arg_parse(argc, argv, (void **) &bench_tcp_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, bench_tcp_args.end, argv[0]);
+        return ESP_OK;
+    }
+    return bench_net_start(false, &bench_tcp_args.common, 0);
+}
+
+static int bench_udp(int argc, char **argv){
+    int nerrors = arg_parse(argc, argv, (void **) &bench_udp_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, bench_udp_args.end, argv[0]);
+        return ESP_OK;
+    }
+    int rate_kbps = (bench_udp_args.bandwidth->count > 0) ? bench_udp_args.bandwidth->ival[0] : 10000;
+    if (rate_kbps < 1){
+        ESP_LOGE(TAG,"Bandwidth must be at least 1 kbps");
+        result_error(RESULT_CMD_BENCH_UDP,ESP_ERR_INVALID_ARG,"bandwidth must be at least 1 kbps");
+        return ESP_OK;
+    }
+    return bench_net_start(true, &bench_udp_args.common, rate_kbps);
+}
+
+static void bench_net_args(bench_net_args_t *args, const char *length_help){
+    args->host = arg_str0("c", "host", "<ip>", "peer to connect to (default: the connect_to peer)");
+    args->listen = arg_lit0(NULL, "listen", "wait for the peer to connect, it chooses direction and duration");
+    args->reverse = arg_lit0("R", "reverse", "the peer sends, this side receives");
+    args->seconds = arg_int0("t", "time", "<s>", "length of the test (default 10)");
+    args->interval = arg_int0("i", "interval", "<s>", "seconds between interval reports, 0 for none (default 1)");
+    args->length = arg_int0("l", "length", "<bytes>", length_help);
+    args->parallel = arg_int0("P", "parallel", "<n>", "parallel streams (default 1)");
+    args->port = arg_int0("p", "port", "<port>", "peer or listening port (default 5201)");
+    args->stop = arg_lit0(NULL, "stop", "end the running benchmark");
+}
+
+void register_bench_net(void){
+    bench_net_args(&bench_tcp_args.common, "bytes per send/recv (default 4096)");
+    bench_tcp_args.end = arg_end(0);
+    const esp_console_cmd_t tcp_cmd = {
+        .command = "bench_tcp",
+        .help = "Timed bulk TCP transfer to or from a station running host/bench_peer, with interval and final Mbps",
+        .hint = NULL,
+        .func = &bench_tcp,
+        .argtable = &bench_tcp_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&tcp_cmd));
+
+    bench_net_args(&bench_udp_args.common, "datagram size (default 1460)");
+    bench_udp_args.bandwidth = arg_int0("b", "bandwidth", "<kbps>", "total sending rate (default 10000)");
+    bench_udp_args.end = arg_end(0);
+    const esp_console_cmd_t udp_cmd = {
+        .command = "bench_udp",
+        .help = "Timed UDP transfer at a set rate to or from host/bench_peer: Mbps, loss, reordering and jitter",
+        .hint = NULL,
+        .func = &bench_udp,
+        .argtable = &bench_udp_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&udp_cmd));
+}
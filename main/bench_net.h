@@ -0,0 +1,84 @@
+/* Bulk TCP/UDP throughput between the AP and a station (bench_tcp, bench_udp)
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Wire protocol, shared with host/bench_peer.cpp. Every record is packed
+ * and little endian (both ends are).
+ *
+ * The side that connects is the client. Its first record on every stream
+ * is a hello saying how long the test runs and which side sends. The
+ * sender then moves data until the time is up and ends the stream (TCP:
+ * shutdown of its write side; UDP: a datagram with BENCH_NET_FIN, repeated
+ * until answered). The receiver answers the end with a result record, so
+ * the sender can report what actually arrived.
+ *
+ * UDP streams start with the hello datagram, which the server echoes back
+ * as the go-ahead. Each data datagram begins with bench_net_datagram_t.
+ */
+#define BENCH_NET_PORT      5201
+#define BENCH_NET_VERSION   1
+#define BENCH_NET_HELLO     0x4f4c4548  // "HELO"
+#define BENCH_NET_DATA      0x41544144  // "DATA"
+#define BENCH_NET_RESULT    0x54534552  // "REST"
+
+#define BENCH_NET_MAX_STREAMS   4
+#define BENCH_NET_MAX_LENGTH    8192
+#define BENCH_NET_UDP_MAX_LENGTH 1472    // one unfragmented datagram on a 1500 byte MTU
+
+// bench_net_hello_t.flags
+#define BENCH_NET_UDP           (1 << 0)
+#define BENCH_NET_CLIENT_SENDS  (1 << 1)
+
+// bench_net_datagram_t.flags
+#define BENCH_NET_FIN           (1 << 0)
+
+typedef struct {
+    uint32_t magic;             // BENCH_NET_HELLO
+    uint8_t version;
+    uint8_t flags;
+    uint8_t stream;             // index of this stream
+    uint8_t streams;            // streams in the test
+    uint32_t duration_ms;
+    uint32_t length;            // bytes per send, datagram size for UDP
+    uint32_t rate_kbps;         // UDP: total over all streams
+} __attribute__((__packed__)) bench_net_hello_t;
+
+typedef struct {
+    uint32_t magic;             // BENCH_NET_DATA
+    uint8_t stream;
+    uint8_t flags;
+    uint16_t reserved;
+    uint32_t seq;
+    int64_t sent_us;            // sender clock, for the jitter estimate
+} __attribute__((__packed__)) bench_net_datagram_t;
+
+typedef struct {
+    uint32_t magic;             // BENCH_NET_RESULT
+    uint8_t stream;
+    uint8_t reserved[3];
+    uint64_t bytes;             // payload received
+    uint32_t duration_us;       // first to last byte received
+    uint32_t packets;           // UDP: datagrams received
+    uint32_t lost;              // UDP: sequence numbers never seen
+    uint32_t out_of_order;      // UDP: arrived after a later sequence number
+    uint32_t jitter_us;         // UDP: RFC 3550 interarrival jitter
+} __attribute__((__packed__)) bench_net_result_t;
+
+// Register the "bench_tcp" and "bench_udp" console commands
+void register_bench_net(void);
+
+#ifdef __cplusplus
+}
+#endif
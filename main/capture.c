@@ -0,0 +1,204 @@
+/* Columnar capture of received sensor frames
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <math.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "capture.h"
+
+static const char *field_names[CAPTURE_FIELD_COUNT] = {
+    "time", "accelX", "accelY", "accelZ", "gyroX", "gyroY", "gyroZ", "battery"
+};
+
+typedef struct {
+    int64_t count;
+    int64_t sum;
+    int64_t sum_squares;
+    int32_t min;
+    int32_t max;
+} capture_accumulator_t;
+
+#define CAPTURE_ALIGN(bytes) (((bytes) + 15) & ~(size_t)15)
+
+size_t capture_storage_size(uint32_t frames){
+    return 15 + CAPTURE_ALIGN(frames*sizeof(int64_t)) + (CAPTURE_AXES + 1)*CAPTURE_ALIGN(frames*sizeof(int16_t));
+}
+
+void capture_init(capture_t *capture, void *storage, uint32_t frames){
+    uint8_t *next = (uint8_t *)(((uintptr_t)storage + 15) & ~(uintptr_t)15);
+    capture->capacity = frames;
+    capture->count = 0;
+    capture->head = 0;
+    capture->time = (int64_t *)next;
+    next += CAPTURE_ALIGN(frames*sizeof(int64_t));
+    for(int i = 0; i < CAPTURE_AXES; i++){
+        capture->axis[i] = (int16_t *)next;
+        next += CAPTURE_ALIGN(frames*sizeof(int16_t));
+    }
+    capture->battery = (uint16_t *)next;
+}
+
+void capture_clear(capture_t *capture){
+    capture->count = 0;
+    capture->head = 0;
+}
+
+void capture_get(const capture_t *capture, uint32_t index, battery_packet *frame){
+    uint32_t oldest = (capture->count < capture->capacity) ? 0 : capture->head;
+    uint32_t slot = (oldest + index) % capture->capacity;
+    frame->ID0 = FRAME_ID0;
+    frame->time = capture->time[slot];
+    frame->accelX = capture->axis[0][slot];
+    frame->accelY = capture->axis[1][slot];
+    frame->accelZ = capture->axis[2][slot];
+    frame->gyroX = capture->axis[3][slot];
+    frame->gyroY = capture->axis[4][slot];
+    frame->gyroZ = capture->axis[5][slot];
+    frame->battery = capture->battery[slot];
+    frame->IDfinal = FRAME_IDFINAL;
+}
+
+int64_t capture_first_time(const capture_t *capture){
+    if (capture->count == 0){
+        return 0;
+    }
+    return capture->time[(capture->count < capture->capacity) ? 0 : capture->head];
+}
+
+int capture_field_from_name(const char *name){
+    for(int i = 0; i < CAPTURE_FIELD_COUNT; i++){
+        if (strcmp(name, field_names[i]) == 0){
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char *capture_field_name(capture_field_t field){
+    return (field < CAPTURE_FIELD_COUNT) ? field_names[field] : "?";
+}
+
+/* The order of the frames does not matter for these aggregates, so every
+ * held slot is scanned front to back. The time filter is folded into the
+ * arithmetic instead of branching, which keeps the loops vectorizable.
+ */
+#define CAPTURE_SCAN_COLUMN(suffix, type)                                                           \
+static void capture_scan_##suffix(const int64_t *time, const type *values, uint32_t count,        \
+                                  int64_t from_us, int64_t to_us, capture_accumulator_t *acc){     \
+    int64_t n = 0, sum = 0, sum_squares = 0;                                                        \
+    int32_t min = INT32_MAX, max = INT32_MIN;                                                       \
+    for(uint32_t i = 0; i < count; i++){                                                            \
+        int32_t in = (time[i] >= from_us) & (time[i] <= to_us);                                     \
+        int32_t value = values[i];                                                                  \
+        n += in;                                                                                    \
+        sum += in ? value : 0;                                                                      \
+        sum_squares += in ? (int64_t)value*value : 0;                                               \
+        min = (in && (value < min)) ? value : min;                                                  \
+        max = (in && (value > max)) ? value : max;                                                  \
+    }                                                                                               \
+    acc->count = n;                                                                                 \
+    acc->sum = sum;                                                                                 \
+    acc->sum_squares = sum_squares;                                                                 \
+    acc->min = min;                                                                                 \
+    acc->max = max;                                                                                 \
+}
+
+CAPTURE_SCAN_COLUMN(int16, int16_t)
+CAPTURE_SCAN_COLUMN(uint16, uint16_t)
+
+static void capture_finish(const capture_accumulator_t *acc, capture_stats_t *stats){
+    memset(stats, 0, sizeof(*stats));
+    stats->count = acc->count;
+    if (acc->count == 0){
+        return;
+    }
+    stats->min = acc->min;
+    stats->max = acc->max;
+    stats->mean = (double)acc->sum/acc->count;
+    double variance = (double)acc->sum_squares/acc->count - stats->mean*stats->mean;
+    stats->stddev = (variance > 0) ? sqrt(variance) : 0;
+}
+
+// Times are summed relative to `base` so doubles keep microsecond precision
+static void capture_time_stats(const int64_t *time, uint32_t count, int64_t from_us, int64_t to_us, int64_t base,
+                               size_t stride, capture_stats_t *stats){
+    const uint8_t *bytes = (const uint8_t *)time;
+    double sum = 0, sum_squares = 0;
+    int64_t min = INT64_MAX, max = INT64_MIN;
+    uint32_t n = 0;
+    for(uint32_t i = 0; i < count; i++){
+        int64_t t;
+        memcpy(&t, bytes + i*stride, sizeof(t));
+        if ((t < from_us) || (t > to_us)){
+            continue;
+        }
+        double relative = (double)(t - base);
+        n++;
+        sum += relative;
+        sum_squares += relative*relative;
+        min = (t < min) ? t : min;
+        max = (t > max) ? t : max;
+    }
+    memset(stats, 0, sizeof(*stats));
+    stats->count = n;
+    if (n == 0){
+        return;
+    }
+    stats->min = (double)min;
+    stats->max = (double)max;
+    stats->mean = base + sum/n;
+    double variance = sum_squares/n - (sum/n)*(sum/n);
+    stats->stddev = (variance > 0) ? sqrt(variance) : 0;
+}
+
+void capture_query(const capture_t *capture, capture_field_t field, int64_t from_us, int64_t to_us, capture_stats_t *stats){
+    capture_accumulator_t acc;
+    if (field == CAPTURE_TIME){
+        capture_time_stats(capture->time, capture->count, from_us, to_us, capture_first_time(capture), sizeof(int64_t), stats);
+        return;
+    }
+    if (field == CAPTURE_BATTERY){
+        capture_scan_uint16(capture->time, capture->battery, capture->count, from_us, to_us, &acc);
+    }else{
+        capture_scan_int16(capture->time, capture->axis[field - CAPTURE_ACCEL_X], capture->count, from_us, to_us, &acc);
+    }
+    capture_finish(&acc, stats);
+}
+
+#define CAPTURE_SCAN_PACKED(member)                                                 \
+    for(uint32_t i = 0; i < count; i++){                                            \
+        int64_t t = frames[i].time;                                                 \
+        int32_t in = (t >= from_us) & (t <= to_us);                                 \
+        int32_t value = frames[i].member;                                           \
+        acc.count += in;                                                            \
+        acc.sum += in ? value : 0;                                                  \
+        acc.sum_squares += in ? (int64_t)value*value : 0;                           \
+        acc.min = (in && (value < acc.min)) ? value : acc.min;                      \
+        acc.max = (in && (value > acc.max)) ? value : acc.max;                      \
+    }
+
+void capture_query_packed(const battery_packet *frames, uint32_t count, capture_field_t field, int64_t from_us, int64_t to_us, capture_stats_t *stats){
+    capture_accumulator_t acc = {0, 0, 0, INT32_MAX, INT32_MIN};
+    switch (field){
+        case CAPTURE_TIME:
+            capture_time_stats((const int64_t *)((const uint8_t *)frames + offsetof(battery_packet, time)), count, from_us, to_us,
+                               (count > 0) ? frames[0].time : 0, sizeof(battery_packet), stats);
+            return;
+        case CAPTURE_ACCEL_X: CAPTURE_SCAN_PACKED(accelX) break;
+        case CAPTURE_ACCEL_Y: CAPTURE_SCAN_PACKED(accelY) break;
+        case CAPTURE_ACCEL_Z: CAPTURE_SCAN_PACKED(accelZ) break;
+        case CAPTURE_GYRO_X: CAPTURE_SCAN_PACKED(gyroX) break;
+        case CAPTURE_GYRO_Y: CAPTURE_SCAN_PACKED(gyroY) break;
+        case CAPTURE_GYRO_Z: CAPTURE_SCAN_PACKED(gyroZ) break;
+        case CAPTURE_BATTERY: CAPTURE_SCAN_PACKED(battery) break;
+        default: break;
+    }
+    capture_finish(&acc, stats);
+}
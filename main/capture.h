@@ -0,0 +1,100 @@
+/* Columnar capture of received sensor frames
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    CAPTURE_TIME,
+    CAPTURE_ACCEL_X,
+    CAPTURE_ACCEL_Y,
+    CAPTURE_ACCEL_Z,
+    CAPTURE_GYRO_X,
+    CAPTURE_GYRO_Y,
+    CAPTURE_GYRO_Z,
+    CAPTURE_BATTERY,
+    CAPTURE_FIELD_COUNT
+} capture_field_t;
+
+#define CAPTURE_AXES 6
+
+/* Frames are split into one aligned array per field as they arrive, so a
+ * scan over one field only touches that field. The arrays form a ring that
+ * keeps the newest `capacity` frames.
+ */
+typedef struct {
+    uint32_t capacity;
+    uint32_t count;         // frames held, at most capacity
+    uint32_t head;          // slot the next frame goes to
+    int64_t *time;
+    int16_t *axis[CAPTURE_AXES];   // accelX, accelY, accelZ, gyroX, gyroY, gyroZ
+    uint16_t *battery;
+} capture_t;
+
+typedef struct {
+    uint32_t count;
+    double min;
+    double max;
+    double mean;
+    double stddev;
+} capture_stats_t;
+
+/* The columns of a capture live in one block the caller provides, so a
+ * capture sized in Kconfig can come from the heap at boot instead of static
+ * DRAM. Bytes the block needs for `frames` frames, alignment slack included.
+ */
+size_t capture_storage_size(uint32_t frames);
+
+// Lay the 16-byte aligned columns of an empty capture out in `storage`
+void capture_init(capture_t *capture, void *storage, uint32_t frames);
+
+static inline void capture_append(capture_t *capture, const battery_packet *frame){
+    uint32_t slot = capture->head;
+    capture->time[slot] = frame->time;
+    capture->axis[0][slot] = frame->accelX;
+    capture->axis[1][slot] = frame->accelY;
+    capture->axis[2][slot] = frame->accelZ;
+    capture->axis[3][slot] = frame->gyroX;
+    capture->axis[4][slot] = frame->gyroY;
+    capture->axis[5][slot] = frame->gyroZ;
+    capture->battery[slot] = frame->battery;
+    capture->head = (slot + 1 == capture->capacity) ? 0 : slot + 1;
+    if (capture->count < capture->capacity){
+        capture->count++;
+    }
+}
+
+void capture_clear(capture_t *capture);
+
+// Rebuild frame `index` (0 is the oldest held) in the wire layout
+void capture_get(const capture_t *capture, uint32_t index, battery_packet *frame);
+
+// Sensor time of the oldest frame held, 0 when empty
+int64_t capture_first_time(const capture_t *capture);
+
+// Returns -1 for an unknown name; names match the battery_packet members
+int capture_field_from_name(const char *name);
+const char *capture_field_name(capture_field_t field);
+
+// count/min/max/mean/stddev of one field over frames with from_us <= time <= to_us (sensor time)
+void capture_query(const capture_t *capture, capture_field_t field, int64_t from_us, int64_t to_us, capture_stats_t *stats);
+
+// Same result computed by scanning packed frames, the reference the columnar layout is measured against
+void capture_query_packed(const battery_packet *frames, uint32_t count, capture_field_t field, int64_t from_us, int64_t to_us, capture_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
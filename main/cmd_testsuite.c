@@ -8,6 +8,7 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
 #include <string.h>
 #include <ctype.h>
@@ -15,20 +16,45 @@
 #include "esp_log.h"
 #include "esp_console.h"
 #include "esp_system.h"
+#include "esp_timer.h"
 #include "esp_sleep.h"
 #include "esp_spi_flash.h"
+#include "esp_heap_caps.h"
 #include "driver/rtc_io.h"
 #include "driver/uart.h"
 #include "linenoise/linenoise.h"
 #include "argtable3/argtable3.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "sdkconfig.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "nvs.h"
 #include "nvs_flash.h"
 #include "cmd_testsuite.h"
+#include "worker_pool.h"
+#include "trace.h"
+#include "dlog.h"
+#include "console_tcp.h"
+#include "frame.h"
+#include "capture.h"
+#include "fft.h"
+#include "soak.h"
+#include "frame_schema.h"
+#include "tuning.h"
+#include "stall.h"
+#include "session.h"
+#include "history.h"
+#include "generator.h"
+#include "bench_net.h"
+#include "rtt.h"
+#include "drift.h"
+#include "fairness.h"
+#include "result.h"
+#include "control.h"
+#include "demux.h"
+#include "sensor_info.h"
 #include "lwip/err.h"
 #include "lwip/sockets.h"
 #include "lwip/sys.h"
@@ -55,6 +81,10 @@ static const char stop_transmission[] = "{\"command\": \"stop_transmission\"}";
 
 static bool soft_ap_on = false;
 static bool streaming = false;
+static volatile bool soak_running = false;      // soak's own stop flag, "soak --stop" must not end another run
+static volatile bool generate_running = false;  // same for "generate --stop"
+static volatile bool tune_ab_running = false;   // and "tune_ab --stop"
+static volatile bool fairness_running = false;  // and "fairness --stop"
 static bool sending_on = false;
 static bool generic_buffer = false;
 static int sockfd = -1;
@@ -67,11 +97,29 @@ static void register_socket_close(void);
 static void register_connect_socket(void);
 static void register_send_system_info(void);
 static void register_receive_stream_pckt(void);
+static void register_soak(void);
+static void register_schema(void);
+static void register_tune_ab(void);
+static void register_generate(void);
+static void register_rtt(void);
+static void register_fairness(void);
 static void register_generic_receiver(void);
 static void register_stations_list(void);
 static void register_print_packets(void);
+static void capture_setup(void);
+static void register_query(void);
+static void register_spectrum(void);
+static void register_bench_dispatch(void);
+
+// Fields out of the sensor's replies, fed by every receive loop, started over by connect_to
+static sensor_parser_t sensor_parser;
+
+static void sensor_reply_done(void *ctx, const sensor_info_t *info){
+    session_sensor_update(info);
+}
 
 void register_testsuite(void){
+    capture_setup();
 	register_startap();
 	register_clear();
 	register_turn_wifi_off();
@@ -80,15 +128,35 @@ void register_testsuite(void){
     register_connect_socket();
     register_send_system_info();
     register_receive_stream_pckt();
+    register_soak();
+    register_schema();
+    register_tuning();
+    register_tune_ab();
+    register_generate();
+    register_bench_net();
+    register_rtt();
+    register_fairness();
+    register_stall();
+    register_session();
+    register_history();
     register_generic_receiver();
 	register_stations_list();
     register_print_packets();
+    register_query();
+    register_spectrum();
+    register_bench_dispatch();
+    register_trace();
+    register_dlog();
+    register_console_tcp();
+    register_results();
+    register_control();
 }
 
 
 static void wifi_event_handler(void* arg, esp_event_base_t event_base,
                                     int32_t event_id, void* event_data)
 {
+    TRACE_EVENT(TRACE_WIFI, event_id);
     if (event_id == WIFI_EVENT_AP_STACONNECTED) {
         wifi_event_ap_staconnected_t* event = (wifi_event_ap_staconnected_t*) event_data;
         ESP_LOGI(TAG, "station "MACSTR" join, AID=%d",
@@ -185,6 +253,10 @@ static int turn_wifi_off(int argc, char **argv){
     
     sockfd = -1;
     streaming = false;
+    soak_running = false;
+    generate_running = false;
+    tune_ab_running = false;
+    fairness_running = false;
     generic_buffer = false;
     ESP_LOGW(TAG, "Shutting down socket");
     shutdown(sockfd, 0);
@@ -290,11 +362,14 @@ static int connect_socket(int argc, char **argv){
     dest_addr.sin_family = AF_INET;
     dest_addr.sin_addr.s_addr = inet_addr(connect_args.ip->sval[0]);
     dest_addr.sin_port = htons(8001);
+    // streams started with --reconnect come back here after a drop
+    session_set_peer(&dest_addr);
+    sensor_parser_init(&sensor_parser,sensor_reply_done,NULL);
 
-    
     if (connect(sockfd, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) != 0) {
         ESP_LOGE(TAG,"Connection with the server failed: error = %s\n",strerror(errno));
         if (errno == 128){
+            close(sockfd);
             sockfd = -1;    
         }
         return ESP_OK;
@@ -331,53 +406,59 @@ static void task_send_system_info(void *pvParameters){
     switch (system_info_args.message->ival[0]){
         case info:
             err = send(sockfd,&system_info_command,sizeof(system_info_command),0);
+            TRACE_EVENT(TRACE_SEND, err);
             if (err < 0){
                 ESP_LOGE(TAG,"System info JSON not sent!! Error: %s",strerror(errno));
                 sending_on = false;
-                vTaskDelete(NULL);
+                return;
             }else{
                 ESP_LOGI(TAG,"System info JSON sent!!");
             }
         break;
         case restart:
             err = send(sockfd,&restart_command,sizeof(restart_command),0);
+            TRACE_EVENT(TRACE_SEND, err);
             if (err < 0){
                 ESP_LOGE(TAG,"Restart command JSON not sent!! Error: %s",strerror(errno));
                 sending_on = false;
-                vTaskDelete(NULL);
+                return;
             }else{
                 ESP_LOGI(TAG,"Restart command JSON sent!!");
             }
         break;
         case reset:
             err = send(sockfd,&reset_command,sizeof(reset_command),0);
+            TRACE_EVENT(TRACE_SEND, err);
             if (err < 0){
                 ESP_LOGE(TAG,"Reset command JSON not sent!! Error: %s",strerror(errno));
                 sending_on = false;
-                vTaskDelete(NULL);
+                return;
             }else{
                 ESP_LOGI(TAG,"Reset command JSON sent!!");
             }
         break;
         case stop:
             err = send(sockfd,&stop_command,sizeof(stop_command),0);
+            TRACE_EVENT(TRACE_SEND, err);
             if (err < 0){
                 ESP_LOGE(TAG,"Stop command JSON not sent!! Error: %s",strerror(errno));
                 sending_on = false;
-                vTaskDelete(NULL);
+                return;
             }else{
                 ESP_LOGI(TAG,"Stop command JSON sent!!");
                 streaming = false;
+                soak_running = false;
+                generate_running = false;
+                tune_ab_running = false;
+                fairness_running = false;
             }
         break;
         default:
             ESP_LOGE(TAG,"INVALID CHOICE!!!");
             sending_on = false;
-            vTaskDelete(NULL);
+            return;
     }
     sending_on = false;
-    vTaskDelete(NULL);
-
 }
 
 static int send_system_info(int argc, char **argv){
@@ -395,8 +476,10 @@ static int send_system_info(int argc, char **argv){
     }
 
     if(!sending_on){
-        xTaskCreatePinnedToCore(task_send_system_info, "socket send system info", 8096,NULL, 6, NULL,1);
         sending_on = true;
+        if (worker_submit("socket send system info", task_send_system_info, NULL) != ESP_OK){
+            sending_on = false;
+        }
     }
 
     return ESP_OK;
@@ -415,23 +498,11 @@ static void register_send_system_info(void){
     ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
 }
 
-typedef struct{
-    uint8_t ID0;
-    int64_t time;
-    int16_t accelX;
-    int16_t accelY;
-    int16_t accelZ;
-    int16_t gyroX;
-    int16_t gyroY;
-    int16_t gyroZ;
-    uint16_t battery;
-    uint8_t IDfinal;
-}__attribute__((__packed__)) battery_packet;
-
 static struct {
     struct arg_int *sensor_frequency;
     struct arg_int *number_of_pckts;
     struct arg_int *rounds;
+    struct arg_lit *reconnect;
     struct arg_end *end;
 } packet_stream_args;
 
@@ -523,84 +594,401 @@ static struct {
     vTaskDelete(NULL);
 }*/
 
-static battery_packet last_iteration[150] = {0,};
+/* The capture is the largest buffer of the suite: it comes from the heap
+ * once at boot rather than from static DRAM, which WiFi and lwIP need
+ */
+static capture_t capture;
+
+static void capture_setup(void){
+    void *storage = heap_caps_malloc(capture_storage_size(CONFIG_TESTSUITE_CAPTURE_FRAMES),MALLOC_CAP_8BIT);
+    if (storage == NULL){
+        ESP_LOGE(TAG,"No memory for a %d frame capture, lower CONFIG_TESTSUITE_CAPTURE_FRAMES",CONFIG_TESTSUITE_CAPTURE_FRAMES);
+        ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+    }
+    capture_init(&capture,storage,CONFIG_TESTSUITE_CAPTURE_FRAMES);
+}
+
+/* Receive buffers live here instead of on the worker stack, reserved once at boot */
+static uint8_t stream_rx_buffer[TUNING_MAX_READ + FRAME_SCHEMA_MAX_SIZE];
+static uint8_t stream_frames[150*sizeof(battery_packet)];
+
+// Layout of the frames the sensor sends, see the "schema" command
+static frame_schema_t active_schema;
+static uint8_t generic_rx_buffer[4096];
+
+static stall_t stream_stall;
+static stall_t generic_stall;
+static history_run_t stream_run;
+static drift_t stream_drift;
+
+/* End offset and arrival time of each read that went into the current
+ * block, so a frame is stamped with the read that completed it rather than
+ * the end of the block. Past the last entry reads are merged into it, which
+ * only ever stamps a frame late.
+ */
+#define STREAM_READ_LOG 64
+static struct {
+    size_t end;
+    int64_t at_us;
+} stream_reads[STREAM_READ_LOG];
+
+/* Replies the sensor sends on the stream socket (to socket_send) reach the
+ * console whole, whichever receive loop is running, and their fields reach
+ * the session as they are read
+ */
+static struct {
+    char text[256];
+    size_t len;
+} sensor_reply;
+
+static void sensor_reply_part(void *ctx, const char *text, size_t len, demux_json_part_t part){
+    if (part == DEMUX_JSON_ABORT){
+        sensor_reply.len = 0;
+        sensor_parser_abort(&sensor_parser);
+        return;
+    }
+    sensor_parser_feed(&sensor_parser,text,len);
+    size_t room = sizeof(sensor_reply.text) - sensor_reply.len;
+    len = (len < room) ? len : room;
+    memcpy(sensor_reply.text + sensor_reply.len,text,len);
+    sensor_reply.len += len;
+    if (part == DEMUX_JSON_END){
+        dlog_write_text(ESP_LOG_INFO,TAG,sensor_reply.text,sensor_reply.len);
+        sensor_reply.len = 0;
+    }
+}
+
+static demux_t stream_demux;
+
+// Decoding state of recv_sensor, carried from one block to the next
+static struct {
+    int64_t nominal_us;
+    int64_t last_frame_time;
+    int16_t tempo_anterior;
+    bool reconnected;
+    uint32_t reads;             // entries of stream_reads for the block being decoded
+    uint32_t read;
+    // this block
+    uint32_t slots;
+    uint32_t valid;
+    uint32_t corrupted;
+    uint32_t crc_failed;
+    float freq_sum;
+} stream_rx;
+
+static void stream_frame(void *ctx, frame_status_t status, const battery_packet *frame, size_t end){
+    stream_rx.slots++;
+    if (status != FRAME_OK){
+        stream_rx.corrupted += (status == FRAME_BAD_MARKER);
+        stream_rx.crc_failed += (status == FRAME_BAD_CRC);
+        stream_run.record.corrupted += (status == FRAME_BAD_MARKER);
+        stream_run.record.crc_failed += (status == FRAME_BAD_CRC);
+        return;
+    }
+    capture_append(&capture,frame);
+    stream_rx.valid++;
+    for(; (stream_rx.read + 1 < stream_rx.reads) && (stream_reads[stream_rx.read].end < end); stream_rx.read++);
+    drift_add(&stream_drift,frame->time,stream_reads[stream_rx.read].at_us);
+    if (stream_rx.last_frame_time >= 0){
+        int64_t interval = frame->time - stream_rx.last_frame_time;
+        int64_t nominal_us = stream_rx.nominal_us;
+        int64_t deviation = (interval > nominal_us) ? interval - nominal_us : nominal_us - interval;
+        history_jitter_sample(&stream_run,(deviation > UINT32_MAX) ? UINT32_MAX : (uint32_t)deviation);
+        if (2*interval > 3*nominal_us){
+            stream_run.record.gaps++;
+            stream_run.record.lost += (interval + nominal_us/2)/nominal_us - 1;
+        }
+    }
+    stream_rx.last_frame_time = frame->time;
+    if (stream_rx.reconnected){
+        session_resumed(frame->time);
+        stream_rx.reconnected = false;
+    }
+
+    int16_t tempo_atual = frame->time - stream_rx.tempo_anterior;
+    stream_rx.freq_sum += (1/(float)tempo_atual)*pow(10,6);
+    stream_rx.tempo_anterior = frame->time;
+}
+
+/* Route the `filled` bytes of a block through the demultiplexer. The partial
+ * frame at its end moves to the front, returns its size.
+ */
+static size_t stream_feed(uint8_t *data, size_t filled, uint32_t reads){
+    stream_rx.reads = reads;
+    stream_rx.read = 0;
+    size_t used = demux_feed(&stream_demux,data,filled);
+    memmove(data,data + used,filled - used);
+    return filled - used;
+}
+
+/* Replace a dropped sensor connection and start the stream again at the
+ * same frequency. Returns 0 once the start command went out.
+ */
+static int stream_reconnect(stall_t *stall, const char *start_command, size_t size, int64_t last_sensor_time,
+                            const volatile bool *running){
+    if (session_reconnect(&sockfd,running,last_sensor_time) != 0){
+        return -1;
+    }
+    tuning_apply_socket(tuning_active(),sockfd);
+    int err = send(sockfd,start_command,size,0);
+    TRACE_EVENT(TRACE_SEND, err);
+    if (err < 0){
+        DLOGE(TAG,"Start command not sent after reconnecting");
+        return -1;
+    }
+    stall_arm(stall,esp_timer_get_time());
+    return 0;
+}
+
+// Sensor clock against the AP clock, for the record of a round or a run
+static void run_drift(result_run_t *summary, const drift_t *drift){
+    drift_estimate_t estimate;
+    drift_estimate(drift,&estimate);
+    summary->drift_ppm = (estimate.windows >= 2) ? estimate.envelope_ppm : estimate.drift_ppm;
+    summary->offset_ms = estimate.offset_ms;
+    summary->residual_us = estimate.residual_us;
+}
+
+/* Summary and jitter histogram of a finished run for the result channel,
+ * from the record history_save() completed. `drift` is NULL when the clock
+ * fit does not span the run.
+ */
+static void run_result(result_command_t command, const history_run_t *run, const drift_t *drift, uint16_t flags){
+    const history_record_t *record = &run->record;
+    result_run_t summary = {
+        .command = command,
+        .rounds = record->rounds,
+        .flags = flags,
+        .frequency = record->frequency,
+        .duration_ms = record->duration_ms,
+        .frames = record->frames,
+        .corrupted = record->corrupted,
+        .crc_failed = record->crc_failed,
+        .gaps = record->gaps,
+        .lost = record->lost,
+        .stalls = record->stalls,
+        .reconnects = record->reconnects,
+        .rate_hz = record->rate_hz,
+        .jitter_p50 = record->jitter_p50,
+        .jitter_p99 = record->jitter_p99,
+        .jitter_max = record->jitter_max,
+        .cpu_pct = record->cpu_valid ? record->cpu_pct : 0,
+        .run_id = record->id,
+    };
+    if (drift != NULL){
+        run_drift(&summary,drift);
+    }
+    result_run(&summary);
+    result_histogram(command,RESULT_HISTOGRAM_JITTER,RESULT_BUCKETS_SOAK,0,run->jitter,SOAK_JITTER_BUCKETS);
+}
+
+static void stream_run_save(uint16_t flags){
+    stream_run.record.stalls = stream_stall.events;
+    stream_run.record.reconnects = session_stats()->reconnects;
+    history_save(&stream_run);
+    run_result(RESULT_CMD_RECV_SENSOR,&stream_run,NULL,flags);
+}
+
+// The numbers of the "Frequencia Media" and clock lines of one round
+static void stream_round_result(int round, int rounds, int frequency, int64_t start_us, uint64_t frames,
+                                uint64_t corrupted, uint64_t crc_failed, float rate_hz, uint16_t flags){
+    result_run_t summary = {
+        .command = RESULT_CMD_RECV_SENSOR,
+        .round = round,
+        .rounds = rounds,
+        .flags = flags,
+        .frequency = frequency,
+        .duration_ms = (uint32_t)((esp_timer_get_time() - start_us)/1000),
+        .frames = frames,
+        .corrupted = corrupted,
+        .crc_failed = crc_failed,
+        .rate_hz = rate_hz,
+    };
+    run_drift(&summary,&stream_drift);
+    result_run(&summary);
+}
 
 static void task_stream_pckts(void *pvParameters){
     uint16_t limit_of_packets = (uint16_t)packet_stream_args.number_of_pckts->ival[0];
     int sensor_frequency = packet_stream_args.sensor_frequency->ival[0];
     int rounds = packet_stream_args.rounds->ival[0];
 
-    int16_t tempo_anterior = 0;
-    int16_t tempo_atual = 0;
     unsigned long long int corrompido = 0;
+    unsigned long long int crc_failed = 0;
     unsigned long long int total_pacotes = 0;
-    float frequencia = 0;
 
     char init_transmission[100] = {0,};
     sprintf(init_transmission,"%s%d%s",init_transmissionBEGIN,sensor_frequency,init_transmissionEND);
-    uint8_t packet[75*sizeof(battery_packet)];
-    battery_packet data[150] = {0,};
+    uint8_t *data = stream_frames;
+    const uint32_t frames_per_block = sizeof(stream_frames)/active_schema.size;
+    const size_t block_bytes = frames_per_block*active_schema.size;
+    const tuning_profile_t *profile = tuning_active();
+    UBaseType_t previous_priority = tuning_apply_priority(profile);
+    tuning_apply_socket(profile,sockfd);
 
     int err;
 
     float media_freq = 0;
-    
-    for(int j = 0; j < rounds;j++){
 
-        tempo_atual = 0;
-        tempo_anterior = 0;
+    memset(stream_frames,0,sizeof(stream_frames));
+    capture_clear(&capture);
+    stall_init(&stream_stall,sensor_frequency);
+    bool socket_dead = false;
+    bool reconnect = (packet_stream_args.reconnect->count > 0);
+    memset(&stream_rx,0,sizeof(stream_rx));
+    stream_rx.nominal_us = 1000000/sensor_frequency;
+    demux_init(&stream_demux,&active_schema,stream_frame,sensor_reply_part,NULL);
+    size_t held = 0;
+    session_reset();
+    history_begin(&stream_run,HISTORY_RECV_SENSOR,sensor_frequency,active_schema.name);
+    stream_run.record.rounds = rounds;
+    char stall_line[256];
+    uint16_t run_flags = 0;
+    for(int j = 0; (j < rounds) && !socket_dead && streaming;j++){
+        int64_t round_start = esp_timer_get_time();
+        uint16_t round_flags = 0;
+        // the sensor restarts its stream, the first interval of a round means nothing
+        stream_rx.last_frame_time = -1;
+        drift_init(&stream_drift,DRIFT_WINDOW_US);
+        demux_reset(&stream_demux);
+        held = 0;
+
+        stream_rx.tempo_anterior = 0;
         corrompido = 0;
+        crc_failed = 0;
         total_pacotes = 0;
-        frequencia = 0;
         media_freq = 0;
 
         err = send(sockfd,&init_transmission,sizeof(init_transmission),0);//MSG_DONTWAIT);
+        TRACE_EVENT(TRACE_SEND, err);
         if (err < 0){
-            ESP_LOGE(TAG,"NAO ENVIADO\n");
+            DLOGE(TAG,"NAO ENVIADO\n");
+        }
+        stall_arm(&stream_stall,esp_timer_get_time());
+        if (j == 0){
+            DLOGD(TAG,"Command to first recv: %lld us",esp_timer_get_time() - worker_submitted_at());
         }
         for(int i = 0; i < limit_of_packets;i = i + 150){
         
-            total_pacotes += 150;
             if(!streaming){
-                ESP_LOGI(TAG,"(%d/%d)Frequencia Media(%lld pacotes) = %f Hz (esperado: %dHz)\n",j+1,rounds,total_pacotes,media_freq/total_pacotes,sensor_frequency);
-                ESP_LOGW(TAG,"Number of corrupted packets: %llu\n",corrompido);
-                vTaskDelete(NULL);
+                DLOGI(TAG,"(%d/%d)Frequencia Media(%lld pacotes) = %f Hz (esperado: %dHz)\n",j+1,rounds,total_pacotes,media_freq/total_pacotes,sensor_frequency);
+                DLOGW(TAG,"Number of corrupted packets: %llu\n",corrompido);
+                if (active_schema.crc != FRAME_CRC_NONE){
+                    DLOGW(TAG,"CRC failures: %llu (%.4f%% of frames)",crc_failed,100.0*crc_failed/(total_pacotes ? total_pacotes : 1));
+                }
+                stream_round_result(j+1,rounds,sensor_frequency,round_start,total_pacotes,corrompido,crc_failed,
+                                    media_freq/total_pacotes,RESULT_RUN_STOPPED);
+                stream_run_save(run_flags | RESULT_RUN_STOPPED);
+                vTaskPrioritySet(NULL,previous_priority);
+                return;
+            }
+            // fill a whole block in reads of the profile's size, however the stream is segmented
+            size_t filled = held;
+            uint32_t reads = 0;
+            stream_rx.slots = 0;
+            stream_rx.valid = 0;
+            stream_rx.corrupted = 0;
+            stream_rx.crc_failed = 0;
+            stream_rx.freq_sum = 0;
+            bool waiting = false;
+            int64_t block_start = esp_timer_get_time();
+            while (filled < block_bytes){
+                size_t want = block_bytes - filled;
+                want = (want < profile->read_size) ? want : profile->read_size;
+                TRACE_EVENT(TRACE_RECV_START, want);
+                err = stall_recv(&stream_stall,sockfd,data + filled,want,&streaming);
+                TRACE_EVENT(TRACE_RECV_END, err);
+                if (err > 0){
+                    filled += err;
+                    reads += (reads < STREAM_READ_LOG);
+                    stream_reads[reads - 1].end = filled;
+                    stream_reads[reads - 1].at_us = esp_timer_get_time();
+                    if (waiting){
+                        DLOGI(TAG,"(%d/%d) Stream back after %.1f ms",j+1,rounds,stream_stall.last_silence_us/1000.0);
+                        waiting = false;
+                    }
+                }else if ((err == STALL_DETECTED) && (stream_stall.config.policy == STALL_RESUME)){
+                    DLOGW(TAG,"(%d/%d) Stall: no data for %.1f ms, waiting",j+1,rounds,stream_stall.last_detect_us/1000.0);
+                    waiting = true;
+                }else if (reconnect && (err != STALL_STOPPED)){
+                    DLOGW(TAG,"(%d/%d) Link lost (%d), reconnecting",j+1,rounds,err);
+                    if (stream_reconnect(&stream_stall,init_transmission,sizeof(init_transmission),stream_rx.last_frame_time,&streaming) != 0){
+                        err = streaming ? -1 : STALL_STOPPED;
+                        break;
+                    }
+                    // frames completed before the drop still count, the partial one never completes
+                    stream_feed(data,filled,reads);
+                    demux_reset(&stream_demux);
+                    filled = 0;
+                    reads = 0;
+                    waiting = false;
+                    stream_rx.reconnected = true;
+                    stream_rx.last_frame_time = -1;
+                }else{
+                    break;
+                }
             }
-            for(int metade = 0; metade <=75; metade = metade + 75){
-                err = recv(sockfd,packet,sizeof(packet),0);
-                memcpy(data+metade,packet,sizeof(packet));
+            if (err == STALL_STOPPED){
+                // reported by the check at the top of the loop
+                continue;
             }
-            if (err < 0){
-                ESP_LOGE(TAG,"error no socket\n");
+            if ((err == STALL_DETECTED) || (err == STALL_GAVE_UP)){
+                DLOGE(TAG,"(%d/%d) Stall: no data for %.1f ms, round aborted",j+1,rounds,
+                      (esp_timer_get_time() - stream_stall.last_rx_us)/1000.0);
+                result_error(RESULT_CMD_RECV_SENSOR,err,"stall, round aborted");
+                stall_abort(&stream_stall);
+                round_flags |= RESULT_RUN_FAILED;
                 break;
             }
-
-            for (int k = 0; k < (sizeof(data)/sizeof(battery_packet)); k++){
-                
-                // ESP_LOGI(TAG,"time[%d] %lld",k,data[k].time);
-
-                if ((data[k].ID0 != 0) || (data[k].IDfinal != 255)){
-                    corrompido++;
-                    continue;
-                }
-
-                tempo_atual = data[k].time - tempo_anterior;
-                frequencia = (1/(float)tempo_atual)*pow(10,6);
-                tempo_anterior = data[k].time;
-                media_freq += frequencia;
+            if (err <= 0){
+                DLOGE(TAG,"error no socket\n");
+                result_error(RESULT_CMD_RECV_SENSOR,errno,"socket error");
+                socket_dead = true;
+                round_flags |= RESULT_RUN_FAILED;
+                break;
             }
+
+            held = stream_feed(data,filled,reads);
+            uint32_t valid = stream_rx.valid;
+            total_pacotes += stream_rx.slots;
+            corrompido += stream_rx.corrupted;
+            crc_failed += stream_rx.crc_failed;
+            media_freq += stream_rx.freq_sum;
+            TRACE_EVENT(TRACE_DECODE, stream_rx.slots);
+            stream_run.record.frames += valid;
+            history_rate_sample(&stream_run,valid*1e6/(esp_timer_get_time() - block_start));
         }
         err = send(sockfd,&stop_transmission,sizeof(stop_transmission),0);//MSG_DONTWAIT);
+        TRACE_EVENT(TRACE_SEND, err);
         if (err < 0){ 
-            ESP_LOGE(TAG,"NAO ENVIADO\n");
+            DLOGE(TAG,"NAO ENVIADO\n");
         }
-        ESP_LOGI(TAG,"(%d/%d)Frequencia Media(%lld pacotes) = %f Hz (esperado: %dHz)\n",j+1,rounds,total_pacotes,media_freq/total_pacotes,sensor_frequency);
-        ESP_LOGW(TAG,"Number of corrupted packets: %llu\n",corrompido);
+        DLOGI(TAG,"(%d/%d)Frequencia Media(%lld pacotes) = %f Hz (esperado: %dHz)\n",j+1,rounds,total_pacotes,media_freq/total_pacotes,sensor_frequency);
+        DLOGW(TAG,"Number of corrupted packets: %llu\n",corrompido);
+        if (active_schema.crc != FRAME_CRC_NONE){
+            DLOGW(TAG,"CRC failures: %llu (%.4f%% of frames)",crc_failed,100.0*crc_failed/(total_pacotes ? total_pacotes : 1));
+        }
+        stream_round_result(j+1,rounds,sensor_frequency,round_start,total_pacotes,corrompido,crc_failed,
+                            media_freq/total_pacotes,round_flags);
+        run_flags |= round_flags;
+        int len = stall_format(&stream_stall,stall_line,sizeof(stall_line));
+        dlog_write_text(stream_stall.events ? ESP_LOG_WARN : ESP_LOG_INFO,TAG,stall_line,
+                        (len < sizeof(stall_line)) ? len : sizeof(stall_line) - 1);
+        if (reconnect){
+            len = session_format(stall_line,sizeof(stall_line));
+            dlog_write_text(ESP_LOG_INFO,TAG,stall_line,(len < sizeof(stall_line)) ? len : sizeof(stall_line) - 1);
+        }
+        len = snprintf(stall_line,sizeof(stall_line),"(%d/%d) ",j+1,rounds);
+        len += drift_format(&stream_drift,stall_line + len,sizeof(stall_line) - len);
+        dlog_write_text(ESP_LOG_INFO,TAG,stall_line,(len < sizeof(stall_line)) ? len : sizeof(stall_line) - 1);
+        len = demux_format(&stream_demux,stall_line,sizeof(stall_line));
+        dlog_write_text(stream_demux.stats.corrupted ? ESP_LOG_WARN : ESP_LOG_INFO,TAG,stall_line,
+                        (len < sizeof(stall_line)) ? len : sizeof(stall_line) - 1);
         vTaskDelay(1000/portTICK_PERIOD_MS);
     }
-    memcpy(last_iteration,data,sizeof(data));
+    stream_run_save(run_flags | (streaming ? 0 : RESULT_RUN_STOPPED));
+    vTaskPrioritySet(NULL,previous_priority);
     streaming = false;
-    vTaskDelete(NULL);
 }
 
 
@@ -614,25 +1002,33 @@ static int receive_stream_pckt(int argc, char **argv){
         }
         if ((packet_stream_args.sensor_frequency->ival[0] < 1) || (packet_stream_args.sensor_frequency->ival[0] > 4000)){
             ESP_LOGE(TAG,"Invalid frequency!!");
+            result_error(RESULT_CMD_RECV_SENSOR,ESP_ERR_INVALID_ARG,"invalid frequency");
             return ESP_OK;
         }
         if ((packet_stream_args.number_of_pckts->ival[0] <= 0) || (packet_stream_args.number_of_pckts->ival[0] > 60000)){
             ESP_LOGE(TAG,"Invalid number of packets!!");
+            result_error(RESULT_CMD_RECV_SENSOR,ESP_ERR_INVALID_ARG,"invalid number of packets");
             return ESP_OK;
         }
         if ((packet_stream_args.rounds->ival[0] <= 0) || (packet_stream_args.rounds->ival[0] > 10)){
             ESP_LOGE(TAG,"\"%d\" is an Invalid number of rounds!!",packet_stream_args.rounds->ival[0]);
+            result_error(RESULT_CMD_RECV_SENSOR,ESP_ERR_INVALID_ARG,"invalid number of rounds");
             return ESP_OK;
         }
-        ESP_LOGI(TAG,"Starting receiving stream of packets\n");
-        xTaskCreatePinnedToCore(task_stream_pckts, "socket_streaming_recv", 10240,NULL, 6, NULL,1);
+        ESP_LOGI(TAG,"Starting receiving stream of packets (profile %s)\n",tuning_active()->name);
         streaming = true;
+        if (worker_submit_on("socket_streaming_recv", task_stream_pckts, NULL, tuning_active()->core) != ESP_OK){
+            streaming = false;
+            result_error(RESULT_CMD_RECV_SENSOR,ESP_ERR_NO_MEM,"no idle worker");
+        }
         return ESP_OK;
     }
     if ((streaming) || (generic_buffer)){
         ESP_LOGW(TAG,"Stream still ongoing!!");
+        result_error(RESULT_CMD_RECV_SENSOR,ESP_ERR_INVALID_STATE,"stream still ongoing");
     }else{
         ESP_LOGE(TAG,"Socket is not open!!");
+        result_error(RESULT_CMD_RECV_SENSOR,ESP_ERR_INVALID_STATE,"socket is not open");
     }
     return ESP_OK;
 }
@@ -641,6 +1037,7 @@ static void register_receive_stream_pckt(void){
     packet_stream_args.sensor_frequency = arg_int1("f","frequency","<int>","sensor's transmission frequency");
     packet_stream_args.number_of_pckts = arg_int1("c", "count", "<int>", "number of packets to receive");
     packet_stream_args.rounds = arg_int1("r","rounds","<int>","number of sequential transmissions of \'c\' packets");
+    packet_stream_args.reconnect = arg_lit0("R","reconnect","reconnect and restart the sensor when the link drops");
     packet_stream_args.end = arg_end(0);
     const esp_console_cmd_t cmd = {
         .command = "recv_sensor",
@@ -652,102 +1049,2074 @@ static void register_receive_stream_pckt(void){
     ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
 }
 
-static void task_generic_receiver(void *pvParameters){
-    uint8_t packet[1024] = {0,};
-    int err;
-    while(true){
-        err = recv(sockfd,packet,sizeof(packet),0);
-        if (err < 0){
-            ESP_LOGE(TAG,"error no socket: %s",strerror(errno));
-            generic_buffer = false;
+static struct {
+    struct arg_int *sensor_frequency;
+    struct arg_int *min_rate;
+    struct arg_int *max_jitter;
+    struct arg_int *max_corrupt;
+    struct arg_int *max_gaps;
+    struct arg_lit *every_second;
+    struct arg_lit *stop;
+    struct arg_lit *reconnect;
+    struct arg_end *end;
+} soak_args;
+
+static soak_t soak_state;
+static stall_t soak_stall;
+static history_run_t soak_run;
+static drift_t soak_drift;
+static bool soak_every_second = false;
+static demux_t soak_demux;
+
+// What a soak frame needs besides the frame
+static struct {
+    int64_t arrival;            // of the read that completed the frame
+    bool reconnected;
+} soak_rx;
+
+static void soak_frame_sink(void *ctx, frame_status_t status, const battery_packet *frame, size_t end){
+    if (status == FRAME_BAD_MARKER){
+        soak_corrupt(&soak_state);
+        return;
+    }
+    if (status == FRAME_BAD_CRC){
+        soak_crc_failed(&soak_state);
+        return;
+    }
+    soak_frame(&soak_state,frame->time);
+    drift_add(&soak_drift,frame->time,soak_rx.arrival);
+    capture_append(&capture,frame);
+    if (soak_rx.reconnected){
+        session_resumed(frame->time);
+        soak_rx.reconnected = false;
+    }
+}
+
+static void soak_report(uint32_t windows){
+    char line[160];
+    const uint32_t order[] = {SOAK_WINDOW_1S, SOAK_WINDOW_10S, SOAK_WINDOW_60S};
+    for(int i = 0; i < 3; i++){
+        if (!(windows & order[i]) || ((order[i] == SOAK_WINDOW_1S) && !soak_every_second)){
+            continue;
+        }
+        int len = soak_format(&soak_state,order[i],line,sizeof(line));
+        dlog_write_text(soak_state.alarms ? ESP_LOG_WARN : ESP_LOG_INFO,TAG,line,(len < sizeof(line)) ? len : sizeof(line) - 1);
+    }
+    if (soak_state.raised){
+        int len = snprintf(line,sizeof(line),"soak ALARM at t=%us: ",soak_state.seconds);
+        len += soak_format_alarms(soak_state.raised,line + len,sizeof(line) - len);
+        dlog_write_text(ESP_LOG_ERROR,TAG,line,(len < sizeof(line)) ? len : sizeof(line) - 1);
+    }
+    if (soak_state.cleared){
+        int len = snprintf(line,sizeof(line),"soak alarm cleared at t=%us: ",soak_state.seconds);
+        len += soak_format_alarms(soak_state.cleared,line + len,sizeof(line) - len);
+        dlog_write_text(ESP_LOG_INFO,TAG,line,(len < sizeof(line)) ? len : sizeof(line) - 1);
+    }
+}
+
+/* Streams until "soak --stop". Everything lives in static buffers and the
+ * rolling windows are fixed rings, so memory use does not grow with the
+ * length of the run. Frames are reassembled across recv() boundaries.
+ */
+static void task_soak(void *pvParameters){
+    int sensor_frequency = soak_args.sensor_frequency->ival[0];
+    char init_transmission[100] = {0,};
+    sprintf(init_transmission,"%s%d%s",init_transmissionBEGIN,sensor_frequency,init_transmissionEND);
+
+    const tuning_profile_t *profile = tuning_active();
+    tuning_apply_socket(profile,sockfd);
+
+    int err = send(sockfd,&init_transmission,sizeof(init_transmission),0);
+    TRACE_EVENT(TRACE_SEND, err);
+    if (err < 0){
+        DLOGE(TAG,"soak: start command not sent");
+        result_error(RESULT_CMD_SOAK,errno,"start command not sent");
+        soak_running = false;
+        streaming = false;
+        return;
+    }
+    UBaseType_t previous_priority = tuning_apply_priority(profile);
+    capture_clear(&capture);
+    stall_init(&soak_stall,sensor_frequency);
+    stall_arm(&soak_stall,esp_timer_get_time());
+    bool waiting = false;
+    bool reconnect = (soak_args.reconnect->count > 0);
+    soak_rx.reconnected = false;
+    demux_init(&soak_demux,&active_schema,soak_frame_sink,sensor_reply_part,NULL);
+    session_reset();
+    history_begin(&soak_run,HISTORY_SOAK,sensor_frequency,active_schema.name);
+    soak_run.record.rounds = 1;
+    drift_init(&soak_drift,DRIFT_WINDOW_US);
+    uint32_t sampled = 0;
+    size_t held = 0;
+    while (soak_running){
+        // a partial frame is never more than FRAME_SCHEMA_MAX_SIZE bytes, so a full read always fits
+        TRACE_EVENT(TRACE_RECV_START, profile->read_size);
+        err = stall_recv(&soak_stall,sockfd,stream_rx_buffer + held,profile->read_size,&soak_running);
+        TRACE_EVENT(TRACE_RECV_END, err);
+        if (err == STALL_STOPPED){
             break;
         }
-        if(!generic_buffer){
-            ESP_LOGW(TAG,"generic_receiver is being closed");
-            vTaskDelete(NULL);
+        if ((err == STALL_DETECTED) && (soak_stall.config.policy == STALL_RESUME)){
+            DLOGW(TAG,"soak: stall at t=%us, no data for %.1f ms, waiting",soak_state.seconds,soak_stall.last_detect_us/1000.0);
+            waiting = true;
+            continue;
+        }
+        if (err <= 0){
+            if ((err == STALL_DETECTED) || (err == STALL_GAVE_UP)){
+                DLOGE(TAG,"soak: stall at t=%us, no data for %.1f ms",soak_state.seconds,
+                      (esp_timer_get_time() - soak_stall.last_rx_us)/1000.0);
+                stall_abort(&soak_stall);
+                result_error(RESULT_CMD_SOAK,err,"stall");
+            }else{
+                DLOGE(TAG,"soak: socket error or closed (%d) after %u s",err,soak_state.seconds);
+                result_error(RESULT_CMD_SOAK,(err < 0) ? errno : 0,"socket error or closed");
+            }
+            if (reconnect && (stream_reconnect(&soak_stall,init_transmission,sizeof(init_transmission),soak_state.last_time,&soak_running) == 0)){
+                // a partial frame from the old connection never completes
+                soak_reconnect(&soak_state);
+                demux_reset(&soak_demux);
+                held = 0;
+                waiting = false;
+                soak_rx.reconnected = true;
+                continue;
+            }
+            break;
+        }
+        if (waiting){
+            DLOGI(TAG,"soak: stream back after %.1f ms",soak_stall.last_silence_us/1000.0);
+            waiting = false;
+        }
+        held += err;
+        // every frame this read completes arrived with it
+        soak_rx.arrival = esp_timer_get_time();
+        size_t used = demux_feed(&soak_demux,stream_rx_buffer,held);
+        held -= used;
+        memmove(stream_rx_buffer,stream_rx_buffer + used,held);
+        TRACE_EVENT(TRACE_DECODE, used/active_schema.size);
+
+        uint32_t windows = soak_tick(&soak_state,esp_timer_get_time());
+        if (windows){
+            soak_report(windows);
+        }
+        // every completed second is one throughput sample of the run
+        if (soak_state.seconds - sampled > SOAK_HISTORY_SECONDS){
+            sampled = soak_state.seconds - SOAK_HISTORY_SECONDS;
+        }
+        for(; sampled < soak_state.seconds; sampled++){
+            history_rate_sample(&soak_run,soak_state.history[sampled % SOAK_HISTORY_SECONDS].frames);
         }
-        ESP_LOGW(TAG,"%s\n",packet);
     }
-    ESP_LOGE(TAG,"Receiver is being closed!!");
-    vTaskDelete(NULL);
+    // only an error leaves the loop with the stream still wanted
+    bool failed = soak_running;
+    err = send(sockfd,&stop_transmission,sizeof(stop_transmission),0);
+    TRACE_EVENT(TRACE_SEND, err);
+    DLOGI(TAG,"soak finished after %u s: %llu frames, %llu corrupted, %llu CRC failures, %llu gaps (%llu frames lost)",
+          soak_state.seconds,soak_state.total_frames,soak_state.total_corrupted,soak_state.total_crc_failed,
+          soak_state.total_gaps,soak_state.total_lost);
+    DLOGI(TAG,"soak raised %u alarms",soak_state.alarm_count);
+    char line[256];
+    int len = drift_format(&soak_drift,line,sizeof(line));
+    dlog_write_text(ESP_LOG_INFO,TAG,line,(len < sizeof(line)) ? len : sizeof(line) - 1);
+    len = stall_format(&soak_stall,line,sizeof(line));
+    dlog_write_text(soak_stall.events ? ESP_LOG_WARN : ESP_LOG_INFO,TAG,line,(len < sizeof(line)) ? len : sizeof(line) - 1);
+    len = demux_format(&soak_demux,line,sizeof(line));
+    dlog_write_text(soak_demux.stats.corrupted ? ESP_LOG_WARN : ESP_LOG_INFO,TAG,line,(len < sizeof(line)) ? len : sizeof(line) - 1);
+    if (reconnect){
+        len = session_format(line,sizeof(line));
+        dlog_write_text(ESP_LOG_INFO,TAG,line,(len < sizeof(line)) ? len : sizeof(line) - 1);
+    }
+    history_record_t *record = &soak_run.record;
+    record->frames = soak_state.total_frames;
+    record->corrupted = soak_state.total_corrupted;
+    record->crc_failed = soak_state.total_crc_failed;
+    record->gaps = soak_state.total_gaps;
+    record->lost = soak_state.total_lost;
+    record->reconnects = soak_state.total_reconnects;
+    record->stalls = soak_stall.events;
+    memcpy(soak_run.jitter,soak_state.total_jitter,sizeof(soak_run.jitter));
+    history_save(&soak_run);
+    run_result(RESULT_CMD_SOAK,&soak_run,&soak_drift,failed ? RESULT_RUN_FAILED : 0);
+    vTaskPrioritySet(NULL,previous_priority);
+    soak_running = false;
+    streaming = false;
 }
-static int generic_receiver(int argc, char **argv){
-    if ((sockfd > 0) && (!streaming) && (!generic_buffer)){
-        xTaskCreatePinnedToCore(task_generic_receiver, "generic_receiver_task", 8096,NULL, 6, NULL,1);
-        generic_buffer = true;
-    }else if((streaming) || (generic_buffer)){
+
+static int soak(int argc, char **argv){
+    int nerrors = arg_parse(argc, argv, (void **) &soak_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, soak_args.end, argv[0]);
+        return ESP_OK;
+    }
+    if (soak_args.stop->count > 0){
+        if (!soak_running){
+            ESP_LOGW(TAG,"No soak running");
+        }
+        soak_running = false;
+        return ESP_OK;
+    }
+    if (streaming || generic_buffer){
         ESP_LOGW(TAG,"Stream still ongoing!!");
+        result_error(RESULT_CMD_SOAK,ESP_ERR_INVALID_STATE,"stream still ongoing");
         return ESP_OK;
-    }else{
+    }
+    if (sockfd <= 0){
         ESP_LOGE(TAG,"Socket is not open!!");
+        result_error(RESULT_CMD_SOAK,ESP_ERR_INVALID_STATE,"socket is not open");
+        return ESP_OK;
+    }
+    if (soak_args.sensor_frequency->count == 0){
+        ESP_LOGE(TAG,"--frequency is required");
+        result_error(RESULT_CMD_SOAK,ESP_ERR_INVALID_ARG,"--frequency is required");
+        return ESP_OK;
+    }
+    int frequency = soak_args.sensor_frequency->ival[0];
+    if ((frequency < 1) || (frequency > 4000)){
+        ESP_LOGE(TAG,"Invalid frequency!!");
+        result_error(RESULT_CMD_SOAK,ESP_ERR_INVALID_ARG,"invalid frequency");
+        return ESP_OK;
+    }
+    soak_limits_t limits = {
+        .min_rate_pct = (soak_args.min_rate->count > 0) ? soak_args.min_rate->ival[0] : 95,
+        // half a nominal interval unless told otherwise
+        .max_jitter_us = (soak_args.max_jitter->count > 0) ? soak_args.max_jitter->ival[0] : 500000/frequency,
+        .max_corrupt = (soak_args.max_corrupt->count > 0) ? soak_args.max_corrupt->ival[0] : 0,
+        .max_gaps = (soak_args.max_gaps->count > 0) ? soak_args.max_gaps->ival[0] : 0,
+    };
+    soak_init(&soak_state,frequency,&limits,esp_timer_get_time());
+    soak_every_second = (soak_args.every_second->count > 0);
+    ESP_LOGI(TAG,"Soak at %d Hz until \"soak --stop\" (alarms: rate < %u%%, jitter p99 > %u us, corrupt > %u/s, gaps > %u/s)",
+             frequency,limits.min_rate_pct,limits.max_jitter_us,limits.max_corrupt,limits.max_gaps);
+    streaming = true;
+    soak_running = true;
+    if (worker_submit_on("soak_recv", task_soak, NULL, tuning_active()->core) != ESP_OK){
+        soak_running = false;
+        streaming = false;
+        result_error(RESULT_CMD_SOAK,ESP_ERR_NO_MEM,"no idle worker");
     }
     return ESP_OK;
-
-
 }
 
-static void register_generic_receiver(void){
+static void register_soak(void){
+    soak_args.sensor_frequency = arg_int0("f", "frequency", "<int>", "sensor's transmission frequency");
+    soak_args.min_rate = arg_int0(NULL, "min-rate", "<pct>", "alarm below this percentage of the nominal rate (default 95)");
+    soak_args.max_jitter = arg_int0(NULL, "max-jitter", "<us>", "alarm when the jitter p99 exceeds this (default half an interval)");
+    soak_args.max_corrupt = arg_int0(NULL, "max-corrupt", "<n>", "alarm above n corrupted frames per second (default 0)");
+    soak_args.max_gaps = arg_int0(NULL, "max-gaps", "<n>", "alarm above n gaps per second (default 0)");
+    soak_args.every_second = arg_lit0("v", "verbose", "also print the 1 s window every second");
+    soak_args.stop = arg_lit0(NULL, "stop", "end the running soak");
+    soak_args.reconnect = arg_lit0("R", "reconnect", "reconnect and restart the sensor when the link drops");
+    soak_args.end = arg_end(0);
     const esp_console_cmd_t cmd = {
-        .command = "generic_recv_on",
-        .help = "turn on the receving socket",
+        .command = "soak",
+        .help = "stream from the sensor indefinitely with rolling 1 s/10 s/60 s statistics and threshold alarms",
         .hint = NULL,
-        .func = &generic_receiver,
+        .func = &soak,
+        .argtable = &soak_args
     };
     ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
 }
 
-static int stations_list(int argc, char **argv){
-	wifi_sta_list_t list;
-	if (!soft_ap_on){
-		ESP_LOGE(TAG,"Wireless Interface off");
-		return ESP_OK;
-	}
-	ESP_ERROR_CHECK(esp_wifi_ap_get_sta_list(&list));
-	int list_iterator = list.num - 1;
-	tcpip_adapter_sta_list_t tcpip_sta_list;
+static struct {
+    struct arg_str *profiles;
+    struct arg_int *sensor_frequency;
+    struct arg_int *seconds;
+    struct arg_int *rounds;
+    struct arg_lit *stop;
+    struct arg_end *end;
+} tune_ab_args;
+
+typedef struct {
+    const tuning_profile_t *profile;
+    uint64_t frames;
+    uint64_t bytes;
+    uint64_t corrupted;
+    uint64_t recv_calls;
+    double seconds;
+    uint32_t jitter[SOAK_JITTER_BUCKETS];   // RFC 3550 style: change in transit time of the newest frame between reads
+    uint32_t stalls;
+    int cpu_runs;
+    float cpu_task;
+    float cpu_load[portNUM_PROCESSORS];
+} tune_ab_result_t;
+
+static tune_ab_result_t tune_ab_results[2];
+static tune_ab_result_t *tune_ab_current;
+static stall_t tune_ab_stall;
+static int tune_ab_frequency;
+static int tune_ab_seconds;
+static int tune_ab_rounds;
+static StaticSemaphore_t tune_ab_done_buffer;
+static SemaphoreHandle_t tune_ab_done = NULL;
+
+// Read and drop whatever the sensor still sends after the stop command
+static void tune_ab_drain(void){
+    struct timeval timeout = {0, 200000};
+    setsockopt(sockfd,SOL_SOCKET,SO_RCVTIMEO,&timeout,sizeof(timeout));
+    while (recv(sockfd,stream_rx_buffer,TUNING_MAX_READ,0) > 0){
+    }
+    timeout.tv_usec = 0;
+    setsockopt(sockfd,SOL_SOCKET,SO_RCVTIMEO,&timeout,sizeof(timeout));
+}
 
-	tcpip_adapter_get_sta_list(&list, &tcpip_sta_list);
-	// tcpip_adapter_sta_list.sta[i].ip
+/* One run of one profile, on a worker pinned to the profile's core. The
+ * loop is the soak receive loop without the rolling windows.
+ */
+static void task_tune_ab_run(void *pvParameters){
+    tune_ab_result_t *result = tune_ab_current;
+    const tuning_profile_t *profile = result->profile;
+    char init_transmission[100] = {0,};
+    sprintf(init_transmission,"%s%d%s",init_transmissionBEGIN,tune_ab_frequency,init_transmissionEND);
+
+    tuning_apply_socket(profile,sockfd);
+    UBaseType_t previous_priority = tuning_apply_priority(profile);
+    tuning_cpu_t cpu;
+    tuning_cpu_begin(&cpu);
+
+    int err = send(sockfd,&init_transmission,sizeof(init_transmission),0);
+    int64_t start = esp_timer_get_time();
+    stall_init(&tune_ab_stall,tune_ab_frequency);
+    stall_arm(&tune_ab_stall,start);
+    int64_t stop = start + (int64_t)tune_ab_seconds*1000000;
+    int64_t previous_transit = 0;
+    bool have_transit = false;
+    size_t held = 0;
+    int64_t now = start;
+    while ((err >= 0) && tune_ab_running && (now < stop)){
+        err = stall_recv(&tune_ab_stall,sockfd,stream_rx_buffer + held,profile->read_size,&tune_ab_running);
+        now = esp_timer_get_time();
+        if ((err == STALL_DETECTED) && (tune_ab_stall.config.policy == STALL_RESUME)){
+            err = 0;
+            continue;
+        }
+        if (err == STALL_STOPPED){
+            break;
+        }
+        if ((err == STALL_DETECTED) || (err == STALL_GAVE_UP)){
+            DLOGE(TAG,"tune_ab: %s stalled, no data for %.1f ms",profile->name,(now - tune_ab_stall.last_rx_us)/1000.0);
+            result_error(RESULT_CMD_TUNE_AB,err,"stall, run aborted");
+            stall_abort(&tune_ab_stall);
+            break;
+        }
+        if (err <= 0){
+            DLOGE(TAG,"tune_ab: socket error or closed (%d)",err);
+            result_error(RESULT_CMD_TUNE_AB,(err < 0) ? errno : 0,"socket error or closed");
+            break;
+        }
+        result->recv_calls++;
+        result->bytes += err;
+        held += err;
+        size_t offset = 0;
+        bool decoded = false;
+        int64_t newest = 0;
+        for(; held - offset >= active_schema.size; offset += active_schema.size){
+            battery_packet frame;
+            if (frame_decode(&active_schema,stream_rx_buffer + offset,&frame) != FRAME_OK){
+                result->corrupted++;
+                continue;
+            }
+            result->frames++;
+            newest = frame.time;
+            decoded = true;
+        }
+        /* Every frame of one read shares its arrival time, so per-frame
+         * transits would show no jitter inside a batch and hide it more the
+         * larger the read size. One sample per read, the newest frame's,
+         * is measured the same way under either profile.
+         */
+        if (decoded){
+            int64_t transit = now - newest;
+            if (have_transit){
+                int64_t change = (transit > previous_transit) ? transit - previous_transit : previous_transit - transit;
+                result->jitter[soak_jitter_bucket((change > UINT32_MAX) ? UINT32_MAX : (uint32_t)change)]++;
+            }
+            previous_transit = transit;
+            have_transit = true;
+        }
+        held -= offset;
+        memmove(stream_rx_buffer,stream_rx_buffer + offset,held);
+    }
+    result->seconds += (now - start)/1e6;
+    result->stalls += tune_ab_stall.events;
+
+    tuning_cpu_usage_t usage;
+    tuning_cpu_end(&cpu,&usage);
+    if (usage.valid){
+        result->cpu_runs++;
+        result->cpu_task += usage.task_pct;
+        for(int core = 0; core < portNUM_PROCESSORS; core++){
+            result->cpu_load[core] += usage.load_pct[core];
+        }
+    }
+    send(sockfd,&stop_transmission,sizeof(stop_transmission),0);
+    tune_ab_drain();
+    vTaskPrioritySet(NULL,previous_priority);
+    xSemaphoreGive(tune_ab_done);
+}
 
-	for(int i = 0; i <= list_iterator; i++){
-		ESP_LOGI(TAG,"\nMAC: %2x:%2x:%2x:%2x:%2x:%2x\t\tIP:"IPSTR"\t\tRSSI:%d\n",list.sta[i].mac[0],list.sta[i].mac[1],list.sta[i].mac[2],
-			list.sta[i].mac[3],list.sta[i].mac[4],list.sta[i].mac[5],IP2STR(&tcpip_sta_list.sta[i].ip),list.sta[i].rssi);
-	}
-	return ESP_OK;
+// `side` is 1 for A and 2 for B
+static void tune_ab_report(const tune_ab_result_t *result, int side, uint16_t flags){
+    double seconds = (result->seconds > 0) ? result->seconds : 1;
+    char cpu[64] = "cpu n/a";
+    if (result->cpu_runs > 0){
+        snprintf(cpu,sizeof(cpu),"cpu task %.1f%% core0 %.1f%% core1 %.1f%%",result->cpu_task/result->cpu_runs,
+                 result->cpu_load[0]/result->cpu_runs,result->cpu_load[portNUM_PROCESSORS - 1]/result->cpu_runs);
+    }
+    char line[200];
+    int len = snprintf(line,sizeof(line),"%-8s %.1f frames/s %.1f kB/s %.0f B/recv read jitter p50 %uus p99 %uus max %uus corrupt %llu stalls %u %s",
+                       result->profile->name,result->frames/seconds,result->bytes/seconds/1000,
+                       result->recv_calls ? (double)result->bytes/result->recv_calls : 0,
+                       soak_histogram_percentile(result->jitter,50),soak_histogram_percentile(result->jitter,99),
+                       soak_histogram_percentile(result->jitter,100),result->corrupted,result->stalls,cpu);
+    dlog_write_text(ESP_LOG_INFO,TAG,line,(len < sizeof(line)) ? len : sizeof(line) - 1);
+    result_run_t summary = {
+        .command = RESULT_CMD_TUNE_AB,
+        .round = side,
+        .rounds = tune_ab_rounds,
+        .flags = flags,
+        .frequency = tune_ab_frequency,
+        .duration_ms = (uint32_t)(result->seconds*1000),
+        .frames = result->frames,
+        .corrupted = result->corrupted,
+        .stalls = result->stalls,
+        .rate_hz = result->frames/seconds,
+        .jitter_p50 = soak_histogram_percentile(result->jitter,50),
+        .jitter_p99 = soak_histogram_percentile(result->jitter,99),
+        .jitter_max = soak_histogram_percentile(result->jitter,100),
+        .bytes = result->bytes,
+        .cpu_pct = (result->cpu_runs > 0) ? result->cpu_task/result->cpu_runs : 0,
+    };
+    result_run(&summary);
 }
 
-static void register_stations_list(void){
-	const esp_console_cmd_t cmd = {
-		.command = "list_stations",
-		.help = "list the stations associated",
-		.hint = NULL,
-		.func = &stations_list,
-	};
-    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
+// Alternates A and B every round so slow drifts in the radio conditions hit both equally
+static void task_tune_ab(void *pvParameters){
+    uint16_t flags = 0;
+    for(int round = 0; (round < tune_ab_rounds) && tune_ab_running; round++){
+        for(int side = 0; (side < 2) && tune_ab_running; side++){
+            tune_ab_current = &tune_ab_results[(round & 1) ? 1 - side : side];
+            if (worker_submit_on("tune_ab_run",task_tune_ab_run,NULL,tune_ab_current->profile->core) != ESP_OK){
+                DLOGE(TAG,"tune_ab: no worker free on core %d",tune_ab_current->profile->core);
+                result_error(RESULT_CMD_TUNE_AB,ESP_ERR_NO_MEM,"no idle worker");
+                flags |= RESULT_RUN_FAILED;
+                tune_ab_running = false;
+                break;
+            }
+            xSemaphoreTake(tune_ab_done,portMAX_DELAY);
+        }
+    }
+    if (!tune_ab_running && !(flags & RESULT_RUN_FAILED)){
+        flags |= RESULT_RUN_STOPPED;
+    }
+    DLOGI(TAG,"tune_ab: %d rounds of %d s at %d Hz",tune_ab_rounds,tune_ab_seconds,tune_ab_frequency);
+    tune_ab_report(&tune_ab_results[0],1,flags);
+    tune_ab_report(&tune_ab_results[1],2,flags);
+    tune_ab_running = false;
+    streaming = false;
 }
 
-static int print_packets(int argc, char **argv){
-    if ((streaming) || (generic_buffer)){
-        ESP_LOGE(TAG,"Can't print while the trasmission is on");
+static int tune_ab(int argc, char **argv){
+    int nerrors = arg_parse(argc, argv, (void **) &tune_ab_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, tune_ab_args.end, argv[0]);
         return ESP_OK;
     }
-
-/*  uint16_t battery;
-    uint8_t IDfinal;*/
-    for(int i = 0; i < 150; i++){
-        ESP_LOGI(TAG,"{\n\n\tID0: %d, time: %lld, accelX: %d, accelY: %d, accelZ: %d, gyroX: %d, gyroY: %d, gyroZ: %d, battery: %u, IDfinal: %d\n",
-            last_iteration[i].ID0,last_iteration[i].time,last_iteration[i].accelX,last_iteration[i].accelY,last_iteration[i].accelZ,
-            last_iteration[i].gyroX,last_iteration[i].gyroY,last_iteration[i].gyroZ,last_iteration[i].battery,last_iteration[i].IDfinal);
+    if (tune_ab_args.stop->count > 0){
+        if (!tune_ab_running){
+            ESP_LOGW(TAG,"No tune_ab running");
+        }
+        tune_ab_running = false;
+        return ESP_OK;
+    }
+    if ((tune_ab_args.profiles->count != 2) || (tune_ab_args.sensor_frequency->count == 0)){
+        ESP_LOGE(TAG,"Two profiles and --frequency are required");
+        result_error(RESULT_CMD_TUNE_AB,ESP_ERR_INVALID_ARG,"two profiles and --frequency are required");
+        return ESP_OK;
+    }
+    if (streaming || generic_buffer){
+        ESP_LOGW(TAG,"Stream still ongoing!!");
+        result_error(RESULT_CMD_TUNE_AB,ESP_ERR_INVALID_STATE,"stream still ongoing");
+        return ESP_OK;
+    }
+    if (sockfd <= 0){
+        ESP_LOGE(TAG,"Socket is not open!!");
+        result_error(RESULT_CMD_TUNE_AB,ESP_ERR_INVALID_STATE,"socket is not open");
+        return ESP_OK;
+    }
+    for(int i = 0; i < 2; i++){
+        memset(&tune_ab_results[i],0,sizeof(tune_ab_results[i]));
+        tune_ab_results[i].profile = tuning_find(tune_ab_args.profiles->sval[i]);
+        if (tune_ab_results[i].profile == NULL){
+            ESP_LOGE(TAG,"Unknown profile \"%s\" (see \"tune\")",tune_ab_args.profiles->sval[i]);
+            result_error(RESULT_CMD_TUNE_AB,ESP_ERR_NOT_FOUND,"unknown profile");
+            return ESP_OK;
+        }
+    }
+    tune_ab_frequency = tune_ab_args.sensor_frequency->ival[0];
+    tune_ab_seconds = (tune_ab_args.seconds->count > 0) ? tune_ab_args.seconds->ival[0] : 10;
+    tune_ab_rounds = (tune_ab_args.rounds->count > 0) ? tune_ab_args.rounds->ival[0] : 2;
+    if ((tune_ab_frequency < 1) || (tune_ab_frequency > 4000) || (tune_ab_seconds < 1) || (tune_ab_seconds > 600) ||
+        (tune_ab_rounds < 1) || (tune_ab_rounds > 20)){
+        ESP_LOGE(TAG,"Frequency 1..4000 Hz, duration 1..600 s, rounds 1..20");
+        result_error(RESULT_CMD_TUNE_AB,ESP_ERR_INVALID_ARG,"invalid frequency, duration or rounds");
+        return ESP_OK;
+    }
+    if (tune_ab_done == NULL){
+        tune_ab_done = xSemaphoreCreateBinaryStatic(&tune_ab_done_buffer);
+    }
+    tuning_print_build();
+    ESP_LOGI(TAG,"A/B: %s vs %s, %d x %d s each",tune_ab_results[0].profile->name,tune_ab_results[1].profile->name,
+             tune_ab_rounds,tune_ab_seconds);
+    streaming = true;
+    tune_ab_running = true;
+    if (worker_submit("tune_ab", task_tune_ab, NULL) != ESP_OK){
+        result_error(RESULT_CMD_TUNE_AB,ESP_ERR_NO_MEM,"no idle worker");
+        tune_ab_running = false;
+        streaming = false;
     }
     return ESP_OK;
 }
 
-static void register_print_packets(void){
+static void register_tune_ab(void){
+    tune_ab_args.profiles = arg_strn(NULL, NULL, "<profile>", 0, 2, "the two profiles to compare");
+    tune_ab_args.sensor_frequency = arg_int0("f", "frequency", "<int>", "sensor's transmission frequency");
+    tune_ab_args.seconds = arg_int0("d", "duration", "<s>", "length of each run (default 10)");
+    tune_ab_args.rounds = arg_int0("r", "rounds", "<n>", "runs per profile, alternating A and B (default 2)");
+    tune_ab_args.stop = arg_lit0(NULL, "stop", "end the running comparison");
+    tune_ab_args.end = arg_end(0);
     const esp_console_cmd_t cmd = {
-        .command = "print_packets",
-        .help = "print all 150 last received packets",
+        .command = "tune_ab",
+        .help = "Stream under two tuning profiles in turn and compare throughput, jitter and CPU",
         .hint = NULL,
-        .func = &print_packets,
+        .func = &tune_ab,
+        .argtable = &tune_ab_args
     };
     ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
-}
\ No newline at end of file
+}
+
+static struct {
+    struct arg_int *frequency;
+    struct arg_int *batch;
+    struct arg_int *seconds;
+    struct arg_int *count;
+    struct arg_lit *replay;
+    struct arg_lit *stop;
+    struct arg_end *end;
+} generate_args;
+
+static generator_config_t generate_config;
+static generator_t generate_state;
+static bool generate_replay = false;
+
+// Replays the capture buffer from its oldest frame, looping when it runs out
+static void generate_from_capture(void *ctx, uint64_t index, battery_packet *frame){
+    const capture_t *source = (const capture_t *)ctx;
+    capture_get(source,(uint32_t)(index % source->count),frame);
+}
+
+static void task_generate(void *pvParameters){
+    const tuning_profile_t *profile = tuning_active();
+    UBaseType_t previous_priority = tuning_apply_priority(profile);
+    if (generate_replay){
+        generator_run(&generate_state,&generate_config,sockfd,generate_from_capture,&capture,&generate_running);
+    }else{
+        generator_run(&generate_state,&generate_config,sockfd,generator_synthetic,NULL,&generate_running);
+    }
+    char line[200];
+    int len = generator_format(&generate_state,line,sizeof(line));
+    dlog_write_text(generate_state.error ? ESP_LOG_WARN : ESP_LOG_INFO,TAG,line,(len < sizeof(line)) ? len : sizeof(line) - 1);
+    if (generate_state.error){
+        result_error(RESULT_CMD_GENERATE,generate_state.error,"send failed");
+    }
+    // only a stop (generate --stop, the AP going down) clears the flag before the run ends
+    result_run_t summary = {
+        .command = RESULT_CMD_GENERATE,
+        .flags = generate_state.error ? RESULT_RUN_FAILED : (generate_running ? 0 : RESULT_RUN_STOPPED),
+        .frequency = generate_config.frequency,
+        .duration_ms = (uint32_t)((generate_state.end_us - generate_state.start_us)/1000),
+        .frames = generate_state.frames,
+        .rate_hz = generator_rate(&generate_state),
+    };
+    result_run(&summary);
+    result_histogram(RESULT_CMD_GENERATE,RESULT_HISTOGRAM_SEND,RESULT_BUCKETS_SOAK,0,generate_state.latency,SOAK_JITTER_BUCKETS);
+    vTaskPrioritySet(NULL,previous_priority);
+    generate_running = false;
+    streaming = false;
+}
+
+static int generate(int argc, char **argv){
+    int nerrors = arg_parse(argc, argv, (void **) &generate_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, generate_args.end, argv[0]);
+        return ESP_OK;
+    }
+    if (generate_args.stop->count > 0){
+        if (!generate_running){
+            ESP_LOGW(TAG,"No generator running");
+        }
+        generate_running = false;
+        return ESP_OK;
+    }
+    if (streaming || generic_buffer){
+        ESP_LOGW(TAG,"Stream still ongoing!!");
+        result_error(RESULT_CMD_GENERATE,ESP_ERR_INVALID_STATE,"stream still ongoing");
+        return ESP_OK;
+    }
+    if (sockfd <= 0){
+        ESP_LOGE(TAG,"Socket is not open!!");
+        result_error(RESULT_CMD_GENERATE,ESP_ERR_INVALID_STATE,"socket is not open");
+        return ESP_OK;
+    }
+    if (generate_args.frequency->count == 0){
+        ESP_LOGE(TAG,"--frequency is required");
+        result_error(RESULT_CMD_GENERATE,ESP_ERR_INVALID_ARG,"--frequency is required");
+        return ESP_OK;
+    }
+    generate_config.frequency = generate_args.frequency->ival[0];
+    generate_config.batch = (generate_args.batch->count > 0) ? generate_args.batch->ival[0] : 1;
+    generate_config.duration_ms = (generate_args.seconds->count > 0) ? generate_args.seconds->ival[0]*1000 : 0;
+    generate_config.count = (generate_args.count->count > 0) ? generate_args.count->ival[0] : 0;
+    if ((generate_config.frequency < 1) || (generate_config.frequency > GENERATOR_MAX_FREQUENCY) ||
+        (generate_config.batch < 1) || (generate_config.batch > GENERATOR_MAX_BATCH)){
+        ESP_LOGE(TAG,"Frequency 1..%d Hz, batch 1..%d frames",GENERATOR_MAX_FREQUENCY,GENERATOR_MAX_BATCH);
+        result_error(RESULT_CMD_GENERATE,ESP_ERR_INVALID_ARG,"invalid frequency or batch");
+        return ESP_OK;
+    }
+    generate_replay = (generate_args.replay->count > 0);
+    if (generate_replay && (capture.count == 0)){
+        ESP_LOGE(TAG,"Capture buffer is empty, receive a stream first");
+        result_error(RESULT_CMD_GENERATE,ESP_ERR_INVALID_STATE,"capture buffer is empty");
+        return ESP_OK;
+    }
+    ESP_LOGI(TAG,"Generating %s frames at %u Hz, %u per send, %s",generate_replay ? "replayed" : "synthetic",
+             generate_config.frequency,generate_config.batch,
+             (generate_config.duration_ms || generate_config.count) ? "until done" : "until \"generate --stop\"");
+    streaming = true;
+    generate_running = true;
+    if (worker_submit_on("generate", task_generate, NULL, tuning_active()->core) != ESP_OK){
+        result_error(RESULT_CMD_GENERATE,ESP_ERR_NO_MEM,"no idle worker");
+        generate_running = false;
+        streaming = false;
+    }
+    return ESP_OK;
+}
+
+static void register_generate(void){
+    generate_args.frequency = arg_int0("f", "frequency", "<hz>", "frames per second");
+    generate_args.batch = arg_int0("b", "batch", "<n>", "frames per send() (default 1)");
+    generate_args.seconds = arg_int0("d", "duration", "<s>", "stop after this long");
+    generate_args.count = arg_int0("n", "count", "<n>", "stop after n frames");
+    generate_args.replay = arg_lit0("r", "replay", "send the capture buffer instead of synthetic frames");
+    generate_args.stop = arg_lit0(NULL, "stop", "end the running generator");
+    generate_args.end = arg_end(0);
+    const esp_console_cmd_t cmd = {
+        .command = "generate",
+        .help = "Send battery_packet frames on the test socket at a timer-paced rate, time field set to each frame's due time",
+        .hint = NULL,
+        .func = &generate,
+        .argtable = &generate_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
+}
+
+static struct {
+    struct arg_int *rate;
+    struct arg_int *size;
+    struct arg_int *count;
+    struct arg_int *timeout;
+    struct arg_int *port;
+    struct arg_lit *histogram;
+    struct arg_lit *stop;
+    struct arg_end *end;
+} rtt_args;
+
+static rtt_t rtt_state;
+static uint8_t rtt_tx[RTT_MAX_SIZE];
+static uint8_t rtt_rx[RTT_MAX_SIZE];
+static size_t rtt_rx_have;              // bytes of the next echo already in rtt_rx
+static int rtt_rate;
+static int rtt_size;
+static int rtt_count;
+static int rtt_timeout_ms;
+static int rtt_port;
+static bool rtt_histogram = false;
+static volatile bool rtt_running = false;
+static esp_timer_handle_t rtt_timer = NULL;
+static StaticSemaphore_t rtt_tick_buffer;
+static SemaphoreHandle_t rtt_tick = NULL;
+
+static void rtt_tick_cb(void *arg){
+    xSemaphoreGive(rtt_tick);
+}
+
+// A second connection to the connect_to peer, for when a stream owns sockfd
+static int rtt_connect(void){
+    struct sockaddr_in peer;
+    if (!session_peer(&peer)){
+        DLOGE(TAG,"rtt: no peer, use connect_to first");
+        return -1;
+    }
+    peer.sin_port = htons(rtt_port);
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if ((sock < 0) || (connect(sock,(struct sockaddr *)&peer,sizeof(peer)) != 0)){
+        // DLOG keeps only the pointer and inet_ntoa's buffer is shared: format the line here
+        char line[80];
+        int len = snprintf(line,sizeof(line),"rtt: cannot connect to %s:%d, errno %d",inet_ntoa(peer.sin_addr),rtt_port,errno);
+        dlog_write_text(ESP_LOG_ERROR,TAG,line,(len < sizeof(line)) ? len : sizeof(line) - 1);
+        if (sock >= 0){
+            close(sock);
+        }
+        return -1;
+    }
+    return sock;
+}
+
+/* Wait for the echo of `seq`, at most until `deadline`. Echoes of messages
+ * that already timed out are counted late and skipped. An echo cut by the
+ * deadline stays in rtt_rx for the next call, so the stream keeps its
+ * framing. Returns the round trip, -1 on timeout, -2 if the peer is gone,
+ * does not echo or the socket failed.
+ */
+static int64_t rtt_wait_echo(int sock, uint32_t seq, int64_t deadline){
+    while (rtt_running){
+        int64_t now = esp_timer_get_time();
+        if (now >= deadline){
+            return -1;
+        }
+        fd_set readfds;
+        FD_ZERO(&readfds);
+        FD_SET(sock,&readfds);
+        struct timeval tv = {(deadline - now)/1000000, (deadline - now) % 1000000};
+        int ready = select(sock + 1,&readfds,NULL,NULL,&tv);
+        if (ready < 0){
+            DLOGE(TAG,"rtt: select failed, errno %d",errno);
+            return -2;
+        }
+        if (ready == 0){
+            continue;
+        }
+        int err = recv(sock,rtt_rx + rtt_rx_have,rtt_size - rtt_rx_have,0);
+        if (err <= 0){
+            return -2;
+        }
+        rtt_rx_have += err;
+        if (rtt_rx_have < rtt_size){
+            continue;
+        }
+        rtt_rx_have = 0;
+        int64_t received = esp_timer_get_time();
+        rtt_message_t echo;
+        memcpy(&echo,rtt_rx,sizeof(echo));
+        if (echo.magic != RTT_MAGIC){
+            return -2;
+        }
+        if (echo.seq == seq){
+            return received - echo.sent_us;
+        }
+        rtt_state.late++;
+    }
+    return -1;
+}
+
+/* One message in flight at a time, started by a periodic esp_timer tick.
+ * A tick that comes while waiting for an echo is merged into the next
+ * one, so a slow echo lowers the rate instead of queueing messages.
+ */
+static void task_rtt(void *pvParameters){
+    bool own_socket = (rtt_port != 0);
+    int sock = own_socket ? rtt_connect() : sockfd;
+    if (sock < 0){
+        result_error(RESULT_CMD_RTT,errno,"can't connect to the echo peer");
+        rtt_running = false;
+        return;
+    }
+    int nodelay = 1;
+    setsockopt(sock,IPPROTO_TCP,TCP_NODELAY,&nodelay,sizeof(nodelay));
+    for(int i = sizeof(rtt_message_t); i < rtt_size; i++){
+        rtt_tx[i] = (uint8_t)i;
+    }
+    rtt_reset(&rtt_state);
+    rtt_rx_have = 0;
+    xSemaphoreTake(rtt_tick,0);
+    ESP_ERROR_CHECK(esp_timer_start_periodic(rtt_timer,1000000/rtt_rate));
+    const int64_t start = esp_timer_get_time();
+    uint16_t flags = 0;
+    for(uint32_t seq = 0; rtt_running && ((rtt_count == 0) || (seq < rtt_count)); seq++){
+        while (rtt_running && (xSemaphoreTake(rtt_tick,pdMS_TO_TICKS(100)) != pdTRUE)){
+        }
+        if (!rtt_running){
+            break;
+        }
+        rtt_message_t message = {RTT_MAGIC, seq, esp_timer_get_time()};
+        memcpy(rtt_tx,&message,sizeof(message));
+        int err = send(sock,rtt_tx,rtt_size,0);
+        TRACE_EVENT(TRACE_SEND, err);
+        if (err != rtt_size){
+            DLOGE(TAG,"rtt: send failed (%d), errno %d",err,errno);
+            result_error(RESULT_CMD_RTT,errno,"send failed");
+            flags |= RESULT_RUN_FAILED;
+            break;
+        }
+        int64_t rtt = rtt_wait_echo(sock,seq,message.sent_us + (int64_t)rtt_timeout_ms*1000);
+        if (rtt == -2){
+            DLOGE(TAG,"rtt: the peer closed the connection or does not echo");
+            result_error(RESULT_CMD_RTT,0,"the peer closed the connection or does not echo");
+            flags |= RESULT_RUN_FAILED;
+            break;
+        }
+        if (rtt == -1){
+            rtt_state.timeouts++;
+            continue;
+        }
+        rtt_record(&rtt_state,seq,(uint32_t)((message.sent_us - start)/1000),(uint32_t)rtt);
+    }
+    esp_timer_stop(rtt_timer);
+    // messages answered count as frames and timeouts as lost, the latencies are in the histogram
+    result_run_t summary = {
+        .command = RESULT_CMD_RTT,
+        .flags = flags | (rtt_running ? 0 : RESULT_RUN_STOPPED),
+        .frequency = rtt_rate,
+        .duration_ms = (uint32_t)((esp_timer_get_time() - start)/1000),
+        .frames = rtt_state.count,
+        .lost = rtt_state.timeouts,
+        .rate_hz = (esp_timer_get_time() > start) ? rtt_state.count*1e6f/(esp_timer_get_time() - start) : 0,
+    };
+    result_run(&summary);
+    result_histogram(RESULT_CMD_RTT,RESULT_HISTOGRAM_RTT,RESULT_BUCKETS_RTT,0,rtt_state.histogram,RTT_BUCKETS);
+
+    char line[200];
+    int len = rtt_format(&rtt_state,line,sizeof(line));
+    dlog_write_text(rtt_state.timeouts ? ESP_LOG_WARN : ESP_LOG_INFO,TAG,line,(len < sizeof(line)) ? len : sizeof(line) - 1);
+    DLOGI(TAG,"rtt: %d byte messages at %d/s, %s",rtt_size,rtt_rate,
+          own_socket ? (streaming ? "own connection, stream running" : "own connection") : "on the stream socket");
+    for(uint32_t i = 0; i < rtt_state.worst_count; i++){
+        DLOGI(TAG,"rtt: worst #%u: seq %u at %u ms, %u us",i + 1,rtt_state.worst[i].seq,
+              rtt_state.worst[i].at_ms,rtt_state.worst[i].rtt_us);
+    }
+    for(uint32_t b = 0; rtt_histogram && (b < RTT_BUCKETS); b++){
+        if (rtt_state.histogram[b]){
+            DLOGI(TAG,"rtt: %8u us %8u",rtt_bucket_floor(b),rtt_state.histogram[b]);
+        }
+    }
+    if (own_socket){
+        close(sock);
+    }else{
+        streaming = false;
+    }
+    rtt_running = false;
+}
+
+static int rtt(int argc, char **argv){
+    int nerrors = arg_parse(argc, argv, (void **) &rtt_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, rtt_args.end, argv[0]);
+        return ESP_OK;
+    }
+    if (rtt_args.stop->count > 0){
+        if (!rtt_running){
+            ESP_LOGW(TAG,"No rtt running");
+        }
+        rtt_running = false;
+        return ESP_OK;
+    }
+    if (rtt_running){
+        ESP_LOGW(TAG,"rtt still running, stop it with --stop");
+        result_error(RESULT_CMD_RTT,ESP_ERR_INVALID_STATE,"rtt still running");
+        return ESP_OK;
+    }
+    rtt_rate = (rtt_args.rate->count > 0) ? rtt_args.rate->ival[0] : 100;
+    rtt_size = (rtt_args.size->count > 0) ? rtt_args.size->ival[0] : 32;
+    rtt_count = (rtt_args.count->count > 0) ? rtt_args.count->ival[0] : 1000;
+    rtt_timeout_ms = (rtt_args.timeout->count > 0) ? rtt_args.timeout->ival[0] : 1000;
+    rtt_port = (rtt_args.port->count > 0) ? rtt_args.port->ival[0] : 0;
+    rtt_histogram = (rtt_args.histogram->count > 0);
+    if ((rtt_rate < 1) || (rtt_rate > 5000) || (rtt_size < (int)sizeof(rtt_message_t)) || (rtt_size > RTT_MAX_SIZE) ||
+        (rtt_count < 0) || (rtt_timeout_ms < 1) || (rtt_port < 0) || (rtt_port > 65535)){
+        ESP_LOGE(TAG,"Rate 1..5000/s, size %d..%d bytes, timeout at least 1 ms",(int)sizeof(rtt_message_t),RTT_MAX_SIZE);
+        result_error(RESULT_CMD_RTT,ESP_ERR_INVALID_ARG,"invalid rate, size or timeout");
+        return ESP_OK;
+    }
+    if (streaming || generic_buffer){
+        // the stream owns sockfd: measure on a second connection to the same peer, under the stream's load
+        rtt_port = (rtt_port != 0) ? rtt_port : RTT_ECHO_PORT;
+    }else if ((rtt_port == 0) && (sockfd <= 0)){
+        ESP_LOGE(TAG,"Socket is not open!!");
+        result_error(RESULT_CMD_RTT,ESP_ERR_INVALID_STATE,"socket is not open");
+        return ESP_OK;
+    }
+    if (rtt_timer == NULL){
+        rtt_tick = xSemaphoreCreateBinaryStatic(&rtt_tick_buffer);
+        const esp_timer_create_args_t timer_args = {
+            .callback = &rtt_tick_cb,
+            .name = "rtt",
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&timer_args,&rtt_timer));
+    }
+    if (rtt_port == 0){
+        streaming = true;
+    }
+    rtt_running = true;
+    if (worker_submit("rtt", task_rtt, NULL) != ESP_OK){
+        result_error(RESULT_CMD_RTT,ESP_ERR_NO_MEM,"no idle worker");
+        rtt_running = false;
+        streaming = (rtt_port == 0) ? false : streaming;
+    }
+    return ESP_OK;
+}
+
+static void register_rtt(void){
+    rtt_args.rate = arg_int0("r", "rate", "<n>", "messages per second (default 100)");
+    rtt_args.size = arg_int0("s", "size", "<bytes>", "message size (default 32)");
+    rtt_args.count = arg_int0("n", "count", "<n>", "messages to send, 0 until stopped (default 1000)");
+    rtt_args.timeout = arg_int0("T", "timeout", "<ms>", "wait this long for each echo (default 1000)");
+    rtt_args.port = arg_int0("p", "port", "<port>", "use a second connection to the connect_to peer on this port "
+                                                    "(always while a stream runs, default 7007)");
+    rtt_args.histogram = arg_lit0("H", "histogram", "also print the histogram");
+    rtt_args.stop = arg_lit0(NULL, "stop", "end the running measurement");
+    rtt_args.end = arg_end(0);
+    const esp_console_cmd_t cmd = {
+        .command = "rtt",
+        .help = "Ping-pong timestamped messages with an echo peer (host/echo_peer) and report round trip percentiles",
+        .hint = NULL,
+        .func = &rtt,
+        .argtable = &rtt_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
+}
+
+static struct {
+    struct arg_int *frequency;
+    struct arg_int *seconds;
+    struct arg_int *from;
+    struct arg_int *max;
+    struct arg_int *starve;
+    struct arg_int *port;
+    struct arg_int *merge;
+    struct arg_lit *stop;
+    struct arg_end *end;
+} fairness_args;
+
+static fairness_t fairness_state;
+// fairness() never steps past the stations the AP accepts, the merge needs no more inputs than that
+#define FAIRNESS_MERGE_INPUTS ((EXAMPLE_MAX_STA_CONN < FAIRNESS_MAX_STATIONS) ? EXAMPLE_MAX_STA_CONN : FAIRNESS_MAX_STATIONS)
+MERGE_DEFINE(fairness_merged, FAIRNESS_MERGE_INPUTS, CONFIG_TESTSUITE_MERGE_DEPTH);
+
+/* Sockets the rest of the suite may hold while a fairness step runs: the
+ * console, control and result listeners, the console sessions, one result
+ * and one control client, sockfd and rtt's own connection. The stations
+ * get what CONFIG_LWIP_MAX_SOCKETS leaves.
+ */
+#ifdef CONFIG_TESTSUITE_TCP_CONSOLE_SESSIONS
+#define FAIRNESS_RESERVED_SOCKETS  (3 + CONFIG_TESTSUITE_TCP_CONSOLE_SESSIONS + 2 + 1 + 1)
+#else
+#define FAIRNESS_RESERVED_SOCKETS  (3 + 2 + 1 + 1)
+#endif
+#define FAIRNESS_SOCKETS           (CONFIG_LWIP_MAX_SOCKETS - FAIRNESS_RESERVED_SOCKETS)
+
+// Stations of the run, in the order the AP lists them, and their sockets during a step
+static struct {
+    uint32_t count;
+    struct sockaddr_in address[FAIRNESS_MAX_STATIONS];
+    int sock[FAIRNESS_MAX_STATIONS];
+    char start_command[100];
+} fairness_peers;
+
+static int64_t fairness_now(void *ctx){
+    return esp_timer_get_time();
+}
+
+static int fairness_open(void *ctx, uint32_t station){
+    struct sockaddr_in *address = &fairness_peers.address[station];
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    fairness_peers.sock[station] = -1;
+    if ((sock < 0) || (connect(sock,(struct sockaddr *)address,sizeof(*address)) != 0)){
+        // DLOG keeps only the pointer and inet_ntoa's buffer is shared: format the line here
+        char line[80];
+        int len = snprintf(line,sizeof(line),"fairness: cannot connect to %s:%d, errno %d",inet_ntoa(address->sin_addr),
+                           ntohs(address->sin_port),errno);
+        dlog_write_text(ESP_LOG_ERROR,TAG,line,(len < sizeof(line)) ? len : sizeof(line) - 1);
+        if (sock >= 0){
+            close(sock);
+        }
+        return -1;
+    }
+    tuning_apply_socket(tuning_active(),sock);
+    int err = send(sock,fairness_peers.start_command,sizeof(fairness_peers.start_command),0);
+    TRACE_EVENT(TRACE_SEND, err);
+    if (err < 0){
+        char line[80];
+        int len = snprintf(line,sizeof(line),"fairness: start command not sent to %s",inet_ntoa(address->sin_addr));
+        dlog_write_text(ESP_LOG_ERROR,TAG,line,(len < sizeof(line)) ? len : sizeof(line) - 1);
+        close(sock);
+        return -1;
+    }
+    fairness_peers.sock[station] = sock;
+    return 0;
+}
+
+static void fairness_close(void *ctx, uint32_t station){
+    int sock = fairness_peers.sock[station];
+    if (sock < 0){
+        return;
+    }
+    int err = send(sock,&stop_transmission,sizeof(stop_transmission),0);
+    TRACE_EVENT(TRACE_SEND, err);
+    shutdown(sock,0);
+    close(sock);
+    fairness_peers.sock[station] = -1;
+}
+
+static int fairness_wait(void *ctx, uint32_t stations, int64_t timeout_us, uint32_t *ready){
+    fd_set readfds;
+    FD_ZERO(&readfds);
+    int top = -1;
+    for(uint32_t i = 0; i < stations; i++){
+        if (fairness_peers.sock[i] >= 0){
+            FD_SET(fairness_peers.sock[i],&readfds);
+            top = (fairness_peers.sock[i] > top) ? fairness_peers.sock[i] : top;
+        }
+    }
+    struct timeval tv = {timeout_us/1000000, timeout_us % 1000000};
+    if (top < 0){
+        // every station failed or hung up, let the step run out
+        vTaskDelay(timeout_us/1000/portTICK_PERIOD_MS + 1);
+        return 0;
+    }
+    int n = select(top + 1,&readfds,NULL,NULL,&tv);
+    if (n < 0){
+        DLOGE(TAG,"fairness: select failed, errno %d",errno);
+        return -1;
+    }
+    for(uint32_t i = 0; (n > 0) && (i < stations); i++){
+        if ((fairness_peers.sock[i] >= 0) && FD_ISSET(fairness_peers.sock[i],&readfds)){
+            *ready |= 1u << i;
+        }
+    }
+    return 0;
+}
+
+static int fairness_recv(void *ctx, uint32_t station, uint8_t *buffer, size_t size){
+    TRACE_EVENT(TRACE_RECV_START, size);
+    int err = recv(fairness_peers.sock[station],buffer,size,0);
+    TRACE_EVENT(TRACE_RECV_END, err);
+    return err;
+}
+
+static const fairness_io_t fairness_sockets = {
+    .now = fairness_now,
+    .open = fairness_open,
+    .close = fairness_close,
+    .wait = fairness_wait,
+    .recv = fairness_recv,
+};
+
+// The merged stream replaces the capture, stamped with AP time so the stations line up
+static void fairness_merged_frame(void *ctx, uint32_t input, int64_t key, const battery_packet *frame){
+    battery_packet aligned = *frame;
+    aligned.time = key;
+    capture_append(&capture,&aligned);
+}
+
+// One run record per step, then its stations and the merge latency
+static void fairness_result(const fairness_t *fairness, const fairness_summary_t *summary){
+    result_run_t step = {
+        .command = RESULT_CMD_FAIRNESS,
+        .round = fairness->steps,
+        .rounds = fairness->last - fairness->first + 1,
+        .flags = *fairness->running ? 0 : RESULT_RUN_STOPPED,
+        .frequency = fairness->frequency,
+        .duration_ms = (uint32_t)(summary->seconds*1000),
+        .rate_hz = summary->aggregate_fps,
+        .stations = summary->stations,
+        .jain = summary->jain,
+    };
+    for(uint32_t i = 0; i < summary->stations; i++){
+        const fairness_station_t *station = &fairness->station[i];
+        step.frames += station->frames;
+        step.corrupted += station->corrupted;
+        step.gaps += station->gaps;
+        step.lost += station->lost;
+        result_station_t entry = {
+            .command = RESULT_CMD_FAIRNESS,
+            .index = i + 1,
+            .flags = (station->failed ? RESULT_STATION_FAILED : 0) | (station->closed ? RESULT_STATION_CLOSED : 0),
+            .ip = fairness_peers.address[i].sin_addr.s_addr,
+            .frames = station->frames,
+            .lost = station->lost,
+            .corrupted = station->corrupted,
+            .starvations = station->starvations,
+            .jitter_p50 = soak_histogram_percentile(station->jitter,50),
+            .jitter_p99 = soak_histogram_percentile(station->jitter,99),
+            .longest_silence_ms = (uint32_t)(station->longest_silence_us/1000),
+            .rate_hz = (summary->seconds > 0) ? station->frames/summary->seconds : 0,
+        };
+        result_station(&entry);
+    }
+    result_run(&step);
+    if (fairness->merge){
+        result_histogram(RESULT_CMD_FAIRNESS,RESULT_HISTOGRAM_MERGE,RESULT_BUCKETS_SOAK,0,fairness->merge->latency,
+                         SOAK_JITTER_BUCKETS);
+    }
+}
+
+static void fairness_report(void *ctx, const fairness_t *fairness, const fairness_summary_t *summary){
+    char line[256];
+    int len = fairness_format(summary,line,sizeof(line));
+    dlog_write_text((summary->starvations || summary->failed) ? ESP_LOG_WARN : ESP_LOG_INFO,TAG,line,
+                    (len < sizeof(line)) ? len : sizeof(line) - 1);
+    if (fairness->merge){
+        len = merge_format(fairness->merge,line,sizeof(line));
+        dlog_write_text(merge_late(fairness->merge) ? ESP_LOG_WARN : ESP_LOG_INFO,TAG,line,
+                        (len < sizeof(line)) ? len : sizeof(line) - 1);
+    }
+    for(uint32_t i = 0; i < summary->stations; i++){
+        len = snprintf(line,sizeof(line),"fairness: station %u is %s",i + 1,inet_ntoa(fairness_peers.address[i].sin_addr));
+        dlog_write_text(ESP_LOG_DEBUG,TAG,line,(len < sizeof(line)) ? len : sizeof(line) - 1);
+        len = fairness_format_station(fairness,i,summary->seconds,line,sizeof(line));
+        dlog_write_text(fairness->station[i].starvations ? ESP_LOG_WARN : ESP_LOG_INFO,TAG,line,
+                        (len < sizeof(line)) ? len : sizeof(line) - 1);
+    }
+    fairness_result(fairness,summary);
+}
+
+/* One step per station count, from -F to every station the AP lists (or
+ * -m). Each step connects to its stations, starts all of them at once and
+ * reads whatever is ready until the step time is over.
+ */
+static void task_fairness(void *pvParameters){
+    const tuning_profile_t *profile = tuning_active();
+    UBaseType_t previous_priority = tuning_apply_priority(profile);
+    uint32_t frequency = fairness_state.frequency;
+    sprintf(fairness_peers.start_command,"%s%u%s",init_transmissionBEGIN,frequency,init_transmissionEND);
+    DLOGI(TAG,"fairness: %u stations at %u Hz, %lld s per step",fairness_peers.count,frequency,fairness_state.step_us/1000000);
+
+    uint32_t steps = fairness_run(&fairness_state,&fairness_sockets,NULL,fairness_report,NULL);
+    for(uint32_t i = 0; i < steps; i++){
+        const fairness_summary_t *summary = &fairness_state.step[i];
+        // scaling: what each added station costs the others
+        DLOGI(TAG,"fairness: %2u stations %8.1f fps, %5.1f%% of demand, Jain %.3f, %u starvations",summary->stations,
+              summary->aggregate_fps,100.0f*summary->aggregate_fps/(summary->stations*frequency),summary->jain,
+              summary->starvations);
+    }
+    vTaskPrioritySet(NULL,previous_priority);
+    fairness_running = false;
+    streaming = false;
+}
+
+static int fairness(int argc, char **argv){
+    int nerrors = arg_parse(argc, argv, (void **) &fairness_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, fairness_args.end, argv[0]);
+        return ESP_OK;
+    }
+    if (fairness_args.stop->count > 0){
+        if (!fairness_running){
+            ESP_LOGW(TAG,"No fairness run");
+        }
+        fairness_running = false;
+        return ESP_OK;
+    }
+    if (!soft_ap_on){
+        ESP_LOGE(TAG,"Wireless Interface off");
+        result_error(RESULT_CMD_FAIRNESS,ESP_ERR_INVALID_STATE,"wireless interface off");
+        return ESP_OK;
+    }
+    if (streaming || generic_buffer){
+        ESP_LOGW(TAG,"Stream still ongoing!!");
+        result_error(RESULT_CMD_FAIRNESS,ESP_ERR_INVALID_STATE,"stream still ongoing");
+        return ESP_OK;
+    }
+    int frequency = (fairness_args.frequency->count > 0) ? fairness_args.frequency->ival[0] : 100;
+    int seconds = (fairness_args.seconds->count > 0) ? fairness_args.seconds->ival[0] : 10;
+    int from = (fairness_args.from->count > 0) ? fairness_args.from->ival[0] : 1;
+    int max = (fairness_args.max->count > 0) ? fairness_args.max->ival[0] : EXAMPLE_MAX_STA_CONN;
+    int starve_ms = (fairness_args.starve->count > 0) ? fairness_args.starve->ival[0] : 0;
+    int port = (fairness_args.port->count > 0) ? fairness_args.port->ival[0] : 8001;
+    int window_ms = (fairness_args.merge->count > 0) ? fairness_args.merge->ival[0] : -1;
+    if ((frequency < 1) || (frequency > 4000) || (seconds < 1) || (seconds > 3600) || (from < 1) || (max < from) ||
+        (starve_ms < 0) || (port < 1) || (port > 65535) || (window_ms > 10000)){
+        ESP_LOGE(TAG,"Frequency 1..4000 Hz, 1..3600 s per step, 1 <= first <= max stations");
+        result_error(RESULT_CMD_FAIRNESS,ESP_ERR_INVALID_ARG,"invalid frequency, duration or station range");
+        return ESP_OK;
+    }
+
+    wifi_sta_list_t list;
+    tcpip_adapter_sta_list_t tcpip_sta_list;
+    ESP_ERROR_CHECK(esp_wifi_ap_get_sta_list(&list));
+    tcpip_adapter_get_sta_list(&list,&tcpip_sta_list);
+    fairness_peers.count = 0;
+    max = (max < EXAMPLE_MAX_STA_CONN) ? max : EXAMPLE_MAX_STA_CONN;
+    max = (max < FAIRNESS_MAX_STATIONS) ? max : FAIRNESS_MAX_STATIONS;
+    if (max > FAIRNESS_SOCKETS){
+        ESP_LOGW(TAG,"%d sockets left for stations (CONFIG_LWIP_MAX_SOCKETS %d)",FAIRNESS_SOCKETS,CONFIG_LWIP_MAX_SOCKETS);
+        max = FAIRNESS_SOCKETS;
+    }
+    for(int i = 0; (i < tcpip_sta_list.num) && (fairness_peers.count < max); i++){
+        if (tcpip_sta_list.sta[i].ip.addr == 0){
+            // associated but no DHCP lease yet
+            continue;
+        }
+        struct sockaddr_in *address = &fairness_peers.address[fairness_peers.count++];
+        memset(address,0,sizeof(*address));
+        address->sin_family = AF_INET;
+        address->sin_addr.s_addr = tcpip_sta_list.sta[i].ip.addr;
+        address->sin_port = htons(port);
+    }
+    if (fairness_peers.count < from){
+        ESP_LOGE(TAG,"%u stations with an address, %d needed",fairness_peers.count,from);
+        result_error(RESULT_CMD_FAIRNESS,ESP_ERR_NOT_FOUND,"not enough stations with an address");
+        return ESP_OK;
+    }
+    fairness_init(&fairness_state,&active_schema,frequency,seconds*1000,from,fairness_peers.count,starve_ms,&fairness_running);
+    if (window_ms >= 0){
+        capture_clear(&capture);
+        fairness_merge(&fairness_state,&fairness_merged,(int64_t)window_ms*1000,fairness_merged_frame,NULL);
+    }
+    ESP_LOGI(TAG,"Stepping from %d to %u stations (profile %s)",from,fairness_peers.count,tuning_active()->name);
+    streaming = true;
+    fairness_running = true;
+    if (worker_submit_on("fairness", task_fairness, NULL, tuning_active()->core) != ESP_OK){
+        result_error(RESULT_CMD_FAIRNESS,ESP_ERR_NO_MEM,"no idle worker");
+        fairness_running = false;
+        streaming = false;
+    }
+    return ESP_OK;
+}
+
+static void register_fairness(void){
+    fairness_args.frequency = arg_int0("f", "frequency", "<Hz>", "rate every sensor is started at (default 100)");
+    fairness_args.seconds = arg_int0("d", "duration", "<s>", "length of each step (default 10)");
+    fairness_args.from = arg_int0("F", "from", "<n>", "stations in the first step (default 1)");
+    fairness_args.max = arg_int0("m", "max", "<n>", "stations in the last step (default every associated one, "
+                                                 "at most CONFIG_ESP_MAX_STA_CONN)");
+    fairness_args.starve = arg_int0("S", "starve", "<ms>", "silence that counts as starvation "
+                                                        "(default 10 intervals, at least 250 ms)");
+    fairness_args.port = arg_int0("p", "port", "<port>", "port the sensors listen on (default 8001)");
+    fairness_args.merge = arg_int0("M", "merge", "<ms>", "merge every station into one capture in AP time order, "
+                                                      "waiting at most this long for a slow station");
+    fairness_args.stop = arg_lit0(NULL, "stop", "end the run after the current poll");
+    fairness_args.end = arg_end(0);
+    const esp_console_cmd_t cmd = {
+        .command = "fairness",
+        .help = "Stream from 1, 2, ... of the associated stations at once and report how the AP shares its "
+                "throughput: per-station rate, jitter and loss, aggregate, Jain's index and starvation. "
+                "Each station gets its own connection, close the test socket first if a sensor takes only one",
+        .hint = NULL,
+        .func = &fairness,
+        .argtable = &fairness_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
+}
+
+#define SINK_SIZE_BUCKETS 13
+
+static struct {
+    struct arg_lit *sink;
+    struct arg_int *read_size;
+    struct arg_int *preview;
+    struct arg_lit *frames;
+    struct arg_lit *demux;
+    struct arg_end *end;
+} generic_args;
+
+// --demux: frames are counted, JSON replies printed, instead of printing everything as text
+static bool generic_demux_on = false;
+static demux_t generic_demux;
+
+static struct {
+    bool enabled;
+    int read_size;
+    int preview_every;
+    bool preview_frames;
+    unsigned long long bytes;
+    unsigned long long calls;
+    uint32_t size_hist[SINK_SIZE_BUCKETS];  // bucket b counts reads of [2^b, 2^(b+1)) bytes
+    int64_t start;
+    int64_t interval_start;
+    unsigned long long interval_bytes;
+    unsigned long long interval_calls;
+} sink;
+
+static char sink_preview_text[3*32 + 1];
+
+static void sink_preview(const uint8_t *buffer, int len){
+    if ((sink.preview_frames) && (len >= sizeof(battery_packet)) && (buffer[0] == 0) && (buffer[sizeof(battery_packet) - 1] == 255)){
+        battery_packet frame;
+        memcpy(&frame,buffer,sizeof(frame));
+        DLOGI(TAG,"recv #%llu (%d bytes) frame: time %lld, accel %d %d %d",sink.calls,len,frame.time,frame.accelX,frame.accelY,frame.accelZ);
+        DLOGI(TAG,"recv #%llu gyro %d %d %d, battery %u",sink.calls,frame.gyroX,frame.gyroY,frame.gyroZ,frame.battery);
+        return;
+    }
+    int shown = (len < 32) ? len : 32;
+    for(int i = 0; i < shown; i++){
+        sprintf(sink_preview_text + 3*i,"%02x ",buffer[i]);
+    }
+    DLOGI(TAG,"recv #%llu (%d bytes) hex:",sink.calls,len);
+    dlog_write_text(ESP_LOG_INFO,TAG,sink_preview_text,3*shown);
+}
+
+static void sink_report(bool final){
+    int64_t now = esp_timer_get_time();
+    if (!final){
+        float seconds = (now - sink.interval_start)/1e6;
+        DLOGI(TAG,"[%5.1f s] %llu bytes in %llu recvs: %.3f Mbps",(now - sink.start)/1e6,sink.interval_bytes,sink.interval_calls,
+              (sink.interval_bytes*8)/(seconds*1e6));
+        sink.interval_start = now;
+        sink.interval_bytes = 0;
+        sink.interval_calls = 0;
+        return;
+    }
+    float seconds = (now - sink.start)/1e6;
+    ESP_LOGI(TAG,"Sink closed after %.3f s: %llu bytes in %llu recvs, %.3f Mbps, %.1f bytes/recv",seconds,sink.bytes,sink.calls,
+             (seconds > 0) ? (sink.bytes*8)/(seconds*1e6) : 0,(sink.calls > 0) ? (float)sink.bytes/sink.calls : 0);
+    for(int b = 0; b < SINK_SIZE_BUCKETS; b++){
+        if (sink.size_hist[b] > 0){
+            ESP_LOGI(TAG,"\trecv size %5d..%5d: %u",1 << b,(1 << (b + 1)) - 1,sink.size_hist[b]);
+        }
+    }
+}
+
+static void sink_account(const uint8_t *buffer, int len){
+    sink.bytes += len;
+    sink.calls++;
+    sink.interval_bytes += len;
+    sink.interval_calls++;
+    int bucket = 31 - __builtin_clz(len);
+    sink.size_hist[(bucket < SINK_SIZE_BUCKETS) ? bucket : SINK_SIZE_BUCKETS - 1]++;
+    if ((sink.preview_every > 0) && ((sink.calls % sink.preview_every) == 0)){
+        sink_preview(buffer,len);
+    }
+    if (esp_timer_get_time() - sink.interval_start >= 1000000){
+        sink_report(false);
+    }
+}
+
+static void generic_report(void){
+    if (sink.enabled){
+        sink_report(true);
+    }
+    if (generic_demux_on){
+        char line[256];
+        int len = demux_format(&generic_demux,line,sizeof(line));
+        dlog_write_text(ESP_LOG_INFO,TAG,line,(len < sizeof(line)) ? len : sizeof(line) - 1);
+    }
+}
+
+static void task_generic_receiver(void *pvParameters){
+    uint8_t *packet = generic_rx_buffer;
+    int read_size = sink.enabled ? sink.read_size : 1024;
+    size_t held = 0;
+    int err;
+    memset(generic_rx_buffer,0,sizeof(generic_rx_buffer));
+    DLOGD(TAG,"Command to first recv: %lld us",esp_timer_get_time() - worker_submitted_at());
+    sink.start = esp_timer_get_time();
+    sink.interval_start = sink.start;
+    stall_init(&generic_stall,0);
+    stall_arm(&generic_stall,sink.start);
+    while(true){
+        TRACE_EVENT(TRACE_RECV_START, read_size);
+        err = stall_recv(&generic_stall,sockfd,packet + held,read_size,&generic_buffer);
+        TRACE_EVENT(TRACE_RECV_END, err);
+        if (err == STALL_DETECTED){
+            DLOGD(TAG,"No data for %.1f ms",generic_stall.last_detect_us/1000.0);
+            continue;
+        }
+        if (err == STALL_GAVE_UP){
+            // any traffic is welcome here at any pace, keep listening
+            stall_arm(&generic_stall,esp_timer_get_time());
+            continue;
+        }
+        if (err == STALL_STOPPED){
+            ESP_LOGW(TAG,"generic_receiver is being closed");
+            generic_report();
+            return;
+        }
+        if (err < 0){
+            ESP_LOGE(TAG,"error no socket: %s",strerror(errno));
+            generic_buffer = false;
+            break;
+        }
+        if (err == 0){
+            ESP_LOGW(TAG,"Connection closed by the peer");
+            generic_buffer = false;
+            break;
+        }
+        if(!generic_buffer){
+            ESP_LOGW(TAG,"generic_receiver is being closed");
+            generic_report();
+            return;
+        }
+        if (sink.enabled){
+            sink_account(packet,err);
+        }else if (generic_demux_on){
+            held += err;
+            size_t used = demux_feed(&generic_demux,packet,held);
+            held -= used;
+            memmove(packet,packet + used,held);
+        }else{
+            dlog_write_text(ESP_LOG_WARN,TAG,packet,err);
+            sensor_parser_feed(&sensor_parser,(const char *)packet,err);
+        }
+    }
+    generic_report();
+    ESP_LOGE(TAG,"Receiver is being closed!!");
+}
+
+static int generic_receiver(int argc, char **argv){
+    if ((sockfd > 0) && (!streaming) && (!generic_buffer)){
+        int nerrors = arg_parse(argc, argv, (void **) &generic_args);
+        if (nerrors != 0) {
+            arg_print_errors(stderr, generic_args.end, argv[0]);
+            return ESP_OK;
+        }
+        if ((generic_args.sink->count == 0) && ((generic_args.read_size->count > 0) || (generic_args.preview->count > 0))){
+            ESP_LOGE(TAG,"--bytes and --preview need --sink!!");
+            return ESP_OK;
+        }
+        memset(&sink,0,sizeof(sink));
+        sink.enabled = (generic_args.sink->count > 0);
+        sink.read_size = sizeof(generic_rx_buffer);
+        if (generic_args.read_size->count > 0){
+            sink.read_size = generic_args.read_size->ival[0];
+        }
+        if ((sink.read_size <= 0) || (sink.read_size > sizeof(generic_rx_buffer))){
+            ESP_LOGE(TAG,"Invalid read size, must be 1..%d!!",(int)sizeof(generic_rx_buffer));
+            return ESP_OK;
+        }
+        if (generic_args.preview->count > 0){
+            sink.preview_every = generic_args.preview->ival[0];
+        }
+        sink.preview_frames = (generic_args.frames->count > 0);
+        generic_demux_on = (generic_args.demux->count > 0);
+        if (generic_demux_on && sink.enabled){
+            ESP_LOGE(TAG,"--demux and --sink exclude each other!!");
+            return ESP_OK;
+        }
+        if (generic_demux_on){
+            demux_init(&generic_demux,&active_schema,NULL,sensor_reply_part,NULL);
+        }
+        // plain text is searched for replies too, never one left over from an earlier loop
+        sensor_parser_abort(&sensor_parser);
+
+        generic_buffer = true;
+        if (worker_submit("generic_receiver_task", task_generic_receiver, NULL) != ESP_OK){
+            generic_buffer = false;
+        }
+    }else if((streaming) || (generic_buffer)){
+        ESP_LOGW(TAG,"Stream still ongoing!!");
+        return ESP_OK;
+    }else{
+        ESP_LOGE(TAG,"Socket is not open!!");
+    }
+    return ESP_OK;
+
+
+}
+
+static void register_generic_receiver(void){
+    generic_args.sink = arg_lit0("s", "sink", "discard the payload and only measure throughput");
+    generic_args.read_size = arg_int0("b", "bytes", "<int>", "bytes requested per recv in sink mode (default: whole buffer)");
+    generic_args.preview = arg_int0("p", "preview", "<N>", "in sink mode, show 1 in N received buffers");
+    generic_args.frames = arg_lit0("F", "frames", "decode previewed buffers as sensor frames when they look like one");
+    generic_args.demux = arg_lit0("D", "demux", "tell sensor frames from JSON replies: count the frames, print the replies");
+    generic_args.end = arg_end(0);
+    const esp_console_cmd_t cmd = {
+        .command = "generic_recv_on",
+        .help = "turn on the receving socket",
+        .hint = NULL,
+        .func = &generic_receiver,
+        .argtable = &generic_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
+}
+
+static int stations_list(int argc, char **argv){
+	wifi_sta_list_t list;
+	if (!soft_ap_on){
+		ESP_LOGE(TAG,"Wireless Interface off");
+		result_error(RESULT_CMD_LIST_STATIONS,ESP_ERR_INVALID_STATE,"wireless interface off");
+		return ESP_OK;
+	}
+	ESP_ERROR_CHECK(esp_wifi_ap_get_sta_list(&list));
+	int list_iterator = list.num - 1;
+	tcpip_adapter_sta_list_t tcpip_sta_list;
+
+	tcpip_adapter_get_sta_list(&list, &tcpip_sta_list);
+	// tcpip_adapter_sta_list.sta[i].ip
+
+	for(int i = 0; i <= list_iterator; i++){
+		ESP_LOGI(TAG,"\nMAC: %2x:%2x:%2x:%2x:%2x:%2x\t\tIP:"IPSTR"\t\tRSSI:%d\n",list.sta[i].mac[0],list.sta[i].mac[1],list.sta[i].mac[2],
+			list.sta[i].mac[3],list.sta[i].mac[4],list.sta[i].mac[5],IP2STR(&tcpip_sta_list.sta[i].ip),list.sta[i].rssi);
+		result_station_t entry = {
+			.command = RESULT_CMD_LIST_STATIONS,
+			.index = i + 1,
+			.rssi = list.sta[i].rssi,
+			.ip = tcpip_sta_list.sta[i].ip.addr,
+		};
+		memcpy(entry.mac,list.sta[i].mac,sizeof(entry.mac));
+		result_station(&entry);
+	}
+	return ESP_OK;
+}
+
+static void register_stations_list(void){
+	const esp_console_cmd_t cmd = {
+		.command = "list_stations",
+		.help = "list the stations associated",
+		.hint = NULL,
+		.func = &stations_list,
+	};
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
+}
+
+static struct {
+    struct arg_int *count;
+    struct arg_end *end;
+} print_packets_args;
+
+#define PRINT_BATCH 32
+
+// The dump in progress, written by print_packets() under the console lock
+static struct {
+    int count;
+    uint32_t shown;
+    uint32_t total;         // capture.count and head when the dump started
+    uint32_t head;
+} print_job;
+static battery_packet print_batch[PRINT_BATCH];
+
+/* Runs after the command lock is given back. Each batch is copied out of
+ * the capture under the lock and written without it, so a slow TCP client
+ * only holds up its own session.
+ */
+static void print_packets_dump(void *ctx){
+    int64_t start = esp_timer_get_time();
+    int n = 0;
+    while (n < print_job.count){
+        int batch = (print_job.count - n < PRINT_BATCH) ? print_job.count - n : PRINT_BATCH;
+        console_hold();
+        bool changed = streaming || generic_buffer || (capture.count != print_job.total) || (capture.head != print_job.head);
+        for(int i = 0; !changed && (i < batch); i++){
+            capture_get(&capture,print_job.total - print_job.shown + ((n + i) % print_job.shown),&print_batch[i]);
+        }
+        console_release();
+        if (changed){
+            ESP_LOGW(TAG,"Capture changed, dump stopped after %d frames",n);
+            break;
+        }
+        for(int i = 0; i < batch; i++){
+            const battery_packet *frame = &print_batch[i];
+            ESP_LOGI(TAG,"{\n\n\tID0: %d, time: %lld, accelX: %d, accelY: %d, accelZ: %d, gyroX: %d, gyroY: %d, gyroZ: %d, battery: %u, IDfinal: %d\n",
+                frame->ID0,frame->time,frame->accelX,frame->accelY,frame->accelZ,
+                frame->gyroX,frame->gyroY,frame->gyroZ,frame->battery,frame->IDfinal);
+        }
+        n += batch;
+    }
+    fflush(stdout);
+    int64_t elapsed = esp_timer_get_time() - start;
+    ESP_LOGI(TAG,"Dumped %d frames in %lld ms (%.1f frames/s)",n,elapsed/1000,(elapsed > 0) ? n*1e6/elapsed : 0);
+}
+
+static int print_packets(int argc, char **argv){
+    if ((streaming) || (generic_buffer)){
+        ESP_LOGE(TAG,"Can't print while the trasmission is on");
+        return ESP_OK;
+    }
+    int nerrors = arg_parse(argc, argv, (void **) &print_packets_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, print_packets_args.end, argv[0]);
+        return ESP_OK;
+    }
+    if (capture.count == 0){
+        ESP_LOGW(TAG,"No packets captured yet");
+        return ESP_OK;
+    }
+    // the last 150 frames by default; more than the capture holds repeats it, to time bulk dumps on each console transport
+    uint32_t shown = (capture.count < 150) ? capture.count : 150;
+    int count = shown;
+    if (print_packets_args.count->count > 0){
+        count = print_packets_args.count->ival[0];
+        if (count < 1){
+            ESP_LOGE(TAG,"Count must be positive");
+            return ESP_OK;
+        }
+        shown = ((uint32_t)count < capture.count) ? (uint32_t)count : capture.count;
+    }
+    print_job.count = count;
+    print_job.shown = shown;
+    print_job.total = capture.count;
+    print_job.head = capture.head;
+    console_after(print_packets_dump,NULL);
+    return ESP_OK;
+}
+
+static void register_print_packets(void){
+    print_packets_args.count = arg_int0("n", "count", "<int>", "number of frames to print (default 150), more than captured repeats the capture");
+    print_packets_args.end = arg_end(0);
+    const esp_console_cmd_t cmd = {
+        .command = "print_packets",
+        .help = "print the last received packets (150 by default)",
+        .hint = NULL,
+        .func = &print_packets,
+        .argtable = &print_packets_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
+}
+
+#define BENCH_DISPATCH_BUCKETS 1024
+
+static struct {
+    struct arg_int *iterations;
+    struct arg_end *end;
+} bench_dispatch_args;
+
+static StaticSemaphore_t bench_dispatch_done_buffer;
+static SemaphoreHandle_t bench_dispatch_done = NULL;
+static int64_t bench_dispatch_latency = 0;
+static uint32_t bench_dispatch_hist[BENCH_DISPATCH_BUCKETS];
+static int bench_dispatch_sock = -1;
+
+/* Does what the receiving jobs do first: a recv() on a socket that already
+ * holds data, a loopback datagram sent before the job was submitted, timed
+ * until it returns with it
+ */
+static void task_bench_dispatch(void *pvParameters){
+    uint8_t byte;
+    int err = recv(bench_dispatch_sock,&byte,sizeof(byte),0);
+    bench_dispatch_latency = (err == sizeof(byte)) ? esp_timer_get_time() - worker_submitted_at() : -1;
+    xSemaphoreGive(bench_dispatch_done);
+}
+
+// Queue the datagram, submit the job and wait for it; false if either failed
+static bool bench_dispatch_once(const struct sockaddr_in *self){
+    const uint8_t byte = 0;
+    if (sendto(bench_dispatch_sock,&byte,sizeof(byte),0,(const struct sockaddr *)self,sizeof(*self)) != sizeof(byte)){
+        ESP_LOGE(TAG,"Loopback send failed: %s",strerror(errno));
+        return false;
+    }
+    if (worker_submit("bench_dispatch", task_bench_dispatch, NULL) != ESP_OK){
+        return false;
+    }
+    xSemaphoreTake(bench_dispatch_done, portMAX_DELAY);
+    if (bench_dispatch_latency < 0){
+        ESP_LOGE(TAG,"Loopback recv failed");
+        return false;
+    }
+    return true;
+}
+
+static uint32_t bench_dispatch_percentile(uint32_t total, float percentile){
+    uint32_t target = (uint32_t)(total*percentile);
+    uint32_t seen = 0;
+    for(int i = 0; i < BENCH_DISPATCH_BUCKETS; i++){
+        seen += bench_dispatch_hist[i];
+        if (seen > target){
+            return i;
+        }
+    }
+    return BENCH_DISPATCH_BUCKETS - 1;
+}
+
+static int bench_dispatch(int argc, char **argv){
+    int nerrors = arg_parse(argc, argv, (void **) &bench_dispatch_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, bench_dispatch_args.end, argv[0]);
+        return ESP_OK;
+    }
+    int iterations = 10000;
+    if (bench_dispatch_args.iterations->count > 0){
+        iterations = bench_dispatch_args.iterations->ival[0];
+    }
+    if (iterations <= 0){
+        ESP_LOGE(TAG,"Invalid number of iterations!!");
+        return ESP_OK;
+    }
+    if (bench_dispatch_done == NULL){
+        bench_dispatch_done = xSemaphoreCreateBinaryStatic(&bench_dispatch_done_buffer);
+    }
+    memset(bench_dispatch_hist,0,sizeof(bench_dispatch_hist));
+
+    struct sockaddr_in self = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t self_len = sizeof(self);
+    bench_dispatch_sock = socket(AF_INET,SOCK_DGRAM,IPPROTO_UDP);
+    if (bench_dispatch_sock < 0){
+        ESP_LOGE(TAG,"Unable to create socket: %s",strerror(errno));
+        return ESP_OK;
+    }
+    struct timeval timeout = {.tv_sec = 1};
+    setsockopt(bench_dispatch_sock,SOL_SOCKET,SO_RCVTIMEO,&timeout,sizeof(timeout));
+    if ((bind(bench_dispatch_sock,(struct sockaddr *)&self,sizeof(self)) != 0) ||
+        (getsockname(bench_dispatch_sock,(struct sockaddr *)&self,&self_len) != 0)){
+        ESP_LOGE(TAG,"Unable to bind the loopback socket: %s",strerror(errno));
+        close(bench_dispatch_sock);
+        return ESP_OK;
+    }
+
+    // one warm-up run so that nothing lazily initialised is counted as drift
+    if (!bench_dispatch_once(&self)){
+        close(bench_dispatch_sock);
+        return ESP_OK;
+    }
+
+    uint32_t heap_before = esp_get_free_heap_size();
+    int64_t min = INT64_MAX, max = 0, sum = 0;
+    for(int i = 0; i < iterations; i++){
+        if (!bench_dispatch_once(&self)){
+            close(bench_dispatch_sock);
+            return ESP_OK;
+        }
+        min = (bench_dispatch_latency < min) ? bench_dispatch_latency : min;
+        max = (bench_dispatch_latency > max) ? bench_dispatch_latency : max;
+        sum += bench_dispatch_latency;
+        bench_dispatch_hist[(bench_dispatch_latency < BENCH_DISPATCH_BUCKETS) ? bench_dispatch_latency : BENCH_DISPATCH_BUCKETS - 1]++;
+    }
+    uint32_t heap_after = esp_get_free_heap_size();
+    close(bench_dispatch_sock);
+
+    ESP_LOGI(TAG,"Command to first recv over %d runs: min %lld us, mean %.2f us, p50 %u us, p99 %u us, max %lld us",
+             iterations,min,(double)sum/iterations,bench_dispatch_percentile(iterations,0.5),bench_dispatch_percentile(iterations,0.99),max);
+    if (heap_before != heap_after){
+        ESP_LOGW(TAG,"Heap drift: %d bytes (free before: %u, after: %u)",(int)(heap_before - heap_after),heap_before,heap_after);
+    }else{
+        ESP_LOGI(TAG,"Heap drift: 0 bytes (free: %u, minimum ever: %u)",heap_after,esp_get_minimum_free_heap_size());
+    }
+    worker_pool_print_status();
+    return ESP_OK;
+}
+
+static void register_bench_dispatch(void){
+    bench_dispatch_args.iterations = arg_int0("n", "iterations", "<int>", "number of dispatches to time (default 10000)");
+    bench_dispatch_args.end = arg_end(0);
+    const esp_console_cmd_t cmd = {
+        .command = "bench_dispatch",
+        .help = "time command to worker dispatch and first recv() and check for heap drift",
+        .hint = NULL,
+        .func = &bench_dispatch,
+        .argtable = &bench_dispatch_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
+}
+
+static struct {
+    struct arg_str *field;
+    struct arg_str *from;
+    struct arg_str *to;
+    struct arg_end *end;
+} query_args;
+
+// "1.2s", "350ms", "1200us" or a plain number of seconds
+static bool parse_duration_us(const char *text, int64_t *us){
+    char *unit;
+    double value = strtod(text,&unit);
+    if (unit == text){
+        return false;
+    }
+    if ((*unit == '\0') || (strcmp(unit,"s") == 0)){
+        *us = (int64_t)(value*1e6);
+    }else if (strcmp(unit,"ms") == 0){
+        *us = (int64_t)(value*1e3);
+    }else if (strcmp(unit,"us") == 0){
+        *us = (int64_t)value;
+    }else{
+        return false;
+    }
+    return true;
+}
+
+static int query(int argc, char **argv){
+    int nerrors = arg_parse(argc, argv, (void **) &query_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, query_args.end, argv[0]);
+        return ESP_OK;
+    }
+    if (streaming){
+        ESP_LOGE(TAG,"Can't query while the trasmission is on");
+        return ESP_OK;
+    }
+    int field = capture_field_from_name(query_args.field->sval[0]);
+    if (field < 0){
+        ESP_LOGE(TAG,"Unknown field \"%s\" (time, accelX, accelY, accelZ, gyroX, gyroY, gyroZ, battery)",query_args.field->sval[0]);
+        return ESP_OK;
+    }
+    // the range is relative to the oldest captured frame
+    int64_t from = 0, to = INT64_MAX/2;
+    if ((query_args.from->count > 0) && !parse_duration_us(query_args.from->sval[0],&from)){
+        ESP_LOGE(TAG,"Invalid --from \"%s\"",query_args.from->sval[0]);
+        return ESP_OK;
+    }
+    if ((query_args.to->count > 0) && !parse_duration_us(query_args.to->sval[0],&to)){
+        ESP_LOGE(TAG,"Invalid --to \"%s\"",query_args.to->sval[0]);
+        return ESP_OK;
+    }
+    int64_t base = capture_first_time(&capture);
+    capture_stats_t stats;
+    int64_t start = esp_timer_get_time();
+    capture_query(&capture,field,base + from,base + to,&stats);
+    int64_t elapsed = esp_timer_get_time() - start;
+
+    if (stats.count == 0){
+        ESP_LOGW(TAG,"No captured frames in range (%u frames held)",capture.count);
+        return ESP_OK;
+    }
+    if (field == CAPTURE_TIME){
+        // shown in seconds from the oldest frame
+        ESP_LOGI(TAG,"time: count %u, min %.6f s, max %.6f s, mean %.6f s, stddev %.6f s (%lld us)",stats.count,
+                 (stats.min - base)/1e6,(stats.max - base)/1e6,(stats.mean - base)/1e6,stats.stddev/1e6,elapsed);
+    }else{
+        ESP_LOGI(TAG,"%s: count %u, min %.0f, max %.0f, mean %.3f, stddev %.3f (%lld us)",capture_field_name(field),stats.count,
+                 stats.min,stats.max,stats.mean,stats.stddev,elapsed);
+    }
+    return ESP_OK;
+}
+
+static void register_query(void){
+    query_args.field = arg_str1(NULL, "field", "<name>", "time, accelX, accelY, accelZ, gyroX, gyroY, gyroZ or battery");
+    query_args.from = arg_str0(NULL, "from", "<time>", "start of the range, e.g. 1.2s, 350ms (default: first frame)");
+    query_args.to = arg_str0(NULL, "to", "<time>", "end of the range (default: last frame)");
+    query_args.end = arg_end(0);
+    const esp_console_cmd_t cmd = {
+        .command = "query",
+        .help = "min/max/mean/stddev/count of a captured field over a time range",
+        .hint = NULL,
+        .func = &query,
+        .argtable = &query_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
+}
+
+#define SPECTRUM_MAX_POINTS 4096
+
+/* A transform never has more points than the capture holds, so the work
+ * buffer and sine table are sized to it and taken from the heap with it
+ */
+static uint32_t spectrum_max_points;
+static float *spectrum_buffer;
+static fft_table_t spectrum_table;
+
+static struct {
+    struct arg_str *axis;
+    struct arg_int *points;
+    struct arg_lit *bench;
+    struct arg_end *end;
+} spectrum_args;
+
+static int spectrum(int argc, char **argv){
+    int nerrors = arg_parse(argc, argv, (void **) &spectrum_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, spectrum_args.end, argv[0]);
+        return ESP_OK;
+    }
+    if (spectrum_table.max_n == 0){
+        fft_table_init(&spectrum_table,spectrum_max_points);
+    }
+    if (spectrum_args.bench->count > 0){
+        for(uint32_t n = (spectrum_max_points < 256) ? spectrum_max_points : 256; n <= spectrum_max_points; n <<= 1){
+            fft_bench_result_t result;
+            fft_bench(spectrum_buffer,n,20,&spectrum_table,esp_timer_get_time,&result);
+            ESP_LOGI(TAG,"fft %4u points: %.1f us, max relative error %.2e",n,result.us_per_fft,result.max_error);
+        }
+        return ESP_OK;
+    }
+    if (spectrum_args.axis->count == 0){
+        ESP_LOGE(TAG,"--axis is required unless --bench is given");
+        return ESP_OK;
+    }
+    if (streaming || generic_buffer){
+        ESP_LOGE(TAG,"Can't analyse while the trasmission is on");
+        return ESP_OK;
+    }
+    int field = capture_field_from_name(spectrum_args.axis->sval[0]);
+    if ((field < CAPTURE_ACCEL_X) || (field > CAPTURE_GYRO_Z)){
+        ESP_LOGE(TAG,"Unknown axis \"%s\" (accelX, accelY, accelZ, gyroX, gyroY, gyroZ)",spectrum_args.axis->sval[0]);
+        return ESP_OK;
+    }
+    uint32_t limit = (capture.count < spectrum_max_points) ? capture.count : spectrum_max_points;
+    uint32_t n = 4;
+    while ((n << 1) <= limit){
+        n <<= 1;
+    }
+    if (spectrum_args.points->count > 0){
+        n = (uint32_t)spectrum_args.points->ival[0];
+        if (!fft_is_power_of_two(n) || (n > limit)){
+            ESP_LOGE(TAG,"--points must be a power of two between 4 and %u (%u frames captured)",limit,capture.count);
+            return ESP_OK;
+        }
+    }
+    if (n > limit){
+        ESP_LOGE(TAG,"Not enough captured frames (%u)",capture.count);
+        return ESP_OK;
+    }
+
+    // the newest n frames, oldest first
+    const int16_t *column = capture.axis[field - CAPTURE_ACCEL_X];
+    uint32_t slot = (capture.head + capture.capacity - n) % capture.capacity;
+    int64_t first = capture.time[slot];
+    for(uint32_t i = 0; i < n; i++){
+        spectrum_buffer[i] = column[slot];
+        slot = (slot + 1 == capture.capacity) ? 0 : slot + 1;
+    }
+    int64_t last = capture.time[(slot + capture.capacity - 1) % capture.capacity];
+    if (last <= first){
+        ESP_LOGE(TAG,"Captured timestamps do not advance, can't derive the sample rate");
+        return ESP_OK;
+    }
+    float sample_rate = (float)((n - 1)*1e6/(double)(last - first));
+
+    fft_spectrum_t result;
+    int64_t start = esp_timer_get_time();
+    fft_spectrum(spectrum_buffer,n,sample_rate,&spectrum_table,&result);
+    int64_t elapsed = esp_timer_get_time() - start;
+
+    ESP_LOGI(TAG,"%s: %u points at %.2f Hz, %.3f Hz/bin, noise floor %.1f dBFS (%lld us)",capture_field_name(field),n,
+             result.sample_rate,result.resolution,result.noise_floor_db,elapsed);
+    for(int i = 0; i < result.peak_count; i++){
+        ESP_LOGI(TAG,"  peak %9.3f Hz  +%.1f dB",result.peaks[i].frequency,result.peaks[i].level_db);
+    }
+    for(int i = 0; i < result.spur_count; i++){
+        ESP_LOGW(TAG,"  spur %9.3f Hz  +%.1f dB near a multiple of fs/%u: samples duplicated or dropped every %u frames?",
+                 result.spurs[i].frequency,result.spurs[i].level_db,result.spurs[i].divisor,result.spurs[i].divisor);
+    }
+    return ESP_OK;
+}
+
+static void register_spectrum(void){
+    spectrum_max_points = 4;
+    while (((spectrum_max_points << 1) <= SPECTRUM_MAX_POINTS) && ((spectrum_max_points << 1) <= capture.capacity)){
+        spectrum_max_points <<= 1;
+    }
+    spectrum_buffer = heap_caps_malloc(spectrum_max_points*sizeof(float),MALLOC_CAP_8BIT);
+    spectrum_table.sine = heap_caps_malloc((spectrum_max_points/4 + 1)*sizeof(float),MALLOC_CAP_8BIT);
+    if ((spectrum_buffer == NULL) || (spectrum_table.sine == NULL)){
+        ESP_LOGE(TAG,"No memory for a %u point spectrum",spectrum_max_points);
+        ESP_ERROR_CHECK(ESP_ERR_NO_MEM);
+    }
+    spectrum_args.axis = arg_str0("a", "axis", "<name>", "accelX, accelY, accelZ, gyroX, gyroY or gyroZ");
+    spectrum_args.points = arg_int0("n", "points", "<n>", "FFT size, a power of two (default: largest that fits the capture, max 4096 or the capture size)");
+    spectrum_args.bench = arg_lit0(NULL, "bench", "time the FFT at 256 points up to the largest size and check it against a direct DFT");
+    spectrum_args.end = arg_end(0);
+    const esp_console_cmd_t cmd = {
+        .command = "spectrum",
+        .help = "Spectrum of a captured axis: noise floor, dominant peaks and spurs at fractions of the sample rate",
+        .hint = NULL,
+        .func = &spectrum,
+        .argtable = &spectrum_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
+}
+
+#define SCHEMA_NVS_NAMESPACE "testsuite"
+#define SCHEMA_NVS_KEY "schema"
+
+static struct {
+    struct arg_str *action;
+    struct arg_str *tokens;
+    struct arg_end *end;
+} schema_args;
+
+static void schema_show(void){
+    char text[FRAME_SCHEMA_TEXT_LEN];
+    frame_schema_format(&active_schema,text,sizeof(text));
+    ESP_LOGI(TAG,"%s (%s decoder)",text,active_schema.native ? "native" : "generic");
+}
+
+static void schema_save(const char *text){
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(SCHEMA_NVS_NAMESPACE,NVS_READWRITE,&handle);
+    if (err == ESP_OK){
+        err = (text != NULL) ? nvs_set_str(handle,SCHEMA_NVS_KEY,text) : nvs_erase_key(handle,SCHEMA_NVS_KEY);
+        err = ((err == ESP_OK) || (err == ESP_ERR_NVS_NOT_FOUND)) ? nvs_commit(handle) : err;
+        nvs_close(handle);
+    }
+    if (err != ESP_OK){
+        ESP_LOGW(TAG,"Layout not saved to NVS: %s",esp_err_to_name(err));
+    }
+}
+
+// The layout saved by "schema set", or the battery_packet layout
+static void schema_load(void){
+    active_schema = frame_schema_default;
+    nvs_handle_t handle;
+    if (nvs_open(SCHEMA_NVS_NAMESPACE,NVS_READONLY,&handle) != ESP_OK){
+        return;
+    }
+    char text[FRAME_SCHEMA_TEXT_LEN];
+    size_t length = sizeof(text);
+    if (nvs_get_str(handle,SCHEMA_NVS_KEY,text,&length) == ESP_OK){
+        char error[80];
+        if (!frame_schema_parse(text,&active_schema,error,sizeof(error))){
+            ESP_LOGW(TAG,"Saved frame layout ignored, %s",error);
+            active_schema = frame_schema_default;
+        }
+    }
+    nvs_close(handle);
+}
+
+static int schema(int argc, char **argv){
+    int nerrors = arg_parse(argc, argv, (void **) &schema_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, schema_args.end, argv[0]);
+        return ESP_OK;
+    }
+    const char *action = (schema_args.action->count > 0) ? schema_args.action->sval[0] : "show";
+    if (strcmp(action,"show") == 0){
+        schema_show();
+        return ESP_OK;
+    }
+    if (streaming){
+        ESP_LOGE(TAG,"Can't change the frame layout while the trasmission is on");
+        return ESP_OK;
+    }
+    if (strcmp(action,"reset") == 0){
+        active_schema = frame_schema_default;
+        schema_save(NULL);
+        schema_show();
+        return ESP_OK;
+    }
+    if (strcmp(action,"set") != 0){
+        ESP_LOGE(TAG,"Unknown action \"%s\" (show, set, reset)",action);
+        return ESP_OK;
+    }
+    char text[FRAME_SCHEMA_TEXT_LEN] = {0,};
+    size_t len = 0;
+    for(int i = 0; i < schema_args.tokens->count; i++){
+        len += snprintf(text + len,sizeof(text) - len,"%s%s",(i > 0) ? " " : "",schema_args.tokens->sval[i]);
+        if (len >= sizeof(text)){
+            ESP_LOGE(TAG,"Layout longer than %d characters",FRAME_SCHEMA_TEXT_LEN - 1);
+            return ESP_OK;
+        }
+    }
+    frame_schema_t parsed;
+    char error[80];
+    if (!frame_schema_parse(text,&parsed,error,sizeof(error))){
+        ESP_LOGE(TAG,"Invalid layout, %s",error);
+        return ESP_OK;
+    }
+    if (parsed.size > sizeof(battery_packet)*75){
+        ESP_LOGE(TAG,"Frames larger than the receive buffer");
+        return ESP_OK;
+    }
+    active_schema = parsed;
+    frame_schema_format(&active_schema,text,sizeof(text));
+    schema_save(text);
+    schema_show();
+    return ESP_OK;
+}
+
+static void register_schema(void){
+    schema_load();
+    schema_args.action = arg_str0(NULL, NULL, "<show|set|reset>", "show the frame layout, set a new one or go back to battery_packet");
+    schema_args.tokens = arg_strn(NULL, NULL, "<key=value>", 0, 24, "size=<n> mark=<offset>:<byte> <member>=<offset>:<type>[be] crc=<offset>:crc8|crc16[be] name=<name>");
+    schema_args.end = arg_end(0);
+    const esp_console_cmd_t cmd = {
+        .command = "schema",
+        .help = "Frame layout used to decode the sensor stream, kept in NVS. Members: time, accelX, accelY, accelZ, "
+                "gyroX, gyroY, gyroZ, battery; types: u8, i8, u16, i16, u32, i32, u64, i64",
+        .hint = NULL,
+        .func = &schema,
+        .argtable = &schema_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
+}
@@ -0,0 +1,479 @@
+/* TCP console transport
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "esp_console.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+#include "lwip/sockets.h"
+#include "console_tcp.h"
+
+static const char *TAG = "console_tcp";
+
+static StaticSemaphore_t console_lock_buffer;
+static SemaphoreHandle_t console_lock = NULL;
+static console_after_t after_fn = NULL;     // set by the running command, under console_lock
+static void *after_ctx = NULL;
+
+void console_hold(void){
+    if (console_lock != NULL){
+        xSemaphoreTake(console_lock, portMAX_DELAY);
+    }
+}
+
+void console_release(void){
+    if (console_lock != NULL){
+        xSemaphoreGive(console_lock);
+    }
+}
+
+void console_after(console_after_t after, void *ctx){
+    after_fn = after;
+    after_ctx = ctx;
+}
+
+/* esp_console_run() parses into a shared buffer and every command keeps its
+ * argtable in a static, so only one command line may run at a time.
+ */
+esp_err_t console_run_status(const char *line, int *ret){
+    console_hold();
+    after_fn = NULL;
+    esp_err_t err = esp_console_run(line, ret);
+    console_after_t after = after_fn;
+    void *ctx = after_ctx;
+    after_fn = NULL;
+    console_release();
+    if (after != NULL){
+        after(ctx);
+    }
+    return err;
+}
+
+void console_run(const char *line){
+    int ret;
+    esp_err_t err = console_run_status(line, &ret);
+    if (err == ESP_ERR_NOT_FOUND) {
+        printf("Unrecognized command\n");
+    } else if (err == ESP_ERR_INVALID_ARG) {
+        // command was empty
+    } else if (err == ESP_OK && ret != ESP_OK) {
+        printf("Command returned non-zero error code: 0x%x (%s)\n", ret, esp_err_to_name(ret));
+    } else if (err != ESP_OK) {
+        printf("Internal error: %s\n", esp_err_to_name(err));
+    }
+}
+
+static void console_lock_create(void){
+    if (console_lock == NULL){
+        console_lock = xSemaphoreCreateMutexStatic(&console_lock_buffer);
+    }
+}
+
+#if CONFIG_TESTSUITE_TCP_CONSOLE
+
+#define SESSION_COUNT          CONFIG_TESTSUITE_TCP_CONSOLE_SESSIONS
+#define SESSION_STACK_SIZE     6144
+#define SESSION_PRIORITY       5
+#define SESSION_LINE_LENGTH    256
+#define SESSION_HISTORY        4
+#define SESSION_OUT_BUFFER     1460
+#define LISTENER_STACK_SIZE    3072
+
+#define TELNET_IAC   255
+#define TELNET_DONT  254
+#define TELNET_DO    253
+#define TELNET_WONT  252
+#define TELNET_WILL  251
+#define TELNET_SB    250
+#define TELNET_SE    240
+#define TELNET_ECHO  1
+#define TELNET_SGA   3
+
+static const char *prompt = LOG_COLOR_I "Test Suite> " LOG_RESET_COLOR;
+
+enum editor_state {EDIT_NORMAL, EDIT_IAC, EDIT_IAC_OPTION, EDIT_SB, EDIT_SB_IAC, EDIT_ESC, EDIT_CSI};
+
+typedef struct {
+    TaskHandle_t handle;
+    StaticTask_t tcb;
+    char task_name[configMAX_TASK_NAME_LEN];
+    int fd;
+    bool active;
+    bool follow_logs;
+    uint32_t dropped_log_bytes;
+    struct sockaddr_in peer;
+    FILE *out;
+    char out_buffer[SESSION_OUT_BUFFER];
+
+    // line editor
+    enum editor_state state;
+    uint8_t telnet_command;
+    bool echo;
+    bool last_was_cr;
+    char line[SESSION_LINE_LENGTH];
+    int length;
+    char history[SESSION_HISTORY][SESSION_LINE_LENGTH];
+    int history_count;
+    int history_cursor;
+} console_session_t;
+
+static StackType_t session_stacks[SESSION_COUNT][SESSION_STACK_SIZE];
+static console_session_t sessions[SESSION_COUNT];
+static StaticSemaphore_t sessions_lock_buffer;
+static SemaphoreHandle_t sessions_lock = NULL;
+static StackType_t listener_stack[LISTENER_STACK_SIZE];
+static StaticTask_t listener_tcb;
+static vprintf_like_t uart_vprintf = NULL;
+static uint32_t sessions_connected = 0;     // read without the lock by every ESP_LOG
+static char log_copy[256];                  // formatted under sessions_lock, off the caller's stack
+
+static console_session_t *current_session(void){
+    TaskHandle_t current = xTaskGetCurrentTaskHandle();
+    for(int i = 0; i < SESSION_COUNT; i++){
+        if (sessions[i].handle == current){
+            return &sessions[i];
+        }
+    }
+    return NULL;
+}
+
+/* Logs from every other task (stream summaries, receivers, the deferred
+ * logger) still go to the UART and are copied to the sessions following them.
+ * A session's own command output already goes to its socket through stdout.
+ * This runs for every ESP_LOG of every task, WiFi and lwIP included, so with
+ * no session connected it costs one load, and otherwise it never waits: the
+ * lock is only tried, the text is formatted into a static buffer rather than
+ * on the caller's stack, and the send does not block.
+ */
+static int console_tcp_vprintf(const char *format, va_list args){
+    if (__atomic_load_n(&sessions_connected, __ATOMIC_RELAXED) == 0){
+        return uart_vprintf(format, args);
+    }
+    va_list copy;
+    va_copy(copy, args);
+    int ret = uart_vprintf(format, args);
+    if ((current_session() == NULL) && (xSemaphoreTake(sessions_lock, 0) == pdTRUE)){
+        int len = -1;
+        for(int i = 0; i < SESSION_COUNT; i++){
+            if (!sessions[i].active || !sessions[i].follow_logs){
+                continue;
+            }
+            if (len < 0){
+                len = vsnprintf(log_copy, sizeof(log_copy), format, copy);
+                len = (len >= (int)sizeof(log_copy)) ? (int)sizeof(log_copy) - 1 : len;
+            }
+            // never stall the logging task on a slow client
+            int sent = send(sessions[i].fd, log_copy, len, MSG_DONTWAIT);
+            if (sent < len){
+                sessions[i].dropped_log_bytes += len - ((sent > 0) ? sent : 0);
+            }
+        }
+        xSemaphoreGive(sessions_lock);
+    }
+    va_end(copy);
+    return ret;
+}
+
+static void session_redraw(console_session_t *session){
+    fprintf(stdout, "\r\x1b[K%s%.*s", prompt, session->length, session->line);
+}
+
+static void session_history_add(console_session_t *session){
+    if (session->length == 0){
+        return;
+    }
+    memmove(session->history[1], session->history[0], (SESSION_HISTORY - 1)*SESSION_LINE_LENGTH);
+    strlcpy(session->history[0], session->line, SESSION_LINE_LENGTH);
+    if (session->history_count < SESSION_HISTORY){
+        session->history_count++;
+    }
+}
+
+static void session_history_recall(console_session_t *session, int direction){
+    int cursor = session->history_cursor + direction;
+    if ((cursor < -1) || (cursor >= session->history_count)){
+        return;
+    }
+    session->history_cursor = cursor;
+    if (cursor == -1){
+        session->length = 0;
+    }else{
+        strlcpy(session->line, session->history[cursor], SESSION_LINE_LENGTH);
+        session->length = strlen(session->line);
+    }
+    session_redraw(session);
+}
+
+// Returns true once a full line is in session->line
+static bool session_feed(console_session_t *session, uint8_t c){
+    switch (session->state){
+        case EDIT_IAC:
+            if ((c >= TELNET_WILL) && (c <= TELNET_DONT)){
+                session->telnet_command = c;
+                session->state = EDIT_IAC_OPTION;
+            }else{
+                session->state = (c == TELNET_SB) ? EDIT_SB : EDIT_NORMAL;
+            }
+            return false;
+        case EDIT_IAC_OPTION:
+            // the client agreed to let us echo: it is a real telnet in character mode
+            if ((session->telnet_command == TELNET_DO) && (c == TELNET_ECHO)){
+                session->echo = true;
+            }
+            session->state = EDIT_NORMAL;
+            return false;
+        case EDIT_SB:
+            session->state = (c == TELNET_IAC) ? EDIT_SB_IAC : EDIT_SB;
+            return false;
+        case EDIT_SB_IAC:
+            session->state = (c == TELNET_SE) ? EDIT_NORMAL : EDIT_SB;
+            return false;
+        case EDIT_ESC:
+            session->state = (c == '[') ? EDIT_CSI : EDIT_NORMAL;
+            return false;
+        case EDIT_CSI:
+            if ((c >= '@') && (c <= '~')){
+                if (session->echo && (c == 'A')){
+                    session_history_recall(session, 1);
+                }else if (session->echo && (c == 'B')){
+                    session_history_recall(session, -1);
+                }
+                session->state = EDIT_NORMAL;
+            }
+            return false;
+        case EDIT_NORMAL:
+            break;
+    }
+
+    bool was_cr = session->last_was_cr;
+    session->last_was_cr = (c == '\r');
+    switch (c){
+        case TELNET_IAC:
+            session->state = EDIT_IAC;
+            return false;
+        case 0x1b:
+            session->state = EDIT_ESC;
+            return false;
+        case '\r':
+            session->line[session->length] = '\0';
+            return true;
+        case '\n':
+            if (was_cr){
+                return false;
+            }
+            session->line[session->length] = '\0';
+            return true;
+        case '\0':
+            return false;
+        case 0x03: // Ctrl+C drops the line
+            session->length = 0;
+            fprintf(stdout, "^C\n%s", prompt);
+            return false;
+        case 0x08:
+        case 0x7f:
+            if (session->length > 0){
+                session->length--;
+                if (session->echo){
+                    fputs("\b \b", stdout);
+                }
+            }
+            return false;
+        default:
+            if ((c >= 0x20) && (session->length < SESSION_LINE_LENGTH - 1)){
+                session->line[session->length++] = c;
+                if (session->echo){
+                    fputc(c, stdout);
+                }
+            }
+            return false;
+    }
+}
+
+static void session_run(console_session_t *session){
+    static const uint8_t negotiation[] = {TELNET_IAC, TELNET_WILL, TELNET_ECHO, TELNET_IAC, TELNET_WILL, TELNET_SGA};
+    uint8_t input[64];
+    int nodelay = 1;
+
+    setsockopt(session->fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    send(session->fd, negotiation, sizeof(negotiation), 0);
+
+    session->out = fdopen(session->fd, "w");
+    if (session->out == NULL){
+        ESP_LOGE(TAG,"fdopen failed: %s", strerror(errno));
+        close(session->fd);
+        return;
+    }
+    setvbuf(session->out, session->out_buffer, _IOFBF, sizeof(session->out_buffer));
+    // stdout is per task in ESP-IDF, this only redirects the session task
+    FILE *saved_stdout = stdout;
+    stdout = session->out;
+
+    printf("\nTest Suite over TCP. Type 'help' to get the list of commands, 'exit' to leave.\n%s", prompt);
+    fflush(stdout);
+    while(true){
+        int len = recv(session->fd, input, sizeof(input), 0);
+        if (len <= 0){
+            break;
+        }
+        bool quit = false;
+        for(int i = 0; (i < len) && !quit; i++){
+            if (!session_feed(session, input[i])){
+                continue;
+            }
+            if (session->echo){
+                fputc('\n', stdout);
+            }
+            if ((strcmp(session->line, "exit") == 0) || (strcmp(session->line, "quit") == 0)){
+                quit = true;
+                break;
+            }
+            session_history_add(session);
+            session->history_cursor = -1;
+            if (session->length > 0){
+                console_run(session->line);
+            }
+            session->length = 0;
+            fputs(prompt, stdout);
+        }
+        fflush(stdout);
+        if (quit){
+            break;
+        }
+    }
+
+    stdout = saved_stdout;
+    xSemaphoreTake(sessions_lock, portMAX_DELAY);
+    session->active = false;
+    __atomic_fetch_sub(&sessions_connected, 1, __ATOMIC_RELAXED);
+    fclose(session->out);   // also closes the socket
+    session->out = NULL;
+    session->fd = -1;
+    xSemaphoreGive(sessions_lock);
+    ESP_LOGI(TAG,"Session from %s closed", inet_ntoa(session->peer.sin_addr));
+}
+
+static void session_task(void *pvParameters){
+    console_session_t *self = (console_session_t *)pvParameters;
+    while(true){
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        session_run(self);
+    }
+}
+
+static void listener_task(void *pvParameters){
+    struct sockaddr_in addr = {0,};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(CONFIG_TESTSUITE_TCP_CONSOLE_PORT);
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    if ((listener < 0) || (setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0) ||
+        (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0) || (listen(listener, SESSION_COUNT) != 0)){
+        ESP_LOGE(TAG,"Can't listen on port %d: %s", CONFIG_TESTSUITE_TCP_CONSOLE_PORT, strerror(errno));
+        if (listener >= 0){
+            close(listener);
+        }
+        vTaskDelete(NULL);
+    }
+    ESP_LOGI(TAG,"Console listening on TCP port %d", CONFIG_TESTSUITE_TCP_CONSOLE_PORT);
+
+    while(true){
+        struct sockaddr_in peer;
+        socklen_t peer_len = sizeof(peer);
+        int fd = accept(listener, (struct sockaddr *)&peer, &peer_len);
+        if (fd < 0){
+            vTaskDelay(100/portTICK_PERIOD_MS);
+            continue;
+        }
+        console_session_t *session = NULL;
+        xSemaphoreTake(sessions_lock, portMAX_DELAY);
+        for(int i = 0; i < SESSION_COUNT; i++){
+            if (!sessions[i].active){
+                session = &sessions[i];
+                session->active = true;
+                __atomic_fetch_add(&sessions_connected, 1, __ATOMIC_RELAXED);
+                session->fd = fd;
+                session->peer = peer;
+                session->follow_logs = true;
+                session->dropped_log_bytes = 0;
+                session->state = EDIT_NORMAL;
+                session->echo = false;
+                session->last_was_cr = false;
+                session->length = 0;
+                session->history_cursor = -1;
+                break;
+            }
+        }
+        xSemaphoreGive(sessions_lock);
+        if (session == NULL){
+            static const char busy[] = "All console sessions are in use\r\n";
+            send(fd, busy, sizeof(busy) - 1, 0);
+            close(fd);
+            continue;
+        }
+        ESP_LOGI(TAG,"Session from %s on %s", inet_ntoa(peer.sin_addr), session->task_name);
+        xTaskNotifyGive(session->handle);
+    }
+}
+
+void console_tcp_start(void){
+    console_lock_create();
+    sessions_lock = xSemaphoreCreateMutexStatic(&sessions_lock_buffer);
+    for(int i = 0; i < SESSION_COUNT; i++){
+        sessions[i].fd = -1;
+        snprintf(sessions[i].task_name, sizeof(sessions[i].task_name), "console%d", i);
+        sessions[i].handle = xTaskCreateStaticPinnedToCore(session_task, sessions[i].task_name, SESSION_STACK_SIZE, &sessions[i],
+                                                           SESSION_PRIORITY, session_stacks[i], &sessions[i].tcb, 0);
+    }
+    uart_vprintf = esp_log_set_vprintf(console_tcp_vprintf);
+    xTaskCreateStaticPinnedToCore(listener_task, "console_listen", LISTENER_STACK_SIZE, NULL, SESSION_PRIORITY,
+                                  listener_stack, &listener_tcb, 0);
+}
+
+static int console_sessions(int argc, char **argv){
+    console_session_t *caller = current_session();
+    for(int i = 0; i < SESSION_COUNT; i++){
+        if (sessions[i].active){
+            printf("%s: %s%s, log bytes dropped: %u\n", sessions[i].task_name, inet_ntoa(sessions[i].peer.sin_addr),
+                   (&sessions[i] == caller) ? " (this session)" : "", sessions[i].dropped_log_bytes);
+        }else{
+            printf("%s: free\n", sessions[i].task_name);
+        }
+    }
+    return ESP_OK;
+}
+
+void register_console_tcp(void){
+    const esp_console_cmd_t cmd = {
+        .command = "console_sessions",
+        .help = "list the TCP console sessions",
+        .hint = NULL,
+        .func = &console_sessions,
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
+}
+
+#else
+
+// other transports (control.c) still share the lock with the UART REPL
+void console_tcp_start(void){
+    console_lock_create();
+}
+
+void register_console_tcp(void){
+}
+
+#endif
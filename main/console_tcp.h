@@ -0,0 +1,50 @@
+/* TCP console transport
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Limits of one command line for esp_console_init(), so a transport that
+ * is not typed by hand (see control.h) can pass every option of a command
+ */
+#define CONSOLE_MAX_ARGS    32
+#define CONSOLE_MAX_LINE    1024
+
+// Run one command line and print any error to the caller's stdout. Safe to call from several transports at once.
+void console_run(const char *line);
+
+/* Same, but hand back esp_console_run()'s status and the command's return
+ * code instead of printing them
+ */
+esp_err_t console_run_status(const char *line, int *ret);
+
+/* Bulk output is written after the command lock is given back, so a slow
+ * client does not hold up the other transports: a command hands the
+ * writing to console_after(), which runs it on the same task and stdout
+ * once the command returns. It takes the lock with console_hold() and
+ * console_release() around whatever still needs it, a batch at a time.
+ */
+typedef void (*console_after_t)(void *ctx);
+void console_after(console_after_t after, void *ctx);
+void console_hold(void);
+void console_release(void);
+
+// Start listening for TCP console sessions (only creates the command lock when CONFIG_TESTSUITE_TCP_CONSOLE is off)
+void console_tcp_start(void);
+
+// Register the "console_sessions" console command
+void register_console_tcp(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,278 @@
+/* Remote control server for orchestrating test runs over TCP
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_console.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+#include "lwip/sockets.h"
+#include "console_tcp.h"
+#include "worker_pool.h"
+#include "control.h"
+
+static const char *TAG = "control";
+
+#if CONFIG_TESTSUITE_CONTROL
+
+#define CONTROL_TASK_STACK      6144        // commands run on this task, like on a console session
+#define CONTROL_TASK_PRIORITY   5
+#define CONTROL_TASK_CORE       0
+#define CONTROL_INPUT_SIZE      (CONSOLE_MAX_LINE + 16)
+#define CONTROL_OUTPUT_SIZE     4096
+#define CONTROL_HEADER_SIZE     64
+
+static TaskHandle_t control_task_handle = NULL;
+static StackType_t control_task_stack[CONTROL_TASK_STACK];
+static StaticTask_t control_task_tcb;
+static StaticSemaphore_t control_send_lock_buffer;
+static SemaphoreHandle_t control_send_lock = NULL;
+static volatile int control_client = -1;
+static struct sockaddr_in control_peer;
+
+// a request line, then what its command printed
+static char control_input[CONTROL_INPUT_SIZE];
+static char control_output[CONTROL_OUTPUT_SIZE];
+static FILE *control_out = NULL;
+
+static struct {
+    uint32_t connections;
+    uint32_t requests;
+    uint32_t errors;
+    uint32_t jobs;
+    uint32_t done;
+    uint32_t truncated;         // responses cut to CONTROL_OUTPUT_SIZE
+    uint32_t running_max_us;    // longest time a command kept the control task
+    uint64_t running_us;
+} control_stats;
+
+/* Responses and done events come from different tasks: each message goes
+ * out whole under the send lock so they never interleave on the socket.
+ */
+static void control_send(uint32_t id, const char *kind, int32_t code, uint32_t jobs, uint32_t ms, const char *body, size_t len){
+    char header[CONTROL_HEADER_SIZE];
+    int header_len = snprintf(header, sizeof(header), "%u %s %d %u %u %u\n", id, kind, code, jobs, ms, len);
+    xSemaphoreTake(control_send_lock, portMAX_DELAY);
+    int client = control_client;
+    if (client >= 0){
+        send(client, header, header_len, (len > 0) ? MSG_MORE : 0);
+        if (len > 0){
+            send(client, body, len, 0);
+        }
+    }
+    xSemaphoreGive(control_send_lock);
+}
+
+static void control_error(uint32_t id, esp_err_t code, const char *text){
+    control_stats.errors++;
+    control_send(id, "error", code, 0, 0, text, strlen(text));
+}
+
+/* Runs on the worker that ran the job. Jobs return nothing, so the code is
+ * always 0; how a run went is in its result records.
+ */
+static void control_job_done(uint32_t tag, const char *name, int64_t submitted_at){
+    uint32_t elapsed_ms = (esp_timer_get_time() - submitted_at) / 1000;
+    control_stats.done++;
+    control_send(tag, "done", 0, 0, elapsed_ms, name, (name != NULL) ? strlen(name) : 0);
+}
+
+static void control_request(char *line){
+    char *end;
+    unsigned long id = strtoul(line, &end, 10);
+    if ((end == line) || (id == 0) || (id > UINT32_MAX) || ((*end != ' ') && (*end != '\0'))){
+        control_error(0, ESP_ERR_INVALID_ARG, "request must start with an id from 1 to 4294967295");
+        return;
+    }
+    control_stats.requests++;
+
+    rewind(control_out);
+    int64_t started = esp_timer_get_time();
+    int ret = ESP_OK;
+    worker_tag_begin(id);
+    esp_err_t err = console_run_status(end, &ret);
+    uint32_t jobs = worker_tag_end();
+    uint32_t running_us = esp_timer_get_time() - started;
+    fflush(control_out);
+    long len = ftell(control_out);
+
+    control_stats.running_us += running_us;
+    if (running_us > control_stats.running_max_us){
+        control_stats.running_max_us = running_us;
+    }
+    control_stats.jobs += jobs;
+    if (err == ESP_ERR_NOT_FOUND){
+        control_error(id, err, "unknown command");
+        return;
+    }
+    if (err == ESP_ERR_INVALID_ARG){
+        control_error(id, err, "empty command");
+        return;
+    }
+    // fmemopen keeps the last byte for a terminating zero
+    if ((len < 0) || (len >= CONTROL_OUTPUT_SIZE - 1)){
+        control_stats.truncated++;
+        len = CONTROL_OUTPUT_SIZE - 1;
+    }
+    control_send(id, "ok", (err == ESP_OK) ? ret : err, jobs, running_us / 1000, control_output, len);
+}
+
+static void control_serve(int client){
+    char hello[CONTROL_HEADER_SIZE];
+    int hello_len = snprintf(hello, sizeof(hello), "0 hello %d 0 0 0\n", CONTROL_VERSION);
+    int nodelay = 1;
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    if (send(client, hello, hello_len, 0) != hello_len){
+        return;
+    }
+
+    int held = 0;
+    bool discarding = false;    // inside a line too long to keep
+    while(true){
+        int got = recv(client, control_input + held, sizeof(control_input) - 1 - held, 0);
+        if (got <= 0){
+            return;
+        }
+        held += got;
+        // every complete line in the buffer, in order
+        char *start = control_input;
+        char *newline;
+        while ((newline = memchr(start, '\n', control_input + held - start)) != NULL){
+            *newline = '\0';
+            if (newline > start && newline[-1] == '\r'){
+                newline[-1] = '\0';
+            }
+            if (discarding){
+                discarding = false;
+            }else if (*start != '\0'){
+                control_request(start);
+            }
+            start = newline + 1;
+        }
+        held -= start - control_input;
+        memmove(control_input, start, held);
+        if (held == sizeof(control_input) - 1){
+            if (!discarding){
+                control_error(0, ESP_ERR_INVALID_SIZE, "line too long");
+            }
+            discarding = true;
+            held = 0;
+        }
+    }
+}
+
+static void control_task(void *pvParameters){
+    struct sockaddr_in addr = {0,};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(CONFIG_TESTSUITE_CONTROL_PORT);
+
+    // stdout and stderr are per task in ESP-IDF: everything a command prints lands in control_output
+    control_out = fmemopen(control_output, sizeof(control_output), "w");
+    if (control_out == NULL){
+        ESP_LOGE(TAG,"fmemopen failed: %s", strerror(errno));
+        vTaskDelete(NULL);
+    }
+    setvbuf(control_out, NULL, _IONBF, 0);
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if ((listener < 0) || (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0) || (listen(listener, 1) != 0)){
+        ESP_LOGE(TAG,"Can't listen on port %d: %s", CONFIG_TESTSUITE_CONTROL_PORT, strerror(errno));
+        vTaskDelete(NULL);
+    }
+    ESP_LOGI(TAG,"Control on TCP port %d", CONFIG_TESTSUITE_CONTROL_PORT);
+
+    while(true){
+        socklen_t peer_len = sizeof(control_peer);
+        int client = accept(listener, (struct sockaddr *)&control_peer, &peer_len);
+        if (client < 0){
+            vTaskDelay(100/portTICK_PERIOD_MS);
+            continue;
+        }
+        control_stats.connections++;
+        control_client = client;
+        ESP_LOGI(TAG,"Host %s connected", inet_ntoa(control_peer.sin_addr));
+
+        FILE *saved_stdout = stdout;
+        FILE *saved_stderr = stderr;
+        stdout = control_out;
+        stderr = control_out;
+        control_serve(client);
+        stdout = saved_stdout;
+        stderr = saved_stderr;
+
+        // jobs still running after this find no client and stay quiet
+        xSemaphoreTake(control_send_lock, portMAX_DELAY);
+        control_client = -1;
+        xSemaphoreGive(control_send_lock);
+        close(client);
+        ESP_LOGI(TAG,"Host %s disconnected", inet_ntoa(control_peer.sin_addr));
+    }
+}
+
+void control_start(void){
+    control_send_lock = xSemaphoreCreateMutexStatic(&control_send_lock_buffer);
+    worker_on_done(control_job_done);
+    control_task_handle = xTaskCreateStaticPinnedToCore(control_task, "control", CONTROL_TASK_STACK, NULL, CONTROL_TASK_PRIORITY,
+                                                        control_task_stack, &control_task_tcb, CONTROL_TASK_CORE);
+}
+
+static int control(int argc, char **argv){
+    ESP_LOGI(TAG,"port %d, %s%s", CONFIG_TESTSUITE_CONTROL_PORT,
+             (control_client >= 0) ? "host " : "no host connected",
+             (control_client >= 0) ? inet_ntoa(control_peer.sin_addr) : "");
+    ESP_LOGI(TAG,"connections: %u, requests: %u, errors: %u, jobs started: %u, done: %u, truncated responses: %u",
+             control_stats.connections, control_stats.requests, control_stats.errors, control_stats.jobs,
+             control_stats.done, control_stats.truncated);
+    if (control_stats.requests > 0){
+        ESP_LOGI(TAG,"command time: mean %llu us, max %u us",
+                 control_stats.running_us / control_stats.requests, control_stats.running_max_us);
+    }
+    return ESP_OK;
+}
+
+void register_control(void){
+    const esp_console_cmd_t cmd = {
+        .command = "control",
+        .help = "state of the remote control server",
+        .hint = NULL,
+        .func = &control,
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
+}
+
+#else
+
+void control_start(void){
+}
+
+static int control(int argc, char **argv){
+    ESP_LOGE(TAG,"Remote control disabled, enable CONFIG_TESTSUITE_CONTROL");
+    return ESP_OK;
+}
+
+void register_control(void){
+    const esp_console_cmd_t cmd = {
+        .command = "control",
+        .help = "remote control server (disabled in this build)",
+        .hint = NULL,
+        .func = &control,
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
+}
+
+#endif
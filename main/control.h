@@ -0,0 +1,58 @@
+/* Remote control server for orchestrating test runs over TCP
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* One host at a time connects to CONFIG_TESTSUITE_CONTROL_PORT and sends
+ * requests, one per line, without waiting for the answers:
+ *
+ *     <id> <command line>\n
+ *
+ * <id> is a decimal number from 1 to 4294967295 chosen by the host. The
+ * line runs through esp_console like one typed on the UART, so every
+ * registered command and its argtable is there, with up to
+ * CONSOLE_MAX_ARGS arguments. Requests run one after the other in the
+ * order they came. Every message the board sends is a header line and a
+ * body:
+ *
+ *     <id> <kind> <code> <jobs> <ms> <length>\n<length bytes>
+ *
+ *     hello   id 0, code CONTROL_VERSION, sent once on connection
+ *     ok      the command returned <code> after running <ms> ms; the
+ *             body is what it printed; <jobs> background jobs (streams,
+ *             benchmarks) it started will each send a "done" later
+ *     error   the line did not run: <code> is ESP_ERR_NOT_FOUND for an
+ *             unknown command, ESP_ERR_INVALID_ARG for a bad id or an
+ *             empty line, ESP_ERR_INVALID_SIZE for a line too long; the
+ *             body says which
+ *     done    a job of request <id> finished <ms> ms after it was
+ *             started; <code> and <jobs> are 0 and the body is the
+ *             job's name. The result channel says how the run went.
+ *
+ * A "done" may come before the "ok" of its own request when the job is
+ * quick; match them by id, not by order, and count them against the
+ * <jobs> of the "ok".
+ */
+// 2: <ms> added, "done" moved its time there from <code>
+#define CONTROL_VERSION 2
+
+// Start listening for a control host. Call once at boot, after console_tcp_start().
+void control_start(void);
+
+// Register the "control" console command
+void register_control(void);
+
+#ifdef __cplusplus
+}
+#endif
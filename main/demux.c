@@ -0,0 +1,194 @@
+/* Demultiplexer for sensor sockets carrying both frames and JSON replies
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "demux.h"
+
+void demux_init(demux_t *demux, const frame_schema_t *schema, demux_frame_sink_t on_frame, demux_json_sink_t on_json, void *ctx){
+    memset(demux, 0, sizeof(*demux));
+    demux->schema = schema;
+    demux->on_frame = on_frame;
+    demux->on_json = on_json;
+    demux->ctx = ctx;
+    // only a marker on the first byte rules a frame out at the first byte
+    demux->brace_may_start_frame = true;
+    for(int i = 0; i < schema->marker_count; i++){
+        if (schema->markers[i].offset == 0){
+            demux->brace_may_start_frame = (schema->markers[i].value == '{');
+        }
+    }
+}
+
+static void demux_json(demux_t *demux, const uint8_t *text, size_t len, demux_json_part_t part){
+    if (demux->on_json != NULL){
+        demux->on_json(demux->ctx, (const char *)text, len, part);
+    }
+}
+
+void demux_reset(demux_t *demux){
+    if (demux->in_message){
+        demux_json(demux, NULL, 0, DEMUX_JSON_ABORT);
+        demux->stats.false_starts++;
+        demux->in_message = false;
+    }
+    demux->resyncing = false;
+    demux->after_message = false;
+}
+
+static inline bool demux_space(uint8_t c){
+    return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n');
+}
+
+// The message was not one: drop it, and look for the boundary again from data[at]
+static size_t demux_abandon(demux_t *demux, const uint8_t *data, size_t from, size_t at){
+    demux_json(demux, data + from, at - from, DEMUX_JSON_ABORT);
+    demux->stats.false_starts++;
+    demux->stats.skipped += demux->message_len + at - from;
+    demux->in_message = false;
+    if (!demux->resyncing){
+        demux->resyncing = true;
+        demux->stats.corrupted++;
+        if (demux->on_frame != NULL){
+            demux->on_frame(demux->ctx, FRAME_BAD_MARKER, NULL, at);
+        }
+    }
+    return at;
+}
+
+/* Scan the message bytes in data[from..len) for the brace that closes the
+ * object, skipping the first `skip`. Returns where the stream goes on:
+ * past the closing brace, at the end, or at the byte that showed it was
+ * not JSON.
+ */
+static size_t demux_scan(demux_t *demux, const uint8_t *data, size_t from, size_t skip, size_t len){
+    size_t limit = from + DEMUX_MAX_MESSAGE - demux->message_len;
+    for(size_t i = from + skip; i < len; i++){
+        uint8_t c = data[i];
+        if (i >= limit){
+            return demux_abandon(demux, data, from, i);
+        }
+        if (demux->in_string){
+            if (demux->escape){
+                demux->escape = false;
+            }else if (c == '\\'){
+                demux->escape = true;
+            }else if (c == '"'){
+                demux->in_string = false;
+            }else if (c < 0x20){
+                return demux_abandon(demux, data, from, i);
+            }
+            continue;
+        }
+        if (demux_space(c)){
+            continue;
+        }
+        if (demux->opened){
+            // an object opens with a key or closes at once
+            if ((c != '"') && (c != '}')){
+                return demux_abandon(demux, data, from, i);
+            }
+            demux->opened = false;
+        }
+        if (c == '"'){
+            demux->in_string = true;
+        }else if ((c == '{') || (c == '[')){
+            if (++demux->depth > DEMUX_MAX_DEPTH){
+                return demux_abandon(demux, data, from, i);
+            }
+        }else if ((c == '}') || (c == ']')){
+            if (--demux->depth == 0){
+                demux_json(demux, data + from, i + 1 - from, DEMUX_JSON_END);
+                demux->stats.messages++;
+                demux->stats.message_bytes += demux->message_len + i + 1 - from;
+                demux->in_message = false;
+                demux->after_message = true;
+                demux->resyncing = false;
+                return i + 1;
+            }
+        }else if ((c < 0x20) || (c >= 0x7f)){
+            return demux_abandon(demux, data, from, i);
+        }
+    }
+    demux_json(demux, data + from, len - from, DEMUX_JSON_MORE);
+    demux->message_len += len - from;
+    return len;
+}
+
+// data[at] is '{'
+static size_t demux_open(demux_t *demux, const uint8_t *data, size_t at, size_t len){
+    demux->in_message = true;
+    demux->opened = true;
+    demux->in_string = false;
+    demux->escape = false;
+    demux->depth = 1;
+    demux->message_len = 0;
+    return demux_scan(demux, data, at, 1, len);
+}
+
+size_t demux_feed(demux_t *demux, const uint8_t *data, size_t len){
+    const size_t size = demux->schema->size;
+    size_t at = 0;
+    while (at < len){
+        if (demux->in_message){
+            at = demux_scan(demux, data, at, 0, len);
+            continue;
+        }
+        uint8_t first = data[at];
+        if ((first == '{') && !demux->brace_may_start_frame){
+            at = demux_open(demux, data, at, len);
+            continue;
+        }
+        if (len - at < size){
+            break;
+        }
+        battery_packet frame;
+        frame_status_t status = frame_decode(demux->schema, data + at, &frame);
+        if (status != FRAME_BAD_MARKER){
+            demux->stats.frames += (status == FRAME_OK);
+            demux->stats.crc_failed += (status == FRAME_BAD_CRC);
+            demux->resyncing = false;
+            demux->after_message = false;
+            at += size;
+            if (demux->on_frame != NULL){
+                demux->on_frame(demux->ctx, status, &frame, at);
+            }
+            continue;
+        }
+        if (first == '{'){
+            at = demux_open(demux, data, at, len);
+            continue;
+        }
+        if (demux->after_message && ((first == '\0') || demux_space(first))){
+            demux->stats.message_bytes++;
+            at++;
+            continue;
+        }
+        if (!demux->resyncing){
+            demux->resyncing = true;
+            demux->stats.corrupted++;
+            if (demux->on_frame != NULL){
+                demux->on_frame(demux->ctx, FRAME_BAD_MARKER, NULL, at);
+            }
+        }
+        demux->stats.skipped++;
+        at++;
+    }
+    return at;
+}
+
+int demux_format(const demux_t *demux, char *line, size_t size){
+    const demux_stats_t *s = &demux->stats;
+    return snprintf(line, size,
+                    "demux: %llu frames, %llu CRC failures, boundary lost %llu times (%llu bytes skipped), "
+                    "%llu JSON messages (%llu bytes), %llu false starts",
+                    (unsigned long long)s->frames, (unsigned long long)s->crc_failed, (unsigned long long)s->corrupted,
+                    (unsigned long long)s->skipped, (unsigned long long)s->messages, (unsigned long long)s->message_bytes,
+                    (unsigned long long)s->false_starts);
+}
@@ -0,0 +1,100 @@
+/* Demultiplexer for sensor sockets carrying both frames and JSON replies
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "frame.h"
+#include "frame_schema.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DEMUX_MAX_MESSAGE   1024    // a longer "message" is taken for frame bytes that happened to start with '{'
+#define DEMUX_MAX_DEPTH     16
+
+typedef enum {
+    DEMUX_JSON_MORE,            // part of a message, more follows
+    DEMUX_JSON_END,             // the last part, the message is complete
+    DEMUX_JSON_ABORT,           // it was not JSON after all: forget the parts seen so far
+} demux_json_part_t;
+
+/* Called for every frame slot: FRAME_OK and FRAME_BAD_CRC with the decoded
+ * frame, FRAME_BAD_MARKER with NULL once each time the frame boundary is
+ * lost. `end` is the offset in the fed buffer just past the frame, or where
+ * the boundary was lost.
+ */
+typedef void (*demux_frame_sink_t)(void *ctx, frame_status_t status, const battery_packet *frame, size_t end);
+
+// Called with each piece of a JSON message as it arrives; text points into the fed buffer
+typedef void (*demux_json_sink_t)(void *ctx, const char *text, size_t len, demux_json_part_t part);
+
+typedef struct {
+    uint64_t frames;
+    uint64_t crc_failed;
+    uint64_t corrupted;         // times the frame boundary was lost
+    uint64_t skipped;           // bytes passed over to find it again, false starts included
+    uint64_t messages;
+    uint64_t message_bytes;     // padding after a message included
+    uint64_t false_starts;      // '{' that turned out not to start a message
+} demux_stats_t;
+
+/* The sensor answers commands with JSON objects on the socket it streams
+ * frames on. At a frame boundary the first byte tells them apart: a frame
+ * starts with its marker, a message with '{'. Frames are decoded in place
+ * with one extra compare per frame and nothing per byte; only message bytes
+ * are scanned, for the brace that closes the object. They go to the JSON
+ * sink in pieces, so a message split over reads costs no copy here.
+ *
+ * A frame whose markers fail means the boundary is lost (or a message began
+ * where a frame was expected): the stream is then searched byte by byte for
+ * the next valid frame or message. A message must look like an object from
+ * its first token, keep to printable text and close within DEMUX_MAX_MESSAGE
+ * bytes, or it is abandoned and the search goes on from where it failed.
+ *
+ * When the schema lets a frame start with '{' the frame is tried first and
+ * a message shorter than a frame waits for more bytes.
+ */
+typedef struct {
+    const frame_schema_t *schema;
+    demux_frame_sink_t on_frame;
+    demux_json_sink_t on_json;
+    void *ctx;
+    bool brace_may_start_frame;
+    bool resyncing;             // between losing the boundary and the next frame or message
+    bool after_message;         // the padding the sensor sends after a reply is skipped quietly
+    bool in_message;
+    bool opened;                // '{' seen, the first token decides if it is an object
+    bool in_string;
+    bool escape;
+    uint8_t depth;
+    uint32_t message_len;       // bytes of the current message in earlier buffers
+    demux_stats_t stats;
+} demux_t;
+
+// Either sink may be NULL
+void demux_init(demux_t *demux, const frame_schema_t *schema, demux_frame_sink_t on_frame, demux_json_sink_t on_json, void *ctx);
+
+// Forget a partial message, e.g. after reconnecting. The counters are kept.
+void demux_reset(demux_t *demux);
+
+/* Route every frame and message piece in data[0..len) and return the bytes
+ * used. The rest, less than a frame, is the start of the next one: present
+ * it again with more bytes after it.
+ */
+size_t demux_feed(demux_t *demux, const uint8_t *data, size_t len);
+
+// One line: frames, CRC failures, boundary losses, messages and false starts
+int demux_format(const demux_t *demux, char *line, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
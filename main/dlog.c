@@ -0,0 +1,363 @@
+/* Deferred logger
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include "esp_log.h"
+#include "esp_console.h"
+#include "argtable3/argtable3.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include "dlog.h"
+
+#define DLOG_RING_SIZE      CONFIG_TESTSUITE_DLOG_RECORDS
+#define DLOG_TEXT_BYTES     (DLOG_MAX_ARGS*sizeof(uint64_t))
+#define DLOG_MAX_TEXT       1024
+#define DLOG_LINE_LENGTH    (DLOG_MAX_TEXT + 64)
+#define DLOG_TASK_STACK     4096
+#define DLOG_TASK_PRIORITY  (tskIDLE_PRIORITY + 1)
+#define DLOG_TASK_CORE      0
+
+_Static_assert((DLOG_RING_SIZE & (DLOG_RING_SIZE - 1)) == 0, "CONFIG_TESTSUITE_DLOG_RECORDS must be a power of two");
+
+static const char *TAG = "dlog";
+
+enum dlog_kind {DLOG_FORMAT, DLOG_TEXT};
+
+typedef struct {
+    uint32_t sequence;
+    uint8_t level;
+    uint8_t kind;
+    uint16_t count;         // arguments for DLOG_FORMAT, slots used for DLOG_TEXT
+    const char *tag;
+    const char *format;
+    uint32_t timestamp;
+    union {
+        uint64_t args[DLOG_MAX_ARGS];
+        char text[DLOG_TEXT_BYTES];
+    };
+} dlog_record_t;
+
+/* Bounded multi-producer ring: a slot is free for position p when its
+ * sequence equals p and holds a record once it equals p + 1, so producers on
+ * either core (or in an ISR) only race on one compare-and-swap of the head.
+ */
+static dlog_record_t dlog_ring[DLOG_RING_SIZE];
+static uint32_t dlog_head = 0;
+static uint32_t dlog_tail = 0;
+static dlog_stats_t dlog_stats = {0,};
+
+static StackType_t dlog_task_stack[DLOG_TASK_STACK];
+static StaticTask_t dlog_task_tcb;
+static TaskHandle_t dlog_task_handle = NULL;
+static bool dlog_waiting = false;   // the logging task found the ring empty and sleeps until notified
+static char dlog_line[DLOG_LINE_LENGTH];
+static esp_log_level_t dlog_level = CONFIG_LOG_DEFAULT_LEVEL;   // records above it never take a slot
+
+static dlog_record_t *dlog_claim(int slots, uint32_t *position){
+    uint32_t pos = __atomic_load_n(&dlog_head, __ATOMIC_RELAXED);
+    while(true){
+        // the consumer frees slots in order, so the last slot being free means all of them are
+        uint32_t last = pos + slots - 1;
+        uint32_t sequence = __atomic_load_n(&dlog_ring[last & (DLOG_RING_SIZE - 1)].sequence, __ATOMIC_ACQUIRE);
+        int32_t diff = (int32_t)(sequence - last);
+        if (diff == 0){
+            if (__atomic_compare_exchange_n(&dlog_head, &pos, pos + slots, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+                break;
+            }
+        }else if (diff < 0){
+            __atomic_fetch_add(&dlog_stats.dropped, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }else{
+            pos = __atomic_load_n(&dlog_head, __ATOMIC_RELAXED);
+        }
+    }
+    uint32_t used = pos + slots - __atomic_load_n(&dlog_tail, __ATOMIC_RELAXED);
+    uint32_t high_water = __atomic_load_n(&dlog_stats.high_water, __ATOMIC_RELAXED);
+    while ((used > high_water) &&
+           !__atomic_compare_exchange_n(&dlog_stats.high_water, &high_water, used, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+    }
+    __atomic_fetch_add(&dlog_stats.written, 1, __ATOMIC_RELAXED);
+    *position = pos;
+    return &dlog_ring[pos & (DLOG_RING_SIZE - 1)];
+}
+
+/* The store of the sequence and the load of dlog_waiting pair with the
+ * consumer's store of dlog_waiting and load of the sequence, both sequentially
+ * consistent: either the consumer sees the record or the producer sees it
+ * waiting. Only a sleeping consumer costs the producer a notification.
+ */
+static void dlog_publish(uint32_t position){
+    __atomic_store_n(&dlog_ring[position & (DLOG_RING_SIZE - 1)].sequence, position + 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&dlog_waiting, __ATOMIC_SEQ_CST) && __atomic_exchange_n(&dlog_waiting, false, __ATOMIC_SEQ_CST)){
+        if (xPortInIsrContext()){
+            BaseType_t woken = pdFALSE;
+            vTaskNotifyGiveFromISR(dlog_task_handle, &woken);
+            if (woken == pdTRUE){
+                portYIELD_FROM_ISR();
+            }
+        }else{
+            xTaskNotifyGive(dlog_task_handle);
+        }
+    }
+}
+
+void dlog_write(esp_log_level_t level, const char *tag, const char *format, int nargs, const uint64_t *args){
+    if (level > dlog_level){
+        return;
+    }
+    uint32_t position;
+    dlog_record_t *record = dlog_claim(1, &position);
+    if (record == NULL){
+        return;
+    }
+    record->level = level;
+    record->kind = DLOG_FORMAT;
+    record->count = (nargs > DLOG_MAX_ARGS) ? DLOG_MAX_ARGS : nargs;
+    record->tag = tag;
+    record->format = format;
+    record->timestamp = esp_log_timestamp();
+    memcpy(record->args, args, record->count*sizeof(uint64_t));
+    dlog_publish(position);
+}
+
+void dlog_write_text(esp_log_level_t level, const char *tag, const void *data, size_t len){
+    if (level > dlog_level){
+        return;
+    }
+    if (len > DLOG_MAX_TEXT){
+        len = DLOG_MAX_TEXT;
+    }
+    int slots = (len + DLOG_TEXT_BYTES - 1)/DLOG_TEXT_BYTES;
+    if (slots == 0){
+        slots = 1;
+    }
+    uint32_t position;
+    dlog_record_t *record = dlog_claim(slots, &position);
+    if (record == NULL){
+        return;
+    }
+    const uint8_t *bytes = data;
+    for(int i = slots - 1; i >= 0; i--){
+        record = &dlog_ring[(position + i) & (DLOG_RING_SIZE - 1)];
+        size_t offset = i*DLOG_TEXT_BYTES;
+        size_t chunk = (len - offset < DLOG_TEXT_BYTES) ? len - offset : DLOG_TEXT_BYTES;
+        record->level = level;
+        record->kind = DLOG_TEXT;
+        record->count = (i == 0) ? slots : 0;
+        record->tag = tag;
+        record->format = NULL;
+        record->timestamp = esp_log_timestamp();
+        memcpy(record->text, bytes + offset, chunk);
+        if (chunk < DLOG_TEXT_BYTES){
+            record->text[chunk] = '\0';
+        }
+        // the first slot is published last, the consumer never sees a partial text
+        if (i != 0){
+            __atomic_store_n(&record->sequence, position + i + 1, __ATOMIC_RELAXED);
+        }
+    }
+    dlog_publish(position);
+}
+
+/* printf only ever sees one conversion at a time, with the argument cast to
+ * the type its length modifier asks for.
+ */
+static size_t dlog_format(char *out, size_t size, const char *format, const uint64_t *args, int nargs){
+    size_t len = 0;
+    int arg = 0;
+    const char *p = format;
+
+    while((*p != '\0') && (len < size - 1)){
+        if (*p != '%'){
+            out[len++] = *p++;
+            continue;
+        }
+        if (p[1] == '%'){
+            out[len++] = '%';
+            p += 2;
+            continue;
+        }
+        char spec[16];
+        int spec_len = 0;
+        spec[spec_len++] = *p++;
+        while((*p != '\0') && (strchr("-+ #0123456789.hlLjzt", *p) != NULL) && (spec_len < (int)sizeof(spec) - 2)){
+            spec[spec_len++] = *p++;
+        }
+        if (*p == '\0'){
+            break;
+        }
+        char conversion = *p++;
+        spec[spec_len++] = conversion;
+        spec[spec_len] = '\0';
+
+        uint64_t value = (arg < nargs) ? args[arg++] : 0;
+        int written;
+        switch (conversion){
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': {
+                double d;
+                memcpy(&d, &value, sizeof(d));
+                written = snprintf(out + len, size - len, spec, d);
+                break;
+            }
+            case 's':
+                written = snprintf(out + len, size - len, spec, value ? (const char *)(uintptr_t)value : "(null)");
+                break;
+            case 'p':
+                written = snprintf(out + len, size - len, spec, (void *)(uintptr_t)value);
+                break;
+            default:
+                if ((strstr(spec, "ll") != NULL) || (strchr(spec, 'j') != NULL)){
+                    written = snprintf(out + len, size - len, spec, (long long)value);
+                }else if ((strchr(spec, 'l') != NULL) || (strchr(spec, 'z') != NULL) || (strchr(spec, 't') != NULL)){
+                    written = snprintf(out + len, size - len, spec, (long)value);
+                }else{
+                    written = snprintf(out + len, size - len, spec, (int)value);
+                }
+                break;
+        }
+        if (written < 0){
+            break;
+        }
+        len += written;
+        if (len >= size){
+            len = size - 1;
+        }
+    }
+    out[len] = '\0';
+    return len;
+}
+
+static char dlog_level_letter(uint8_t level){
+    switch (level){
+        case ESP_LOG_ERROR: return 'E';
+        case ESP_LOG_WARN: return 'W';
+        case ESP_LOG_INFO: return 'I';
+        case ESP_LOG_DEBUG: return 'D';
+        default: return 'V';
+    }
+}
+
+static const char *dlog_level_color(uint8_t level){
+    switch (level){
+        case ESP_LOG_ERROR: return LOG_COLOR_E;
+        case ESP_LOG_WARN: return LOG_COLOR_W;
+        case ESP_LOG_INFO: return LOG_COLOR_I;
+        default: return "";
+    }
+}
+
+static void dlog_print(const dlog_record_t *first, uint32_t position){
+    size_t len = 0;
+    if (first->kind == DLOG_FORMAT){
+        len = dlog_format(dlog_line, sizeof(dlog_line), first->format, first->args, first->count);
+    }else{
+        for(int i = 0; i < first->count; i++){
+            const dlog_record_t *record = &dlog_ring[(position + i) & (DLOG_RING_SIZE - 1)];
+            for(int j = 0; (j < DLOG_TEXT_BYTES) && (len < sizeof(dlog_line) - 1); j++){
+                char c = record->text[j];
+                if (c == '\0'){
+                    break;
+                }
+                dlog_line[len++] = (isprint((unsigned char)c) || (c == '\n') || (c == '\t')) ? c : '.';
+            }
+        }
+        dlog_line[len] = '\0';
+    }
+    // same layout as ESP_LOGx, but with the time the record was written
+    esp_log_write(first->level, first->tag, "%s%c (%u) %s: %s" LOG_RESET_COLOR "\n",
+                  dlog_level_color(first->level), dlog_level_letter(first->level), first->timestamp, first->tag, dlog_line);
+}
+
+static void dlog_task(void *pvParameters){
+    while(true){
+        uint32_t position = dlog_tail;
+        dlog_record_t *record = &dlog_ring[position & (DLOG_RING_SIZE - 1)];
+        if (__atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE) != position + 1){
+            __atomic_store_n(&dlog_waiting, true, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&record->sequence, __ATOMIC_SEQ_CST) != position + 1){
+                ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            }
+            __atomic_store_n(&dlog_waiting, false, __ATOMIC_RELAXED);
+            continue;
+        }
+        int slots = (record->kind == DLOG_TEXT) ? record->count : 1;
+        dlog_print(record, position);
+        for(int i = 0; i < slots; i++){
+            __atomic_store_n(&dlog_ring[(position + i) & (DLOG_RING_SIZE - 1)].sequence, position + i + DLOG_RING_SIZE, __ATOMIC_RELEASE);
+        }
+        __atomic_store_n(&dlog_tail, position + slots, __ATOMIC_RELAXED);
+        __atomic_store_n(&dlog_stats.printed, dlog_stats.printed + 1, __ATOMIC_RELAXED);
+    }
+}
+
+void dlog_init(void){
+    for(uint32_t i = 0; i < DLOG_RING_SIZE; i++){
+        dlog_ring[i].sequence = i;
+    }
+    dlog_task_handle = xTaskCreateStaticPinnedToCore(dlog_task, "dlog", DLOG_TASK_STACK, NULL, DLOG_TASK_PRIORITY,
+                                                     dlog_task_stack, &dlog_task_tcb, DLOG_TASK_CORE);
+}
+
+void dlog_get_stats(dlog_stats_t *stats){
+    stats->written = __atomic_load_n(&dlog_stats.written, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&dlog_stats.dropped, __ATOMIC_RELAXED);
+    stats->printed = __atomic_load_n(&dlog_stats.printed, __ATOMIC_RELAXED);
+    stats->high_water = __atomic_load_n(&dlog_stats.high_water, __ATOMIC_RELAXED);
+}
+
+static struct {
+    struct arg_str *level;
+    struct arg_end *end;
+} log_stats_args;
+
+static const char *const dlog_level_names[] = {"none", "error", "warn", "info", "debug", "verbose"};
+
+static int log_stats(int argc, char **argv){
+    int nerrors = arg_parse(argc, argv, (void **) &log_stats_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, log_stats_args.end, argv[0]);
+        return ESP_OK;
+    }
+    if (log_stats_args.level->count > 0){
+        int level = 0;
+        while ((level <= ESP_LOG_VERBOSE) && (strcmp(log_stats_args.level->sval[0], dlog_level_names[level]) != 0)){
+            level++;
+        }
+        if (level > ESP_LOG_VERBOSE){
+            ESP_LOGE(TAG,"Level is none, error, warn, info, debug or verbose");
+            return ESP_OK;
+        }
+        // the logger filters before the ring, esp_log by tag when printing
+        dlog_level = (esp_log_level_t)level;
+        esp_log_level_set("*", dlog_level);
+        ESP_LOGI(TAG,"Log level %s",dlog_level_names[level]);
+    }
+    dlog_stats_t stats;
+    dlog_get_stats(&stats);
+    ESP_LOGI(TAG,"records written: %u, printed: %u, dropped: %u, ring high water: %u/%d slots",
+             stats.written, stats.printed, stats.dropped, stats.high_water, DLOG_RING_SIZE);
+    return ESP_OK;
+}
+
+void register_dlog(void){
+    log_stats_args.level = arg_str0("l", "level", "<none|error|warn|info|debug|verbose>", "set the log level of every tag");
+    log_stats_args.end = arg_end(1);
+    const esp_console_cmd_t cmd = {
+        .command = "log_stats",
+        .help = "show deferred logger counters",
+        .hint = NULL,
+        .func = &log_stats,
+        .argtable = &log_stats_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
+}
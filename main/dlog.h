@@ -0,0 +1,97 @@
+/* Deferred logger
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "esp_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* DLOGx() take the same arguments as ESP_LOGx() but only copy the format
+ * pointer and up to DLOG_MAX_ARGS raw arguments into a lock-free ring. A low
+ * priority task formats and prints them later, so callers never wait on the
+ * UART. Format strings and %s arguments must therefore be string literals or
+ * otherwise outlive the call; use dlog_write_text() for volatile buffers.
+ * Levels above LOG_LOCAL_LEVEL compile away and levels above the logger's
+ * runtime level (log_stats --level) are dropped before taking a slot.
+ */
+#define DLOG_MAX_ARGS 6
+
+typedef struct {
+    uint32_t written;       // records accepted
+    uint32_t dropped;       // records lost because the ring was full
+    uint32_t printed;       // records formatted by the logging task
+    uint32_t high_water;    // largest number of slots ever in use
+} dlog_stats_t;
+
+// Start the logging task. Call once at boot.
+void dlog_init(void);
+
+void dlog_write(esp_log_level_t level, const char *tag, const char *format, int nargs, const uint64_t *args);
+
+// Queue a copy of a (binary-safe) buffer, printed as text with non-printable bytes as '.'
+void dlog_write_text(esp_log_level_t level, const char *tag, const void *data, size_t len);
+
+void dlog_get_stats(dlog_stats_t *stats);
+
+// Register the "log_stats" console command
+void register_dlog(void);
+
+static inline uint64_t dlog_pack_int(long long value){ return (uint64_t)value; }
+static inline uint64_t dlog_pack_uint(unsigned long long value){ return value; }
+static inline uint64_t dlog_pack_ptr(const void *value){ return (uint64_t)(uintptr_t)value; }
+static inline uint64_t dlog_pack_double(double value){
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+#define DLOG_PACK(x) _Generic((x),                      \
+        float: dlog_pack_double,                        \
+        double: dlog_pack_double,                       \
+        char *: dlog_pack_ptr,                          \
+        const char *: dlog_pack_ptr,                    \
+        unsigned char: dlog_pack_uint,                  \
+        unsigned short: dlog_pack_uint,                 \
+        unsigned int: dlog_pack_uint,                   \
+        unsigned long: dlog_pack_uint,                  \
+        unsigned long long: dlog_pack_uint,             \
+        default: dlog_pack_int)(x)
+
+#define DLOG_NARGS(...) DLOG_NARGS_(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define DLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, N, ...) N
+#define DLOG_CAT(a, b) DLOG_CAT_(a, b)
+#define DLOG_CAT_(a, b) a##b
+#define DLOG_P0()
+#define DLOG_P1(a) DLOG_PACK(a),
+#define DLOG_P2(a, ...) DLOG_PACK(a), DLOG_P1(__VA_ARGS__)
+#define DLOG_P3(a, ...) DLOG_PACK(a), DLOG_P2(__VA_ARGS__)
+#define DLOG_P4(a, ...) DLOG_PACK(a), DLOG_P3(__VA_ARGS__)
+#define DLOG_P5(a, ...) DLOG_PACK(a), DLOG_P4(__VA_ARGS__)
+#define DLOG_P6(a, ...) DLOG_PACK(a), DLOG_P5(__VA_ARGS__)
+
+#define DLOG_LEVEL(level, tag, format, ...) do {                                        \
+        if (LOG_LOCAL_LEVEL >= (level)){                                                \
+            dlog_write((level), (tag), (format), DLOG_NARGS(__VA_ARGS__),               \
+                       (const uint64_t[]){ DLOG_CAT(DLOG_P, DLOG_NARGS(__VA_ARGS__))(__VA_ARGS__) 0 }); \
+        }                                                                               \
+    } while (0)
+
+#define DLOGE(tag, format, ...) DLOG_LEVEL(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define DLOGW(tag, format, ...) DLOG_LEVEL(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define DLOGI(tag, format, ...) DLOG_LEVEL(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define DLOGD(tag, format, ...) DLOG_LEVEL(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+
+#ifdef __cplusplus
+}
+#endif
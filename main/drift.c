@@ -0,0 +1,118 @@
+/* Sensor clock drift and offset against the AP clock
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "drift.h"
+
+void drift_init(drift_t *drift, int64_t window_us){
+    memset(drift, 0, sizeof(*drift));
+    drift->window_us = (window_us > 0) ? window_us : DRIFT_WINDOW_US;
+}
+
+void drift_add(drift_t *drift, int64_t sensor_us, int64_t arrival_us){
+    if ((drift->all.n > 0) && (sensor_us < drift->last_y)){
+        // the sensor restarted its clock, nothing before this frame applies
+        uint32_t resets = drift->resets + 1;
+        drift_init(drift, drift->window_us);
+        drift->resets = resets;
+    }
+    if (drift->all.n == 0){
+        drift->x0 = arrival_us;
+        drift->y0 = sensor_us;
+        drift->window_start = arrival_us;
+    }
+    double x = (double)(arrival_us - drift->x0);
+    double y = (double)(sensor_us - drift->y0) - x;
+    drift_fit_add(&drift->all, x, y);
+
+    if (arrival_us - drift->window_start >= drift->window_us){
+        if (drift->window_has){
+            drift_fit_add(&drift->envelope, drift->window_x, drift->window_y);
+        }
+        drift->window_start = arrival_us - (arrival_us - drift->window_start) % drift->window_us;
+        drift->window_has = false;
+    }
+    // least delay: the sensor time furthest ahead of its arrival
+    if (!drift->window_has || (y > drift->window_y)){
+        drift->window_x = x;
+        drift->window_y = y;
+        drift->window_has = true;
+    }
+    drift->last_x = arrival_us;
+    drift->last_y = sensor_us;
+}
+
+static double drift_slope(const drift_fit_t *fit){
+    return (fit->sxx > 0) ? fit->sxy/fit->sxx : 0;
+}
+
+static double drift_residual(const drift_fit_t *fit){
+    if ((fit->n < 3) || (fit->sxx <= 0)){
+        return 0;
+    }
+    double sse = fit->syy - fit->sxy*fit->sxy/fit->sxx;
+    return (sse > 0) ? sqrt(sse/(fit->n - 2)) : 0;
+}
+
+void drift_estimate(const drift_t *drift, drift_estimate_t *estimate){
+    memset(estimate, 0, sizeof(*estimate));
+    estimate->frames = drift->all.n;
+    estimate->windows = drift->envelope.n;
+    if (drift->all.n < 2){
+        return;
+    }
+    estimate->drift_ppm = drift_slope(&drift->all)*1e6;
+    estimate->residual_us = drift_residual(&drift->all);
+    const drift_fit_t *fit = &drift->all;
+    if (drift->envelope.n >= 2){
+        estimate->envelope_ppm = drift_slope(&drift->envelope)*1e6;
+        estimate->envelope_residual_us = drift_residual(&drift->envelope);
+        fit = &drift->envelope;
+    }
+    // the fitted line at the last arrival, back in absolute times
+    double x = (double)(drift->last_x - drift->x0);
+    double y = fit->mean_y + drift_slope(fit)*(x - fit->mean_x);
+    estimate->offset_ms = ((double)(drift->y0 - drift->x0) + y)/1000.0;
+}
+
+int64_t drift_local(const drift_t *drift, int64_t sensor_us){
+    const drift_fit_t *fit = &drift->all;
+    if (fit->n == 0){
+        return sensor_us;
+    }
+    // a spread of 0.25 s around the mean is about a second of frames
+    double slope = (fit->sxx >= 0.0625e12*fit->n) ? drift_slope(fit) : 0;
+    double offset = fit->mean_y - slope*fit->mean_x;
+    // y = offset + slope*x with y = s - x, so x = (s - offset)/(1 + slope)
+    double x = ((double)(sensor_us - drift->y0) - offset)/(1 + slope);
+    return drift->x0 + (int64_t)llround(x);
+}
+
+int drift_format(const drift_t *drift, char *line, size_t size){
+    drift_estimate_t e;
+    drift_estimate(drift, &e);
+    if (e.frames < 2){
+        return snprintf(line, size, "clock: not enough frames");
+    }
+    int len = snprintf(line, size, "clock: sensor %+.1f ppm vs AP over %u frames, residual %.0f us rms",
+                       e.drift_ppm, e.frames, e.residual_us);
+    if ((e.windows >= 2) && ((size_t)len < size)){
+        len += snprintf(line + len, size - len, "; envelope %+.1f ppm over %u windows, residual %.0f us rms",
+                        e.envelope_ppm, e.windows, e.envelope_residual_us);
+    }
+    if ((size_t)len < size){
+        len += snprintf(line + len, size - len, "; offset %.3f ms", e.offset_ms);
+    }
+    if (drift->resets && ((size_t)len < size)){
+        len += snprintf(line + len, size - len, "; %u clock restarts", drift->resets);
+    }
+    return len;
+}
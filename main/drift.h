@@ -0,0 +1,102 @@
+/* Sensor clock drift and offset against the AP clock
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Envelope window: the frame that arrived with the least delay in each is kept
+#define DRIFT_WINDOW_US 1000000
+
+// Streaming least squares of y on x (Welford co-moments), O(1) per point
+typedef struct {
+    uint32_t n;
+    double mean_x;
+    double mean_y;
+    double sxx;
+    double sxy;
+    double syy;
+} drift_fit_t;
+
+/* Sensor time minus arrival time (y) fitted against the AP arrival time
+ * (x), both relative to the first frame: the slope is the drift itself, and
+ * y stays small, so the sums keep their precision over hours. Two fits run
+ * side by side:
+ *
+ *   all frames  least squares over every frame. Arrival delay is noise on
+ *               x, so it is unbiased only while the delay is stationary.
+ *   envelope    least squares over the frame with the least delay (largest
+ *               sensor minus arrival) of each window. Queueing and batching
+ *               only ever add delay, so the envelope follows the fastest
+ *               path and shrugs off bursts; it needs a few windows.
+ *
+ * Drift is the sensor's rate error: +5000 ppm means its clock runs 0.5%
+ * fast, and the frequency it reports is 0.5% higher than the real one.
+ */
+typedef struct {
+    int64_t x0;                 // arrival and sensor time of the first frame
+    int64_t y0;
+    int64_t last_x;
+    int64_t last_y;
+    uint32_t resets;            // sensor time went backwards, the fit started over
+    int64_t window_us;
+    int64_t window_start;
+    bool window_has;
+    double window_x;            // frame of the current window with the largest y
+    double window_y;
+    drift_fit_t all;
+    drift_fit_t envelope;
+} drift_t;
+
+typedef struct {
+    uint32_t frames;
+    uint32_t windows;
+    double drift_ppm;           // all frames
+    double envelope_ppm;        // envelope, 0 until it has two windows
+    double offset_ms;           // sensor minus AP time at the last frame, from the envelope when it has one
+    double residual_us;         // RMS of the all frames fit: arrival jitter plus sensor jitter
+    double envelope_residual_us;
+} drift_estimate_t;
+
+void drift_init(drift_t *drift, int64_t window_us);
+
+static inline void drift_fit_add(drift_fit_t *fit, double x, double y){
+    fit->n++;
+    double dx = x - fit->mean_x;
+    double dy = y - fit->mean_y;
+    fit->mean_x += dx/fit->n;
+    fit->mean_y += dy/fit->n;
+    fit->sxx += dx*(x - fit->mean_x);
+    fit->sxy += dx*(y - fit->mean_y);
+    fit->syy += dy*(y - fit->mean_y);
+}
+
+// One valid frame: sensor timestamp and local arrival time (esp_timer_get_time()). O(1), no allocation.
+void drift_add(drift_t *drift, int64_t sensor_us, int64_t arrival_us);
+
+void drift_estimate(const drift_t *drift, drift_estimate_t *estimate);
+
+/* Sensor time mapped to the AP clock through the all frames fit: the time
+ * a frame stamped `sensor_us` is expected to arrive. Only the offset is
+ * used until the fit spans about a second, so early frames do not swing
+ * with a slope fitted over a few intervals.
+ */
+int64_t drift_local(const drift_t *drift, int64_t sensor_us);
+
+// One line: drift of both fits, offset and residual jitter
+int drift_format(const drift_t *drift, char *line, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
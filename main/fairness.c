@@ -0,0 +1,253 @@
+/* Multi-station fairness and scaling benchmark
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "fairness.h"
+
+void fairness_init(fairness_t *fairness, const frame_schema_t *schema, uint32_t frequency, uint32_t step_ms,
+                   uint32_t first, uint32_t last, uint32_t starve_ms, const volatile bool *running){
+    memset(fairness, 0, sizeof(*fairness));
+    fairness->schema = schema;
+    fairness->frequency = frequency;
+    fairness->nominal_us = 1000000/frequency;
+    fairness->step_us = (int64_t)step_ms*1000;
+    fairness->first = (first < 1) ? 1 : first;
+    fairness->last = (last > FAIRNESS_MAX_STATIONS) ? FAIRNESS_MAX_STATIONS : last;
+    int64_t starve_us = (int64_t)starve_ms*1000;
+    if (starve_us == 0){
+        starve_us = 10*(int64_t)fairness->nominal_us;
+        starve_us = (starve_us < FAIRNESS_STARVE_MIN_US) ? FAIRNESS_STARVE_MIN_US : starve_us;
+    }
+    fairness->starve_us = starve_us;
+    fairness->running = running;
+}
+
+static void fairness_station_reset(fairness_station_t *station, int64_t now_us){
+    memset(station, 0, offsetof(fairness_station_t, buffer));
+    station->last_time = -1;
+    station->last_rx_us = now_us;
+    drift_init(&station->clock, DRIFT_WINDOW_US);
+}
+
+void fairness_merge(fairness_t *fairness, merge_t *merge, int64_t window_us, merge_sink_t sink, void *ctx){
+    fairness->merge = merge;
+    fairness->merge_window_us = window_us;
+    merge->sink = sink;
+    merge->ctx = ctx;
+}
+
+// Same accounting as soak_frame(): jitter against the nominal interval, gaps and the frames they lost
+static bool fairness_frame(fairness_t *fairness, fairness_station_t *station, int64_t time_us){
+    if (station->last_time >= 0){
+        int64_t interval = time_us - station->last_time;
+        if (interval <= 0){
+            station->corrupted++;
+            return false;
+        }
+        int64_t deviation = interval - fairness->nominal_us;
+        deviation = (deviation < 0) ? -deviation : deviation;
+        station->jitter[soak_jitter_bucket((deviation > UINT32_MAX) ? UINT32_MAX : (uint32_t)deviation)]++;
+        if (2*interval > 3*(int64_t)fairness->nominal_us){
+            station->gaps++;
+            station->lost += (uint32_t)((interval + fairness->nominal_us/2)/fairness->nominal_us - 1);
+        }
+    }
+    station->frames++;
+    station->last_time = time_us;
+    return true;
+}
+
+void fairness_receive(fairness_t *fairness, uint32_t index, size_t size, int64_t now_us){
+    fairness_station_t *station = &fairness->station[index];
+    const frame_schema_t *schema = fairness->schema;
+    int64_t silence = now_us - station->last_rx_us;
+    station->longest_silence_us = (silence > station->longest_silence_us) ? silence : station->longest_silence_us;
+    station->last_rx_us = now_us;
+    station->starving = false;
+    station->bytes += size;
+    station->held += size;
+
+    size_t offset = 0;
+    for(; station->held - offset >= schema->size; offset += schema->size){
+        battery_packet frame;
+        if (frame_decode(schema, station->buffer + offset, &frame) != FRAME_OK){
+            station->corrupted++;
+            continue;
+        }
+        if (!fairness_frame(fairness, station, frame.time)){
+            continue;
+        }
+        drift_add(&station->clock, frame.time, now_us);
+        if (fairness->merge){
+            merge_push(fairness->merge, index, drift_local(&station->clock, frame.time), now_us, &frame);
+        }
+    }
+    station->held -= offset;
+    memmove(station->buffer, station->buffer + offset, station->held);
+}
+
+void fairness_poll(fairness_t *fairness, uint32_t stations, int64_t now_us){
+    for(uint32_t i = 0; i < stations; i++){
+        fairness_station_t *station = &fairness->station[i];
+        if (station->failed || station->closed || station->starving){
+            continue;
+        }
+        if (now_us - station->last_rx_us > fairness->starve_us){
+            station->starving = true;
+            station->starvations++;
+        }
+    }
+}
+
+float fairness_jain(const float *values, uint32_t count){
+    double sum = 0;
+    double squares = 0;
+    for(uint32_t i = 0; i < count; i++){
+        sum += values[i];
+        squares += (double)values[i]*values[i];
+    }
+    return (squares > 0) ? (float)(sum*sum/(count*squares)) : 0;
+}
+
+void fairness_summarize(const fairness_t *fairness, uint32_t stations, int64_t now_us, fairness_summary_t *summary){
+    memset(summary, 0, sizeof(*summary));
+    summary->stations = stations;
+    int64_t elapsed = now_us - fairness->step_start;
+    summary->seconds = (elapsed > 0) ? elapsed/1e6f : 0;
+    float rates[FAIRNESS_MAX_STATIONS];
+    uint64_t frames = 0;
+    uint64_t lost = 0;
+    uint64_t bytes = 0;
+    for(uint32_t i = 0; i < stations; i++){
+        const fairness_station_t *station = &fairness->station[i];
+        rates[i] = (summary->seconds > 0) ? station->frames/summary->seconds : 0;
+        summary->min_fps = ((i == 0) || (rates[i] < summary->min_fps)) ? rates[i] : summary->min_fps;
+        summary->max_fps = (rates[i] > summary->max_fps) ? rates[i] : summary->max_fps;
+        frames += station->frames;
+        lost += station->lost;
+        bytes += station->bytes;
+        summary->starvations += station->starvations;
+        summary->starved += (station->starvations > 0);
+        summary->failed += station->failed;
+    }
+    if (summary->seconds > 0){
+        summary->aggregate_fps = frames/summary->seconds;
+        summary->aggregate_kbps = bytes/summary->seconds/1000;
+    }
+    summary->jain = fairness_jain(rates, stations);
+    summary->loss_pct = (frames + lost) ? 100.0f*lost/(frames + lost) : 0;
+}
+
+// Read every station that has data until the step is over; false when io->wait() failed
+static bool fairness_step(fairness_t *fairness, uint32_t stations, const fairness_io_t *io, void *ctx){
+    const int64_t end = fairness->step_start + fairness->step_us;
+    int64_t now = io->now(ctx);
+    while ((now < end) && *fairness->running){
+        int64_t timeout = end - now;
+        timeout = (timeout > FAIRNESS_POLL_US) ? FAIRNESS_POLL_US : timeout;
+        uint32_t ready = 0;
+        if (io->wait(ctx, stations, timeout, &ready) < 0){
+            return false;
+        }
+        now = io->now(ctx);
+        for(uint32_t i = 0; i < stations; i++){
+            fairness_station_t *station = &fairness->station[i];
+            if (!(ready & (1u << i)) || station->failed || station->closed){
+                continue;
+            }
+            int got = io->recv(ctx, i, station->buffer + station->held, FAIRNESS_READ_SIZE);
+            if (got > 0){
+                fairness_receive(fairness, i, got, now);
+            }else{
+                station->closed = true;
+                if (fairness->merge){
+                    merge_close(fairness->merge, i, now);
+                }
+            }
+        }
+        fairness_poll(fairness, stations, now);
+        if (fairness->merge){
+            merge_advance(fairness->merge, now);
+        }
+    }
+    return true;
+}
+
+uint32_t fairness_run(fairness_t *fairness, const fairness_io_t *io, void *ctx, fairness_report_t report, void *report_ctx){
+    for(uint32_t stations = fairness->first; (stations <= fairness->last) && *fairness->running; stations++){
+        fairness->step_start = io->now(ctx);
+        for(uint32_t i = 0; i < stations; i++){
+            fairness_station_reset(&fairness->station[i], fairness->step_start);
+            fairness->station[i].failed = (io->open(ctx, i) < 0);
+        }
+        // connecting takes time, the step starts once every station was asked to stream
+        fairness->step_start = io->now(ctx);
+        if (fairness->merge){
+            merge_reset(fairness->merge, stations, fairness->merge_window_us, fairness->merge->sink, fairness->merge->ctx);
+        }
+        for(uint32_t i = 0; i < stations; i++){
+            fairness->station[i].last_rx_us = fairness->step_start;
+            if (fairness->merge && fairness->station[i].failed){
+                merge_close(fairness->merge, i, fairness->step_start);
+            }
+        }
+        bool ok = fairness_step(fairness, stations, io, ctx);
+        int64_t now = io->now(ctx);
+        for(uint32_t i = 0; i < stations; i++){
+            // a silence still running at the end of the step counts too
+            fairness_station_t *station = &fairness->station[i];
+            int64_t silence = now - station->last_rx_us;
+            station->longest_silence_us = (silence > station->longest_silence_us) ? silence : station->longest_silence_us;
+        }
+        if (fairness->merge){
+            merge_flush(fairness->merge, now);
+        }
+        fairness_summary_t *summary = &fairness->step[fairness->steps];
+        fairness_summarize(fairness, stations, now, summary);
+        for(uint32_t i = 0; i < stations; i++){
+            if (!fairness->station[i].failed){
+                io->close(ctx, i);
+            }
+        }
+        fairness->steps++;
+        if (report){
+            report(report_ctx, fairness, summary);
+        }
+        if (!ok){
+            break;
+        }
+    }
+    return fairness->steps;
+}
+
+int fairness_format_station(const fairness_t *fairness, uint32_t index, float seconds, char *line, size_t size){
+    const fairness_station_t *station = &fairness->station[index];
+    if (station->failed){
+        return snprintf(line, size, "  station %u: could not connect", index + 1);
+    }
+    float fps = (seconds > 0) ? station->frames/seconds : 0;
+    uint32_t sent = station->frames + station->lost;
+    return snprintf(line, size,
+                    "  station %u: %.1f fps (%.1f%% of %u Hz), jitter p50 %u p99 %u us, %u lost (%.2f%%), "
+                    "%u corrupted, %u starvations, longest silence %.0f ms%s",
+                    index + 1, fps, 100.0f*fps/fairness->frequency, fairness->frequency,
+                    soak_histogram_percentile(station->jitter, 50), soak_histogram_percentile(station->jitter, 99),
+                    station->lost, sent ? 100.0f*station->lost/sent : 0.0f, station->corrupted, station->starvations,
+                    station->longest_silence_us/1000.0, station->closed ? ", closed by the station" : "");
+}
+
+int fairness_format(const fairness_summary_t *summary, char *line, size_t size){
+    return snprintf(line, size,
+                    "fairness: %u stations over %.1f s: aggregate %.1f fps (%.1f kB/s), per station %.1f..%.1f fps, "
+                    "Jain %.3f, loss %.2f%%, %u starvations on %u stations, %u not connected",
+                    summary->stations, summary->seconds, summary->aggregate_fps, summary->aggregate_kbps,
+                    summary->min_fps, summary->max_fps, summary->jain, summary->loss_pct, summary->starvations,
+                    summary->starved, summary->failed);
+}
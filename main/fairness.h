@@ -0,0 +1,141 @@
+/* Multi-station fairness and scaling benchmark
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "frame_schema.h"
+#include "soak.h"
+#include "drift.h"
+#include "merge.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The soft AP takes at most 10 stations
+#define FAIRNESS_MAX_STATIONS   10
+// Bytes asked of one station per recv(), plus room for a partial frame
+#define FAIRNESS_READ_SIZE      1024
+// A station silent this long, and at least 10 nominal intervals, is starving
+#define FAIRNESS_STARVE_MIN_US  250000
+// Longest wait for data before the starvation check runs again
+#define FAIRNESS_POLL_US        10000
+
+/* How the benchmark reaches the stations. The firmware connects sockets to
+ * the associated stations; host/sim_fairness shares a simulated channel
+ * between simulated sensors. Stations are numbered 0..count-1 and every
+ * call returns a negative value on failure.
+ */
+typedef struct {
+    int64_t (*now)(void *ctx);
+    // Connect to the station and start its stream
+    int (*open)(void *ctx, uint32_t station);
+    // Stop the stream and disconnect; called for every opened station
+    void (*close)(void *ctx, uint32_t station);
+    /* Wait up to timeout_us for data on the first `stations` stations,
+     * setting bit i of *ready when station i has some
+     */
+    int (*wait)(void *ctx, uint32_t stations, int64_t timeout_us, uint32_t *ready);
+    // Bytes read, 0 once the station closed the connection
+    int (*recv)(void *ctx, uint32_t station, uint8_t *buffer, size_t size);
+} fairness_io_t;
+
+typedef struct {
+    bool failed;                // could not be opened, counts as a station that got nothing
+    bool closed;                // the station hung up during the step
+    uint32_t frames;
+    uint32_t corrupted;         // framing or CRC failures
+    uint32_t gaps;              // sensor intervals longer than 1.5 nominal intervals
+    uint32_t lost;              // frames those gaps account for
+    uint64_t bytes;
+    int64_t last_time;          // sensor time of the previous frame, -1 before the first
+    int64_t last_rx_us;         // local time data last came, the step start before any
+    int64_t longest_silence_us;
+    uint32_t starvations;       // silences past the threshold, each counted once
+    bool starving;
+    uint32_t jitter[SOAK_JITTER_BUCKETS];   // |interval - nominal| of the sensor timestamps
+    drift_t clock;              // sensor clock against the AP's, maps frames to AP time for the merge
+    size_t held;                // bytes of a partial frame waiting for the rest
+    uint8_t buffer[FAIRNESS_READ_SIZE + FRAME_SCHEMA_MAX_SIZE];
+} fairness_station_t;
+
+typedef struct {
+    uint32_t stations;
+    float seconds;
+    float aggregate_fps;        // frames per second over every station
+    float aggregate_kbps;       // payload kilobytes per second
+    float min_fps;
+    float max_fps;
+    float jain;                 // Jain's index of the per-station rates, 1/stations..1
+    float loss_pct;             // lost frames over frames sent
+    uint32_t starvations;
+    uint32_t starved;           // stations with at least one starvation
+    uint32_t failed;
+} fairness_summary_t;
+
+typedef struct {
+    uint32_t frequency;         // every sensor is started at this rate
+    uint32_t nominal_us;
+    int64_t step_us;            // length of each step
+    int64_t starve_us;
+    uint32_t first;             // steps run from `first` to `last` stations
+    uint32_t last;
+    const frame_schema_t *schema;
+    const volatile bool *running;   // cleared to stop between polls
+    merge_t *merge;             // NULL unless fairness_merge() asked for one time-ordered stream
+    int64_t merge_window_us;
+    int64_t step_start;
+    fairness_station_t station[FAIRNESS_MAX_STATIONS];
+    uint32_t steps;             // steps completed, summaries in step[]
+    fairness_summary_t step[FAIRNESS_MAX_STATIONS];
+} fairness_t;
+
+/* Called after each step with its summary; the per-station results are
+ * still in fairness->station[]
+ */
+typedef void (*fairness_report_t)(void *ctx, const fairness_t *fairness, const fairness_summary_t *summary);
+
+/* Steps from `first` to `last` stations (1..FAIRNESS_MAX_STATIONS), each
+ * streaming at `frequency` for `step_ms`. starve_ms 0 picks the default.
+ */
+void fairness_init(fairness_t *fairness, const frame_schema_t *schema, uint32_t frequency, uint32_t step_ms,
+                   uint32_t first, uint32_t last, uint32_t starve_ms, const volatile bool *running);
+
+/* Run every step: open the stations of the step, read them all until the
+ * step ends, close them and report. Blocks the caller; returns the number
+ * of steps completed.
+ */
+uint32_t fairness_run(fairness_t *fairness, const fairness_io_t *io, void *ctx, fairness_report_t report, void *report_ctx);
+
+/* Also merge the frames of every station into one stream ordered by AP
+ * time, handed to `sink`; reset at the start of each step and flushed at
+ * its end
+ */
+void fairness_merge(fairness_t *fairness, merge_t *merge, int64_t window_us, merge_sink_t sink, void *ctx);
+
+// Bytes just read from a station: decodes every whole frame and keeps the rest
+void fairness_receive(fairness_t *fairness, uint32_t station, size_t size, int64_t now_us);
+
+// Count stations silent past the threshold
+void fairness_poll(fairness_t *fairness, uint32_t stations, int64_t now_us);
+
+// (sum x)^2 / (n sum x^2): 1 when every value is equal, 1/n when one takes everything
+float fairness_jain(const float *values, uint32_t count);
+
+void fairness_summarize(const fairness_t *fairness, uint32_t stations, int64_t now_us, fairness_summary_t *summary);
+
+// One line per station of the last step, and one per step
+int fairness_format_station(const fairness_t *fairness, uint32_t station, float seconds, char *line, size_t size);
+int fairness_format(const fairness_summary_t *summary, char *line, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
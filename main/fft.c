@@ -0,0 +1,298 @@
+/* Radix-2 real FFT and spectrum analysis of captured channels
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <math.h>
+#include <string.h>
+#include "fft.h"
+
+#define FFT_PI 3.14159265358979323846
+#define FFT_SPUR_MARGIN_DB 10.0f
+#define FFT_FULL_SCALE 32767.0f
+
+void fft_table_init(fft_table_t *table, uint32_t max_n){
+    table->max_n = max_n;
+    for(uint32_t j = 0; j <= max_n/4; j++){
+        table->sine[j] = (float)sin(2*FFT_PI*j/max_n);
+    }
+}
+
+// cos and sin of 2*pi*j/max_n for 0 <= j < max_n, from the quarter wave table
+static inline void fft_twiddle(const fft_table_t *table, uint32_t j, float *c, float *s){
+    const uint32_t q = table->max_n/4;
+    const float *sine = table->sine;
+    if (j <= q){
+        *s = sine[j];
+        *c = sine[q - j];
+    }else if (j <= 2*q){
+        *s = sine[2*q - j];
+        *c = -sine[j - q];
+    }else if (j <= 3*q){
+        *s = -sine[j - 2*q];
+        *c = -sine[3*q - j];
+    }else{
+        *s = -sine[4*q - j];
+        *c = sine[j - 3*q];
+    }
+}
+
+// In-place complex FFT of m interleaved (re, im) points
+static void fft_complex(float *z, uint32_t m, const fft_table_t *table){
+    for(uint32_t i = 1, j = 0; i < m; i++){
+        uint32_t bit = m >> 1;
+        for(; j & bit; bit >>= 1){
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j){
+            float re = z[2*i], im = z[2*i + 1];
+            z[2*i] = z[2*j];
+            z[2*i + 1] = z[2*j + 1];
+            z[2*j] = re;
+            z[2*j + 1] = im;
+        }
+    }
+    for(uint32_t len = 2; len <= m; len <<= 1){
+        uint32_t half = len/2;
+        uint32_t step = table->max_n/len;
+        for(uint32_t k = 0; k < half; k++){
+            float wr, wi;
+            fft_twiddle(table, k*step, &wr, &wi);
+            wi = -wi;
+            for(uint32_t i = k; i < m; i += len){
+                float *a = z + 2*i;
+                float *b = z + 2*(i + half);
+                float tr = b[0]*wr - b[1]*wi;
+                float ti = b[0]*wi + b[1]*wr;
+                b[0] = a[0] - tr;
+                b[1] = a[1] - ti;
+                a[0] += tr;
+                a[1] += ti;
+            }
+        }
+    }
+}
+
+/* The n real samples are transformed as n/2 complex points (even samples as
+ * the real part, odd as the imaginary part) and the two interleaved spectra
+ * are separated afterwards.
+ */
+void fft_real(float *data, uint32_t n, const fft_table_t *table){
+    const uint32_t m = n/2;
+    const uint32_t step = table->max_n/n;
+    fft_complex(data, m, table);
+
+    float z0r = data[0], z0i = data[1];
+    data[0] = z0r + z0i;
+    data[1] = z0r - z0i;
+    for(uint32_t k = 1; k <= m/2; k++){
+        uint32_t mk = m - k;
+        float ar = data[2*k], ai = data[2*k + 1];
+        float br = data[2*mk], bi = data[2*mk + 1];
+        float er = 0.5f*(ar + br), ei = 0.5f*(ai - bi);
+        float orr = 0.5f*(ai + bi), oi = -0.5f*(ar - br);
+        float wr, wi;
+        fft_twiddle(table, k*step, &wr, &wi);
+        wi = -wi;
+        float tr = orr*wr - oi*wi;
+        float ti = orr*wi + oi*wr;
+        data[2*mk] = er - tr;
+        data[2*mk + 1] = ti - ei;
+        data[2*k] = er + tr;
+        data[2*k + 1] = ei + ti;
+    }
+}
+
+static float fft_select(float *values, uint32_t count, uint32_t rank){
+    uint32_t left = 0, right = count - 1;
+    while(left < right){
+        float pivot = values[(left + right)/2];
+        uint32_t i = left, j = right;
+        while(i <= j){
+            while(values[i] < pivot) i++;
+            while(values[j] > pivot) j--;
+            if (i <= j){
+                float tmp = values[i];
+                values[i] = values[j];
+                values[j] = tmp;
+                i++;
+                if (j == 0) break;
+                j--;
+            }
+        }
+        if (rank <= j){
+            right = j;
+        }else if (rank >= i){
+            left = i;
+        }else{
+            break;
+        }
+    }
+    return values[rank];
+}
+
+static float fft_db(float magnitude, uint32_t n){
+    // a full scale int16 sine under a Hann window peaks at 32767*n/4
+    float reference = FFT_FULL_SCALE*n/4;
+    return 20.0f*log10f((magnitude > 1e-9f ? magnitude : 1e-9f)/reference);
+}
+
+static void fft_keep_peak(fft_peak_t *peaks, int *count, int max, float frequency, float level){
+    int slot = *count;
+    if (*count == max){
+        slot = 0;
+        for(int i = 1; i < max; i++){
+            if (peaks[i].level_db < peaks[slot].level_db){
+                slot = i;
+            }
+        }
+        if (peaks[slot].level_db >= level){
+            return;
+        }
+    }else{
+        (*count)++;
+    }
+    peaks[slot].frequency = frequency;
+    peaks[slot].level_db = level;
+}
+
+static uint32_t fft_gcd(uint32_t a, uint32_t b){
+    while(b != 0){
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+void fft_spectrum(float *data, uint32_t n, float sample_rate, const fft_table_t *table, fft_spectrum_t *spectrum){
+    const uint32_t m = n/2;
+    const uint32_t step = table->max_n/n;
+
+    float mean = 0;
+    for(uint32_t i = 0; i < n; i++){
+        mean += data[i];
+    }
+    mean /= n;
+    for(uint32_t i = 0; i < n; i++){
+        float c, s;
+        fft_twiddle(table, i*step, &c, &s);
+        data[i] = (data[i] - mean)*(0.5f - 0.5f*c);
+    }
+
+    fft_real(data, n, table);
+    data[0] = fabsf(data[0]);
+    for(uint32_t k = 1; k < m; k++){
+        data[k] = sqrtf(data[2*k]*data[2*k] + data[2*k + 1]*data[2*k + 1]);
+    }
+
+    memset(spectrum, 0, sizeof(*spectrum));
+    spectrum->n = n;
+    spectrum->sample_rate = sample_rate;
+    spectrum->resolution = sample_rate/n;
+
+    // the upper half of the buffer is free now, the median is taken there
+    memcpy(data + m, data, m*sizeof(float));
+    spectrum->noise_floor_db = fft_db(fft_select(data + m, m, m/2), n);
+
+    for(uint32_t k = 2; k < m - 1; k++){
+        if ((data[k] <= data[k - 1]) || (data[k] < data[k + 1])){
+            continue;
+        }
+        // parabolic interpolation between the neighbouring bins
+        float a = data[k - 1], b = data[k], c = data[k + 1];
+        float denominator = a - 2*b + c;
+        float offset = (denominator != 0) ? 0.5f*(a - c)/denominator : 0;
+        fft_keep_peak(spectrum->peaks, &spectrum->peak_count, FFT_MAX_PEAKS, (k + offset)*spectrum->resolution,
+                      fft_db(b, n) - spectrum->noise_floor_db);
+    }
+
+    // duplicated or dropped samples every d-th sample put images of the signal around multiples of fs/d
+    float dominant = 0, dominant_level = -1e9f;
+    for(int i = 0; i < spectrum->peak_count; i++){
+        if (spectrum->peaks[i].level_db > dominant_level){
+            dominant = spectrum->peaks[i].frequency;
+            dominant_level = spectrum->peaks[i].level_db;
+        }
+    }
+    const float nyquist = sample_rate/2;
+    const float guard = 2*spectrum->resolution;
+    for(uint32_t d = 2; d <= 8; d++){
+        for(uint32_t multiple = 1; multiple < d; multiple++){
+            if (fft_gcd(multiple, d) != 1){
+                continue;
+            }
+            for(int side = -1; side <= 1; side++){
+                float frequency = fabsf(sample_rate*multiple/d + side*dominant);
+                frequency = (frequency > nyquist) ? sample_rate - frequency : frequency;
+                if ((frequency < guard) || (frequency > nyquist - guard) || (fabsf(frequency - dominant) < guard)){
+                    continue;
+                }
+                bool known = false;
+                for(int i = 0; i < spectrum->spur_count; i++){
+                    known |= (fabsf(spectrum->spurs[i].frequency - frequency) < guard);
+                }
+                uint32_t bin = (uint32_t)(frequency/spectrum->resolution + 0.5f);
+                float level = 0;
+                for(uint32_t k = bin - 1; (k <= bin + 1) && (k < m); k++){
+                    level = (data[k] > level) ? data[k] : level;
+                }
+                float above = fft_db(level, n) - spectrum->noise_floor_db;
+                if (!known && (above >= FFT_SPUR_MARGIN_DB) && (spectrum->spur_count < FFT_MAX_SPURS)){
+                    spectrum->spurs[spectrum->spur_count].frequency = frequency;
+                    spectrum->spurs[spectrum->spur_count].level_db = above;
+                    spectrum->spurs[spectrum->spur_count].divisor = d;
+                    spectrum->spur_count++;
+                }
+            }
+        }
+    }
+}
+
+static float fft_bench_sample(uint32_t i, uint32_t n){
+    // two tones and a deterministic pseudo-random ripple
+    uint32_t hash = i*2654435761u;
+    return 8000.0f*(float)sin(2*FFT_PI*50.25*i/n) + 3000.0f*(float)cos(2*FFT_PI*200*i/n) + (float)((hash >> 20) & 0xff) - 128.0f;
+}
+
+void fft_bench(float *work, uint32_t n, int iterations, const fft_table_t *table, int64_t (*now_us)(void), fft_bench_result_t *result){
+    int64_t total = 0;
+    for(int it = 0; it < iterations; it++){
+        for(uint32_t i = 0; i < n; i++){
+            work[i] = fft_bench_sample(i, n);
+        }
+        int64_t start = now_us();
+        fft_real(work, n, table);
+        total += now_us() - start;
+    }
+
+    // spot-check a few bins against a direct DFT in double precision
+    const uint32_t bins[] = {1, 50, 200, n/8, n/2 - 1};
+    float max_error = 0, max_magnitude = 1;
+    for(uint32_t b = 0; b < sizeof(bins)/sizeof(bins[0]); b++){
+        uint32_t k = bins[b];
+        if ((k == 0) || (k >= n/2)){
+            continue;
+        }
+        double re = 0, im = 0;
+        for(uint32_t i = 0; i < n; i++){
+            double angle = 2*FFT_PI*(double)((uint64_t)k*i % n)/n;
+            re += fft_bench_sample(i, n)*cos(angle);
+            im -= fft_bench_sample(i, n)*sin(angle);
+        }
+        float error = hypotf(work[2*k] - (float)re, work[2*k + 1] - (float)im);
+        float magnitude = (float)hypot(re, im);
+        max_error = (error > max_error) ? error : max_error;
+        max_magnitude = (magnitude > max_magnitude) ? magnitude : max_magnitude;
+    }
+
+    result->n = n;
+    result->iterations = iterations;
+    result->us_per_fft = (iterations > 0) ? (double)total/iterations : 0;
+    result->max_error = max_error/max_magnitude;
+}
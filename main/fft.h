@@ -0,0 +1,75 @@
+/* Radix-2 real FFT and spectrum analysis of captured channels
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FFT_MAX_PEAKS 5
+#define FFT_MAX_SPURS 8
+
+/* Quarter wave sine table shared by every transform up to max_n points.
+ * `sine` must hold max_n/4 + 1 floats.
+ */
+typedef struct {
+    uint32_t max_n;
+    float *sine;
+} fft_table_t;
+
+typedef struct {
+    float frequency;        // Hz
+    float level_db;         // above the noise floor
+    uint32_t divisor;       // spurs only: found next to a multiple of fs/divisor
+} fft_peak_t;
+
+typedef struct {
+    uint32_t n;
+    float sample_rate;
+    float resolution;       // Hz per bin
+    float noise_floor_db;   // median bin power, dB relative to full scale of an int16 sine
+    int peak_count;
+    fft_peak_t peaks[FFT_MAX_PEAKS];
+    int spur_count;
+    fft_peak_t spurs[FFT_MAX_SPURS];  // tones at m*fs/d or images of the dominant tone around them: duplicated or dropped samples
+} fft_spectrum_t;
+
+typedef struct {
+    uint32_t n;
+    int iterations;
+    double us_per_fft;
+    float max_error;        // worst bin error against a direct DFT on a test signal
+} fft_bench_result_t;
+
+void fft_table_init(fft_table_t *table, uint32_t max_n);
+
+static inline bool fft_is_power_of_two(uint32_t n){
+    return (n >= 4) && ((n & (n - 1)) == 0);
+}
+
+/* In-place forward FFT of n real samples (n a power of two <= table->max_n).
+ * Output packing: data[0] = X[0], data[1] = X[n/2] (both real), then
+ * data[2k], data[2k+1] = Re, Im of X[k] for 0 < k < n/2.
+ */
+void fft_real(float *data, uint32_t n, const fft_table_t *table);
+
+/* Remove the mean, apply a Hann window, transform and analyse n samples.
+ * `data` is overwritten with the bin magnitudes (n/2 of them).
+ */
+void fft_spectrum(float *data, uint32_t n, float sample_rate, const fft_table_t *table, fft_spectrum_t *spectrum);
+
+// Time `iterations` transforms of n points with the caller's microsecond clock
+void fft_bench(float *work, uint32_t n, int iterations, const fft_table_t *table, int64_t (*now_us)(void), fft_bench_result_t *result);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,36 @@
+/* Sensor frame layout
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FRAME_ID0       0
+#define FRAME_IDFINAL   255
+
+// One sample as sent on the wire by the sensor firmware (24 bytes)
+typedef struct{
+    uint8_t ID0;
+    int64_t time;
+    int16_t accelX;
+    int16_t accelY;
+    int16_t accelZ;
+    int16_t gyroX;
+    int16_t gyroY;
+    int16_t gyroZ;
+    uint16_t battery;
+    uint8_t IDfinal;
+}__attribute__((__packed__)) battery_packet;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,57 @@
+/* CRC-8 and CRC-16 over frame bytes
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include "frame_crc.h"
+
+#ifndef ESP_PLATFORM
+
+/* Software fallback for host builds, one table lookup per byte. The tables
+ * are built on first use.
+ */
+static uint8_t crc8_table[256];
+static uint16_t crc16_table[256];
+static int tables_ready = 0;
+
+static void frame_crc_tables(void){
+    for(uint32_t i = 0; i < 256; i++){
+        uint8_t c8 = (uint8_t)i;
+        uint16_t c16 = (uint16_t)i;
+        for(int bit = 0; bit < 8; bit++){
+            c8 = (c8 & 1) ? (uint8_t)((c8 >> 1) ^ 0xe0) : (uint8_t)(c8 >> 1);
+            c16 = (c16 & 1) ? (uint16_t)((c16 >> 1) ^ 0x8408) : (uint16_t)(c16 >> 1);
+        }
+        crc8_table[i] = c8;
+        crc16_table[i] = c16;
+    }
+    tables_ready = 1;
+}
+
+uint8_t frame_crc8(const uint8_t *data, size_t len){
+    if (!tables_ready){
+        frame_crc_tables();
+    }
+    uint8_t crc = 0xff;
+    for(size_t i = 0; i < len; i++){
+        crc = crc8_table[crc ^ data[i]];
+    }
+    return (uint8_t)~crc;
+}
+
+uint16_t frame_crc16(const uint8_t *data, size_t len){
+    if (!tables_ready){
+        frame_crc_tables();
+    }
+    uint16_t crc = 0xffff;
+    for(size_t i = 0; i < len; i++){
+        crc = (uint16_t)((crc >> 8) ^ crc16_table[(crc ^ data[i]) & 0xff]);
+    }
+    return (uint16_t)~crc;
+}
+
+#endif
@@ -0,0 +1,43 @@
+/* CRC-8 and CRC-16 over frame bytes
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Both CRCs are the ones the ESP32 ROM computes with an initial value of 0:
+ *
+ *   crc8   reflected polynomial 0x07, init 0xff, xorout 0xff
+ *   crc16  CRC-16/X-25: reflected polynomial 0x1021, init 0xffff, xorout 0xffff
+ *
+ * On the device they go straight to the ROM routines. Host builds use a
+ * table-driven copy that gives the same results.
+ */
+#ifdef ESP_PLATFORM
+#include "esp_rom_crc.h"
+
+static inline uint8_t frame_crc8(const uint8_t *data, size_t len){
+    return esp_rom_crc8_le(0, data, len);
+}
+
+static inline uint16_t frame_crc16(const uint8_t *data, size_t len){
+    return esp_rom_crc16_le(0, data, len);
+}
+#else
+uint8_t frame_crc8(const uint8_t *data, size_t len);
+uint16_t frame_crc16(const uint8_t *data, size_t len);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,283 @@
+/* Runtime description of sensor frame layouts
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "frame_schema.h"
+
+static const char *target_names[FRAME_FIELD_COUNT] = {
+    "time", "accelX", "accelY", "accelZ", "gyroX", "gyroY", "gyroZ", "battery"
+};
+
+static const char *type_names[] = {"u8", "i8", "u16", "i16", "u32", "i32", "u64", "i64"};
+static const uint8_t type_sizes[] = {1, 1, 2, 2, 4, 4, 8, 8};
+
+const frame_schema_t frame_schema_default = {
+    .name = "battery",
+    .size = sizeof(battery_packet),
+    .marker_count = 2,
+    .field_count = 8,
+    .native = true,
+    .markers = {
+        {offsetof(battery_packet, ID0), FRAME_ID0},
+        {offsetof(battery_packet, IDfinal), FRAME_IDFINAL},
+    },
+    .fields = {
+        {FRAME_FIELD_TIME, FRAME_I64, 0, offsetof(battery_packet, time)},
+        {FRAME_FIELD_ACCEL_X, FRAME_I16, 0, offsetof(battery_packet, accelX)},
+        {FRAME_FIELD_ACCEL_Y, FRAME_I16, 0, offsetof(battery_packet, accelY)},
+        {FRAME_FIELD_ACCEL_Z, FRAME_I16, 0, offsetof(battery_packet, accelZ)},
+        {FRAME_FIELD_GYRO_X, FRAME_I16, 0, offsetof(battery_packet, gyroX)},
+        {FRAME_FIELD_GYRO_Y, FRAME_I16, 0, offsetof(battery_packet, gyroY)},
+        {FRAME_FIELD_GYRO_Z, FRAME_I16, 0, offsetof(battery_packet, gyroZ)},
+        {FRAME_FIELD_BATTERY, FRAME_U16, 0, offsetof(battery_packet, battery)},
+    },
+};
+
+static int frame_find_name(const char *name, size_t len, const char **names, int count){
+    for(int i = 0; i < count; i++){
+        if ((strlen(names[i]) == len) && (strncmp(name, names[i], len) == 0)){
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Memory layout starting with battery_packet, same markers, and every
+ * member present at its own offset with its own type. Only then can the
+ * frame be copied over the struct as it is. Bytes past the struct may only
+ * hold the CRC.
+ */
+static bool frame_schema_is_native(const frame_schema_t *schema){
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+    const frame_schema_t *native = &frame_schema_default;
+    uint32_t expected_size = native->size;
+    if (schema->crc != FRAME_CRC_NONE){
+        expected_size = (schema->crc_offset == native->size) ? native->size + ((schema->crc == FRAME_CRC8) ? 1 : 2) : 0;
+    }
+    if ((schema->size != expected_size) || (schema->marker_count != native->marker_count) ||
+        (schema->field_count != native->field_count)){
+        return false;
+    }
+    for(int m = 0; m < native->marker_count; m++){
+        bool found = false;
+        for(int i = 0; i < schema->marker_count; i++){
+            found |= (schema->markers[i].offset == native->markers[m].offset) && (schema->markers[i].value == native->markers[m].value);
+        }
+        if (!found){
+            return false;
+        }
+    }
+    for(int f = 0; f < native->field_count; f++){
+        bool found = false;
+        for(int i = 0; i < schema->field_count; i++){
+            found |= (memcmp(&schema->fields[i], &native->fields[f], sizeof(frame_field_t)) == 0);
+        }
+        if (!found){
+            return false;
+        }
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+static bool frame_schema_fail(char *error, size_t size, const char *token, size_t len, const char *why){
+    snprintf(error, size, "\"%.*s\": %s", (int)len, token, why);
+    return false;
+}
+
+bool frame_schema_parse(const char *text, frame_schema_t *schema, char *error, size_t error_size){
+    memset(schema, 0, sizeof(*schema));
+    strcpy(schema->name, "custom");
+    uint32_t covered[FRAME_FIELD_COUNT] = {0};
+    const char *p = text;
+    while (*p != '\0'){
+        while (*p == ' '){
+            p++;
+        }
+        const char *token = p;
+        while ((*p != ' ') && (*p != '\0')){
+            p++;
+        }
+        size_t len = p - token;
+        if (len == 0){
+            break;
+        }
+        const char *equals = memchr(token, '=', len);
+        if (equals == NULL){
+            return frame_schema_fail(error, error_size, token, len, "expected key=value");
+        }
+        size_t key_len = equals - token;
+        const char *value = equals + 1;
+        char *end;
+
+        if ((key_len == 4) && (strncmp(token, "name", 4) == 0)){
+            size_t n = len - key_len - 1;
+            n = (n < FRAME_SCHEMA_NAME_LEN - 1) ? n : FRAME_SCHEMA_NAME_LEN - 1;
+            memcpy(schema->name, value, n);
+            schema->name[n] = '\0';
+            continue;
+        }
+        if ((key_len == 4) && (strncmp(token, "size", 4) == 0)){
+            unsigned long size = strtoul(value, &end, 0);
+            if ((end != p) || (size == 0) || (size > FRAME_SCHEMA_MAX_SIZE)){
+                return frame_schema_fail(error, error_size, token, len, "size must be 1..64");
+            }
+            schema->size = (uint8_t)size;
+            continue;
+        }
+
+        // mark=<offset>:<byte> and <member>=<offset>:<type>
+        unsigned long offset = strtoul(value, &end, 0);
+        if ((end == value) || (*end != ':') || (offset >= FRAME_SCHEMA_MAX_SIZE)){
+            return frame_schema_fail(error, error_size, token, len, "expected <offset>:...");
+        }
+        const char *detail = end + 1;
+        size_t detail_len = p - detail;
+        if ((key_len == 3) && (strncmp(token, "crc", 3) == 0)){
+            bool big_endian = (detail_len == 7) && (strncmp(detail, "crc16be", 7) == 0);
+            if ((detail_len == 4) && (strncmp(detail, "crc8", 4) == 0)){
+                schema->crc = FRAME_CRC8;
+            }else if (big_endian || ((detail_len == 5) && (strncmp(detail, "crc16", 5) == 0))){
+                schema->crc = FRAME_CRC16;
+            }else{
+                return frame_schema_fail(error, error_size, token, len, "expected crc=<offset>:crc8|crc16|crc16be");
+            }
+            if (offset == 0){
+                return frame_schema_fail(error, error_size, token, len, "the CRC covers the bytes before it, offset can't be 0");
+            }
+            schema->crc_offset = (uint8_t)offset;
+            schema->crc_big_endian = big_endian;
+            continue;
+        }
+        if ((key_len == 4) && (strncmp(token, "mark", 4) == 0)){
+            unsigned long byte = strtoul(detail, &end, 0);
+            if ((end != p) || (byte > 0xff) || (schema->marker_count == FRAME_SCHEMA_MAX_MARKERS)){
+                return frame_schema_fail(error, error_size, token, len, "expected mark=<offset>:<byte>, at most 4");
+            }
+            schema->markers[schema->marker_count].offset = (uint8_t)offset;
+            schema->markers[schema->marker_count].value = (uint8_t)byte;
+            schema->marker_count++;
+            continue;
+        }
+        int target = frame_find_name(token, key_len, target_names, FRAME_FIELD_COUNT);
+        if (target < 0){
+            return frame_schema_fail(error, error_size, token, len, "unknown key");
+        }
+        bool big_endian = (detail_len > 2) && (strncmp(p - 2, "be", 2) == 0);
+        bool little_endian = (detail_len > 2) && (strncmp(p - 2, "le", 2) == 0);
+        int type = frame_find_name(detail, detail_len - ((big_endian || little_endian) ? 2 : 0), type_names, 8);
+        if (type < 0){
+            return frame_schema_fail(error, error_size, token, len, "unknown type");
+        }
+        if (covered[target] || (schema->field_count == FRAME_SCHEMA_MAX_FIELDS)){
+            return frame_schema_fail(error, error_size, token, len, "member given twice");
+        }
+        covered[target] = 1;
+        frame_field_t *field = &schema->fields[schema->field_count++];
+        field->target = (uint8_t)target;
+        field->type = (uint8_t)type;
+        field->big_endian = big_endian;
+        field->offset = (uint8_t)offset;
+    }
+
+    if (schema->size == 0){
+        return frame_schema_fail(error, error_size, "size", 4, "missing");
+    }
+    for(int i = 0; i < schema->marker_count; i++){
+        if (schema->markers[i].offset >= schema->size){
+            return frame_schema_fail(error, error_size, "mark", 4, "past the end of the frame");
+        }
+    }
+    for(int i = 0; i < schema->field_count; i++){
+        if (schema->fields[i].offset + type_sizes[schema->fields[i].type] > schema->size){
+            return frame_schema_fail(error, error_size, target_names[schema->fields[i].target],
+                                     strlen(target_names[schema->fields[i].target]), "past the end of the frame");
+        }
+    }
+    if ((schema->crc != FRAME_CRC_NONE) && (schema->crc_offset + ((schema->crc == FRAME_CRC8) ? 1 : 2) > schema->size)){
+        return frame_schema_fail(error, error_size, "crc", 3, "past the end of the frame");
+    }
+    if (!covered[FRAME_FIELD_TIME]){
+        return frame_schema_fail(error, error_size, "time", 4, "missing, every layout needs a timestamp");
+    }
+    schema->native = frame_schema_is_native(schema);
+    return true;
+}
+
+int frame_schema_format(const frame_schema_t *schema, char *text, size_t size){
+    int len = snprintf(text, size, "name=%s size=%u", schema->name, schema->size);
+    for(int i = 0; (i < schema->marker_count) && (len < (int)size); i++){
+        len += snprintf(text + len, size - len, " mark=%u:0x%02x", schema->markers[i].offset, schema->markers[i].value);
+    }
+    for(int i = 0; (i < schema->field_count) && (len < (int)size); i++){
+        const frame_field_t *field = &schema->fields[i];
+        len += snprintf(text + len, size - len, " %s=%u:%s%s", target_names[field->target], field->offset,
+                        type_names[field->type], field->big_endian ? "be" : "");
+    }
+    if ((schema->crc != FRAME_CRC_NONE) && (len < (int)size)){
+        len += snprintf(text + len, size - len, " crc=%u:%s%s", schema->crc_offset, (schema->crc == FRAME_CRC8) ? "crc8" : "crc16",
+                        schema->crc_big_endian ? "be" : "");
+    }
+    return len;
+}
+
+static int64_t frame_read(const uint8_t *raw, const frame_field_t *field){
+    uint32_t bytes = type_sizes[field->type];
+    uint64_t value = 0;
+    if (field->big_endian){
+        for(uint32_t i = 0; i < bytes; i++){
+            value = (value << 8) | raw[field->offset + i];
+        }
+    }else{
+        for(uint32_t i = bytes; i > 0; i--){
+            value = (value << 8) | raw[field->offset + i - 1];
+        }
+    }
+    switch (field->type){
+        case FRAME_I8: return (int8_t)value;
+        case FRAME_I16: return (int16_t)value;
+        case FRAME_I32: return (int32_t)value;
+        default: return (int64_t)value;
+    }
+}
+
+frame_status_t frame_decode_generic(const frame_schema_t *schema, const uint8_t *raw, battery_packet *frame){
+    memset(frame, 0, sizeof(*frame));
+    frame->ID0 = FRAME_ID0;
+    frame->IDfinal = FRAME_IDFINAL;
+    bool valid = true;
+    for(int i = 0; i < schema->marker_count; i++){
+        valid &= (raw[schema->markers[i].offset] == schema->markers[i].value);
+    }
+    for(int i = 0; i < schema->field_count; i++){
+        const frame_field_t *field = &schema->fields[i];
+        int64_t value = frame_read(raw, field);
+        switch (field->target){
+            case FRAME_FIELD_TIME: frame->time = value; break;
+            case FRAME_FIELD_ACCEL_X: frame->accelX = (int16_t)value; break;
+            case FRAME_FIELD_ACCEL_Y: frame->accelY = (int16_t)value; break;
+            case FRAME_FIELD_ACCEL_Z: frame->accelZ = (int16_t)value; break;
+            case FRAME_FIELD_GYRO_X: frame->gyroX = (int16_t)value; break;
+            case FRAME_FIELD_GYRO_Y: frame->gyroY = (int16_t)value; break;
+            case FRAME_FIELD_GYRO_Z: frame->gyroZ = (int16_t)value; break;
+            case FRAME_FIELD_BATTERY: frame->battery = (uint16_t)value; break;
+            default: break;
+        }
+    }
+    if (!valid){
+        frame->ID0 = ~FRAME_ID0;
+        return FRAME_BAD_MARKER;
+    }
+    return frame_check_crc(schema, raw);
+}
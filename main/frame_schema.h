@@ -0,0 +1,132 @@
+/* Runtime description of sensor frame layouts
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "frame.h"
+#include "frame_crc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FRAME_SCHEMA_MAX_FIELDS  12
+#define FRAME_SCHEMA_MAX_MARKERS 4
+#define FRAME_SCHEMA_MAX_SIZE    64
+#define FRAME_SCHEMA_NAME_LEN    16
+#define FRAME_SCHEMA_TEXT_LEN    256
+
+typedef enum {
+    FRAME_U8, FRAME_I8, FRAME_U16, FRAME_I16, FRAME_U32, FRAME_I32, FRAME_U64, FRAME_I64
+} frame_type_t;
+
+// Members of battery_packet a field can be decoded into
+typedef enum {
+    FRAME_FIELD_TIME, FRAME_FIELD_ACCEL_X, FRAME_FIELD_ACCEL_Y, FRAME_FIELD_ACCEL_Z,
+    FRAME_FIELD_GYRO_X, FRAME_FIELD_GYRO_Y, FRAME_FIELD_GYRO_Z, FRAME_FIELD_BATTERY,
+    FRAME_FIELD_COUNT
+} frame_field_id_t;
+
+typedef struct {
+    uint8_t target;         // frame_field_id_t
+    uint8_t type;           // frame_type_t
+    uint8_t big_endian;
+    uint8_t offset;
+} frame_field_t;
+
+typedef struct {
+    uint8_t offset;
+    uint8_t value;
+} frame_marker_t;
+
+typedef enum {
+    FRAME_CRC_NONE, FRAME_CRC8, FRAME_CRC16
+} frame_crc_t;
+
+typedef enum {
+    FRAME_OK,
+    FRAME_BAD_MARKER,       // framing failure: a marker byte does not match
+    FRAME_BAD_CRC           // markers fine, the trailing CRC does not match the bytes it covers
+} frame_status_t;
+
+/* A layout is a frame size, marker bytes that must match for the frame to
+ * be valid, and fields decoded into the members of battery_packet. Members
+ * a layout does not carry are left at zero. An optional CRC stored at
+ * crc_offset covers every byte before it.
+ */
+typedef struct {
+    char name[FRAME_SCHEMA_NAME_LEN];
+    uint8_t size;
+    uint8_t marker_count;
+    uint8_t field_count;
+    bool native;            // starts byte for byte with battery_packet: decoded by frame_decode_native()
+    uint8_t crc;            // frame_crc_t
+    uint8_t crc_offset;
+    uint8_t crc_big_endian;
+    frame_marker_t markers[FRAME_SCHEMA_MAX_MARKERS];
+    frame_field_t fields[FRAME_SCHEMA_MAX_FIELDS];
+} frame_schema_t;
+
+// The layout of battery_packet, what the sensor firmware sends today
+extern const frame_schema_t frame_schema_default;
+
+/* Parse a layout written as space separated tokens, e.g.
+ *
+ *   name=battery size=24 mark=0:0x00 mark=23:0xff time=1:i64 accelX=9:i16
+ *   accelY=11:i16 accelZ=13:i16 gyroX=15:i16 gyroY=17:i16 gyroZ=19:i16
+ *   battery=21:u16
+ *
+ * Types are u8, i8, u16, i16, u32, i32, u64 and i64 with an optional "be"
+ * suffix for big endian fields (little endian by default). A trailing CRC
+ * is given as crc=<offset>:crc8 or crc=<offset>:crc16[be]. Returns false
+ * and describes the first problem in `error` if the text is not a valid
+ * layout.
+ */
+bool frame_schema_parse(const char *text, frame_schema_t *schema, char *error, size_t error_size);
+
+// Inverse of frame_schema_parse()
+int frame_schema_format(const frame_schema_t *schema, char *text, size_t size);
+
+static inline frame_status_t frame_check_crc(const frame_schema_t *schema, const uint8_t *raw){
+    const uint8_t *stored = raw + schema->crc_offset;
+    if (schema->crc == FRAME_CRC8){
+        return (frame_crc8(raw, schema->crc_offset) == stored[0]) ? FRAME_OK : FRAME_BAD_CRC;
+    }
+    if (schema->crc == FRAME_CRC16){
+        uint16_t expected = schema->crc_big_endian ? (uint16_t)((stored[0] << 8) | stored[1]) : (uint16_t)(stored[0] | (stored[1] << 8));
+        return (frame_crc16(raw, schema->crc_offset) == expected) ? FRAME_OK : FRAME_BAD_CRC;
+    }
+    return FRAME_OK;
+}
+
+// Decode any layout by walking its field table
+frame_status_t frame_decode_generic(const frame_schema_t *schema, const uint8_t *raw, battery_packet *frame);
+
+// The native layout with constant offsets: one copy and two marker checks, then the CRC if there is one
+static inline frame_status_t frame_decode_native(const frame_schema_t *schema, const uint8_t *raw, battery_packet *frame){
+    memcpy(frame, raw, sizeof(*frame));
+    if ((frame->ID0 != FRAME_ID0) || (frame->IDfinal != FRAME_IDFINAL)){
+        return FRAME_BAD_MARKER;
+    }
+    return (schema->crc == FRAME_CRC_NONE) ? FRAME_OK : frame_check_crc(schema, raw);
+}
+
+static inline frame_status_t frame_decode(const frame_schema_t *schema, const uint8_t *raw, battery_packet *frame){
+    if (schema->native){
+        return frame_decode_native(schema, raw, frame);
+    }
+    return frame_decode_generic(schema, raw, frame);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,153 @@
+/* Timer-paced frame generator for the test socket
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "lwip/sockets.h"
+#include "generator.h"
+#include "trace.h"
+#include "dlog.h"
+
+// Longest wait for a tick, bounds how late a cleared running flag is seen
+#define GENERATOR_POLL_MS 100
+
+static const char *TAG = "generator";
+
+static esp_timer_handle_t tick_timer = NULL;
+static StaticSemaphore_t tick_buffer;
+static SemaphoreHandle_t tick = NULL;
+static battery_packet batch_buffer[GENERATOR_MAX_BATCH];
+
+/* Runs in the esp_timer task. A binary semaphore rather than a task
+ * notification: a tick that lands after the run must not wake the worker
+ * that ran it once it is back in the pool.
+ */
+static void generator_tick(void *arg){
+    xSemaphoreGive(tick);
+}
+
+void generator_synthetic(void *ctx, uint64_t index, battery_packet *frame){
+    frame->ID0 = FRAME_ID0;
+    frame->accelX = (int16_t)(index*7);
+    frame->accelY = (int16_t)(index*13);
+    frame->accelZ = (int16_t)(index*29);
+    frame->gyroX = (int16_t)(index % 2000) - 1000;
+    frame->gyroY = (int16_t)((index*3) % 2000) - 1000;
+    frame->gyroZ = (int16_t)((index*5) % 2000) - 1000;
+    frame->battery = (uint16_t)(4200 - (index/1000) % 1000);
+    frame->IDfinal = FRAME_IDFINAL;
+}
+
+static int64_t generator_due(const generator_t *gen, uint64_t index){
+    return gen->start_us + (int64_t)(index*1000000ULL/gen->config.frequency);
+}
+
+// Send `size` bytes of batch_buffer, timing every send() call
+static bool generator_send(generator_t *gen, int sock, size_t size){
+    const uint8_t *data = (const uint8_t *)batch_buffer;
+    while (size > 0){
+        int64_t before = esp_timer_get_time();
+        int err = send(sock, data, size, 0);
+        int64_t took = esp_timer_get_time() - before;
+        TRACE_EVENT(TRACE_SEND, err);
+        gen->sends++;
+        gen->latency[soak_jitter_bucket((took > UINT32_MAX) ? UINT32_MAX : (uint32_t)took)]++;
+        if (err < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            gen->error = errno;
+            return false;
+        }
+        data += err;
+        size -= err;
+    }
+    return true;
+}
+
+void generator_run(generator_t *gen, const generator_config_t *config, int sock,
+                   generator_source_t source, void *ctx, const volatile bool *running){
+    memset(gen, 0, sizeof(*gen));
+    gen->config = *config;
+    if (tick == NULL){
+        tick = xSemaphoreCreateBinaryStatic(&tick_buffer);
+        const esp_timer_create_args_t args = {
+            .callback = &generator_tick,
+            .name = "generate",
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&args, &tick_timer));
+    }
+    uint64_t period_us = (uint64_t)config->batch*1000000/config->frequency;
+    period_us = (period_us < GENERATOR_MIN_PERIOD_US) ? GENERATOR_MIN_PERIOD_US : period_us;
+    uint64_t limit = (config->count > 0) ? config->count : UINT64_MAX;
+    if (config->duration_ms > 0){
+        uint64_t frames = (uint64_t)config->duration_ms*config->frequency/1000;
+        limit = (frames < limit) ? frames : limit;
+    }
+
+    xSemaphoreTake(tick, 0);    // a tick left over from an earlier run
+    gen->start_us = esp_timer_get_time();
+    gen->end_us = gen->start_us;
+    ESP_ERROR_CHECK(esp_timer_start_periodic(tick_timer, period_us));
+    while (*running && (gen->frames < limit)){
+        xSemaphoreTake(tick, pdMS_TO_TICKS(GENERATOR_POLL_MS));
+        int64_t now = esp_timer_get_time();
+        // frames whose due time has come
+        uint64_t due = (uint64_t)(now - gen->start_us)*config->frequency/1000000 + 1;
+        due = (due < limit) ? due : limit;
+        bool first = true;
+        while (*running && (due > gen->frames) && ((due - gen->frames >= config->batch) || (due == limit))){
+            uint32_t n = (due - gen->frames < config->batch) ? (uint32_t)(due - gen->frames) : config->batch;
+            for(uint32_t i = 0; i < n; i++){
+                source(ctx, gen->frames + i, &batch_buffer[i]);
+                batch_buffer[i].time = generator_due(gen, gen->frames + i);
+            }
+            int64_t lag = esp_timer_get_time() - generator_due(gen, gen->frames + n - 1);
+            gen->max_lag_us = (lag > gen->max_lag_us) ? lag : gen->max_lag_us;
+            if (first && (lag > (int64_t)period_us)){
+                gen->late++;
+            }
+            first = false;
+            if (!generator_send(gen, sock, n*sizeof(battery_packet))){
+                DLOGE(TAG,"send failed after %llu frames: errno %d",gen->frames,gen->error);
+                goto done;
+            }
+            gen->frames += n;
+            gen->batches++;
+            gen->end_us = esp_timer_get_time();
+        }
+    }
+done:
+    esp_timer_stop(tick_timer);
+}
+
+double generator_rate(const generator_t *gen){
+    if (gen->frames == 0){
+        return 0;
+    }
+    // frame i is due at i/frequency, so n frames span n periods counting the last one
+    double seconds = (gen->end_us - gen->start_us)/1e6 + 1.0/gen->config.frequency;
+    return gen->frames/seconds;
+}
+
+int generator_format(const generator_t *gen, char *line, size_t size){
+    double rate = generator_rate(gen);
+    return snprintf(line, size,
+                    "generate: %llu frames in %.3f s, %.1f Hz of %u Hz (%.2f%%), %u batches of %u, "
+                    "send p50 %u p90 %u p99 %u max %u us over %u calls, %u late ticks, max lag %.2f ms",
+                    gen->frames, (gen->end_us - gen->start_us)/1e6, rate, gen->config.frequency,
+                    100.0*rate/gen->config.frequency, gen->batches, gen->config.batch,
+                    soak_histogram_percentile(gen->latency, 50), soak_histogram_percentile(gen->latency, 90),
+                    soak_histogram_percentile(gen->latency, 99), soak_histogram_percentile(gen->latency, 100),
+                    gen->sends, gen->late, gen->max_lag_us/1000.0);
+}
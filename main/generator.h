@@ -0,0 +1,72 @@
+/* Timer-paced frame generator for the test socket
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "frame.h"
+#include "soak.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GENERATOR_MAX_BATCH     64
+#define GENERATOR_MAX_FREQUENCY 20000
+// esp_timer is not asked to fire more often than this, shorter batch periods send several batches per tick
+#define GENERATOR_MIN_PERIOD_US 200
+
+typedef struct {
+    uint32_t frequency;         // frames per second
+    uint32_t batch;             // frames per send(), 1..GENERATOR_MAX_BATCH
+    uint32_t duration_ms;       // 0: until stopped
+    uint32_t count;             // frames to send, 0: until stopped
+} generator_config_t;
+
+/* Fills frame `index` of the run. The generator then overwrites frame->time
+ * with the time the schedule says the frame is due (esp_timer clock), so a
+ * receiver can measure the pacing from the frames alone.
+ */
+typedef void (*generator_source_t)(void *ctx, uint64_t index, battery_packet *frame);
+
+typedef struct {
+    generator_config_t config;
+    int64_t start_us;
+    int64_t end_us;
+    uint64_t frames;            // frames handed to send()
+    uint32_t sends;             // send() calls, a batch takes more than one when the socket buffer is short
+    uint32_t batches;
+    uint32_t late;              // ticks that found more than one batch due
+    int64_t max_lag_us;         // worst distance between a batch's due time and its send
+    int error;                  // errno of the send() that ended the run, 0 otherwise
+    uint32_t latency[SOAK_JITTER_BUCKETS];  // duration of each send() call in us
+} generator_t;
+
+// Synthetic source: slow ramps on every axis and a falling battery, all derived from the index
+void generator_synthetic(void *ctx, uint64_t index, battery_packet *frame);
+
+/* Send frames on `sock` paced by a periodic esp_timer until the configured
+ * count or duration is reached, *running is cleared, or send() fails.
+ * Frame i is due at start + i/frequency; a batch goes out once its last
+ * frame is due, so the average rate does not drift with the tick period.
+ * A late wake-up sends every batch that is due. Blocks the caller.
+ */
+void generator_run(generator_t *gen, const generator_config_t *config, int sock,
+                   generator_source_t source, void *ctx, const volatile bool *running);
+
+// Frames per second achieved over the run
+double generator_rate(const generator_t *gen);
+
+// One line summary of a finished run, returns the length written
+int generator_format(const generator_t *gen, char *line, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,470 @@
+/* Run history kept in NVS, and regression checks against a baseline
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "esp_log.h"
+#include "esp_console.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_ota_ops.h"
+#include "argtable3/argtable3.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+#include "dlog.h"
+#include "history.h"
+#include "result.h"
+
+#define HISTORY_NVS_NAMESPACE "history"
+#define HISTORY_NVS_NEXT "next"
+#define HISTORY_NVS_BASELINE "base"
+#define HISTORY_RUNS CONFIG_TESTSUITE_HISTORY_RUNS
+
+static const char *TAG = "history";
+
+static const char *kind_names[] = {"?", "recv", "soak"};
+
+// Worse by more than this (percent) and significant counts as a regression
+static float threshold_pct = 5;
+
+void history_begin(history_run_t *run, history_kind_t kind, uint32_t frequency, const char *schema){
+    memset(run, 0, sizeof(*run));
+    history_record_t *record = &run->record;
+    record->version = HISTORY_VERSION;
+    record->kind = kind;
+    record->frequency = frequency;
+    const esp_app_desc_t *app = esp_ota_get_app_description();
+    snprintf(record->firmware, sizeof(record->firmware), "%s", app->version);
+    record->firmware_sha = ((uint32_t)app->app_elf_sha256[0] << 24) | ((uint32_t)app->app_elf_sha256[1] << 16) |
+                           ((uint32_t)app->app_elf_sha256[2] << 8) | app->app_elf_sha256[3];
+    snprintf(record->profile, sizeof(record->profile), "%s", tuning_active()->name);
+    snprintf(record->schema, sizeof(record->schema), "%s", schema);
+    run->start_us = esp_timer_get_time();
+    tuning_cpu_begin(&run->cpu);
+}
+
+static void history_slot_key(uint32_t id, char *key){
+    sprintf(key, "r%u", (unsigned)(id % HISTORY_RUNS));
+}
+
+esp_err_t history_save(history_run_t *run){
+    history_record_t *record = &run->record;
+    record->duration_ms = (uint32_t)((esp_timer_get_time() - run->start_us)/1000);
+    record->rate_hz = run->rate_mean;
+    record->rate_sd = (record->rate_n > 1) ? sqrt(run->rate_m2/(record->rate_n - 1)) : 0;
+    record->jitter_p50 = soak_histogram_percentile(run->jitter, 50);
+    record->jitter_p99 = soak_histogram_percentile(run->jitter, 99);
+    record->jitter_max = soak_histogram_percentile(run->jitter, 100);
+    double mean, stddev;
+    record->jitter_n = soak_histogram_moments(run->jitter, &mean, &stddev);
+    record->jitter_mean = mean;
+    record->jitter_sd = stddev;
+    tuning_cpu_usage_t usage;
+    tuning_cpu_end(&run->cpu, &usage);
+    record->cpu_valid = usage.valid;
+    record->cpu_pct = usage.valid ? usage.task_pct : 0;
+    record->heap_free = esp_get_free_heap_size();
+    record->heap_min = esp_get_minimum_free_heap_size();
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(HISTORY_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK){
+        DLOGW(TAG,"Run not saved: %s",esp_err_to_name(err));
+        return err;
+    }
+    uint32_t next = 1;
+    nvs_get_u32(handle, HISTORY_NVS_NEXT, &next);
+    record->id = next;
+    // the slot of the oldest run is overwritten once the ring is full
+    char key[8];
+    history_slot_key(record->id, key);
+    err = nvs_set_blob(handle, key, record, sizeof(*record));
+    if (err == ESP_OK){
+        err = nvs_set_u32(handle, HISTORY_NVS_NEXT, next + 1);
+    }
+    if (err == ESP_OK){
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    if (err != ESP_OK){
+        DLOGW(TAG,"Run not saved: %s",esp_err_to_name(err));
+        return err;
+    }
+    DLOGI(TAG,"Saved as run %u",record->id);
+    history_check(record);
+    return ESP_OK;
+}
+
+static bool history_read(const char *key, history_record_t *record){
+    nvs_handle_t handle;
+    if (nvs_open(HISTORY_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK){
+        return false;
+    }
+    size_t length = sizeof(*record);
+    esp_err_t err = nvs_get_blob(handle, key, record, &length);
+    nvs_close(handle);
+    return (err == ESP_OK) && (length == sizeof(*record)) && (record->version == HISTORY_VERSION);
+}
+
+bool history_load(uint32_t id, history_record_t *record){
+    char key[8];
+    history_slot_key(id, key);
+    return history_read(key, record) && (record->id == id);
+}
+
+bool history_latest(uint32_t *id){
+    nvs_handle_t handle;
+    if (nvs_open(HISTORY_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK){
+        return false;
+    }
+    uint32_t next = 1;
+    esp_err_t err = nvs_get_u32(handle, HISTORY_NVS_NEXT, &next);
+    nvs_close(handle);
+    *id = next - 1;
+    return (err == ESP_OK) && (next > 1);
+}
+
+// Two sided 99% critical values of Student's t for 1..30 degrees of freedom
+static const float t_critical[] = {
+    63.657, 9.925, 5.841, 4.604, 4.032, 3.707, 3.499, 3.355, 3.250, 3.169,
+    3.106, 3.055, 3.012, 2.977, 2.947, 2.921, 2.898, 2.878, 2.861, 2.845,
+    2.831, 2.819, 2.807, 2.797, 2.787, 2.779, 2.771, 2.763, 2.756, 2.750,
+};
+
+static void history_welch(double base_mean, double base_sd, uint32_t base_n, double mean, double sd, uint32_t n,
+                          bool higher_is_worse, float threshold, history_test_t *test){
+    memset(test, 0, sizeof(*test));
+    test->comparable = true;
+    test->delta_pct = (base_mean != 0) ? 100*(mean - base_mean)/base_mean : 0;
+    if ((base_n < 2) || (n < 2)){
+        return;
+    }
+    test->testable = true;
+    double base_var = base_sd*base_sd/base_n;
+    double var = sd*sd/n;
+    if (base_var + var <= 0){
+        // no spread on either side: any difference is real
+        test->significant = (mean != base_mean);
+        test->df = base_n + n - 2;
+    }else{
+        test->t = (mean - base_mean)/sqrt(base_var + var);
+        test->df = (base_var + var)*(base_var + var)/(base_var*base_var/(base_n - 1) + var*var/(n - 1));
+        int df = (int)test->df;
+        float critical = (df < 1) ? t_critical[0] : (df <= 30) ? t_critical[df - 1] : 2.576f;
+        test->significant = (fabsf(test->t) > critical);
+    }
+    bool worse = higher_is_worse ? (test->delta_pct > threshold) : (test->delta_pct < -threshold);
+    test->regression = test->significant && worse;
+}
+
+void history_compare(const history_record_t *baseline, const history_record_t *run, float threshold, history_verdict_t *verdict){
+    memset(verdict, 0, sizeof(*verdict));
+    verdict->comparable = (baseline->kind == run->kind) && (baseline->frequency == run->frequency) &&
+                          (strcmp(baseline->schema, run->schema) == 0);
+    history_welch(baseline->rate_hz, baseline->rate_sd, baseline->rate_n, run->rate_hz, run->rate_sd, run->rate_n,
+                  false, threshold, &verdict->rate);
+    history_welch(baseline->jitter_mean, baseline->jitter_sd, baseline->jitter_n, run->jitter_mean, run->jitter_sd,
+                  run->jitter_n, true, threshold, &verdict->jitter);
+    // a different configuration is expected to differ
+    if (!verdict->comparable){
+        verdict->rate.regression = false;
+        verdict->jitter.regression = false;
+    }
+}
+
+static const char *history_test_word(const history_test_t *test){
+    if (!test->testable){
+        return "too few samples";
+    }
+    if (test->regression){
+        return "REGRESSION";
+    }
+    return test->significant ? "significant" : "no significant change";
+}
+
+static int history_format_verdict(const history_record_t *baseline, const history_record_t *run,
+                                  const history_verdict_t *verdict, char *line, size_t size){
+    return snprintf(line, size, "run %u vs baseline %u: rate %+.2f%% (t %.1f, %s), jitter %+.1f%% (t %.1f, %s)%s",
+                    run->id, baseline->id, verdict->rate.delta_pct, verdict->rate.t, history_test_word(&verdict->rate),
+                    verdict->jitter.delta_pct, verdict->jitter.t, history_test_word(&verdict->jitter),
+                    verdict->comparable ? "" : " [different configuration]");
+}
+
+static esp_log_level_t history_verdict_level(const history_verdict_t *verdict){
+    if (!verdict->comparable){
+        return ESP_LOG_WARN;
+    }
+    return (verdict->rate.regression || verdict->jitter.regression) ? ESP_LOG_ERROR : ESP_LOG_INFO;
+}
+
+void history_check(const history_record_t *run){
+    history_record_t baseline;
+    if (!history_read(HISTORY_NVS_BASELINE, &baseline)){
+        return;
+    }
+    history_verdict_t verdict;
+    history_compare(&baseline, run, threshold_pct, &verdict);
+    char line[200];
+    int len = history_format_verdict(&baseline, run, &verdict, line, sizeof(line));
+    dlog_write_text(history_verdict_level(&verdict), TAG, line, (len < sizeof(line)) ? len : sizeof(line) - 1);
+}
+
+static void history_print(const history_record_t *record){
+    char cpu[16] = "n/a";
+    if (record->cpu_valid){
+        snprintf(cpu, sizeof(cpu), "%.1f%%", record->cpu_pct);
+    }
+    ESP_LOGI(TAG,"#%-4u %-4s %s/%08x %-7s %s %u Hz x%u %.1f s: %.1f +- %.1f Hz, jitter p50 %u p99 %u max %u us, "
+             "corrupt %u crc %u gaps %u lost %u stalls %u reconn %u, cpu %s, heap %u (min %u)",
+             record->id, kind_names[(record->kind <= HISTORY_SOAK) ? record->kind : 0], record->firmware,
+             record->firmware_sha, record->profile, record->schema, record->frequency, record->rounds,
+             record->duration_ms/1000.0, record->rate_hz, record->rate_sd, record->jitter_p50, record->jitter_p99,
+             record->jitter_max, record->corrupted, record->crc_failed, record->gaps, record->lost, record->stalls,
+             record->reconnects, cpu, record->heap_free, record->heap_min);
+}
+
+// A stored run for the result channel, in the form its command sent it
+static void history_result(const history_record_t *record){
+    result_run_t run = {
+        .command = RESULT_CMD_HISTORY,
+        .rounds = record->rounds,
+        .frequency = record->frequency,
+        .duration_ms = record->duration_ms,
+        .frames = record->frames,
+        .corrupted = record->corrupted,
+        .crc_failed = record->crc_failed,
+        .gaps = record->gaps,
+        .lost = record->lost,
+        .stalls = record->stalls,
+        .reconnects = record->reconnects,
+        .rate_hz = record->rate_hz,
+        .jitter_p50 = record->jitter_p50,
+        .jitter_p99 = record->jitter_p99,
+        .jitter_max = record->jitter_max,
+        .cpu_pct = record->cpu_valid ? record->cpu_pct : 0,
+        .run_id = record->id,
+        .source = (record->kind == HISTORY_SOAK) ? RESULT_CMD_SOAK : RESULT_CMD_RECV_SENSOR,
+    };
+    result_run(&run);
+}
+
+static void history_diff(const history_record_t *a, const history_record_t *b){
+    const struct {
+        const char *name;
+        double a;
+        double b;
+    } rows[] = {
+        {"rate Hz", a->rate_hz, b->rate_hz},
+        {"rate sd", a->rate_sd, b->rate_sd},
+        {"jitter mean us", a->jitter_mean, b->jitter_mean},
+        {"jitter p50 us", a->jitter_p50, b->jitter_p50},
+        {"jitter p99 us", a->jitter_p99, b->jitter_p99},
+        {"jitter max us", a->jitter_max, b->jitter_max},
+        {"corrupted", a->corrupted, b->corrupted},
+        {"crc failed", a->crc_failed, b->crc_failed},
+        {"gaps", a->gaps, b->gaps},
+        {"lost", a->lost, b->lost},
+        {"stalls", a->stalls, b->stalls},
+        {"reconnects", a->reconnects, b->reconnects},
+        {"cpu %", a->cpu_pct, b->cpu_pct},
+        {"heap min", a->heap_min, b->heap_min},
+    };
+    ESP_LOGI(TAG,"%-16s %12s %12s %9s", "", "#a", "#b", "change");
+    for(int i = 0; i < sizeof(rows)/sizeof(rows[0]); i++){
+        double change = (rows[i].a != 0) ? 100*(rows[i].b - rows[i].a)/rows[i].a : 0;
+        ESP_LOGI(TAG,"%-16s %12.2f %12.2f %+8.1f%%", rows[i].name, rows[i].a, rows[i].b, change);
+    }
+    history_verdict_t verdict;
+    history_compare(a, b, threshold_pct, &verdict);
+    char line[200];
+    history_format_verdict(a, b, &verdict, line, sizeof(line));
+    ESP_LOGI(TAG,"%s", line);
+}
+
+static struct {
+    struct arg_str *action;
+    struct arg_int *ids;
+    struct arg_end *end;
+} history_args;
+
+static int history_command(int argc, char **argv){
+    int nerrors = arg_parse(argc, argv, (void **) &history_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, history_args.end, argv[0]);
+        return ESP_OK;
+    }
+    const char *action = (history_args.action->count > 0) ? history_args.action->sval[0] : "list";
+    history_record_t a, b;
+    if (strcmp(action, "list") == 0){
+        uint32_t latest;
+        if (!history_latest(&latest)){
+            ESP_LOGI(TAG,"No runs stored");
+            return ESP_OK;
+        }
+        uint32_t first = (latest > HISTORY_RUNS) ? latest - HISTORY_RUNS + 1 : 1;
+        for(uint32_t id = first; id <= latest; id++){
+            if (history_load(id, &a)){
+                history_print(&a);
+                history_result(&a);
+            }
+        }
+    }else if ((strcmp(action, "show") == 0) && (history_args.ids->count == 1)){
+        if (!history_load(history_args.ids->ival[0], &a)){
+            ESP_LOGE(TAG,"No run %d",history_args.ids->ival[0]);
+            result_error(RESULT_CMD_HISTORY,ESP_ERR_NOT_FOUND,"no such run");
+            return ESP_OK;
+        }
+        history_print(&a);
+        history_result(&a);
+    }else if ((strcmp(action, "diff") == 0) && (history_args.ids->count == 2)){
+        if (!history_load(history_args.ids->ival[0], &a) || !history_load(history_args.ids->ival[1], &b)){
+            ESP_LOGE(TAG,"Both runs must still be stored");
+            result_error(RESULT_CMD_HISTORY,ESP_ERR_NOT_FOUND,"both runs must still be stored");
+            return ESP_OK;
+        }
+        history_diff(&a, &b);
+        // the host computes the changes itself
+        history_result(&a);
+        history_result(&b);
+    }else if (strcmp(action, "clear") == 0){
+        // the baseline and the id counter stay, ids are never reused
+        nvs_handle_t handle;
+        if (nvs_open(HISTORY_NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK){
+            char key[8];
+            for(uint32_t slot = 0; slot < HISTORY_RUNS; slot++){
+                history_slot_key(slot, key);
+                nvs_erase_key(handle, key);
+            }
+            nvs_commit(handle);
+            nvs_close(handle);
+        }
+        ESP_LOGI(TAG,"Runs cleared");
+    }else{
+        ESP_LOGE(TAG,"Usage: history [list | show <id> | diff <a> <b> | clear]");
+        result_error(RESULT_CMD_HISTORY,ESP_ERR_INVALID_ARG,"unknown action");
+    }
+    return ESP_OK;
+}
+
+static struct {
+    struct arg_str *action;
+    struct arg_int *id;
+    struct arg_int *threshold;
+    struct arg_end *end;
+} baseline_args;
+
+static int baseline_command(int argc, char **argv){
+    int nerrors = arg_parse(argc, argv, (void **) &baseline_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, baseline_args.end, argv[0]);
+        return ESP_OK;
+    }
+    if (baseline_args.threshold->count > 0){
+        if ((baseline_args.threshold->ival[0] < 0) || (baseline_args.threshold->ival[0] > 100)){
+            ESP_LOGE(TAG,"Threshold is 0..100 %%");
+            return ESP_OK;
+        }
+        threshold_pct = baseline_args.threshold->ival[0];
+    }
+    const char *action = (baseline_args.action->count > 0) ? baseline_args.action->sval[0] : "show";
+    history_record_t baseline, run;
+    uint32_t id = 0;
+    if (baseline_args.id->count > 0){
+        id = baseline_args.id->ival[0];
+    }else if (!history_latest(&id)){
+        id = 0;
+    }
+    if (strcmp(action, "set") == 0){
+        if (!history_load(id, &run)){
+            ESP_LOGE(TAG,"No run %u",id);
+            return ESP_OK;
+        }
+        // a copy, so evicting the run does not lose the baseline
+        nvs_handle_t handle;
+        esp_err_t err = nvs_open(HISTORY_NVS_NAMESPACE, NVS_READWRITE, &handle);
+        if (err == ESP_OK){
+            err = nvs_set_blob(handle, HISTORY_NVS_BASELINE, &run, sizeof(run));
+            err = (err == ESP_OK) ? nvs_commit(handle) : err;
+            nvs_close(handle);
+        }
+        if (err != ESP_OK){
+            ESP_LOGE(TAG,"Baseline not saved: %s",esp_err_to_name(err));
+            return ESP_OK;
+        }
+        ESP_LOGI(TAG,"Baseline is run %u",id);
+        history_print(&run);
+    }else if (strcmp(action, "show") == 0){
+        if (!history_read(HISTORY_NVS_BASELINE, &baseline)){
+            ESP_LOGI(TAG,"No baseline, see \"baseline set\"");
+            return ESP_OK;
+        }
+        history_print(&baseline);
+        ESP_LOGI(TAG,"Regression: significant at 99%% and worse by more than %.0f%%",threshold_pct);
+    }else if (strcmp(action, "check") == 0){
+        if (!history_read(HISTORY_NVS_BASELINE, &baseline)){
+            ESP_LOGE(TAG,"No baseline, see \"baseline set\"");
+            return ESP_OK;
+        }
+        if (!history_load(id, &run)){
+            ESP_LOGE(TAG,"No run %u",id);
+            return ESP_OK;
+        }
+        history_verdict_t verdict;
+        history_compare(&baseline, &run, threshold_pct, &verdict);
+        char line[200];
+        history_format_verdict(&baseline, &run, &verdict, line, sizeof(line));
+        esp_log_level_t level = history_verdict_level(&verdict);
+        if (level == ESP_LOG_ERROR){
+            ESP_LOGE(TAG,"%s",line);
+        }else if (level == ESP_LOG_WARN){
+            ESP_LOGW(TAG,"%s",line);
+        }else{
+            ESP_LOGI(TAG,"%s",line);
+        }
+    }else if (strcmp(action, "clear") == 0){
+        nvs_handle_t handle;
+        if (nvs_open(HISTORY_NVS_NAMESPACE, NVS_READWRITE, &handle) == ESP_OK){
+            nvs_erase_key(handle, HISTORY_NVS_BASELINE);
+            nvs_commit(handle);
+            nvs_close(handle);
+        }
+        ESP_LOGI(TAG,"Baseline cleared");
+    }else{
+        ESP_LOGE(TAG,"Usage: baseline [show | set [id] | check [id] | clear] [-t pct]");
+    }
+    return ESP_OK;
+}
+
+void register_history(void){
+    history_args.action = arg_str0(NULL, NULL, "<list|show|diff|clear>", "what to do (default list)");
+    history_args.ids = arg_intn(NULL, NULL, "<id>", 0, 2, "run ids for show and diff");
+    history_args.end = arg_end(0);
+    const esp_console_cmd_t history_cmd = {
+        .command = "history",
+        .help = "List, show, diff or clear the stored recv_sensor and soak runs",
+        .hint = NULL,
+        .func = &history_command,
+        .argtable = &history_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&history_cmd));
+
+    baseline_args.action = arg_str0(NULL, NULL, "<show|set|check|clear>", "what to do (default show)");
+    baseline_args.id = arg_int0(NULL, NULL, "<id>", "run to set or check (default the newest)");
+    baseline_args.threshold = arg_int0("t", "threshold", "<pct>", "smallest significant change that counts as a regression (default 5)");
+    baseline_args.end = arg_end(0);
+    const esp_console_cmd_t baseline_cmd = {
+        .command = "baseline",
+        .help = "Keep a reference run and flag significant throughput or jitter regressions against it",
+        .hint = NULL,
+        .func = &baseline_command,
+        .argtable = &baseline_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&baseline_cmd));
+}
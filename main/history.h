@@ -0,0 +1,136 @@
+/* Run history kept in NVS, and regression checks against a baseline
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "soak.h"
+#include "tuning.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bumped whenever history_record_t changes, older records are skipped
+#define HISTORY_VERSION 1
+
+typedef enum {
+    HISTORY_RECV_SENSOR = 1,
+    HISTORY_SOAK = 2,
+} history_kind_t;
+
+/* What is stored of one run, 136 bytes. Rate and jitter keep a mean,
+ * a standard deviation and a sample count so two runs can be compared with
+ * a significance test. Rate samples are per block (recv_sensor) or per
+ * second (soak); jitter samples are |interval - nominal| per frame.
+ */
+typedef struct {
+    uint16_t version;
+    uint8_t kind;
+    uint8_t cpu_valid;
+    uint32_t id;                // increasing, never reused
+    char firmware[16];          // application version
+    uint32_t firmware_sha;      // first bytes of the ELF SHA-256, tells builds of one version apart
+    char profile[8];            // tuning profile
+    char schema[12];            // frame layout
+    uint32_t frequency;
+    uint32_t rounds;
+    uint32_t duration_ms;
+    uint32_t frames;
+    uint32_t corrupted;
+    uint32_t crc_failed;
+    uint32_t gaps;
+    uint32_t lost;
+    uint32_t stalls;
+    uint32_t reconnects;
+    float rate_hz;
+    float rate_sd;
+    uint32_t rate_n;
+    uint32_t jitter_p50;
+    uint32_t jitter_p99;
+    uint32_t jitter_max;
+    float jitter_mean;
+    float jitter_sd;
+    uint32_t jitter_n;
+    float cpu_pct;              // receiving task, percent of one core
+    uint32_t heap_free;
+    uint32_t heap_min;          // lowest free heap since boot
+} history_record_t;
+
+// Accumulates one run, the receive loop feeds it
+typedef struct {
+    history_record_t record;
+    uint32_t jitter[SOAK_JITTER_BUCKETS];
+    double rate_mean;
+    double rate_m2;
+    int64_t start_us;
+    tuning_cpu_t cpu;
+} history_run_t;
+
+// Start a run: configuration, firmware, clock and CPU accounting
+void history_begin(history_run_t *run, history_kind_t kind, uint32_t frequency, const char *schema);
+
+// One throughput sample in frames per second (Welford's running variance)
+static inline void history_rate_sample(history_run_t *run, double hz){
+    uint32_t n = ++run->record.rate_n;
+    double delta = hz - run->rate_mean;
+    run->rate_mean += delta/n;
+    run->rate_m2 += delta*(hz - run->rate_mean);
+}
+
+static inline void history_jitter_sample(history_run_t *run, uint32_t jitter_us){
+    run->jitter[soak_jitter_bucket(jitter_us)]++;
+}
+
+/* Finish the record (rate, jitter, CPU, heap) and store it, evicting the
+ * oldest run once CONFIG_TESTSUITE_HISTORY_RUNS are kept. The counters in
+ * run->record are filled by the caller.
+ */
+esp_err_t history_save(history_run_t *run);
+
+// Record `id`, false if it was evicted or never existed
+bool history_load(uint32_t id, history_record_t *record);
+
+// Id of the newest run, false when there is none
+bool history_latest(uint32_t *id);
+
+/* Verdict of comparing a run with the baseline. A change is significant
+ * when Welch's t-test rejects equal means at 99%; it is a regression when
+ * it is also significant and worse by more than the threshold, and only
+ * between runs of the same configuration.
+ */
+typedef struct {
+    bool comparable;            // same kind, frequency and layout
+    bool testable;              // both sides have at least two samples
+    float delta_pct;            // (run - baseline)/baseline
+    float t;
+    float df;
+    bool significant;
+    bool regression;
+} history_test_t;
+
+typedef struct {
+    bool comparable;
+    history_test_t rate;
+    history_test_t jitter;
+} history_verdict_t;
+
+void history_compare(const history_record_t *baseline, const history_record_t *run, float threshold_pct, history_verdict_t *verdict);
+
+// Compare `run` with the stored baseline and log the verdict; nothing when no baseline is set
+void history_check(const history_record_t *run);
+
+// Register the "history" and "baseline" console commands
+void register_history(void);
+
+#ifdef __cplusplus
+}
+#endif
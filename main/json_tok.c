@@ -0,0 +1,425 @@
+/* Incremental JSON tokenizer for sensor replies
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include "json_tok.h"
+
+// What may come next, outside a token
+enum {
+    ST_VALUE,                   // a value: at the top level, after ':' and after ',' in an array
+    ST_FIRST_VALUE,             // after '[': a value or ']'
+    ST_FIRST_KEY,               // after '{': a member name or '}'
+    ST_KEY,                     // after ',' in an object: a member name
+    ST_COLON,
+    ST_NEXT,                    // after a member value: ',' or the end of the container
+    ST_ERROR,
+};
+
+// The token being read
+enum {
+    LEX_NONE,
+    LEX_STRING,
+    LEX_ESCAPE,
+    LEX_UNICODE,
+    LEX_NUMBER,
+    LEX_LITERAL,
+};
+
+// Number grammar: -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+enum {
+    NUM_SIGN,
+    NUM_ZERO,
+    NUM_INT,
+    NUM_DOT,
+    NUM_FRAC,
+    NUM_E,
+    NUM_ESIGN,
+    NUM_EXP,
+};
+
+static const struct {
+    const char *text;
+    uint8_t len;
+    json_type_t type;
+} json_literals[] = {
+    {"true", 4, JSON_TRUE},
+    {"false", 5, JSON_FALSE},
+    {"null", 4, JSON_NULL},
+};
+
+void json_tok_init(json_tok_t *tok, json_sink_t sink, void *ctx){
+    tok->sink = sink;
+    tok->ctx = ctx;
+    json_tok_reset(tok);
+}
+
+void json_tok_reset(json_tok_t *tok){
+    tok->state = ST_VALUE;
+    tok->lex = LEX_NONE;
+    tok->depth = 0;
+    tok->objects = 0;
+    tok->error = JSON_ERR_NONE;
+    tok->offset = 0;
+    tok->keys[0][0] = '\0';
+    tok->key_truncated[0] = false;
+}
+
+bool json_tok_idle(const json_tok_t *tok){
+    return (tok->state == ST_VALUE) && (tok->lex == LEX_NONE) && (tok->depth == 0);
+}
+
+static inline bool json_in_object(const json_tok_t *tok){
+    return (tok->depth > 0) && (tok->objects & (1u << (tok->depth - 1)));
+}
+
+const char *json_tok_key(const json_tok_t *tok, uint8_t depth){
+    if ((depth == 0) || (depth > tok->depth) || !(tok->objects & (1u << (depth - 1)))){
+        return "";
+    }
+    return tok->keys[depth];
+}
+
+static void json_emit(json_tok_t *tok, json_type_t type, const char *text, uint16_t len, bool truncated){
+    bool member = json_in_object(tok);
+    json_token_t token = {
+        .type = type,
+        .depth = tok->depth,
+        .truncated = truncated || (member && tok->key_truncated[tok->depth]),
+        .len = len,
+        .key = member ? tok->keys[tok->depth] : "",
+        .text = text,
+    };
+    if (tok->sink != NULL){
+        tok->sink(tok->ctx, tok, &token);
+    }
+}
+
+// A value is complete at the current depth
+static void json_value_done(json_tok_t *tok){
+    if (tok->depth == 0){
+        tok->values++;
+        tok->state = ST_VALUE;
+    }else{
+        tok->state = ST_NEXT;
+    }
+}
+
+static bool json_fail(json_tok_t *tok, json_error_t error){
+    tok->error = error;
+    tok->state = ST_ERROR;
+    tok->lex = LEX_NONE;
+    return false;
+}
+
+static bool json_push(json_tok_t *tok, bool object){
+    if (tok->depth == JSON_TOK_MAX_DEPTH){
+        return json_fail(tok, JSON_ERR_DEPTH);
+    }
+    json_emit(tok, object ? JSON_OBJECT_BEGIN : JSON_ARRAY_BEGIN, "", 0, false);
+    tok->depth++;
+    if (object){
+        tok->objects |= 1u << (tok->depth - 1);
+    }else{
+        tok->objects &= ~(1u << (tok->depth - 1));
+    }
+    tok->keys[tok->depth][0] = '\0';
+    tok->key_truncated[tok->depth] = false;
+    tok->state = object ? ST_FIRST_KEY : ST_FIRST_VALUE;
+    return true;
+}
+
+static bool json_pop(json_tok_t *tok, bool object){
+    if ((tok->depth == 0) || (json_in_object(tok) != object)){
+        return json_fail(tok, JSON_ERR_SYNTAX);
+    }
+    tok->depth--;
+    json_emit(tok, object ? JSON_OBJECT_END : JSON_ARRAY_END, "", 0, false);
+    json_value_done(tok);
+    return true;
+}
+
+static inline void json_append(json_tok_t *tok, char c){
+    if (tok->len < JSON_TOK_MAX_VALUE){
+        tok->value[tok->len++] = c;
+    }else{
+        tok->truncated = true;
+    }
+}
+
+// \uXXXX as UTF-8; a surrogate half can't be written alone and becomes '?'
+static void json_append_unicode(json_tok_t *tok, uint16_t code){
+    if (code < 0x80){
+        json_append(tok, code);
+    }else if (code < 0x800){
+        json_append(tok, 0xc0 | (code >> 6));
+        json_append(tok, 0x80 | (code & 0x3f));
+    }else if ((code >= 0xd800) && (code <= 0xdfff)){
+        json_append(tok, '?');
+    }else{
+        json_append(tok, 0xe0 | (code >> 12));
+        json_append(tok, 0x80 | ((code >> 6) & 0x3f));
+        json_append(tok, 0x80 | (code & 0x3f));
+    }
+}
+
+static void json_string_done(json_tok_t *tok){
+    tok->value[tok->len] = '\0';
+    tok->lex = LEX_NONE;
+    if (tok->is_key){
+        // the name stays for the value that follows, and for the containers it opens
+        size_t len = (tok->len < JSON_TOK_MAX_KEY) ? tok->len : JSON_TOK_MAX_KEY;
+        memcpy(tok->keys[tok->depth], tok->value, len);
+        tok->keys[tok->depth][len] = '\0';
+        tok->key_truncated[tok->depth] = tok->truncated || (tok->len > JSON_TOK_MAX_KEY);
+        tok->state = ST_COLON;
+        return;
+    }
+    json_emit(tok, JSON_STRING, tok->value, tok->len, tok->truncated);
+    json_value_done(tok);
+}
+
+// Next number state after `c`, or -1 if `c` does not continue the number
+static int json_number_step(uint8_t state, char c){
+    bool digit = (c >= '0') && (c <= '9');
+    switch (state){
+        case NUM_SIGN:
+            return (c == '0') ? NUM_ZERO : digit ? NUM_INT : -1;
+        case NUM_ZERO:
+            return (c == '.') ? NUM_DOT : ((c == 'e') || (c == 'E')) ? NUM_E : -1;
+        case NUM_INT:
+            return digit ? NUM_INT : (c == '.') ? NUM_DOT : ((c == 'e') || (c == 'E')) ? NUM_E : -1;
+        case NUM_DOT:
+            return digit ? NUM_FRAC : -1;
+        case NUM_FRAC:
+            return digit ? NUM_FRAC : ((c == 'e') || (c == 'E')) ? NUM_E : -1;
+        case NUM_E:
+            return ((c == '+') || (c == '-')) ? NUM_ESIGN : digit ? NUM_EXP : -1;
+        case NUM_ESIGN:
+        case NUM_EXP:
+            return digit ? NUM_EXP : -1;
+    }
+    return -1;
+}
+
+static inline bool json_number_complete(uint8_t state){
+    return (state == NUM_ZERO) || (state == NUM_INT) || (state == NUM_FRAC) || (state == NUM_EXP);
+}
+
+static inline int json_hex(char c){
+    if ((c >= '0') && (c <= '9')){
+        return c - '0';
+    }
+    if ((c >= 'a') && (c <= 'f')){
+        return c - 'a' + 10;
+    }
+    if ((c >= 'A') && (c <= 'F')){
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+// Start of a value in ST_VALUE or ST_FIRST_VALUE
+static bool json_value_start(json_tok_t *tok, char c){
+    tok->len = 0;
+    tok->truncated = false;
+    switch (c){
+        case '{':
+            return json_push(tok, true);
+        case '[':
+            return json_push(tok, false);
+        case '"':
+            tok->lex = LEX_STRING;
+            tok->is_key = false;
+            return true;
+        case 't':
+        case 'f':
+        case 'n':
+            tok->lex = LEX_LITERAL;
+            tok->literal = (c == 't') ? 0 : (c == 'f') ? 1 : 2;
+            tok->literal_at = 1;
+            return true;
+        default:
+            if ((c == '-') || ((c >= '0') && (c <= '9'))){
+                tok->lex = LEX_NUMBER;
+                tok->number = (c == '-') ? NUM_SIGN : (c == '0') ? NUM_ZERO : NUM_INT;
+                json_append(tok, c);
+                return true;
+            }
+            return json_fail(tok, JSON_ERR_SYNTAX);
+    }
+}
+
+// A byte outside any token
+static bool json_structure(json_tok_t *tok, char c){
+    if ((c == ' ') || (c == '\t') || (c == '\r') || (c == '\n')){
+        return true;
+    }
+    switch (tok->state){
+        case ST_VALUE:
+            return json_value_start(tok, c);
+        case ST_FIRST_VALUE:
+            return (c == ']') ? json_pop(tok, false) : json_value_start(tok, c);
+        case ST_FIRST_KEY:
+            if (c == '}'){
+                return json_pop(tok, true);
+            }
+            // fall through
+        case ST_KEY:
+            if (c != '"'){
+                return json_fail(tok, JSON_ERR_SYNTAX);
+            }
+            tok->lex = LEX_STRING;
+            tok->is_key = true;
+            tok->len = 0;
+            tok->truncated = false;
+            return true;
+        case ST_COLON:
+            if (c != ':'){
+                return json_fail(tok, JSON_ERR_SYNTAX);
+            }
+            tok->state = ST_VALUE;
+            return true;
+        case ST_NEXT:
+            if (c == ','){
+                tok->state = json_in_object(tok) ? ST_KEY : ST_VALUE;
+                return true;
+            }
+            if ((c == '}') || (c == ']')){
+                return json_pop(tok, c == '}');
+            }
+            return json_fail(tok, JSON_ERR_SYNTAX);
+    }
+    return false;
+}
+
+bool json_tok_feed(json_tok_t *tok, const char *data, size_t len){
+    if (tok->state == ST_ERROR){
+        return false;
+    }
+    for(size_t i = 0; i < len; i++){
+        char c = data[i];
+        switch (tok->lex){
+            case LEX_STRING:
+                if (c == '"'){
+                    json_string_done(tok);
+                }else if (c == '\\'){
+                    tok->lex = LEX_ESCAPE;
+                }else if ((uint8_t)c < 0x20){
+                    tok->offset += i;
+                    return json_fail(tok, JSON_ERR_SYNTAX);
+                }else{
+                    json_append(tok, c);
+                }
+                continue;
+            case LEX_ESCAPE: {
+                const char *from = "\"\\/bfnrt";
+                const char *to = "\"\\/\b\f\n\r\t";
+                const char *found = (c != '\0') ? strchr(from, c) : NULL;
+                if (found != NULL){
+                    json_append(tok, to[found - from]);
+                    tok->lex = LEX_STRING;
+                }else if (c == 'u'){
+                    tok->lex = LEX_UNICODE;
+                    tok->unicode = 0;
+                    tok->unicode_digits = 0;
+                }else{
+                    tok->offset += i;
+                    return json_fail(tok, JSON_ERR_SYNTAX);
+                }
+                continue;
+            }
+            case LEX_UNICODE: {
+                int digit = json_hex(c);
+                if (digit < 0){
+                    tok->offset += i;
+                    return json_fail(tok, JSON_ERR_SYNTAX);
+                }
+                tok->unicode = (tok->unicode << 4) | digit;
+                if (++tok->unicode_digits == 4){
+                    json_append_unicode(tok, tok->unicode);
+                    tok->lex = LEX_STRING;
+                }
+                continue;
+            }
+            case LEX_LITERAL:
+                if (c != json_literals[tok->literal].text[tok->literal_at]){
+                    tok->offset += i;
+                    return json_fail(tok, JSON_ERR_SYNTAX);
+                }
+                if (++tok->literal_at == json_literals[tok->literal].len){
+                    tok->lex = LEX_NONE;
+                    json_emit(tok, json_literals[tok->literal].type, json_literals[tok->literal].text,
+                              json_literals[tok->literal].len, false);
+                    json_value_done(tok);
+                }
+                continue;
+            case LEX_NUMBER: {
+                int next = json_number_step(tok->number, c);
+                if (next >= 0){
+                    tok->number = next;
+                    json_append(tok, c);
+                    continue;
+                }
+                if (!json_number_complete(tok->number)){
+                    tok->offset += i;
+                    return json_fail(tok, JSON_ERR_SYNTAX);
+                }
+                // the byte after a number is the first that is not part of it
+                tok->value[tok->len] = '\0';
+                tok->lex = LEX_NONE;
+                json_emit(tok, JSON_NUMBER, tok->value, tok->len, tok->truncated);
+                json_value_done(tok);
+                break;
+            }
+            default:
+                break;
+        }
+        if (!json_structure(tok, c)){
+            tok->offset += i;
+            return false;
+        }
+    }
+    tok->offset += len;
+    return true;
+}
+
+bool json_token_double(const json_token_t *token, double *value){
+    if (((token->type != JSON_NUMBER) && (token->type != JSON_STRING)) || (token->len == 0) || token->truncated){
+        return false;
+    }
+    char *end;
+    *value = strtod(token->text, &end);
+    return *end == '\0';
+}
+
+bool json_token_int(const json_token_t *token, int64_t *value){
+    if (((token->type != JSON_NUMBER) && (token->type != JSON_STRING)) || (token->len == 0) || token->truncated){
+        return false;
+    }
+    // parsed as an integer: a double loses digits above 2^53, and 1.5 or 1e3 is not one
+    char *end;
+    errno = 0;
+    long long number = strtoll(token->text, &end, 10);
+    if ((*end != '\0') || (errno == ERANGE)){
+        return false;
+    }
+    *value = number;
+    return true;
+}
+
+const char *json_error_name(json_error_t error){
+    switch (error){
+        case JSON_ERR_NONE: return "none";
+        case JSON_ERR_SYNTAX: return "syntax error";
+        case JSON_ERR_DEPTH: return "nested too deep";
+    }
+    return "unknown";
+}
@@ -0,0 +1,116 @@
+/* Incremental JSON tokenizer for sensor replies
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JSON_TOK_MAX_DEPTH  16
+#define JSON_TOK_MAX_KEY    24      // member names are cut to this many bytes
+#define JSON_TOK_MAX_VALUE  64      // and string and number values to this many
+
+typedef enum {
+    JSON_OBJECT_BEGIN,
+    JSON_OBJECT_END,
+    JSON_ARRAY_BEGIN,
+    JSON_ARRAY_END,
+    JSON_STRING,
+    JSON_NUMBER,
+    JSON_TRUE,
+    JSON_FALSE,
+    JSON_NULL,
+} json_type_t;
+
+typedef enum {
+    JSON_ERR_NONE,
+    JSON_ERR_SYNTAX,            // a byte that can't come where it came
+    JSON_ERR_DEPTH,             // nested deeper than JSON_TOK_MAX_DEPTH
+} json_error_t;
+
+/* A value, or the beginning or end of a container. `depth` counts the
+ * containers around it: 0 for a whole reply and its closing brace, 1 for
+ * the members of the reply. `key` is the member name when the token is
+ * (or begins or ends) the value of an object member, "" otherwise. `text`
+ * is the unescaped string, or the number as written, NUL terminated.
+ * Everything points into the tokenizer and is only valid in the sink.
+ */
+typedef struct {
+    json_type_t type;
+    uint8_t depth;
+    bool truncated;             // text or key was cut to fit
+    uint16_t len;
+    const char *key;
+    const char *text;
+} json_token_t;
+
+struct json_tok;
+typedef void (*json_sink_t)(void *ctx, const struct json_tok *tok, const json_token_t *token);
+
+/* A push tokenizer: bytes go in as they arrive, in pieces of any size, and
+ * each token comes out through the sink as soon as its last byte is seen.
+ * The state between pieces is a few bytes of lexer state, the value being
+ * read and the member name at each depth, all in this struct: nothing is
+ * allocated and nesting is a bit stack, not recursion. Any number of
+ * values may follow each other, separated by whitespace or not at all.
+ */
+typedef struct json_tok {
+    json_sink_t sink;
+    void *ctx;
+    uint8_t state;              // what may come next
+    uint8_t lex;                // the token being read, if any
+    uint8_t depth;
+    uint8_t number;             // number grammar state
+    uint8_t literal;            // true, false or null, and how much of it matched
+    uint8_t literal_at;
+    uint8_t unicode_digits;
+    bool is_key;
+    bool truncated;
+    bool key_truncated[JSON_TOK_MAX_DEPTH + 1];
+    uint16_t unicode;
+    uint16_t len;
+    uint32_t objects;           // bit d - 1 set: the container at depth d is an object
+    json_error_t error;
+    uint32_t offset;            // bytes taken since the reset, where the error is once there is one
+    uint32_t values;            // top level values completed
+    char value[JSON_TOK_MAX_VALUE + 1];
+    char keys[JSON_TOK_MAX_DEPTH + 1][JSON_TOK_MAX_KEY + 1];     // keys[d]: the member being read at depth d
+} json_tok_t;
+
+void json_tok_init(json_tok_t *tok, json_sink_t sink, void *ctx);
+
+// Start over before a new reply, e.g. after an error or a reply that was cut off
+void json_tok_reset(json_tok_t *tok);
+
+/* Tokenize the next `len` bytes. Returns false once the input is not JSON;
+ * tok->error and tok->offset tell what and where, and everything is
+ * ignored until json_tok_reset().
+ */
+bool json_tok_feed(json_tok_t *tok, const char *data, size_t len);
+
+// Nothing partial: between two top level values
+bool json_tok_idle(const json_tok_t *tok);
+
+// Member name at `depth` (1..token depth) on the way to the current token, "" inside arrays
+const char *json_tok_key(const json_tok_t *tok, uint8_t depth);
+
+// Numbers, and strings holding one; false for anything else
+bool json_token_double(const json_token_t *token, double *value);
+// The same for integers: false for a fraction, an exponent or a value past int64_t
+bool json_token_int(const json_token_t *token, int64_t *value);
+
+const char *json_error_name(json_error_t error);
+
+#ifdef __cplusplus
+}
+#endif
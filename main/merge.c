@@ -0,0 +1,187 @@
+/* Time-ordered k-way merge of several sensor streams
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "merge.h"
+
+static inline const merge_entry_t *merge_head(const merge_t *merge, uint32_t input){
+    return &merge->entries[input*merge->depth + merge->input[input].head];
+}
+
+// Heap order: smallest key, the lower input first on a tie so the output does not depend on arrival order
+static inline bool merge_before(const merge_head_t *a, const merge_head_t *b){
+    return (a->key < b->key) || ((a->key == b->key) && (a->input < b->input));
+}
+
+static void merge_sift_up(merge_t *merge, uint32_t pos){
+    merge_head_t node = merge->heap[pos];
+    while (pos > 0){
+        uint32_t parent = (pos - 1)/2;
+        if (!merge_before(&node, &merge->heap[parent])){
+            break;
+        }
+        merge->heap[pos] = merge->heap[parent];
+        pos = parent;
+    }
+    merge->heap[pos] = node;
+}
+
+static void merge_sift_down(merge_t *merge, uint32_t pos){
+    merge_head_t node = merge->heap[pos];
+    for(;;){
+        uint32_t child = 2*pos + 1;
+        if (child >= merge->heap_size){
+            break;
+        }
+        if ((child + 1 < merge->heap_size) && merge_before(&merge->heap[child + 1], &merge->heap[child])){
+            child++;
+        }
+        if (!merge_before(&merge->heap[child], &node)){
+            break;
+        }
+        merge->heap[pos] = merge->heap[child];
+        pos = child;
+    }
+    merge->heap[pos] = node;
+}
+
+void merge_reset(merge_t *merge, uint32_t inputs, int64_t window_us, merge_sink_t sink, void *ctx){
+    inputs = (inputs > MERGE_MAX_INPUTS) ? MERGE_MAX_INPUTS : inputs;
+    merge->inputs = inputs;
+    merge->window_us = window_us;
+    merge->sink = sink;
+    merge->ctx = ctx;
+    memset(merge->input, 0, sizeof(merge->input));
+    merge->heap_size = 0;
+    merge->waiting = inputs;
+    merge->emitted_any = false;
+    merge->last_emitted = 0;
+    merge->emitted = 0;
+    merge->max_queued = 0;
+    merge->queued = 0;
+    memset(merge->latency, 0, sizeof(merge->latency));
+    merge->max_latency_us = 0;
+}
+
+static void merge_emit(merge_t *merge, int64_t now_us){
+    uint32_t index = merge->heap[0].input;
+    merge_input_t *input = &merge->input[index];
+    const merge_entry_t *entry = merge_head(merge, index);
+    if (merge->sink){
+        merge->sink(merge->ctx, index, entry->key, &entry->frame);
+    }
+    int64_t latency = now_us - entry->arrival_us;
+    latency = (latency < 0) ? 0 : ((latency > UINT32_MAX) ? UINT32_MAX : latency);
+    merge->latency[soak_jitter_bucket((uint32_t)latency)]++;
+    merge->max_latency_us = (latency > merge->max_latency_us) ? (uint32_t)latency : merge->max_latency_us;
+    merge->last_emitted = entry->key;
+    merge->emitted_any = true;
+    merge->emitted++;
+    merge->queued--;
+
+    input->head = (input->head + 1 == merge->depth) ? 0 : input->head + 1;
+    input->count--;
+    if (input->count > 0){
+        // the new head is no earlier than the one that left
+        merge->heap[0].key = merge_head(merge, index)->key;
+        merge_sift_down(merge, 0);
+        return;
+    }
+    merge->heap[0] = merge->heap[--merge->heap_size];
+    if (merge->heap_size > 0){
+        merge_sift_down(merge, 0);
+    }
+    merge->waiting += !input->closed;
+}
+
+bool merge_push(merge_t *merge, uint32_t index, int64_t key, int64_t arrival_us, const battery_packet *frame){
+    merge_input_t *input = &merge->input[index];
+    input->pushed++;
+    if ((input->pushed > 1) && (key < input->last_key)){
+        // a small step back of the clock estimate, not of the sensor: keep the input in its own order
+        key = input->last_key;
+    }
+    if (merge->emitted_any && (key < merge->last_emitted)){
+        input->late++;
+        return false;
+    }
+    while (input->count == merge->depth){
+        input->forced++;
+        merge_emit(merge, arrival_us);
+    }
+    uint32_t slot = input->head + input->count;
+    slot = (slot >= merge->depth) ? slot - merge->depth : slot;
+    merge_entry_t *entry = &merge->entries[index*merge->depth + slot];
+    entry->key = key;
+    entry->arrival_us = arrival_us;
+    entry->frame = *frame;
+    input->count++;
+    input->last_key = key;
+    merge->queued++;
+    merge->max_queued = (merge->queued > merge->max_queued) ? merge->queued : merge->max_queued;
+    if (input->count == 1){
+        merge->heap[merge->heap_size] = (merge_head_t){key, index};
+        merge_sift_up(merge, merge->heap_size++);
+        merge->waiting -= !input->closed;
+    }
+    // every open input has a frame queued: the smallest head cannot be overtaken
+    while ((merge->heap_size > 0) && (merge->waiting == 0)){
+        merge_emit(merge, arrival_us);
+    }
+    return true;
+}
+
+void merge_advance(merge_t *merge, int64_t now_us){
+    const int64_t watermark = now_us - merge->window_us;
+    while ((merge->heap_size > 0) && ((merge->waiting == 0) || (merge->heap[0].key <= watermark))){
+        merge_emit(merge, now_us);
+    }
+}
+
+void merge_close(merge_t *merge, uint32_t index, int64_t now_us){
+    merge_input_t *input = &merge->input[index];
+    if (!input->closed){
+        input->closed = true;
+        merge->waiting -= (input->count == 0);
+    }
+    merge_advance(merge, now_us);
+}
+
+void merge_flush(merge_t *merge, int64_t now_us){
+    while (merge->heap_size > 0){
+        merge_emit(merge, now_us);
+    }
+}
+
+uint64_t merge_late(const merge_t *merge){
+    uint64_t late = 0;
+    for(uint32_t i = 0; i < merge->inputs; i++){
+        late += merge->input[i].late;
+    }
+    return late;
+}
+
+uint64_t merge_forced(const merge_t *merge){
+    uint64_t forced = 0;
+    for(uint32_t i = 0; i < merge->inputs; i++){
+        forced += merge->input[i].forced;
+    }
+    return forced;
+}
+
+int merge_format(const merge_t *merge, char *line, size_t size){
+    return snprintf(line, size,
+                    "merge: %llu frames from %u inputs in time order, %llu late, %llu forced out by a full queue, "
+                    "latency p50 %u p99 %u max %u us (window %lld ms), deepest %u frames",
+                    (unsigned long long)merge->emitted, merge->inputs, (unsigned long long)merge_late(merge),
+                    (unsigned long long)merge_forced(merge), soak_histogram_percentile(merge->latency, 50),
+                    soak_histogram_percentile(merge->latency, 99), merge->max_latency_us,
+                    (long long)(merge->window_us/1000), merge->max_queued);
+}
@@ -0,0 +1,114 @@
+/* Time-ordered k-way merge of several sensor streams
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "frame.h"
+#include "soak.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MERGE_MAX_INPUTS 16
+
+typedef struct {
+    int64_t key;                // sample time on the AP clock
+    int64_t arrival_us;
+    battery_packet frame;
+} merge_entry_t;
+
+// One connection: a ring of its frames in key order, and its counters
+typedef struct {
+    uint32_t head;
+    uint32_t count;
+    bool closed;                // no more frames will come, the merge does not wait for it
+    int64_t last_key;           // newest key queued, keys of one input never go backwards
+    uint32_t pushed;
+    uint32_t late;              // came after a frame with a later key had been emitted, dropped
+    uint32_t forced;            // frames this full queue pushed out before their time
+} merge_input_t;
+
+// Heap node: an input with frames queued and the key of its oldest, kept here so comparisons stay in the heap
+typedef struct {
+    int64_t key;
+    uint32_t input;
+} merge_head_t;
+
+/* Called for every frame in key order */
+typedef void (*merge_sink_t)(void *ctx, uint32_t input, int64_t key, const battery_packet *frame);
+
+/* Each stream is in time order already, so the merge only compares the
+ * heads of the input queues: a heap of at most MERGE_MAX_INPUTS inputs,
+ * O(log k) per frame. The smallest head goes out as soon as every open
+ * input has a frame queued, since nothing earlier can come then, or once
+ * it is older than the reorder window, so a silent input holds the others
+ * back by the window at most. A frame older than one already emitted is
+ * late and dropped.
+ *
+ * All storage is reserved up front (MERGE_DEFINE): inputs*depth entries,
+ * nothing is allocated while merging.
+ */
+typedef struct {
+    uint32_t depth;             // entries per input queue
+    merge_entry_t *entries;     // input i owns entries[i*depth .. (i+1)*depth)
+    uint32_t inputs;
+    int64_t window_us;
+    merge_sink_t sink;
+    void *ctx;
+    merge_input_t input[MERGE_MAX_INPUTS];
+    merge_head_t heap[MERGE_MAX_INPUTS];    // inputs with frames queued, smallest head key first
+    uint32_t heap_size;
+    uint32_t waiting;           // open inputs with nothing queued, the merge is holding for them
+    bool emitted_any;
+    int64_t last_emitted;
+    uint64_t emitted;
+    uint32_t max_queued;        // most frames held at once over every input
+    uint32_t queued;
+    uint32_t latency[SOAK_JITTER_BUCKETS];  // arrival to emission in us, soak_jitter_bucket() bins
+    uint32_t max_latency_us;
+} merge_t;
+
+// Reserve static storage for a merge of up to `inputs` inputs of `depth` frames each
+#define MERGE_DEFINE(name, inputs, depth)                                                   \
+    static merge_entry_t name##_entries[(inputs)*(depth)];                                  \
+    static merge_t name = {(depth), name##_entries}
+
+/* Start over with `inputs` open inputs, at most MERGE_MAX_INPUTS and the
+ * number the storage was defined for. Frames
+ * still queued are discarded; flush first to keep them.
+ */
+void merge_reset(merge_t *merge, uint32_t inputs, int64_t window_us, merge_sink_t sink, void *ctx);
+
+/* Queue one frame of `input`, then emit whatever became safe. A full queue
+ * pushes out the smallest heads early. Returns false if the frame was late.
+ */
+bool merge_push(merge_t *merge, uint32_t input, int64_t key, int64_t arrival_us, const battery_packet *frame);
+
+// Emit every head older than the window at `now_us`
+void merge_advance(merge_t *merge, int64_t now_us);
+
+// The input will not send again: stop waiting for it
+void merge_close(merge_t *merge, uint32_t input, int64_t now_us);
+
+// Emit everything still queued, at the end of a run
+void merge_flush(merge_t *merge, int64_t now_us);
+
+// Sums over every input
+uint64_t merge_late(const merge_t *merge);
+uint64_t merge_forced(const merge_t *merge);
+
+// One line: frames merged, late, forced, latency percentiles, deepest queue
+int merge_format(const merge_t *merge, char *line, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,343 @@
+/* Binary result channel for automated hosts
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "esp_log.h"
+#include "esp_console.h"
+#include "argtable3/argtable3.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include "lwip/sockets.h"
+#include "result.h"
+
+static const char *TAG = "results";
+
+#if CONFIG_TESTSUITE_RESULTS
+
+#define RESULT_BUFFER_SIZE      CONFIG_TESTSUITE_RESULT_BUFFER
+#define RESULT_TASK_STACK       3072
+#define RESULT_TASK_PRIORITY    (tskIDLE_PRIORITY + 2)
+#define RESULT_TASK_CORE        0
+#define RESULT_IDLE_MS          500
+
+_Static_assert((RESULT_BUFFER_SIZE & (RESULT_BUFFER_SIZE - 1)) == 0, "CONFIG_TESTSUITE_RESULT_BUFFER must be a power of two");
+
+/* Records are copied whole into a byte ring under a spinlock, so a host
+ * never sees half of one. Only the sender task moves the tail, and it sends
+ * straight out of the ring: producers never overwrite bytes not sent yet.
+ */
+static uint8_t result_buffer[RESULT_BUFFER_SIZE];
+static uint32_t result_head = 0;
+static uint32_t result_tail = 0;
+static uint32_t result_records = 0;      // records between tail and head
+static uint32_t result_sequence = 0;
+static result_stats_t result_stats = {0,};
+static portMUX_TYPE result_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static TaskHandle_t result_task_handle = NULL;
+static StackType_t result_task_stack[RESULT_TASK_STACK];
+static StaticTask_t result_task_tcb;
+static volatile int result_client = -1;
+static struct sockaddr_in result_peer;
+
+static void result_copy_in(uint32_t position, const void *data, size_t len){
+    uint32_t offset = position & (RESULT_BUFFER_SIZE - 1);
+    size_t first = (len < RESULT_BUFFER_SIZE - offset) ? len : RESULT_BUFFER_SIZE - offset;
+    memcpy(result_buffer + offset, data, first);
+    memcpy(result_buffer, (const uint8_t *)data + first, len - first);
+}
+
+// The payload is `fixed` followed by `extra`, either may be empty
+static void result_emit(result_type_t type, const void *fixed, size_t fixed_len, const void *extra, size_t extra_len){
+    result_header_t header = {
+        .magic = RESULT_MAGIC,
+        .type = type,
+        .length = fixed_len + extra_len,
+        .timestamp_ms = esp_log_timestamp(),
+    };
+    uint32_t total = sizeof(header) + header.length;
+
+    portENTER_CRITICAL(&result_lock);
+    header.sequence = result_sequence++;
+    uint32_t used = result_head - result_tail;
+    if (total > RESULT_BUFFER_SIZE - used){
+        result_stats.dropped++;
+        portEXIT_CRITICAL(&result_lock);
+        return;
+    }
+    result_copy_in(result_head, &header, sizeof(header));
+    result_copy_in(result_head + sizeof(header), fixed, fixed_len);
+    result_copy_in(result_head + sizeof(header) + fixed_len, extra, extra_len);
+    result_head += total;
+    result_records++;
+    result_stats.written++;
+    if (used + total > result_stats.high_water){
+        result_stats.high_water = used + total;
+    }
+    portEXIT_CRITICAL(&result_lock);
+
+    if (result_task_handle != NULL){
+        xTaskNotifyGive(result_task_handle);
+    }
+}
+
+void result_run(const result_run_t *run){
+    result_emit(RESULT_RUN, run, sizeof(*run), NULL, 0);
+}
+
+void result_histogram(result_command_t command, result_histogram_kind_t kind, result_buckets_t layout,
+                      uint32_t station, const uint32_t *counts, uint32_t buckets){
+    result_histogram_t histogram = {
+        .command = command,
+        .kind = kind,
+        .layout = layout,
+        .buckets = buckets,
+        .station = station,
+    };
+    result_emit(RESULT_HISTOGRAM, &histogram, sizeof(histogram), counts, buckets*sizeof(uint32_t));
+}
+
+void result_station(const result_station_t *station){
+    result_emit(RESULT_STATION, station, sizeof(*station), NULL, 0);
+}
+
+void result_error(result_command_t command, int32_t code, const char *text){
+    result_error_t error = {
+        .command = command,
+        .code = code,
+    };
+    size_t len = strnlen(text, RESULT_MAX_TEXT);
+    result_emit(RESULT_ERROR, &error, sizeof(error), text, len);
+}
+
+static void result_copy_out(uint32_t position, void *data, size_t len){
+    uint32_t offset = position & (RESULT_BUFFER_SIZE - 1);
+    size_t first = (len < RESULT_BUFFER_SIZE - offset) ? len : RESULT_BUFFER_SIZE - offset;
+    memcpy(data, result_buffer + offset, first);
+    memcpy((uint8_t *)data + first, result_buffer, len - first);
+}
+
+static bool result_send_all(int client, uint32_t position, uint32_t len){
+    while (len > 0){
+        uint32_t offset = position & (RESULT_BUFFER_SIZE - 1);
+        uint32_t chunk = (len < RESULT_BUFFER_SIZE - offset) ? len : RESULT_BUFFER_SIZE - offset;
+        int sent = send(client, result_buffer + offset, chunk, 0);
+        if (sent <= 0){
+            return false;
+        }
+        position += sent;
+        len -= sent;
+        portENTER_CRITICAL(&result_lock);
+        result_stats.sent += sent;
+        portEXIT_CRITICAL(&result_lock);
+    }
+    return true;
+}
+
+/* Send everything queued, record by record, false once the host is gone.
+ * A record the host lost halfway is dropped so the next host starts on a
+ * record boundary.
+ */
+static bool result_drain(int client){
+    while(true){
+        portENTER_CRITICAL(&result_lock);
+        bool empty = (result_head == result_tail);
+        portEXIT_CRITICAL(&result_lock);
+        if (empty){
+            return true;
+        }
+        result_header_t header;
+        result_copy_out(result_tail, &header, sizeof(header));
+        uint32_t total = sizeof(header) + header.length;
+        bool ok = result_send_all(client, result_tail, total);
+        portENTER_CRITICAL(&result_lock);
+        result_tail += total;
+        result_records--;
+        portEXIT_CRITICAL(&result_lock);
+        if (!ok){
+            return false;
+        }
+    }
+}
+
+static void result_serve(int client){
+    portENTER_CRITICAL(&result_lock);
+    result_hello_t hello = {
+        .version = RESULT_VERSION,
+        .dropped = result_stats.dropped,
+        .queued = result_records,
+    };
+    result_header_t header = {
+        .magic = RESULT_MAGIC,
+        .type = RESULT_HELLO,
+        .length = sizeof(hello),
+        .sequence = result_sequence,    // not a record of its own: the next new one gets this number
+        .timestamp_ms = esp_log_timestamp(),
+    };
+    portEXIT_CRITICAL(&result_lock);
+    uint8_t first[sizeof(header) + sizeof(hello)];
+    memcpy(first, &header, sizeof(header));
+    memcpy(first + sizeof(header), &hello, sizeof(hello));
+    if (send(client, first, sizeof(first), 0) != sizeof(first)){
+        return;
+    }
+
+    while(result_drain(client)){
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(RESULT_IDLE_MS)) != 0){
+            continue;
+        }
+        // the host never sends, so readable means it closed the connection
+        uint8_t byte;
+        int got = recv(client, &byte, sizeof(byte), MSG_DONTWAIT);
+        if ((got == 0) || ((got < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK))){
+            return;
+        }
+    }
+}
+
+static void result_task(void *pvParameters){
+    struct sockaddr_in addr = {0,};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(CONFIG_TESTSUITE_RESULT_PORT);
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if ((listener < 0) || (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) != 0) || (listen(listener, 1) != 0)){
+        ESP_LOGE(TAG,"Can't listen on port %d: %s", CONFIG_TESTSUITE_RESULT_PORT, strerror(errno));
+        result_task_handle = NULL;
+        vTaskDelete(NULL);
+    }
+    ESP_LOGI(TAG,"Results on TCP port %d", CONFIG_TESTSUITE_RESULT_PORT);
+
+    while(true){
+        socklen_t peer_len = sizeof(result_peer);
+        int client = accept(listener, (struct sockaddr *)&result_peer, &peer_len);
+        if (client < 0){
+            vTaskDelay(100/portTICK_PERIOD_MS);
+            continue;
+        }
+        // under the lock, so results --clear cannot move the tail while a host is being served
+        portENTER_CRITICAL(&result_lock);
+        result_stats.connections++;
+        result_client = client;
+        portEXIT_CRITICAL(&result_lock);
+        ESP_LOGI(TAG,"Host %s connected", inet_ntoa(result_peer.sin_addr));
+        result_serve(client);
+        portENTER_CRITICAL(&result_lock);
+        result_client = -1;
+        portEXIT_CRITICAL(&result_lock);
+        close(client);
+        ESP_LOGI(TAG,"Host %s disconnected", inet_ntoa(result_peer.sin_addr));
+    }
+}
+
+void result_start(void){
+    result_task_handle = xTaskCreateStaticPinnedToCore(result_task, "results", RESULT_TASK_STACK, NULL, RESULT_TASK_PRIORITY,
+                                                       result_task_stack, &result_task_tcb, RESULT_TASK_CORE);
+}
+
+void result_get_stats(result_stats_t *stats){
+    portENTER_CRITICAL(&result_lock);
+    *stats = result_stats;
+    portEXIT_CRITICAL(&result_lock);
+}
+
+static struct {
+    struct arg_lit *clear;
+    struct arg_end *end;
+} results_args;
+
+static int results(int argc, char **argv){
+    int nerrors = arg_parse(argc, argv, (void **) &results_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, results_args.end, argv[0]);
+        return ESP_OK;
+    }
+    if (results_args.clear->count > 0){
+        // the sender is between records only while no host is connected
+        portENTER_CRITICAL(&result_lock);
+        bool reading = (result_client >= 0);
+        if (!reading){
+            result_tail = result_head;
+            result_records = 0;
+        }
+        portEXIT_CRITICAL(&result_lock);
+        if (reading){
+            ESP_LOGW(TAG,"A host is reading, nothing cleared");
+        }
+    }
+    result_stats_t stats;
+    result_get_stats(&stats);
+    portENTER_CRITICAL(&result_lock);
+    uint32_t queued = result_head - result_tail;
+    portEXIT_CRITICAL(&result_lock);
+    ESP_LOGI(TAG,"port %d, %s%s", CONFIG_TESTSUITE_RESULT_PORT,
+             (result_client >= 0) ? "host " : "no host connected",
+             (result_client >= 0) ? inet_ntoa(result_peer.sin_addr) : "");
+    ESP_LOGI(TAG,"records written: %u, dropped: %u, %u bytes waiting (high water %u/%d), %llu bytes sent over %u connections",
+             stats.written, stats.dropped, queued, stats.high_water, RESULT_BUFFER_SIZE, stats.sent, stats.connections);
+    return ESP_OK;
+}
+
+void register_results(void){
+    results_args.clear = arg_lit0(NULL, "clear", "drop the records no host has read");
+    results_args.end = arg_end(0);
+    const esp_console_cmd_t cmd = {
+        .command = "results",
+        .help = "state of the binary result channel",
+        .hint = NULL,
+        .func = &results,
+        .argtable = &results_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
+}
+
+#else
+
+void result_run(const result_run_t *run){
+}
+
+void result_histogram(result_command_t command, result_histogram_kind_t kind, result_buckets_t layout,
+                      uint32_t station, const uint32_t *counts, uint32_t buckets){
+}
+
+void result_station(const result_station_t *station){
+}
+
+void result_error(result_command_t command, int32_t code, const char *text){
+}
+
+void result_start(void){
+}
+
+void result_get_stats(result_stats_t *stats){
+    memset(stats, 0, sizeof(*stats));
+}
+
+static int results(int argc, char **argv){
+    ESP_LOGE(TAG,"Result channel disabled, enable CONFIG_TESTSUITE_RESULTS");
+    return ESP_OK;
+}
+
+void register_results(void){
+    const esp_console_cmd_t cmd = {
+        .command = "results",
+        .help = "binary result channel (disabled in this build)",
+        .hint = NULL,
+        .func = &results,
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
+}
+
+#endif
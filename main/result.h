@@ -0,0 +1,199 @@
+/* Binary result channel for automated hosts
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The results of the measuring commands as typed records on their own TCP
+ * port (CONFIG_TESTSUITE_RESULT_PORT), next to the text on the console.
+ * Numbers are sent as they are kept, never formatted: every field is a
+ * little endian integer or IEEE 754 float at its natural alignment within
+ * the payload. host/result_decoder.h reads them in place.
+ *
+ * Record types, command ids and histogram layouts are shared with the host.
+ * Never renumber them; new fields only ever go at the end of a payload and
+ * readers ignore bytes past the fields they know.
+ */
+#define RESULT_MAGIC    0x5352      // "RS"
+#define RESULT_VERSION  1
+
+typedef enum {
+    RESULT_HELLO = 1,           // result_hello_t, first record of every connection
+    RESULT_RUN,                 // result_run_t
+    RESULT_HISTOGRAM,           // result_histogram_t then `buckets` uint32_t counts
+    RESULT_STATION,             // result_station_t
+    RESULT_ERROR,               // result_error_t then the message, not NUL terminated
+} result_type_t;
+
+typedef enum {
+    RESULT_CMD_NONE = 0,
+    RESULT_CMD_RECV_SENSOR,
+    RESULT_CMD_SOAK,
+    RESULT_CMD_LIST_STATIONS,
+    RESULT_CMD_FAIRNESS,
+    RESULT_CMD_RTT,
+    RESULT_CMD_BENCH_TCP,
+    RESULT_CMD_BENCH_UDP,
+    RESULT_CMD_GENERATE,
+    RESULT_CMD_TUNE_AB,
+    RESULT_CMD_HISTORY,
+} result_command_t;
+
+typedef struct {
+    uint16_t magic;             // RESULT_MAGIC, where a reader that lost its place resynchronises
+    uint16_t type;              // result_type_t
+    uint32_t length;            // payload bytes after the header
+    uint32_t sequence;          // counts every record queued, a gap is records dropped
+    uint32_t timestamp_ms;      // esp_log_timestamp() when the record was queued
+} result_header_t;
+
+typedef struct {
+    uint16_t version;           // RESULT_VERSION
+    uint16_t reserved;
+    uint32_t dropped;           // records lost to a full buffer since boot
+    uint32_t queued;            // records already waiting, sent right after this one
+} result_hello_t;
+
+// Run flags
+#define RESULT_RUN_STOPPED  (1 << 0)    // ended by --stop before it was complete
+#define RESULT_RUN_FAILED   (1 << 1)    // ended by a socket error or a stall
+
+/* A round (recv_sensor), a whole run, or a step (fairness). Fields a
+ * command does not measure are 0. bench_tcp and bench_udp send one per
+ * stream (round 1..streams) and the sum (round 0); tune_ab one per profile,
+ * round 1 for A and 2 for B; history one per stored run it shows.
+ */
+typedef struct {
+    uint16_t command;           // result_command_t
+    uint16_t round;             // 1..rounds, 0 for the whole run
+    uint16_t rounds;            // rounds or steps of the run
+    uint16_t flags;             // RESULT_RUN_x
+    uint32_t frequency;         // requested rate, Hz
+    uint32_t duration_ms;
+    uint64_t frames;
+    uint64_t corrupted;         // framing failures
+    uint64_t crc_failed;
+    uint64_t gaps;
+    uint64_t lost;              // frames the gaps account for
+    uint32_t stalls;
+    uint32_t reconnects;
+    float rate_hz;              // measured rate
+    uint32_t jitter_p50;        // us
+    uint32_t jitter_p99;
+    uint32_t jitter_max;
+    uint32_t stations;          // fairness: stations of the step
+    float jain;                 // fairness: Jain's index of the station rates
+    uint64_t bytes;             // bench_tcp, bench_udp, tune_ab: payload bytes moved
+    float drift_ppm;            // recv_sensor round, soak: sensor clock rate error, from the envelope once it has one
+    float offset_ms;            // sensor minus AP time at the last frame
+    float residual_us;          // RMS of the all frames clock fit
+    float cpu_pct;              // measuring task, percent of one core
+    uint32_t run_id;            // history id the run was stored under, or the one a history record shows
+    uint16_t source;            // history: result_command_t of the stored run
+    uint16_t reserved;
+} result_run_t;
+
+// Histogram layouts
+typedef enum {
+    RESULT_BUCKETS_SOAK = 1,    // soak_jitter_bucket(): exact below 8, then 4 per power of two
+    RESULT_BUCKETS_RTT,         // rtt_bucket(): exact below 8, then 8 per power of two
+} result_buckets_t;
+
+// Histogram kinds
+typedef enum {
+    RESULT_HISTOGRAM_JITTER = 1,    // |interval - nominal| of the sensor timestamps, us
+    RESULT_HISTOGRAM_RTT,           // round trip time, us
+    RESULT_HISTOGRAM_MERGE,         // arrival to emission in the merged stream, us
+    RESULT_HISTOGRAM_SEND,          // duration of one send() call, us
+} result_histogram_kind_t;
+
+typedef struct {
+    uint16_t command;           // result_command_t
+    uint16_t kind;              // result_histogram_kind_t
+    uint16_t layout;            // result_buckets_t
+    uint16_t buckets;           // counts that follow
+    uint16_t station;           // 1.., 0 when the histogram is not per station
+    uint16_t reserved;
+} result_histogram_t;
+
+// Station flags
+#define RESULT_STATION_FAILED   (1 << 0)    // could not be connected
+#define RESULT_STATION_CLOSED   (1 << 1)    // hung up during the step
+
+typedef struct {
+    uint16_t command;           // result_command_t
+    uint16_t index;             // 1.., in the order the AP lists them
+    uint8_t mac[6];
+    int8_t rssi;                // dBm, 0 when not known
+    uint8_t flags;              // RESULT_STATION_x
+    uint32_t ip;                // network byte order, 0 before DHCP
+    uint32_t frames;
+    uint32_t lost;
+    uint32_t corrupted;
+    uint32_t starvations;
+    uint32_t jitter_p50;
+    uint32_t jitter_p99;
+    uint32_t longest_silence_ms;
+    float rate_hz;
+} result_station_t;
+
+typedef struct {
+    uint16_t command;           // result_command_t
+    uint16_t reserved;
+    int32_t code;               // errno, esp_err_t or a negative STALL_x; 0 when there is none
+} result_error_t;
+
+#define RESULT_MAX_TEXT 120
+
+#ifdef __cplusplus
+static_assert(sizeof(result_header_t) == 16, "result_header_t is part of the wire format");
+static_assert(sizeof(result_run_t) == 120, "result_run_t is part of the wire format");
+static_assert(sizeof(result_station_t) == 48, "result_station_t is part of the wire format");
+#else
+_Static_assert(sizeof(result_header_t) == 16, "result_header_t is part of the wire format");
+_Static_assert(sizeof(result_run_t) == 120, "result_run_t is part of the wire format");
+_Static_assert(sizeof(result_station_t) == 48, "result_station_t is part of the wire format");
+#endif
+
+typedef struct {
+    uint32_t written;           // records queued
+    uint32_t dropped;           // records that found the buffer full
+    uint32_t connections;
+    uint64_t sent;              // bytes sent to hosts
+    uint32_t high_water;        // most bytes ever waiting
+} result_stats_t;
+
+/* Queue records for the connected host, or the next one to connect. Safe
+ * from any task; a record that does not fit in the buffer is dropped and
+ * counted. Nothing happens when CONFIG_TESTSUITE_RESULTS is off.
+ */
+void result_run(const result_run_t *run);
+void result_histogram(result_command_t command, result_histogram_kind_t kind, result_buckets_t layout,
+                      uint32_t station, const uint32_t *counts, uint32_t buckets);
+void result_station(const result_station_t *station);
+// `text` is copied, up to RESULT_MAX_TEXT bytes
+void result_error(result_command_t command, int32_t code, const char *text);
+
+// Start the sender task and listen for hosts. Call once at boot.
+void result_start(void);
+
+void result_get_stats(result_stats_t *stats);
+
+// Register the "results" console command
+void register_results(void);
+
+#ifdef __cplusplus
+}
+#endif
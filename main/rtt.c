@@ -0,0 +1,91 @@
+/* Round trip latency statistics for the rtt command
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "rtt.h"
+
+// Outliers are counted against this multiple of the median
+#define RTT_OUTLIER_FACTOR 10
+
+uint32_t rtt_bucket_floor(uint32_t bucket){
+    if (bucket < 8){
+        return bucket;
+    }
+    uint32_t octave = 3 + (bucket - 8)/8;
+    return (8 + (bucket - 8) % 8) << (octave - 3);
+}
+
+void rtt_reset(rtt_t *rtt){
+    memset(rtt, 0, sizeof(*rtt));
+    rtt->min_us = UINT32_MAX;
+}
+
+void rtt_record(rtt_t *rtt, uint32_t seq, uint32_t at_ms, uint32_t rtt_us){
+    rtt->count++;
+    rtt->sum_us += rtt_us;
+    rtt->min_us = (rtt_us < rtt->min_us) ? rtt_us : rtt->min_us;
+    rtt->max_us = (rtt_us > rtt->max_us) ? rtt_us : rtt->max_us;
+    rtt->histogram[rtt_bucket(rtt_us)]++;
+
+    // insertion into the short sorted list of the largest
+    uint32_t n = rtt->worst_count;
+    if ((n == RTT_WORST) && (rtt_us <= rtt->worst[n - 1].rtt_us)){
+        return;
+    }
+    uint32_t i = (n < RTT_WORST) ? n++ : n - 1;
+    for(; (i > 0) && (rtt->worst[i - 1].rtt_us < rtt_us); i--){
+        rtt->worst[i] = rtt->worst[i - 1];
+    }
+    rtt->worst[i] = (rtt_outlier_t){seq, at_ms, rtt_us};
+    rtt->worst_count = n;
+}
+
+uint32_t rtt_quantile(const rtt_t *rtt, uint32_t per_10000){
+    if (rtt->count == 0){
+        return 0;
+    }
+    uint64_t rank = ((uint64_t)rtt->count*per_10000 + 9999)/10000;
+    rank = (rank == 0) ? 1 : rank;
+    uint32_t seen = 0;
+    uint32_t value = rtt->max_us;
+    for(uint32_t b = 0; b < RTT_BUCKETS; b++){
+        seen += rtt->histogram[b];
+        if (seen >= rank){
+            value = (b + 1 < RTT_BUCKETS) ? rtt_bucket_floor(b + 1) - 1 : rtt->max_us;
+            break;
+        }
+    }
+    value = (value > rtt->max_us) ? rtt->max_us : value;
+    return (value < rtt->min_us) ? rtt->min_us : value;
+}
+
+uint32_t rtt_above(const rtt_t *rtt, uint32_t factor){
+    uint64_t limit = (uint64_t)rtt_quantile(rtt, 5000)*factor;
+    uint32_t above = 0;
+    // whole buckets past the limit; the one holding it is left out, it undercounts rather than over
+    for(uint32_t b = 0; b < RTT_BUCKETS; b++){
+        if (rtt_bucket_floor(b) > limit){
+            above += rtt->histogram[b];
+        }
+    }
+    return above;
+}
+
+int rtt_format(const rtt_t *rtt, char *line, size_t size){
+    if (rtt->count == 0){
+        return snprintf(line, size, "rtt: no echo received, %u timeouts", rtt->timeouts);
+    }
+    return snprintf(line, size,
+                    "rtt: %u round trips, min %u p50 %u p99 %u p99.9 %u max %u us, mean %.1f us, "
+                    "%u timeouts, %u late, %u above %ux the median",
+                    rtt->count, rtt->min_us, rtt_quantile(rtt, 5000), rtt_quantile(rtt, 9900),
+                    rtt_quantile(rtt, 9990), rtt->max_us, (double)rtt->sum_us/rtt->count, rtt->timeouts,
+                    rtt->late, rtt_above(rtt, RTT_OUTLIER_FACTOR), RTT_OUTLIER_FACTOR);
+}
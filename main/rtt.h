@@ -0,0 +1,84 @@
+/* Round trip latency statistics for the rtt command
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RTT_MAGIC       0x31545452  // "RTT1"
+#define RTT_MAX_SIZE    1024
+#define RTT_ECHO_PORT   7007
+// Largest round trips kept with their sequence number and time
+#define RTT_WORST       8
+// Exact below 8 us, then 8 buckets per power of two up to 2^24 us (16.7 s)
+#define RTT_BUCKETS     176
+
+/* Sent by the board and echoed byte for byte by the peer; the rest of the
+ * message up to the configured size is filler.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    int64_t sent_us;            // sender clock, read back from the echo
+} __attribute__((__packed__)) rtt_message_t;
+
+typedef struct {
+    uint32_t seq;
+    uint32_t at_ms;             // since the first message
+    uint32_t rtt_us;
+} rtt_outlier_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t timeouts;          // no echo within the timeout
+    uint32_t late;              // echoes that came after their timeout
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint32_t histogram[RTT_BUCKETS];
+    uint32_t worst_count;
+    rtt_outlier_t worst[RTT_WORST];     // largest first
+} rtt_t;
+
+static inline uint32_t rtt_bucket(uint32_t us){
+    if (us < 8){
+        return us;
+    }
+    uint32_t octave = 31 - __builtin_clz(us);
+    uint32_t bucket = 8 + (octave - 3)*8 + ((us >> (octave - 3)) & 7);
+    return (bucket < RTT_BUCKETS) ? bucket : RTT_BUCKETS - 1;
+}
+
+// Smallest value that falls in `bucket`
+uint32_t rtt_bucket_floor(uint32_t bucket);
+
+void rtt_reset(rtt_t *rtt);
+
+// One round trip; no allocation, O(RTT_WORST) at most
+void rtt_record(rtt_t *rtt, uint32_t seq, uint32_t at_ms, uint32_t rtt_us);
+
+/* Upper bound of the bucket holding the quantile given in parts per
+ * 10000 (5000: median, 9990: p99.9), clamped to the exact min and max
+ */
+uint32_t rtt_quantile(const rtt_t *rtt, uint32_t per_10000);
+
+// Round trips longer than `factor` times the median
+uint32_t rtt_above(const rtt_t *rtt, uint32_t factor);
+
+// One line: count, min/p50/p99/p99.9/max, mean, timeouts, outliers
+int rtt_format(const rtt_t *rtt, char *line, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
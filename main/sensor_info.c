@@ -0,0 +1,301 @@
+/* Typed fields out of the sensor's JSON replies
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include "sensor_info.h"
+
+// How a member's value is read
+enum {
+    AS_TEXT,
+    AS_MV,                      // millivolts, or volts when below 20
+    AS_PERCENT,
+    AS_BATTERY,                 // volts with a fraction, a percentage up to 100, millivolts above
+    AS_HZ,
+    AS_FLAG,
+    AS_MS,
+    AS_S,
+};
+
+static const struct {
+    const char *name;
+    uint32_t field;
+    uint8_t as;
+    const char *within;         // also read as a member of this object of the reply
+} sensor_names[] = {
+    {"command",          SENSOR_INFO_COMMAND,         AS_TEXT,     NULL},
+    {"cmd",              SENSOR_INFO_COMMAND,         AS_TEXT,     NULL},
+    {"status",           SENSOR_INFO_STATUS,          AS_TEXT,     NULL},
+    {"result",           SENSOR_INFO_STATUS,          AS_TEXT,     NULL},
+    {"error",            SENSOR_INFO_ERROR,           AS_TEXT,     NULL},
+    {"err",              SENSOR_INFO_ERROR,           AS_TEXT,     NULL},
+    {"firmware",         SENSOR_INFO_FIRMWARE,        AS_TEXT,     NULL},
+    {"firmware_version", SENSOR_INFO_FIRMWARE,        AS_TEXT,     NULL},
+    {"fw",               SENSOR_INFO_FIRMWARE,        AS_TEXT,     NULL},
+    {"fw_version",       SENSOR_INFO_FIRMWARE,        AS_TEXT,     NULL},
+    {"version",          SENSOR_INFO_FIRMWARE,        AS_TEXT,     NULL},
+    {"battery_mv",       SENSOR_INFO_BATTERY_MV,      AS_MV,       NULL},
+    {"battery_voltage",  SENSOR_INFO_BATTERY_MV,      AS_MV,       NULL},
+    {"vbat",             SENSOR_INFO_BATTERY_MV,      AS_MV,       NULL},
+    {"voltage",          SENSOR_INFO_BATTERY_MV,      AS_MV,       NULL},
+    {"battery_percent",  SENSOR_INFO_BATTERY_PERCENT, AS_PERCENT,  NULL},
+    {"battery_pct",      SENSOR_INFO_BATTERY_PERCENT, AS_PERCENT,  NULL},
+    {"battery_level",    SENSOR_INFO_BATTERY_PERCENT, AS_PERCENT,  NULL},
+    {"battery",          0,                           AS_BATTERY,  NULL},
+    {"freq",             SENSOR_INFO_RATE,            AS_HZ,       NULL},
+    {"frequency",        SENSOR_INFO_RATE,            AS_HZ,       NULL},
+    {"rate",             SENSOR_INFO_RATE,            AS_HZ,       NULL},
+    {"rate_hz",          SENSOR_INFO_RATE,            AS_HZ,       NULL},
+    {"sample_rate",      SENSOR_INFO_RATE,            AS_HZ,       NULL},
+    {"accel",            SENSOR_INFO_ACCEL,           AS_FLAG,     "sensors"},
+    {"gyro",             SENSOR_INFO_GYRO,            AS_FLAG,     "sensors"},
+    {"uptime_ms",        SENSOR_INFO_UPTIME,          AS_MS,       NULL},
+    {"uptime",           SENSOR_INFO_UPTIME,          AS_S,        NULL},
+    {"uptime_s",         SENSOR_INFO_UPTIME,          AS_S,        NULL},
+};
+
+static void sensor_copy(char *to, size_t size, const json_token_t *token){
+    size_t len = (token->len < size - 1) ? token->len : size - 1;
+    memcpy(to, token->text, len);
+    to[len] = '\0';
+}
+
+static bool sensor_flag(const json_token_t *token, bool *flag){
+    int64_t value;
+    if ((token->type == JSON_TRUE) || (token->type == JSON_FALSE)){
+        *flag = (token->type == JSON_TRUE);
+    }else if (json_token_int(token, &value)){
+        *flag = (value != 0);
+    }else if (token->type == JSON_STRING){
+        *flag = (strcasecmp(token->text, "true") == 0) || (strcasecmp(token->text, "on") == 0);
+    }else{
+        return false;
+    }
+    return true;
+}
+
+/* One member value: store it if its name is known and the value reads as
+ * that field. `parent` is the member of the reply it is in, NULL for a
+ * member of the reply itself; a name only counts there or within the
+ * object its table entry names.
+ */
+static void sensor_member(sensor_info_t *info, const json_token_t *token, const char *parent){
+    if ((token->key[0] == '\0') || (token->type == JSON_NULL)){
+        return;
+    }
+    size_t n = 0;
+    while ((n < sizeof(sensor_names)/sizeof(sensor_names[0])) &&
+           ((strcasecmp(token->key, sensor_names[n].name) != 0) ||
+            ((parent != NULL) && ((sensor_names[n].within == NULL) || (strcasecmp(parent, sensor_names[n].within) != 0))))){
+        n++;
+    }
+    if (n == sizeof(sensor_names)/sizeof(sensor_names[0])){
+        return;
+    }
+    uint32_t field = sensor_names[n].field;
+    double number = 0;
+    bool is_number = json_token_double(token, &number);
+    switch (sensor_names[n].as){
+        case AS_TEXT: {
+            char *to = (field == SENSOR_INFO_COMMAND) ? info->command : (field == SENSOR_INFO_STATUS) ? info->status
+                       : (field == SENSOR_INFO_ERROR) ? info->error : info->firmware;
+            size_t size = (field == SENSOR_INFO_COMMAND) ? sizeof(info->command) : (field == SENSOR_INFO_STATUS) ? sizeof(info->status)
+                          : (field == SENSOR_INFO_ERROR) ? sizeof(info->error) : sizeof(info->firmware);
+            sensor_copy(to, size, token);
+            break;
+        }
+        case AS_BATTERY:
+            if (!is_number || (number < 0)){
+                return;
+            }
+            if ((number < 20) && (number != (int64_t)number)){
+                field = SENSOR_INFO_BATTERY_MV;
+                info->battery_mv = number*1000 + 0.5;
+            }else if (number <= 100){
+                field = SENSOR_INFO_BATTERY_PERCENT;
+                info->battery_percent = number + 0.5;
+            }else{
+                field = SENSOR_INFO_BATTERY_MV;
+                info->battery_mv = (number < 1e9) ? number + 0.5 : 1e9;
+            }
+            break;
+        case AS_MV:
+            if (!is_number || (number < 0) || (number >= 1e9)){
+                return;
+            }
+            info->battery_mv = ((number < 20) ? number*1000 : number) + 0.5;
+            break;
+        case AS_PERCENT:
+            if (!is_number || (number < 0) || (number > 100)){
+                return;
+            }
+            info->battery_percent = number + 0.5;
+            break;
+        case AS_HZ:
+            if (!is_number || (number <= 0) || (number > 65535)){
+                return;
+            }
+            info->rate_hz = number + 0.5;
+            break;
+        case AS_FLAG:
+            if (!sensor_flag(token, (field == SENSOR_INFO_ACCEL) ? &info->accel : &info->gyro)){
+                return;
+            }
+            break;
+        case AS_MS:
+        case AS_S:
+            if (!is_number || (number < 0) || (number > 1e15)){
+                return;
+            }
+            info->uptime_ms = ((sensor_names[n].as == AS_S) ? number*1000 : number) + 0.5;
+            break;
+    }
+    info->fields |= field;
+}
+
+static void sensor_token(void *ctx, const json_tok_t *tok, const json_token_t *token){
+    sensor_parser_t *parser = (sensor_parser_t *)ctx;
+    if (token->depth == 0){
+        if (token->type == JSON_OBJECT_BEGIN){
+            memset(&parser->info, 0, sizeof(parser->info));
+            parser->in_reply = true;
+        }else if ((token->type == JSON_OBJECT_END) && parser->in_reply){
+            parser->in_reply = false;
+            parser->replies++;
+            if (parser->on_reply != NULL){
+                parser->on_reply(parser->ctx, &parser->info);
+            }
+        }
+        return;
+    }
+    if ((token->type >= JSON_STRING) && !token->truncated && (token->depth <= 2)){
+        sensor_member(&parser->info, token, (token->depth == 2) ? json_tok_key(tok, 1) : NULL);
+    }
+}
+
+void sensor_parser_init(sensor_parser_t *parser, sensor_reply_sink_t on_reply, void *ctx){
+    memset(parser, 0, sizeof(*parser));
+    parser->on_reply = on_reply;
+    parser->ctx = ctx;
+    json_tok_init(&parser->tok, sensor_token, parser);
+}
+
+void sensor_parser_abort(sensor_parser_t *parser){
+    if (parser->in_reply){
+        parser->rejected++;
+        parser->in_reply = false;
+    }
+    json_tok_reset(&parser->tok);
+}
+
+void sensor_parser_feed(sensor_parser_t *parser, const char *text, size_t len){
+    while (len > 0){
+        if (json_tok_idle(&parser->tok)){
+            const char *open = memchr(text, '{', len);
+            if (open == NULL){
+                return;
+            }
+            len -= open - text;
+            text = open;
+            json_tok_reset(&parser->tok);
+        }
+        uint32_t before = parser->tok.offset;
+        if (json_tok_feed(&parser->tok, text, len)){
+            return;
+        }
+        // not JSON from here on: look for the next reply, which may start at the bad byte itself
+        size_t bad = parser->tok.offset - before;
+        sensor_parser_abort(parser);
+        bad += (text[bad] != '{');
+        text += bad;
+        len -= bad;
+    }
+}
+
+void sensor_info_merge(sensor_info_t *into, const sensor_info_t *from){
+    uint32_t fields = from->fields;
+    if (fields & SENSOR_INFO_COMMAND){
+        memcpy(into->command, from->command, sizeof(into->command));
+    }
+    if (fields & SENSOR_INFO_STATUS){
+        memcpy(into->status, from->status, sizeof(into->status));
+    }
+    if (fields & SENSOR_INFO_ERROR){
+        memcpy(into->error, from->error, sizeof(into->error));
+    }
+    if (fields & SENSOR_INFO_FIRMWARE){
+        memcpy(into->firmware, from->firmware, sizeof(into->firmware));
+    }
+    if (fields & SENSOR_INFO_BATTERY_MV){
+        into->battery_mv = from->battery_mv;
+    }
+    if (fields & SENSOR_INFO_BATTERY_PERCENT){
+        into->battery_percent = from->battery_percent;
+    }
+    if (fields & SENSOR_INFO_RATE){
+        into->rate_hz = from->rate_hz;
+    }
+    if (fields & SENSOR_INFO_ACCEL){
+        into->accel = from->accel;
+    }
+    if (fields & SENSOR_INFO_GYRO){
+        into->gyro = from->gyro;
+    }
+    if (fields & SENSOR_INFO_UPTIME){
+        into->uptime_ms = from->uptime_ms;
+    }
+    into->fields |= fields;
+}
+
+int sensor_info_format(const sensor_info_t *info, char *line, size_t size){
+    int len = snprintf(line, size, "sensor:");
+    const char *sep = " ";
+    #define SENSOR_APPEND(...) do { \
+        if ((size_t)len < size){ \
+            len += snprintf(line + len, size - len, __VA_ARGS__); \
+        } \
+        sep = ", "; \
+    } while (0)
+    if (info->fields & SENSOR_INFO_FIRMWARE){
+        SENSOR_APPEND("%sfirmware %s", sep, info->firmware);
+    }
+    if (info->fields & SENSOR_INFO_BATTERY_MV){
+        SENSOR_APPEND("%sbattery %u mV", sep, (unsigned)info->battery_mv);
+    }
+    if (info->fields & SENSOR_INFO_BATTERY_PERCENT){
+        SENSOR_APPEND("%sbattery %u%%", sep, info->battery_percent);
+    }
+    if (info->fields & SENSOR_INFO_RATE){
+        SENSOR_APPEND("%srate %u Hz", sep, info->rate_hz);
+    }
+    if (info->fields & SENSOR_INFO_ACCEL){
+        SENSOR_APPEND("%saccel %s", sep, info->accel ? "on" : "off");
+    }
+    if (info->fields & SENSOR_INFO_GYRO){
+        SENSOR_APPEND("%sgyro %s", sep, info->gyro ? "on" : "off");
+    }
+    if (info->fields & SENSOR_INFO_UPTIME){
+        SENSOR_APPEND("%suptime %.1f s", sep, info->uptime_ms/1000.0);
+    }
+    if (info->fields & SENSOR_INFO_COMMAND){
+        SENSOR_APPEND("%scommand %s", sep, info->command);
+    }
+    if (info->fields & SENSOR_INFO_STATUS){
+        SENSOR_APPEND("%sstatus %s", sep, info->status);
+    }
+    if (info->fields & SENSOR_INFO_ERROR){
+        SENSOR_APPEND("%serror %s", sep, info->error);
+    }
+    if (info->fields == 0){
+        SENSOR_APPEND(" no fields");
+    }
+    #undef SENSOR_APPEND
+    return len;
+}
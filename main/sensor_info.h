@@ -0,0 +1,85 @@
+/* Typed fields out of the sensor's JSON replies
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "json_tok.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bits of sensor_info_t.fields
+#define SENSOR_INFO_COMMAND         (1u << 0)
+#define SENSOR_INFO_STATUS          (1u << 1)
+#define SENSOR_INFO_ERROR           (1u << 2)
+#define SENSOR_INFO_FIRMWARE        (1u << 3)
+#define SENSOR_INFO_BATTERY_MV      (1u << 4)
+#define SENSOR_INFO_BATTERY_PERCENT (1u << 5)
+#define SENSOR_INFO_RATE            (1u << 6)
+#define SENSOR_INFO_ACCEL           (1u << 7)
+#define SENSOR_INFO_GYRO            (1u << 8)
+#define SENSOR_INFO_UPTIME          (1u << 9)
+
+/* What a reply said, as far as it is understood. Only the fields with
+ * their bit in `fields` were in the reply; strings are cut to fit.
+ */
+typedef struct {
+    uint32_t fields;
+    char command[24];           // the command answered
+    char status[24];
+    char error[48];
+    char firmware[24];
+    uint32_t battery_mv;
+    uint8_t battery_percent;
+    uint16_t rate_hz;           // configured sample rate
+    bool accel;
+    bool gyro;
+    uint64_t uptime_ms;
+} sensor_info_t;
+
+typedef void (*sensor_reply_sink_t)(void *ctx, const sensor_info_t *info);
+
+/* Reads replies out of text as it arrives, in pieces of any size, with the
+ * tokenizer in json_tok.h: each member is matched by name against a table
+ * of the names the sensor firmwares use (firmware, fw or version; freq or
+ * rate; ...) as its value ends, and the reply goes to the sink when its
+ * closing brace does. Only members of the reply itself are matched, and
+ * the few names the table places in an object of the reply ("accel" in
+ * "sensors"), so a "version" deep in some other object is not taken for
+ * the firmware. Text before a reply's '{' is skipped, and so is a reply that
+ * turns out not to be JSON, up to the byte that showed it.
+ */
+typedef struct {
+    json_tok_t tok;
+    sensor_info_t info;         // the reply being read
+    bool in_reply;
+    sensor_reply_sink_t on_reply;
+    void *ctx;
+    uint32_t replies;
+    uint32_t rejected;          // replies that were not JSON or were cut off
+} sensor_parser_t;
+
+void sensor_parser_init(sensor_parser_t *parser, sensor_reply_sink_t on_reply, void *ctx);
+void sensor_parser_feed(sensor_parser_t *parser, const char *text, size_t len);
+
+// The reply being read was cut off: drop it
+void sensor_parser_abort(sensor_parser_t *parser);
+
+// Copy the fields `from` has into `into`, keeping the ones it lacks
+void sensor_info_merge(sensor_info_t *into, const sensor_info_t *from);
+
+// One line: the fields present, "no fields" if none
+int sensor_info_format(const sensor_info_t *info, char *line, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
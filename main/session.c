@@ -0,0 +1,258 @@
+/* Sensor connection that survives drops
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_console.h"
+#include "esp_timer.h"
+#include "argtable3/argtable3.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include "dlog.h"
+#include "session.h"
+
+// Longest single sleep or select(), bounds how late a cleared running flag is seen
+#define SESSION_POLL_MS 20
+
+static const char *TAG = "session";
+
+static struct sockaddr_in peer;
+static bool peer_known = false;
+static uint32_t backoff_ms = CONFIG_TESTSUITE_RECONNECT_BACKOFF_MS;
+static uint32_t backoff_max_ms = CONFIG_TESTSUITE_RECONNECT_BACKOFF_MAX_MS;
+static uint32_t giveup_s = 0;       // 0: keep trying until the stream is stopped
+static session_stats_t stats;
+static sensor_info_t sensor;
+static uint32_t sensor_replies = 0;
+static int64_t sensor_updated_us = 0;
+
+void session_set_peer(const struct sockaddr_in *address){
+    peer = *address;
+    peer_known = true;
+    memset(&sensor, 0, sizeof(sensor));
+    sensor_replies = 0;
+}
+
+bool session_has_peer(void){
+    return peer_known;
+}
+
+bool session_peer(struct sockaddr_in *address){
+    if (peer_known){
+        *address = peer;
+    }
+    return peer_known;
+}
+
+void session_reset(void){
+    memset(&stats, 0, sizeof(stats));
+}
+
+const session_stats_t *session_stats(void){
+    return &stats;
+}
+
+void session_sensor_update(const sensor_info_t *info){
+    sensor_info_merge(&sensor, info);
+    sensor_replies++;
+    sensor_updated_us = esp_timer_get_time();
+}
+
+const sensor_info_t *session_sensor(uint32_t *replies, int64_t *updated_us){
+    if (replies != NULL){
+        *replies = sensor_replies;
+    }
+    if (updated_us != NULL){
+        *updated_us = sensor_updated_us;
+    }
+    return &sensor;
+}
+
+// Sleep `ms`, waking early when `running` goes false
+static bool session_sleep(uint32_t ms, const volatile bool *running){
+    for(uint32_t slept = 0; slept < ms; slept += SESSION_POLL_MS){
+        if (!*running){
+            return false;
+        }
+        uint32_t step = (ms - slept < SESSION_POLL_MS) ? ms - slept : SESSION_POLL_MS;
+        vTaskDelay((step + portTICK_PERIOD_MS - 1)/portTICK_PERIOD_MS);
+    }
+    return *running;
+}
+
+/* One connect with a deadline: a blocking connect() to a station that has
+ * roamed away waits for the full TCP SYN timeout.
+ */
+static int session_try_connect(uint32_t timeout_ms, const volatile bool *running){
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0){
+        return -1;
+    }
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+    int err = connect(sock, (struct sockaddr *)&peer, sizeof(peer));
+    if ((err != 0) && (errno == EINPROGRESS)){
+        err = -1;
+        for(uint32_t waited = 0; (waited < timeout_ms) && *running; waited += SESSION_POLL_MS){
+            fd_set writable;
+            FD_ZERO(&writable);
+            FD_SET(sock, &writable);
+            struct timeval timeout = {0, SESSION_POLL_MS*1000};
+            int ready = select(sock + 1, NULL, &writable, NULL, &timeout);
+            if (ready < 0){
+                break;
+            }
+            if (ready > 0){
+                int error = 0;
+                socklen_t length = sizeof(error);
+                getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &length);
+                err = (error == 0) ? 0 : -1;
+                break;
+            }
+        }
+    }
+    if (err != 0){
+        close(sock);
+        return -1;
+    }
+    fcntl(sock, F_SETFL, flags);
+    return sock;
+}
+
+int session_reconnect(int *sock, const volatile bool *running, int64_t last_sensor_time){
+    int64_t down = esp_timer_get_time();
+    if (*sock >= 0){
+        shutdown(*sock, 0);
+        close(*sock);
+        *sock = -1;
+    }
+    if (!peer_known){
+        DLOGE(TAG,"No peer to reconnect to, use connect_to first");
+        return -1;
+    }
+    session_gap_t *gap = &stats.gaps[stats.gap_count % SESSION_GAPS];
+    memset(gap, 0, sizeof(*gap));
+    gap->down_us = down;
+    gap->last_sensor_time = last_sensor_time;
+    gap->resume_sensor_time = -1;
+    stats.gap_count++;
+
+    uint32_t delay = backoff_ms;
+    while (*running){
+        gap->attempts++;
+        // give a connect about as long as the backoff, but never less than a second
+        int fd = session_try_connect((delay > 1000) ? delay : 1000, running);
+        int64_t now = esp_timer_get_time();
+        if (fd >= 0){
+            *sock = fd;
+            gap->latency_ms = (uint32_t)((now - down)/1000);
+            stats.reconnects++;
+            stats.downtime_ms += gap->latency_ms;
+            stats.latency[soak_jitter_bucket(gap->latency_ms)]++;
+            DLOGI(TAG,"Reconnected after %u ms (%u attempts)",gap->latency_ms,gap->attempts);
+            return 0;
+        }
+        stats.failed_attempts++;
+        if ((giveup_s > 0) && (now - down >= (int64_t)giveup_s*1000000)){
+            break;
+        }
+        DLOGD(TAG,"Reconnect attempt %u failed, next in %u ms",gap->attempts,delay);
+        if (!session_sleep(delay, running)){
+            break;
+        }
+        delay = (2*delay < backoff_max_ms) ? 2*delay : backoff_max_ms;
+    }
+    stats.gave_up++;
+    stats.downtime_ms += (esp_timer_get_time() - down)/1000;
+    DLOGE(TAG,"Reconnect abandoned after %u attempts",gap->attempts);
+    return -1;
+}
+
+void session_resumed(int64_t sensor_time){
+    if (stats.gap_count == 0){
+        return;
+    }
+    session_gap_t *gap = &stats.gaps[(stats.gap_count - 1) % SESSION_GAPS];
+    if (gap->resume_sensor_time < 0){
+        gap->resume_sensor_time = sensor_time;
+    }
+}
+
+int session_format(char *line, size_t size){
+    return snprintf(line, size, "reconnects %u (%u failed attempts, %u abandoned) latency p50 %ums p99 %ums max %ums downtime %llums",
+                    stats.reconnects, stats.failed_attempts, stats.gave_up,
+                    soak_histogram_percentile(stats.latency, 50), soak_histogram_percentile(stats.latency, 99),
+                    soak_histogram_percentile(stats.latency, 100), stats.downtime_ms);
+}
+
+static struct {
+    struct arg_int *backoff;
+    struct arg_int *backoff_max;
+    struct arg_int *giveup;
+    struct arg_end *end;
+} session_args;
+
+static int session_command(int argc, char **argv){
+    int nerrors = arg_parse(argc, argv, (void **) &session_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, session_args.end, argv[0]);
+        return ESP_OK;
+    }
+    uint32_t next_backoff = (session_args.backoff->count > 0) ? session_args.backoff->ival[0] : backoff_ms;
+    uint32_t next_max = (session_args.backoff_max->count > 0) ? session_args.backoff_max->ival[0] : backoff_max_ms;
+    if ((next_backoff < 10) || (next_max < next_backoff) || (next_max > 600000)){
+        ESP_LOGE(TAG,"Backoff from 10 ms, maximum not below it and at most 600000 ms");
+        return ESP_OK;
+    }
+    backoff_ms = next_backoff;
+    backoff_max_ms = next_max;
+    if (session_args.giveup->count > 0){
+        giveup_s = (session_args.giveup->ival[0] > 0) ? session_args.giveup->ival[0] : 0;
+    }
+    if (peer_known){
+        ESP_LOGI(TAG,"Peer %s:%d, backoff %u..%u ms, give up after %u s (0: never)", inet_ntoa(peer.sin_addr),
+                 ntohs(peer.sin_port), backoff_ms, backoff_max_ms, giveup_s);
+    }else{
+        ESP_LOGI(TAG,"No peer yet, backoff %u..%u ms, give up after %u s (0: never)", backoff_ms, backoff_max_ms, giveup_s);
+    }
+    char line[256];
+    session_format(line, sizeof(line));
+    ESP_LOGI(TAG,"%s", line);
+    uint32_t replies;
+    int64_t updated_us;
+    const sensor_info_t *info = session_sensor(&replies, &updated_us);
+    if (replies > 0){
+        sensor_info_format(info, line, sizeof(line));
+        ESP_LOGI(TAG,"%s (%u replies, last %.1f s ago)", line, replies, (esp_timer_get_time() - updated_us)/1e6);
+    }
+    uint32_t first = (stats.gap_count > SESSION_GAPS) ? stats.gap_count - SESSION_GAPS : 0;
+    for(uint32_t i = first; i < stats.gap_count; i++){
+        const session_gap_t *gap = &stats.gaps[i % SESSION_GAPS];
+        ESP_LOGI(TAG,"gap %u: at %lld ms, %u ms, %u attempts, sensor time %lld -> %lld", i + 1, gap->down_us/1000,
+                 gap->latency_ms, gap->attempts, gap->last_sensor_time, gap->resume_sensor_time);
+    }
+    return ESP_OK;
+}
+
+void register_session(void){
+    session_args.backoff = arg_int0("b", "backoff", "<ms>", "first reconnect delay, doubled after every failure");
+    session_args.backoff_max = arg_int0("m", "max-backoff", "<ms>", "longest reconnect delay");
+    session_args.giveup = arg_int0("g", "give-up", "<s>", "stop reconnecting after this long, 0 never");
+    session_args.end = arg_end(0);
+    const esp_console_cmd_t cmd = {
+        .command = "session",
+        .help = "Show reconnect statistics, the gaps they left and what the sensor replied, set the backoff",
+        .hint = NULL,
+        .func = &session_command,
+        .argtable = &session_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
+}
@@ -0,0 +1,84 @@
+/* Sensor connection that survives drops
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "lwip/sockets.h"
+#include "soak.h"
+#include "sensor_info.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Reconnect gaps remembered for the "session" command
+#define SESSION_GAPS 16
+
+/* One drop of the sensor link. Sensor times bracket the hole it left in
+ * the capture; resume_sensor_time stays -1 until a frame arrives again.
+ */
+typedef struct {
+    int64_t down_us;            // local time the drop was noticed
+    uint32_t latency_ms;        // drop to connected again
+    uint32_t attempts;
+    int64_t last_sensor_time;   // last frame before the drop, -1 if none
+    int64_t resume_sensor_time;
+} session_gap_t;
+
+typedef struct {
+    uint32_t reconnects;
+    uint32_t failed_attempts;
+    uint32_t gave_up;
+    uint64_t downtime_ms;
+    uint32_t latency[SOAK_JITTER_BUCKETS];  // reconnect latency in ms, soak_jitter_bucket() bins
+    uint32_t gap_count;         // gaps recorded, the newest SESSION_GAPS are kept
+    session_gap_t gaps[SESSION_GAPS];
+} session_stats_t;
+
+// Remember where connect_to connected, the address reconnects go back to
+void session_set_peer(const struct sockaddr_in *peer);
+bool session_has_peer(void);
+
+// Address connect_to connected to, false before the first connect_to
+bool session_peer(struct sockaddr_in *address);
+
+// Clear the statistics, at the start of a run
+void session_reset(void);
+const session_stats_t *session_stats(void);
+
+/* Close `*sock` and connect a new socket to the peer, retrying with
+ * exponential backoff until it works, `running` goes false or the give up
+ * time passes. On success `*sock` is the new socket and 0 is returned; on
+ * failure `*sock` is -1. The caller re-issues start_sensor.
+ */
+int session_reconnect(int *sock, const volatile bool *running, int64_t last_sensor_time);
+
+// First valid frame after a reconnect, closes the gap in the capture
+void session_resumed(int64_t sensor_time);
+
+/* A reply from the sensor: its fields replace the ones remembered, the
+ * rest are kept. What the sensor said lasts until the next connect_to,
+ * across reconnects and session_reset().
+ */
+void session_sensor_update(const sensor_info_t *info);
+
+// Fields remembered from the replies so far, with how many and when the last came
+const sensor_info_t *session_sensor(uint32_t *replies, int64_t *updated_us);
+
+// One line: reconnects, attempts, latency percentiles, downtime
+int session_format(char *line, size_t size);
+
+// Register the "session" console command
+void register_session(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,227 @@
+/* Rolling window statistics for long running streams
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "soak.h"
+
+static const char *alarm_names[] = {"rate", "jitter", "corrupt", "gaps"};
+
+void soak_init(soak_t *soak, uint32_t frequency, const soak_limits_t *limits, int64_t now_us){
+    memset(soak, 0, sizeof(*soak));
+    soak->frequency = frequency;
+    soak->nominal_us = (frequency > 0) ? 1000000/frequency : 1000000;
+    soak->limits = *limits;
+    soak->second_start = now_us;
+    soak->last_time = -1;
+}
+
+static void soak_window_add(soak_window_t *window, const soak_second_t *second){
+    window->frames += second->frames;
+    window->corrupted += second->corrupted;
+    window->crc_failed += second->crc_failed;
+    window->gaps += second->gaps;
+    window->lost += second->lost;
+    window->reconnects += second->reconnects;
+    for(int b = 0; b < SOAK_JITTER_BUCKETS; b++){
+        window->jitter[b] += second->jitter[b];
+    }
+}
+
+static void soak_window_remove(soak_window_t *window, const soak_second_t *second){
+    window->frames -= second->frames;
+    window->corrupted -= second->corrupted;
+    window->crc_failed -= second->crc_failed;
+    window->gaps -= second->gaps;
+    window->lost -= second->lost;
+    window->reconnects -= second->reconnects;
+    for(int b = 0; b < SOAK_JITTER_BUCKETS; b++){
+        window->jitter[b] -= second->jitter[b];
+    }
+}
+
+// Smallest jitter value that falls in `bucket`
+static uint32_t soak_bucket_floor(uint32_t bucket){
+    if (bucket < 8){
+        return bucket;
+    }
+    uint32_t octave = 3 + (bucket - 8)/4;
+    return (4 + (bucket - 8)%4) << (octave - 2);
+}
+
+uint32_t soak_histogram_percentile(const uint32_t *jitter, uint32_t p){
+    uint32_t count = 0;
+    for(int b = 0; b < SOAK_JITTER_BUCKETS; b++){
+        count += jitter[b];
+    }
+    if (count == 0){
+        return 0;
+    }
+    uint64_t rank = ((uint64_t)count*p + 99)/100;
+    rank = (rank == 0) ? 1 : rank;
+    uint32_t seen = 0;
+    for(uint32_t b = 0; b < SOAK_JITTER_BUCKETS; b++){
+        seen += jitter[b];
+        if (seen >= rank){
+            return (b + 1 < SOAK_JITTER_BUCKETS) ? soak_bucket_floor(b + 1) - 1 : soak_bucket_floor(b);
+        }
+    }
+    return soak_bucket_floor(SOAK_JITTER_BUCKETS - 1);
+}
+
+uint32_t soak_histogram_moments(const uint32_t *jitter, double *mean, double *stddev){
+    uint64_t count = 0;
+    double sum = 0, squares = 0;
+    for(uint32_t b = 0; b < SOAK_JITTER_BUCKETS; b++){
+        double low = soak_bucket_floor(b);
+        double high = (b + 1 < SOAK_JITTER_BUCKETS) ? soak_bucket_floor(b + 1) : low;
+        double middle = (b < 8) ? low : (low + high)/2;
+        count += jitter[b];
+        sum += jitter[b]*middle;
+        squares += jitter[b]*middle*middle;
+    }
+    *mean = (count > 0) ? sum/count : 0;
+    double variance = (count > 1) ? (squares - sum*sum/count)/(count - 1) : 0;
+    *stddev = (variance > 0) ? sqrt(variance) : 0;
+    return (count > UINT32_MAX) ? UINT32_MAX : (uint32_t)count;
+}
+
+static void soak_summarize(const soak_t *soak, const soak_window_t *window, uint32_t seconds, soak_summary_t *summary){
+    memset(summary, 0, sizeof(*summary));
+    summary->seconds = seconds;
+    if (seconds == 0){
+        return;
+    }
+    summary->frames = window->frames;
+    summary->corrupted = window->corrupted;
+    summary->crc_failed = window->crc_failed;
+    summary->gaps = window->gaps;
+    summary->lost = window->lost;
+    summary->reconnects = window->reconnects;
+    summary->rate = (float)window->frames/seconds;
+    summary->rate_pct = (soak->frequency > 0) ? 100.0f*summary->rate/soak->frequency : 0;
+    summary->jitter_p50 = soak_histogram_percentile(window->jitter, 50);
+    summary->jitter_p99 = soak_histogram_percentile(window->jitter, 99);
+    summary->jitter_max = soak_histogram_percentile(window->jitter, 100);
+}
+
+void soak_summary(const soak_t *soak, uint32_t window, soak_summary_t *summary){
+    if (window == SOAK_WINDOW_10S){
+        soak_summarize(soak, &soak->window10, (soak->seconds < 10) ? soak->seconds : 10, summary);
+    }else if (window == SOAK_WINDOW_60S){
+        soak_summarize(soak, &soak->window60, (soak->seconds < 60) ? soak->seconds : 60, summary);
+    }else{
+        soak_window_t last;
+        memset(&last, 0, sizeof(last));
+        if (soak->seconds > 0){
+            soak_window_add(&last, &soak->history[(soak->seconds - 1) % SOAK_HISTORY_SECONDS]);
+        }
+        soak_summarize(soak, &last, (soak->seconds > 0) ? 1 : 0, summary);
+    }
+}
+
+// Alarm bits a window violates; counts are compared per second
+static uint32_t soak_violations(const soak_t *soak, const soak_summary_t *summary){
+    const soak_limits_t *limits = &soak->limits;
+    uint32_t alarms = 0;
+    if (summary->seconds == 0){
+        return 0;
+    }
+    if ((limits->min_rate_pct > 0) && (summary->rate_pct < limits->min_rate_pct)){
+        alarms |= SOAK_ALARM_RATE;
+    }
+    if ((limits->max_jitter_us > 0) && (summary->jitter_p99 > limits->max_jitter_us)){
+        alarms |= SOAK_ALARM_JITTER;
+    }
+    if (summary->corrupted + summary->crc_failed > limits->max_corrupt*summary->seconds){
+        alarms |= SOAK_ALARM_CORRUPT;
+    }
+    if (summary->gaps > limits->max_gaps*summary->seconds){
+        alarms |= SOAK_ALARM_GAPS;
+    }
+    return alarms;
+}
+
+/* An alarm is raised as soon as one second crosses its threshold and only
+ * cleared once the whole 10 s window is back within it, so a stream that
+ * hovers around a limit does not flood the log.
+ */
+static void soak_close_second(soak_t *soak){
+    uint32_t slot = soak->seconds % SOAK_HISTORY_SECONDS;
+    if (soak->seconds >= SOAK_HISTORY_SECONDS){
+        soak_window_remove(&soak->window60, &soak->history[slot]);
+    }
+    if (soak->seconds >= 10){
+        soak_window_remove(&soak->window10, &soak->history[(soak->seconds - 10) % SOAK_HISTORY_SECONDS]);
+    }
+    soak->history[slot] = soak->current;
+    soak_window_add(&soak->window10, &soak->current);
+    soak_window_add(&soak->window60, &soak->current);
+    soak->total_frames += soak->current.frames;
+    soak->total_corrupted += soak->current.corrupted;
+    soak->total_crc_failed += soak->current.crc_failed;
+    soak->total_gaps += soak->current.gaps;
+    soak->total_lost += soak->current.lost;
+    soak->total_reconnects += soak->current.reconnects;
+    for(int b = 0; b < SOAK_JITTER_BUCKETS; b++){
+        soak->total_jitter[b] += soak->current.jitter[b];
+    }
+    soak->seconds++;
+    memset(&soak->current, 0, sizeof(soak->current));
+
+    soak_summary_t last, recent;
+    soak_summary(soak, SOAK_WINDOW_1S, &last);
+    soak_summary(soak, SOAK_WINDOW_10S, &recent);
+    uint32_t now = soak_violations(soak, &last);
+    uint32_t lasting = soak_violations(soak, &recent);
+    uint32_t raised = now & ~soak->alarms;
+    uint32_t cleared = soak->alarms & ~now & ~lasting;
+    soak->alarms = (soak->alarms | raised) & ~cleared;
+    // a flap inside one tick is reported once as raised
+    soak->raised |= raised;
+    soak->cleared = (soak->cleared | cleared) & ~soak->alarms;
+    for(uint32_t bits = raised; bits != 0; bits &= bits - 1){
+        soak->alarm_count++;
+    }
+}
+
+uint32_t soak_tick(soak_t *soak, int64_t now_us){
+    uint32_t windows = 0;
+    soak->raised = 0;
+    soak->cleared = 0;
+    while (now_us - soak->second_start >= 1000000){
+        soak->second_start += 1000000;
+        soak_close_second(soak);
+        windows |= SOAK_WINDOW_1S;
+        windows |= (soak->seconds % 10 == 0) ? SOAK_WINDOW_10S : 0;
+        windows |= (soak->seconds % 60 == 0) ? SOAK_WINDOW_60S : 0;
+    }
+    return windows;
+}
+
+int soak_format(const soak_t *soak, uint32_t window, char *line, size_t size){
+    soak_summary_t summary;
+    soak_summary(soak, window, &summary);
+    const char *name = (window == SOAK_WINDOW_60S) ? "60s" : (window == SOAK_WINDOW_10S) ? "10s" : "1s";
+    return snprintf(line, size, "soak %3s t=%us rate %.1f Hz (%.1f%%) jitter p50 %uus p99 %uus max %uus corrupt %u crc %u gaps %u lost %u reconn %u%s",
+                    name, soak->seconds, summary.rate, summary.rate_pct, summary.jitter_p50, summary.jitter_p99,
+                    summary.jitter_max, summary.corrupted, summary.crc_failed, summary.gaps, summary.lost, summary.reconnects, soak->alarms ? " ALARM" : "");
+}
+
+int soak_format_alarms(uint32_t alarms, char *line, size_t size){
+    int len = 0;
+    line[0] = '\0';
+    for(uint32_t i = 0; i < sizeof(alarm_names)/sizeof(alarm_names[0]); i++){
+        if ((alarms & (1u << i)) && (len < (int)size)){
+            len += snprintf(line + len, size - len, "%s%s", (len > 0) ? "," : "", alarm_names[i]);
+        }
+    }
+    return len;
+}
@@ -0,0 +1,177 @@
+/* Rolling window statistics for long running streams
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SOAK_HISTORY_SECONDS 60
+#define SOAK_JITTER_BUCKETS 64
+
+// Windows reported by soak_tick()
+#define SOAK_WINDOW_1S  (1 << 0)
+#define SOAK_WINDOW_10S (1 << 1)
+#define SOAK_WINDOW_60S (1 << 2)
+
+// Alarm bits
+#define SOAK_ALARM_RATE    (1 << 0)
+#define SOAK_ALARM_JITTER  (1 << 1)
+#define SOAK_ALARM_CORRUPT (1 << 2)
+#define SOAK_ALARM_GAPS    (1 << 3)
+
+typedef struct {
+    uint32_t min_rate_pct;      // frames received per second, percent of the nominal rate
+    uint32_t max_jitter_us;     // p99 of |interval - nominal interval|
+    uint32_t max_corrupt;       // corrupted frames (framing or CRC) per second
+    uint32_t max_gaps;          // gaps per second
+} soak_limits_t;
+
+/* One second of the stream. Jitter is |interval - nominal| between
+ * consecutive sensor timestamps, kept as a log-linear histogram so the
+ * percentiles of any window are the sum of its seconds.
+ */
+typedef struct {
+    uint32_t frames;
+    uint32_t corrupted;         // framing failures
+    uint32_t crc_failed;        // frames whose markers matched but whose CRC did not
+    uint32_t gaps;              // intervals longer than 1.5 nominal intervals
+    uint32_t lost;              // frames those gaps account for
+    uint32_t reconnects;        // link drops, their hole is not counted as a gap
+    uint16_t jitter[SOAK_JITTER_BUCKETS];
+} soak_second_t;
+
+typedef struct {
+    uint32_t frames;
+    uint32_t corrupted;
+    uint32_t crc_failed;
+    uint32_t gaps;
+    uint32_t lost;
+    uint32_t reconnects;
+    uint32_t jitter[SOAK_JITTER_BUCKETS];
+} soak_window_t;
+
+typedef struct {
+    uint32_t frequency;
+    uint32_t nominal_us;
+    soak_limits_t limits;
+    int64_t second_start;       // local time the current second began
+    uint32_t seconds;           // seconds completed
+    int64_t last_time;          // sensor time of the previous frame, -1 before the first
+    soak_second_t current;
+    soak_second_t history[SOAK_HISTORY_SECONDS];  // ring of completed seconds
+    soak_window_t window10;     // sliding sums of the last 10 and 60 completed seconds
+    soak_window_t window60;
+    uint64_t total_frames;
+    uint64_t total_corrupted;
+    uint64_t total_crc_failed;
+    uint64_t total_gaps;
+    uint64_t total_lost;
+    uint64_t total_reconnects;
+    uint32_t total_jitter[SOAK_JITTER_BUCKETS];   // every completed second of the run
+    uint32_t alarms;            // alarms active now
+    uint32_t raised;            // alarms raised and cleared by the last soak_tick()
+    uint32_t cleared;
+    uint32_t alarm_count;       // alarms raised since soak_init()
+} soak_t;
+
+typedef struct {
+    uint32_t seconds;           // seconds the window covers (fewer at the start of a run)
+    float rate;                 // frames per second
+    float rate_pct;
+    uint32_t jitter_p50;
+    uint32_t jitter_p99;
+    uint32_t jitter_max;        // upper bound of the highest bucket used
+    uint32_t frames;
+    uint32_t corrupted;
+    uint32_t crc_failed;
+    uint32_t gaps;
+    uint32_t lost;
+    uint32_t reconnects;
+} soak_summary_t;
+
+void soak_init(soak_t *soak, uint32_t frequency, const soak_limits_t *limits, int64_t now_us);
+
+static inline uint32_t soak_jitter_bucket(uint32_t value){
+    // exact below 8 us, then four buckets per power of two
+    if (value < 8){
+        return value;
+    }
+    uint32_t octave = 31 - __builtin_clz(value);
+    uint32_t bucket = 8 + (octave - 3)*4 + ((value >> (octave - 2)) & 3);
+    return (bucket < SOAK_JITTER_BUCKETS) ? bucket : SOAK_JITTER_BUCKETS - 1;
+}
+
+// Account one valid frame carrying sensor timestamp `time_us`. O(1), no allocation.
+static inline void soak_frame(soak_t *soak, int64_t time_us){
+    soak_second_t *second = &soak->current;
+    if (soak->last_time >= 0){
+        int64_t interval = time_us - soak->last_time;
+        if (interval <= 0){
+            // the sensor clock went backwards or stood still: not a frame we can trust
+            second->corrupted++;
+            return;
+        }
+        int64_t deviation = interval - soak->nominal_us;
+        deviation = (deviation < 0) ? -deviation : deviation;
+        uint32_t bucket = soak_jitter_bucket((deviation > UINT32_MAX) ? UINT32_MAX : (uint32_t)deviation);
+        if (second->jitter[bucket] != UINT16_MAX){
+            second->jitter[bucket]++;
+        }
+        if (2*interval > 3*(int64_t)soak->nominal_us){
+            second->gaps++;
+            second->lost += (uint32_t)((interval + soak->nominal_us/2)/soak->nominal_us - 1);
+        }
+    }
+    second->frames++;
+    soak->last_time = time_us;
+}
+
+static inline void soak_corrupt(soak_t *soak){
+    soak->current.corrupted++;
+}
+
+static inline void soak_crc_failed(soak_t *soak){
+    soak->current.crc_failed++;
+}
+
+// The link dropped and came back: the next frame starts a new interval chain
+static inline void soak_reconnect(soak_t *soak){
+    soak->current.reconnects++;
+    soak->last_time = -1;
+}
+
+// Upper bound of the jitter bucket holding the p-th percentile (p in 0..100) of a SOAK_JITTER_BUCKETS histogram
+uint32_t soak_histogram_percentile(const uint32_t *jitter, uint32_t p);
+
+// Sample count, mean and standard deviation of a histogram, each bucket taken at its midpoint
+uint32_t soak_histogram_moments(const uint32_t *jitter, double *mean, double *stddev);
+
+/* Close every second that ended before `now_us`. Returns the SOAK_WINDOW_x
+ * bits of the windows that completed a period, and sets soak->raised and
+ * soak->cleared to the alarm transitions.
+ */
+uint32_t soak_tick(soak_t *soak, int64_t now_us);
+
+// Summary of the last 1, 10 or 60 completed seconds (SOAK_WINDOW_x)
+void soak_summary(const soak_t *soak, uint32_t window, soak_summary_t *summary);
+
+// One line summary of a window, returns the length written
+int soak_format(const soak_t *soak, uint32_t window, char *line, size_t size);
+
+// Names of the alarms in `alarms`, e.g. "rate,jitter"
+int soak_format_alarms(uint32_t alarms, char *line, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,174 @@
+/* Stall detection for the sensor receive loops
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_console.h"
+#include "esp_timer.h"
+#include "argtable3/argtable3.h"
+#include "sdkconfig.h"
+#include "lwip/sockets.h"
+#include "stall.h"
+
+// Longest single select(), bounds how late a cleared running flag is seen
+#define STALL_POLL_US 20000
+
+static const char *TAG = "stall";
+
+static stall_config_t config = {
+    .timeout_ms = CONFIG_TESTSUITE_STALL_TIMEOUT_MS,
+    .giveup_ms = CONFIG_TESTSUITE_STALL_GIVEUP_MS,
+    .policy = STALL_ABORT,
+};
+
+const stall_config_t *stall_config(void){
+    return &config;
+}
+
+void stall_init(stall_t *stall, uint32_t frequency){
+    memset(stall, 0, sizeof(*stall));
+    stall->config = config;
+    stall->timeout_us = (int64_t)config.timeout_ms*1000;
+    // a 1 Hz sensor is not stalled after 250 ms
+    if ((frequency > 0) && (stall->timeout_us < 4000000LL/frequency)){
+        stall->timeout_us = 4000000LL/frequency;
+        // the give up time keeps its ratio to the timeout, or resume mode would give up at the first stall
+        int64_t giveup_us = (int64_t)config.giveup_ms*stall->timeout_us/config.timeout_ms;
+        stall->config.giveup_ms = (giveup_us < UINT32_MAX*1000LL) ? (giveup_us + 999)/1000 : UINT32_MAX;
+    }
+}
+
+void stall_arm(stall_t *stall, int64_t now_us){
+    stall->last_rx_us = now_us;
+    stall->stalled = false;
+}
+
+int stall_recv(stall_t *stall, int sock, void *buffer, size_t size, const volatile bool *running){
+    while (true){
+        int64_t now = esp_timer_get_time();
+        int64_t deadline = stall->last_rx_us + (stall->stalled ? (int64_t)stall->config.giveup_ms*1000 : stall->timeout_us);
+        if (now >= deadline){
+            if (stall->stalled){
+                return STALL_GAVE_UP;
+            }
+            stall->stalled = true;
+            stall->events++;
+            stall->last_detect_us = now - stall->last_rx_us;
+            stall->detect_sum_us += stall->last_detect_us;
+            if (stall->last_detect_us > stall->detect_max_us){
+                stall->detect_max_us = stall->last_detect_us;
+            }
+            return STALL_DETECTED;
+        }
+        if (!*running){
+            return STALL_STOPPED;
+        }
+        int64_t wait = deadline - now;
+        wait = (wait < STALL_POLL_US) ? wait : STALL_POLL_US;
+        struct timeval timeout = {0, (long)wait};
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(sock, &readable);
+        int ready = select(sock + 1, &readable, NULL, NULL, &timeout);
+        if (ready < 0){
+            return -1;
+        }
+        if (ready == 0){
+            continue;
+        }
+        int received = recv(sock, buffer, size, 0);
+        if (received > 0){
+            now = esp_timer_get_time();
+            if (stall->stalled){
+                stall->stalled = false;
+                stall->resumed++;
+                stall->last_silence_us = now - stall->last_rx_us;
+                if (stall->last_silence_us > stall->longest_us){
+                    stall->longest_us = stall->last_silence_us;
+                }
+            }
+            stall->last_rx_us = now;
+        }
+        return received;
+    }
+}
+
+int stall_format(const stall_t *stall, char *line, size_t size){
+    if (stall->events == 0){
+        return snprintf(line, size, "stalls 0 (timeout %lld ms)", stall->timeout_us/1000);
+    }
+    return snprintf(line, size, "stalls %u (timeout %lld ms): detected after avg %.1f ms max %.1f ms, %u resumed (longest %.1f ms), %u aborted",
+                    stall->events, stall->timeout_us/1000, stall->detect_sum_us/1000.0/stall->events,
+                    stall->detect_max_us/1000.0, stall->resumed, stall->longest_us/1000.0, stall->aborted);
+}
+
+static struct {
+    struct arg_int *timeout;
+    struct arg_int *giveup;
+    struct arg_str *policy;
+    struct arg_end *end;
+} stall_args;
+
+static int stall_command(int argc, char **argv){
+    int nerrors = arg_parse(argc, argv, (void **) &stall_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, stall_args.end, argv[0]);
+        return ESP_OK;
+    }
+    if (((stall_args.timeout->count > 0) && (stall_args.timeout->ival[0] < 0))
+        || ((stall_args.giveup->count > 0) && (stall_args.giveup->ival[0] < 0))){
+        ESP_LOGE(TAG,"Timeout and give up time must not be negative");
+        return ESP_OK;
+    }
+    stall_config_t next = config;
+    if (stall_args.timeout->count > 0){
+        next.timeout_ms = stall_args.timeout->ival[0];
+    }
+    if (stall_args.giveup->count > 0){
+        next.giveup_ms = stall_args.giveup->ival[0];
+    }
+    if (stall_args.policy->count > 0){
+        if (strcmp(stall_args.policy->sval[0], "abort") == 0){
+            next.policy = STALL_ABORT;
+        }else if (strcmp(stall_args.policy->sval[0], "resume") == 0){
+            next.policy = STALL_RESUME;
+        }else{
+            ESP_LOGE(TAG,"Policy is \"abort\" or \"resume\"");
+            return ESP_OK;
+        }
+    }
+    if ((next.timeout_ms < 10) || (next.timeout_ms > 60000) || (next.giveup_ms < next.timeout_ms)){
+        ESP_LOGE(TAG,"Timeout 10..60000 ms, give up time not shorter than the timeout");
+        return ESP_OK;
+    }
+    // picked up by the next receive command
+    config = next;
+    ESP_LOGI(TAG,"Stall after %u ms without data, then %s", config.timeout_ms,
+             (config.policy == STALL_ABORT) ? "abort the round" : "keep waiting");
+    if (config.policy == STALL_RESUME){
+        ESP_LOGI(TAG,"Give up after %u ms", config.giveup_ms);
+    }
+    return ESP_OK;
+}
+
+void register_stall(void){
+    stall_args.timeout = arg_int0("t", "timeout", "<ms>", "silence that counts as a stall");
+    stall_args.giveup = arg_int0("g", "give-up", "<ms>", "with resume, abort the round after this much silence");
+    stall_args.policy = arg_str0("p", "policy", "<abort|resume>", "what a stalled round does");
+    stall_args.end = arg_end(0);
+    const esp_console_cmd_t cmd = {
+        .command = "stall",
+        .help = "Show or set how the receive commands detect and handle a silent sensor",
+        .hint = NULL,
+        .func = &stall_command,
+        .argtable = &stall_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
+}
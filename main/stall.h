@@ -0,0 +1,83 @@
+/* Stall detection for the sensor receive loops
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Results of stall_recv() besides the byte count, 0 (closed) and -1 (socket error)
+#define STALL_STOPPED   (-2)    // the running flag went false while waiting
+#define STALL_DETECTED  (-3)    // no data for the stall timeout, returned once per stall
+#define STALL_GAVE_UP   (-4)    // resume policy: still no data after the give up time
+
+typedef enum {
+    STALL_ABORT,                // end the round as soon as the stall is detected
+    STALL_RESUME,               // keep waiting, the round goes on when data comes back
+} stall_policy_t;
+
+typedef struct {
+    uint32_t timeout_ms;        // silence that counts as a stall
+    uint32_t giveup_ms;         // resume policy: silence after which the round is aborted anyway
+    stall_policy_t policy;
+} stall_config_t;
+
+/* Per run state and statistics. Time to detect is the silence between the
+ * last byte and the moment the stall was noticed: the timeout plus however
+ * late the receiving task got to run.
+ */
+typedef struct {
+    stall_config_t config;
+    int64_t timeout_us;         // config.timeout_ms, raised to 4 sample intervals for slow sensors (giveup_ms scaled with it)
+    int64_t last_rx_us;
+    bool stalled;
+    uint32_t events;
+    uint32_t resumed;
+    uint32_t aborted;
+    int64_t last_detect_us;
+    int64_t detect_sum_us;
+    int64_t detect_max_us;
+    int64_t last_silence_us;    // length of the last stall that ended with data
+    int64_t longest_us;
+} stall_t;
+
+// The settings of the "stall" command
+const stall_config_t *stall_config(void);
+
+// Reset `stall` for a run at `frequency` Hz with the current settings
+void stall_init(stall_t *stall, uint32_t frequency);
+
+// Start the silence clock, right after the start command was sent
+void stall_arm(stall_t *stall, int64_t now_us);
+
+/* recv() that never waits past the stall deadline. Returns what recv()
+ * returned, or one of the STALL_ codes. `running` is polled every few
+ * milliseconds so clearing it ends the wait.
+ */
+int stall_recv(stall_t *stall, int sock, void *buffer, size_t size, const volatile bool *running);
+
+// Count a round ended because of a stall
+static inline void stall_abort(stall_t *stall){
+    stall->aborted++;
+    stall->stalled = false;
+}
+
+// One line summary: events, time to detect, longest silence
+int stall_format(const stall_t *stall, char *line, size_t size);
+
+// Register the "stall" console command
+void register_stall(void);
+
+#ifdef __cplusplus
+}
+#endif
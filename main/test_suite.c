@@ -23,6 +23,11 @@
 #include "nvs_flash.h"
 #include "esp_sleep.h"
 #include "cmd_testsuite.h"
+#include "worker_pool.h"
+#include "dlog.h"
+#include "console_tcp.h"
+#include "result.h"
+#include "control.h"
 #include "lwip/err.h"
 #include "lwip/sys.h"
 
@@ -61,8 +66,8 @@ static void initialize_console(void){
 
     /* Initialize the console */
     esp_console_config_t console_config = {
-            .max_cmdline_args = 8,
-            .max_cmdline_length = 256,
+            .max_cmdline_args = CONSOLE_MAX_ARGS,
+            .max_cmdline_length = CONSOLE_MAX_LINE,
     };
     ESP_ERROR_CHECK( esp_console_init(&console_config) );
 
@@ -94,10 +99,17 @@ void app_main(void){
 
     initialize_console();
 
+    worker_pool_init();
+    dlog_init();
+
     esp_console_register_help_command();
 
     register_testsuite();
 
+    console_tcp_start();
+    result_start();
+    control_start();
+
     /* Prompt to be printed before each line.
      * This can be customized, made dynamic, etc.
      */
@@ -133,18 +145,8 @@ void app_main(void){
             linenoiseHistoryAdd(line);
         }
 
-        /* Try to run the command */
-        int ret;
-        esp_err_t err = esp_console_run(line, &ret);
-        if (err == ESP_ERR_NOT_FOUND) {
-            printf("Unrecognized command\n");
-        } else if (err == ESP_ERR_INVALID_ARG) {
-            // command was empty
-        } else if (err == ESP_OK && ret != ESP_OK) {
-            printf("Command returned non-zero error code: 0x%x (%s)\n", ret, esp_err_to_name(ret));
-        } else if (err != ESP_OK) {
-            printf("Internal error: %s\n", esp_err_to_name(err));
-        }
+        /* Try to run the command, the TCP console sessions share the same registry */
+        console_run(line);
         /* linenoise allocates line buffer on the heap, so need to free it */
         linenoiseFree(line);
     }
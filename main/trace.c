@@ -0,0 +1,131 @@
+/* Binary event tracer
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_console.h"
+#include "argtable3/argtable3.h"
+#include "sdkconfig.h"
+#include "trace.h"
+
+static const char *TAG = "trace";
+
+#if CONFIG_TESTSUITE_TRACE
+
+#include "esp32/clk.h"
+
+trace_ring_t trace_rings[portNUM_PROCESSORS];
+volatile bool trace_running = true;
+
+#define TRACE_MAX_TASKS 16
+
+static bool trace_task_seen(uint32_t *tasks, int *count, uint32_t task){
+    for(int i = 0; i < *count; i++){
+        if (tasks[i] == task){
+            return true;
+        }
+    }
+    if (*count < TRACE_MAX_TASKS){
+        tasks[(*count)++] = task;
+    }
+    return false;
+}
+
+/* One line per event so the dump survives the console and can be cut out of
+ * any log by host/trace2json.
+ */
+static void trace_dump(void){
+    uint32_t tasks[TRACE_MAX_TASKS];
+    int task_count = 0;
+    bool was_running = trace_running;
+
+    trace_running = false;
+    printf("TRACE_BEGIN cpu_hz=%d cores=%d\n", esp_clk_cpu_freq(), portNUM_PROCESSORS);
+    for(int core = 0; core < portNUM_PROCESSORS; core++){
+        trace_ring_t *ring = &trace_rings[core];
+        uint32_t head = ring->head;
+        uint32_t first = (head > TRACE_RING_SIZE) ? head - TRACE_RING_SIZE : 0;
+        for(uint32_t i = first; i < head; i++){
+            const trace_event_t *event = &ring->events[i & (TRACE_RING_SIZE - 1)];
+            if (!trace_task_seen(tasks, &task_count, event->task)){
+                // every task of the suite is static and never deleted, so the handle is still valid
+                printf("TN %08x %s\n", event->task, pcTaskGetTaskName((TaskHandle_t)(uintptr_t)event->task));
+            }
+            printf("TE %d %08x %08x %04x %08x\n", core, event->timestamp, event->task, event->type, event->arg);
+        }
+    }
+    printf("TRACE_END\n");
+    trace_running = was_running;
+}
+
+static struct {
+    struct arg_str *action;
+    struct arg_end *end;
+} trace_args;
+
+static int trace_command(int argc, char **argv){
+    int nerrors = arg_parse(argc, argv, (void **) &trace_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, trace_args.end, argv[0]);
+        return ESP_OK;
+    }
+    const char *action = trace_args.action->sval[0];
+    if (strcmp(action, "on") == 0){
+        trace_running = true;
+    }else if (strcmp(action, "off") == 0){
+        trace_running = false;
+    }else if (strcmp(action, "clear") == 0){
+        bool was_running = trace_running;
+        trace_running = false;
+        memset(trace_rings, 0, sizeof(trace_rings));
+        trace_running = was_running;
+    }else if (strcmp(action, "dump") == 0){
+        trace_dump();
+    }else{
+        ESP_LOGE(TAG,"Unknown action \"%s\"", action);
+        return ESP_OK;
+    }
+    for(int core = 0; core < portNUM_PROCESSORS; core++){
+        ESP_LOGI(TAG,"core %d: %u events recorded (%d kept)", core, trace_rings[core].head, TRACE_RING_SIZE);
+    }
+    return ESP_OK;
+}
+
+void register_trace(void){
+    trace_args.action = arg_str1(NULL, NULL, "<on|off|clear|dump>", "what to do with the trace rings");
+    trace_args.end = arg_end(0);
+    const esp_console_cmd_t cmd = {
+        .command = "trace",
+        .help = "control and dump the binary event tracer",
+        .hint = NULL,
+        .func = &trace_command,
+        .argtable = &trace_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
+}
+
+#else
+
+static int trace_command(int argc, char **argv){
+    ESP_LOGE(TAG,"Tracing disabled, enable CONFIG_TESTSUITE_TRACE");
+    return ESP_OK;
+}
+
+void register_trace(void){
+    const esp_console_cmd_t cmd = {
+        .command = "trace",
+        .help = "binary event tracer (disabled in this build)",
+        .hint = NULL,
+        .func = &trace_command,
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
+}
+
+#endif
@@ -0,0 +1,86 @@
+/* Binary event tracer
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Event types, shared with host/trace2json.cpp. Never renumber them. */
+typedef enum {
+    TRACE_RECV_START = 1,   // arg: requested bytes
+    TRACE_RECV_END,         // arg: recv() return value
+    TRACE_DECODE,           // arg: frames decoded in the batch
+    TRACE_SEND,             // arg: send() return value
+    TRACE_JOB_BEGIN,        // arg: worker index
+    TRACE_JOB_END,          // arg: worker index
+    TRACE_WIFI,             // arg: WIFI_EVENT id
+} trace_event_type_t;
+
+typedef struct {
+    uint32_t timestamp;     // CPU cycle count of the recording core
+    uint32_t task;          // handle of the recording task
+    uint16_t type;
+    uint16_t reserved;
+    uint32_t arg;
+} trace_event_t;
+
+#if CONFIG_TESTSUITE_TRACE
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_cpu.h"
+
+#define TRACE_RING_SIZE CONFIG_TESTSUITE_TRACE_EVENTS
+
+_Static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0, "CONFIG_TESTSUITE_TRACE_EVENTS must be a power of two");
+
+typedef struct {
+    uint32_t head;
+    trace_event_t events[TRACE_RING_SIZE];
+} trace_ring_t;
+
+extern trace_ring_t trace_rings[portNUM_PROCESSORS];
+extern volatile bool trace_running;
+
+/* Only tasks and ISRs of one core ever write its ring, so claiming a slot
+ * with an atomic increment is all the synchronisation needed. The oldest
+ * events are overwritten.
+ */
+static inline void trace_record(uint16_t type, uint32_t arg){
+    if (!trace_running){
+        return;
+    }
+    trace_ring_t *ring = &trace_rings[xPortGetCoreID()];
+    uint32_t slot = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED) & (TRACE_RING_SIZE - 1);
+    trace_event_t *event = &ring->events[slot];
+    event->timestamp = esp_cpu_get_ccount();
+    event->task = (uint32_t)(uintptr_t)xTaskGetCurrentTaskHandle();
+    event->type = type;
+    event->arg = arg;
+}
+
+#define TRACE_EVENT(type, arg) trace_record((type), (uint32_t)(arg))
+
+#else
+
+#define TRACE_EVENT(type, arg) do {} while (0)
+
+#endif
+
+// Register the "trace" console command
+void register_trace(void);
+
+#ifdef __cplusplus
+}
+#endif
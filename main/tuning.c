@@ -0,0 +1,230 @@
+/* Receive path tuning profiles
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_console.h"
+#include "esp_timer.h"
+#include "argtable3/argtable3.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+#include "lwip/sockets.h"
+#include "worker_pool.h"
+#include "tuning.h"
+
+static const char *TAG = "tuning";
+
+/* "default" is what the receive commands did before profiles existed.
+ * 1800 bytes is 75 frames, 480 is 20 and 3600 is 150.
+ */
+static const tuning_profile_t profiles[] = {
+    {"default", "lwIP defaults, 1800 byte reads, worker priority on core 1", 0, false, 1800, WORKER_PRIORITY, 1},
+    {"lowlat", "small buffer, TCP_NODELAY, 480 byte reads, high priority", 2880, true, 480, 12, 1},
+    {"bulk", "one TCP window of buffer, 3600 byte reads", CONFIG_LWIP_TCP_WND_DEFAULT, false, 3600, WORKER_PRIORITY, 1},
+    {"core0", "default settings, receiving on core 0 next to WiFi", 0, false, 1800, WORKER_PRIORITY, 0},
+};
+
+#define PROFILE_COUNT (sizeof(profiles)/sizeof(profiles[0]))
+
+static const tuning_profile_t *active = &profiles[0];
+
+const tuning_profile_t *tuning_active(void){
+    return active;
+}
+
+const tuning_profile_t *tuning_find(const char *name){
+    for(int i = 0; i < PROFILE_COUNT; i++){
+        if (strcmp(profiles[i].name, name) == 0){
+            return &profiles[i];
+        }
+    }
+    return NULL;
+}
+
+/* Socket options as lwIP creates them, read once from a fresh socket. A
+ * profile that leaves an option alone puts these back, so the settings of
+ * the previous profile never carry over on a socket that is kept.
+ */
+static int default_rcvbuf = -1;
+static int default_nodelay = 0;
+static bool defaults_read = false;
+
+static void tuning_read_defaults(void){
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock < 0){
+        return;
+    }
+    socklen_t len = sizeof(default_rcvbuf);
+#if CONFIG_LWIP_SO_RCVBUF
+    if (getsockopt(sock, SOL_SOCKET, SO_RCVBUF, &default_rcvbuf, &len) != 0){
+        default_rcvbuf = -1;
+    }
+#endif
+    len = sizeof(default_nodelay);
+    if (getsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &default_nodelay, &len) != 0){
+        default_nodelay = 0;
+    }
+    close(sock);
+    defaults_read = true;
+}
+
+bool tuning_apply_socket(const tuning_profile_t *profile, int sock){
+    bool ok = true;
+    if (!defaults_read){
+        tuning_read_defaults();
+    }
+#if CONFIG_LWIP_SO_RCVBUF
+    int rcvbuf = (profile->rcvbuf > 0) ? profile->rcvbuf : default_rcvbuf;
+    if (rcvbuf > 0){
+        ok &= (setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) == 0);
+    }
+#else
+    if (profile->rcvbuf > 0){
+        ESP_LOGW(TAG,"SO_RCVBUF ignored, enable CONFIG_LWIP_SO_RCVBUF");
+    }
+#endif
+    int nodelay = profile->nodelay ? 1 : default_nodelay;
+    ok &= (setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) == 0);
+    if (!ok){
+        ESP_LOGW(TAG,"Profile %s: socket option refused: %s", profile->name, strerror(errno));
+    }
+    return ok;
+}
+
+UBaseType_t tuning_apply_priority(const tuning_profile_t *profile){
+    UBaseType_t previous = uxTaskPriorityGet(NULL);
+    vTaskPrioritySet(NULL, profile->priority);
+    return previous;
+}
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+#define TUNING_MAX_TASKS 40
+
+static TaskStatus_t task_status[TUNING_MAX_TASKS];
+static StaticSemaphore_t task_status_lock_buffer;
+static SemaphoreHandle_t task_status_lock = NULL;
+
+// Run time counters of `task` and of every idle task
+static void tuning_read_counters(TaskHandle_t task, uint32_t *task_counter, uint32_t *idle){
+    TaskHandle_t idle_handles[portNUM_PROCESSORS];
+    for(int core = 0; core < portNUM_PROCESSORS; core++){
+        idle_handles[core] = xTaskGetIdleTaskHandleForCPU(core);
+        idle[core] = 0;
+    }
+    *task_counter = 0;
+    // the snapshot array is shared by every caller
+    xSemaphoreTake(task_status_lock, portMAX_DELAY);
+    UBaseType_t count = uxTaskGetSystemState(task_status, TUNING_MAX_TASKS, NULL);
+    for(UBaseType_t i = 0; i < count; i++){
+        if (task_status[i].xHandle == task){
+            *task_counter = task_status[i].ulRunTimeCounter;
+        }
+        for(int core = 0; core < portNUM_PROCESSORS; core++){
+            if (task_status[i].xHandle == idle_handles[core]){
+                idle[core] = task_status[i].ulRunTimeCounter;
+            }
+        }
+    }
+    xSemaphoreGive(task_status_lock);
+}
+#endif
+
+void tuning_cpu_begin(tuning_cpu_t *cpu){
+    memset(cpu, 0, sizeof(*cpu));
+    cpu->task = xTaskGetCurrentTaskHandle();
+    cpu->start_us = esp_timer_get_time();
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    tuning_read_counters(cpu->task, &cpu->task_start, cpu->idle_start);
+#endif
+}
+
+void tuning_cpu_end(const tuning_cpu_t *cpu, tuning_cpu_usage_t *usage){
+    memset(usage, 0, sizeof(*usage));
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    // with the esp_timer clock the counters are in microseconds
+    uint32_t task_now, idle_now[portNUM_PROCESSORS];
+    tuning_read_counters(cpu->task, &task_now, idle_now);
+    float elapsed = (float)(esp_timer_get_time() - cpu->start_us);
+    if (elapsed <= 0){
+        return;
+    }
+    usage->valid = true;
+    usage->task_pct = 100.0f*(uint32_t)(task_now - cpu->task_start)/elapsed;
+    for(int core = 0; core < portNUM_PROCESSORS; core++){
+        float idle = 100.0f*(uint32_t)(idle_now[core] - cpu->idle_start[core])/elapsed;
+        usage->load_pct[core] = (idle < 100.0f) ? 100.0f - idle : 0;
+    }
+#endif
+}
+
+void tuning_print_build(void){
+    ESP_LOGI(TAG,"lwIP: TCP window %d, send buffer %d, MSS %d, TCP recvmbox %d, tcpip mbox %d, SO_RCVBUF %s",
+             CONFIG_LWIP_TCP_WND_DEFAULT, CONFIG_LWIP_TCP_SND_BUF_DEFAULT, CONFIG_LWIP_TCP_MSS,
+             CONFIG_LWIP_TCP_RECVMBOX_SIZE, CONFIG_LWIP_TCPIP_RECVMBOX_SIZE,
+#if CONFIG_LWIP_SO_RCVBUF
+             "supported"
+#else
+             "not compiled in"
+#endif
+             );
+    ESP_LOGI(TAG,"WiFi: %d static and %d dynamic RX buffers, run time stats %s",
+             CONFIG_ESP32_WIFI_STATIC_RX_BUFFER_NUM, CONFIG_ESP32_WIFI_DYNAMIC_RX_BUFFER_NUM,
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+             "on"
+#else
+             "off (no CPU figures)"
+#endif
+             );
+}
+
+static struct {
+    struct arg_str *profile;
+    struct arg_end *end;
+} tune_args;
+
+static int tune(int argc, char **argv){
+    int nerrors = arg_parse(argc, argv, (void **) &tune_args);
+    if (nerrors != 0) {
+        arg_print_errors(stderr, tune_args.end, argv[0]);
+        return ESP_OK;
+    }
+    if (tune_args.profile->count > 0){
+        const tuning_profile_t *profile = tuning_find(tune_args.profile->sval[0]);
+        if (profile == NULL){
+            ESP_LOGE(TAG,"Unknown profile \"%s\"", tune_args.profile->sval[0]);
+            return ESP_OK;
+        }
+        // picked up by the next receive command
+        active = profile;
+    }
+    for(int i = 0; i < PROFILE_COUNT; i++){
+        const tuning_profile_t *p = &profiles[i];
+        ESP_LOGI(TAG,"%c %-8s rcvbuf %5d nodelay %d read %4d prio %2d core %d  %s", (p == active) ? '*' : ' ', p->name,
+                 p->rcvbuf, p->nodelay, p->read_size, p->priority, p->core, p->description);
+    }
+    tuning_print_build();
+    return ESP_OK;
+}
+
+void register_tuning(void){
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    task_status_lock = xSemaphoreCreateMutexStatic(&task_status_lock_buffer);
+#endif
+    tune_args.profile = arg_str0(NULL, NULL, "<profile>", "profile to use for the next stream");
+    tune_args.end = arg_end(0);
+    const esp_console_cmd_t cmd = {
+        .command = "tune",
+        .help = "List the receive tuning profiles and select one",
+        .hint = NULL,
+        .func = &tune,
+        .argtable = &tune_args
+    };
+    ESP_ERROR_CHECK( esp_console_cmd_register(&cmd));
+}
@@ -0,0 +1,78 @@
+/* Receive path tuning profiles
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TUNING_MAX_READ 4096
+
+/* Everything a stream receiver can change without rebuilding: socket
+ * options, how much it asks recv() for, and where and how urgently the
+ * receiving task runs. lwIP's own buffers and windows are build settings
+ * and are only reported (tuning_print_build()).
+ */
+typedef struct {
+    const char *name;
+    const char *description;
+    int rcvbuf;             // SO_RCVBUF in bytes, 0 leaves the lwIP default
+    bool nodelay;           // TCP_NODELAY, for the commands sent to the sensor
+    int read_size;          // bytes per recv(), at most TUNING_MAX_READ
+    int priority;           // FreeRTOS priority of the receiving task
+    int core;               // 0, 1 or WORKER_ANY_CORE
+} tuning_profile_t;
+
+typedef struct {
+    TaskHandle_t task;
+    int64_t start_us;
+    uint32_t task_start;
+    uint32_t idle_start[portNUM_PROCESSORS];
+} tuning_cpu_t;
+
+typedef struct {
+    bool valid;             // false when FreeRTOS run time stats are not enabled
+    float task_pct;         // the receiving task, percent of one core
+    float load_pct[portNUM_PROCESSORS];   // busy time of each core
+} tuning_cpu_usage_t;
+
+// The selected profile, used by recv_sensor, soak and tune_ab
+const tuning_profile_t *tuning_active(void);
+
+// NULL if there is no profile with that name
+const tuning_profile_t *tuning_find(const char *name);
+
+// Apply the socket options of `profile` to `sock`, the ones it leaves unset back to lwIP's defaults.
+// Returns false if one was refused.
+bool tuning_apply_socket(const tuning_profile_t *profile, int sock);
+
+// Raise or lower the calling task to the profile priority, returns the previous one
+UBaseType_t tuning_apply_priority(const tuning_profile_t *profile);
+
+/* CPU accounting for the calling task and for every core between
+ * tuning_cpu_begin() and tuning_cpu_end(), from the FreeRTOS run time
+ * counters (CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS).
+ */
+void tuning_cpu_begin(tuning_cpu_t *cpu);
+void tuning_cpu_end(const tuning_cpu_t *cpu, tuning_cpu_usage_t *usage);
+
+// Log the lwIP and WiFi buffer settings this firmware was built with
+void tuning_print_build(void);
+
+// Register the "tune" console command
+void register_tuning(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,155 @@
+/* Static worker pool for the test suite commands
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include "worker_pool.h"
+#include "trace.h"
+
+#define WORKER_COUNT       CONFIG_TESTSUITE_WORKER_COUNT
+#define WORKER_STACK_SIZE  CONFIG_TESTSUITE_WORKER_STACK_SIZE
+#define WORKER_CORE0_COUNT CONFIG_TESTSUITE_WORKER_CORE0_COUNT
+
+_Static_assert(WORKER_CORE0_COUNT <= WORKER_COUNT, "more workers on core 0 than workers");
+
+static const char *TAG = "worker_pool";
+
+typedef struct {
+    TaskHandle_t handle;
+    StaticTask_t tcb;
+    char task_name[configMAX_TASK_NAME_LEN];
+    int core;
+    worker_job_t job;
+    void *arg;
+    const char *job_name;
+    int64_t submitted_at;
+    uint32_t tag;
+    bool busy;
+} worker_t;
+
+/* Everything the pool needs is reserved here, so running a command never
+ * touches the heap and the workers are never deleted.
+ */
+static StackType_t worker_stacks[WORKER_COUNT][WORKER_STACK_SIZE];
+static worker_t workers[WORKER_COUNT];
+static portMUX_TYPE workers_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool pool_ready = false;
+static TaskHandle_t tag_task = NULL;
+static uint32_t tag_value = 0;
+static uint32_t tag_jobs = 0;
+static worker_done_t done_hook = NULL;
+
+static void worker_task(void *pvParameters){
+    worker_t *self = (worker_t *)pvParameters;
+    while(true){
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        TRACE_EVENT(TRACE_JOB_BEGIN, self - workers);
+        self->job(self->arg);
+        TRACE_EVENT(TRACE_JOB_END, self - workers);
+        worker_done_t hook = done_hook;
+        if ((self->tag != 0) && (hook != NULL)){
+            hook(self->tag, self->job_name, self->submitted_at);
+        }
+
+        portENTER_CRITICAL(&workers_lock);
+        self->job = NULL;
+        self->arg = NULL;
+        self->busy = false;
+        portEXIT_CRITICAL(&workers_lock);
+    }
+}
+
+void worker_pool_init(void){
+    if(pool_ready){
+        return;
+    }
+    // the last WORKER_CORE0_COUNT workers share core 0 with the WiFi driver, the rest run on core 1
+    for(int i = 0; i < WORKER_COUNT; i++){
+        workers[i].core = (i >= WORKER_COUNT - WORKER_CORE0_COUNT) ? 0 : 1;
+        snprintf(workers[i].task_name, sizeof(workers[i].task_name), "worker%d", i);
+        workers[i].handle = xTaskCreateStaticPinnedToCore(worker_task, workers[i].task_name, WORKER_STACK_SIZE,
+                                                          &workers[i], WORKER_PRIORITY, worker_stacks[i], &workers[i].tcb, workers[i].core);
+    }
+    pool_ready = true;
+    ESP_LOGI(TAG,"%d workers reserved (%d bytes of stack each, %d on core 0)", WORKER_COUNT, WORKER_STACK_SIZE, WORKER_CORE0_COUNT);
+}
+
+esp_err_t worker_submit(const char *name, worker_job_t job, void *arg){
+    return worker_submit_on(name, job, arg, WORKER_ANY_CORE);
+}
+
+esp_err_t worker_submit_on(const char *name, worker_job_t job, void *arg, int core){
+    worker_t *worker = NULL;
+
+    portENTER_CRITICAL(&workers_lock);
+    for(int i = 0; i < WORKER_COUNT; i++){
+        if(!workers[i].busy && ((core == WORKER_ANY_CORE) || (workers[i].core == core))){
+            worker = &workers[i];
+            worker->busy = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&workers_lock);
+
+    if(worker == NULL){
+        ESP_LOGE(TAG,"No idle worker for \"%s\"%s", name, (core == WORKER_ANY_CORE) ? "" : " on the requested core");
+        return ESP_ERR_NO_MEM;
+    }
+    worker->job = job;
+    worker->arg = arg;
+    worker->job_name = name;
+    worker->submitted_at = esp_timer_get_time();
+    worker->tag = 0;
+    if ((tag_task != NULL) && (tag_task == xTaskGetCurrentTaskHandle())){
+        worker->tag = tag_value;
+        tag_jobs++;
+    }
+    xTaskNotifyGive(worker->handle);
+    return ESP_OK;
+}
+
+void worker_tag_begin(uint32_t tag){
+    tag_value = tag;
+    tag_jobs = 0;
+    tag_task = xTaskGetCurrentTaskHandle();
+}
+
+uint32_t worker_tag_end(void){
+    tag_task = NULL;
+    tag_value = 0;
+    return tag_jobs;
+}
+
+void worker_on_done(worker_done_t hook){
+    done_hook = hook;
+}
+
+int64_t worker_submitted_at(void){
+    TaskHandle_t current = xTaskGetCurrentTaskHandle();
+    for(int i = 0; i < WORKER_COUNT; i++){
+        if(workers[i].handle == current){
+            return workers[i].submitted_at;
+        }
+    }
+    return -1;
+}
+
+void worker_pool_print_status(void){
+    for(int i = 0; i < WORKER_COUNT; i++){
+        ESP_LOGI(TAG,"%s (core %d): %s%s\t\tstack free: %u bytes", workers[i].task_name, workers[i].core,
+                 workers[i].busy ? "busy running " : "idle",
+                 workers[i].busy ? workers[i].job_name : "",
+                 uxTaskGetStackHighWaterMark(workers[i].handle));
+    }
+}
@@ -0,0 +1,54 @@
+/* Static worker pool for the test suite commands
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*worker_job_t)(void *arg);
+
+// Called on the worker when a tagged job returns
+typedef void (*worker_done_t)(uint32_t tag, const char *name, int64_t submitted_at);
+
+#define WORKER_PRIORITY 6
+#define WORKER_ANY_CORE (-1)
+
+// Create every worker task (static TCB and stack). Call once at boot.
+void worker_pool_init(void);
+
+// Hand a job to an idle worker. Returns ESP_ERR_NO_MEM if every worker is busy.
+esp_err_t worker_submit(const char *name, worker_job_t job, void *arg);
+
+// Same, on a worker pinned to `core` (0, 1 or WORKER_ANY_CORE)
+esp_err_t worker_submit_on(const char *name, worker_job_t job, void *arg, int core);
+
+// esp_timer timestamp of the worker_submit() that started the calling job, -1 outside the pool
+int64_t worker_submitted_at(void);
+
+/* Tag every job the calling task submits until worker_tag_end(), so a
+ * transport can tell when the jobs a command started have finished. One
+ * task at a time; tag 0 is untagged. worker_tag_end() returns the number
+ * of jobs submitted under the tag.
+ */
+void worker_tag_begin(uint32_t tag);
+uint32_t worker_tag_end(void);
+
+// Hook run after every tagged job, NULL to remove
+void worker_on_done(worker_done_t hook);
+
+// Log the state and stack high water mark of every worker
+void worker_pool_print_status(void);
+
+#ifdef __cplusplus
+}
+#endif